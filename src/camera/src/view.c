@@ -864,6 +864,10 @@ void V_RenderView(void) {
         R_RenderView();
     }
 
+    // the refresh window is redrawn every frame
+    Draw_MarkDirty(scr_vrect.x, scr_vrect.y, scr_vrect.width,
+                   scr_vrect.height);
+
     if (crosshair.value)
         Draw_Character(scr_vrect.x + scr_vrect.width / 2 + cl_crossx.value,
                        scr_vrect.y + scr_vrect.height / 2 + cl_crossy.value,
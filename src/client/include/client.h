@@ -133,7 +133,8 @@ typedef struct {
 
 
     // connection information
-    i32 signon; // 0 to SIGNONS
+    i32 signon;         // 0 to SIGNONS
+    double connecttime; // Sys_FloatTime when connected, to time the signon
     qsocket_t* netcon;
     sizebuf_t message; // writing buffer to send to server
 
@@ -202,6 +203,8 @@ typedef struct {
 
     float last_received_message; // (realtime) for net trouble icon
 
+    i32 snapshot; // newest svc_snapshot, acked with each move
+
     //
     // information that is static for the entire time connected to a server
     //
@@ -249,6 +252,7 @@ extern cvar_t cl_autofire;
 
 extern cvar_t cl_shownet;
 extern cvar_t cl_nolerp;
+extern cvar_t cl_delta;
 
 extern cvar_t cl_pitchdriftspeed;
 extern cvar_t lookspring;
@@ -339,6 +343,7 @@ void CL_Stop_f(void);
 void CL_Record_f(void);
 void CL_PlayDemo_f(void);
 void CL_TimeDemo_f(void);
+void CL_Benchmark_f(void);
 
 //
 // cl_parse.c
@@ -21,14 +21,67 @@
 
 #include "client.h"
 #include "cmd.h"
+#include "config.h"
 #include "console.h"
 #include "host.h"
+#include "profiler.h"
 #include "sys.h"
 #include <stdlib.h>
 #include <string.h>
 
 
 void CL_FinishTimeDemo(void);
+static void CL_BenchmarkNext(void);
+
+
+//
+// per frame timedemo samples, in milliseconds. Slot 0 is the whole frame,
+// the others are profiler zones and include the zones nested inside them.
+//
+#define TD_MAXFRAMES 32768
+
+static const char* td_phases[] = {
+    "frame",
+    "SCR_UpdateScreen",
+    "R_RenderView",
+    "R_SetupFrame",
+    "R_EdgeDrawing",
+    "D_DrawSurfaces",
+    "R_DrawEntitiesOnList",
+    "R_DrawViewModel",
+    "R_DrawParticles",
+};
+#define TD_NUMPHASES ((i32) (sizeof(td_phases) / sizeof(td_phases[0])))
+
+static float td_times[TD_NUMPHASES][TD_MAXFRAMES];
+static float td_sorted[TD_MAXFRAMES];
+static i32 td_numframes;
+static double td_lastrealtime;
+
+typedef struct {
+    i32 count; // frames the phase was timed in, 0 if never
+    float mean, p50, p95, p99, max;
+} tdstats_t;
+
+//
+// benchmark state, a queue of timedemos whose results go to one file
+//
+#define BENCH_MAXDEMOS 16
+
+typedef struct {
+    char name[MAX_DEMONAME];
+    i32 frames; // 0 if the demo couldn't be played
+    float seconds;
+    tdstats_t phases[TD_NUMPHASES];
+} benchdemo_t;
+
+static struct {
+    qboolean active;
+    char output[MAX_OSPATH];
+    i32 numdemos;
+    i32 current;
+    benchdemo_t demos[BENCH_MAXDEMOS];
+} bench;
 
 
 /*
@@ -86,6 +139,25 @@ void CL_WriteDemoMessage(void) {
     fflush(cls.demofile);
 }
 
+/*
+====================
+CL_TimeDemoFrame
+
+Samples the frame that just finished, the profiler has its zones by now
+====================
+*/
+static void CL_TimeDemoFrame(void) {
+    i32 i;
+
+    if (td_numframes < TD_MAXFRAMES) {
+        td_times[0][td_numframes] = (realtime - td_lastrealtime) * 1000;
+        for (i = 1; i < TD_NUMPHASES; i++)
+            td_times[i][td_numframes] = Prof_LastFrameZone(td_phases[i]);
+        td_numframes++;
+    }
+    td_lastrealtime = realtime;
+}
+
 /*
 ====================
 CL_GetMessage
@@ -107,8 +179,12 @@ i32 CL_GetMessage(void) {
                 cls.td_lastframe = host_framecount;
                 // if this is the second frame, grab the real td_starttime
                 // so the bogus time on the first frame doesn't count
-                if (host_framecount == cls.td_startframe + 1)
+                if (host_framecount == cls.td_startframe + 1) {
                     cls.td_starttime = realtime;
+                    td_lastrealtime = realtime;
+                } else if (host_framecount > cls.td_startframe + 1) {
+                    CL_TimeDemoFrame();
+                }
             } else if (/* cl.time > 0 && */ cl.time <= cl.mtime[0]) {
                 return 0; // don't need another message yet
             }
@@ -303,6 +379,53 @@ void CL_PlayDemo_f(void) {
     //	fscanf (cls.demofile, "%i\n", &cls.forcetrack);
 }
 
+static i32 CL_CompareFloats(const void* a, const void* b) {
+    float fa = *(const float*) a;
+    float fb = *(const float*) b;
+    return (fa > fb) - (fa < fb);
+}
+
+static float CL_Percentile(i32 count, float p) {
+    i32 i = (i32) (p * count + 0.999f) - 1; // nearest rank
+
+    if (i < 0)
+        i = 0;
+    return td_sorted[i];
+}
+
+/*
+====================
+CL_TimeDemoStats
+
+Frames the profiler didn't record are left out of the zone statistics
+====================
+*/
+static void CL_TimeDemoStats(i32 phase, tdstats_t* st) {
+    double sum;
+    i32 i, count;
+
+    count = 0;
+    sum = 0;
+    for (i = 0; i < td_numframes; i++) {
+        if (td_times[phase][i] < 0)
+            continue;
+        td_sorted[count++] = td_times[phase][i];
+        sum += td_times[phase][i];
+    }
+
+    memset(st, 0, sizeof(*st));
+    st->count = count;
+    if (!count)
+        return;
+
+    qsort(td_sorted, count, sizeof(td_sorted[0]), CL_CompareFloats);
+    st->mean = sum / count;
+    st->p50 = CL_Percentile(count, 0.50f);
+    st->p95 = CL_Percentile(count, 0.95f);
+    st->p99 = CL_Percentile(count, 0.99f);
+    st->max = td_sorted[count - 1];
+}
+
 /*
 ====================
 CL_FinishTimeDemo
@@ -310,10 +433,14 @@ CL_FinishTimeDemo
 ====================
 */
 void CL_FinishTimeDemo(void) {
+    tdstats_t stats[TD_NUMPHASES];
+    benchdemo_t* demo;
     i32 frames;
     float time;
+    i32 i;
 
     cls.timedemo = false;
+    Prof_Release();
 
     // the first frame didn't count
     frames = (host_framecount - cls.td_startframe) - 1;
@@ -322,6 +449,28 @@ void CL_FinishTimeDemo(void) {
         time = 1;
     Con_Printf("%i frames %5.1f seconds %5.1f fps\n", frames, time,
                frames / time);
+
+    for (i = 0; i < TD_NUMPHASES; i++)
+        CL_TimeDemoStats(i, &stats[i]);
+    if (stats[0].count) {
+        Con_Printf("%-20s %7s %7s %7s %7s %7s\n", "ms", "mean", "p50", "p95",
+                   "p99", "max");
+        for (i = 0; i < TD_NUMPHASES; i++) {
+            if (!stats[i].count)
+                continue;
+            Con_Printf("%-20s %7.2f %7.2f %7.2f %7.2f %7.2f\n", td_phases[i],
+                       stats[i].mean, stats[i].p50, stats[i].p95,
+                       stats[i].p99, stats[i].max);
+        }
+    }
+
+    if (bench.active) {
+        demo = &bench.demos[bench.current];
+        demo->frames = frames;
+        demo->seconds = time;
+        memcpy(demo->phases, stats, sizeof(stats));
+        CL_BenchmarkNext();
+    }
 }
 
 /*
@@ -341,6 +490,11 @@ void CL_TimeDemo_f(void) {
     }
 
     CL_PlayDemo_f();
+    if (!cls.demoplayback) {
+        if (bench.active)
+            CL_BenchmarkNext();
+        return;
+    }
 
     // cls.td_starttime will be grabbed at the second frame of the demo, so
     // all the loading time doesn't get counted
@@ -348,4 +502,143 @@ void CL_TimeDemo_f(void) {
     cls.timedemo = true;
     cls.td_startframe = host_framecount;
     cls.td_lastframe = -1; // get a new message this frame
+
+    td_numframes = 0;
+    Prof_Hold(); // for the per zone times
+
+    // particle effects use rand, so every run draws the same frames
+    srand(0);
+}
+
+
+/*
+==============================================================================
+
+BENCHMARK
+
+Runs timedemo over a list of demos and writes frame time percentiles for the
+whole frame and the renderer phases to a JSON file in the game directory.
+Started with -benchmark the engine runs headless and quits when done:
+
+quake -benchmark +benchmark results demo1 demo2 demo3
+==============================================================================
+*/
+
+static void CL_BenchmarkWritePhase(FILE* f, const char* sep, i32 phase,
+                                   const tdstats_t* st) {
+    fprintf(f,
+            "%s\n        \"%s\": {\"mean\": %.3f, \"p50\": %.3f, "
+            "\"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f}",
+            sep, td_phases[phase], st->mean, st->p50, st->p95, st->p99,
+            st->max);
+}
+
+/*
+====================
+CL_BenchmarkWrite
+====================
+*/
+static void CL_BenchmarkWrite(void) {
+    benchdemo_t* demo;
+    FILE* f;
+    i32 i, j;
+    char* sep;
+
+    f = fopen(va("%s/%s", com_gamedir, bench.output), "w");
+    if (!f) {
+        Con_Printf("Couldn't write %s.\n", bench.output);
+        return;
+    }
+
+    fprintf(f, "{\n  \"engine\": \"%s\",\n", PACKAGE_STRING);
+    fprintf(f, "  \"width\": %u,\n  \"height\": %u,\n", vid.width,
+            vid.height);
+    fprintf(f, "  \"headless\": %s,\n", isHeadless ? "true" : "false");
+    fprintf(f, "  \"demos\": [");
+    for (i = 0; i < bench.numdemos; i++) {
+        demo = &bench.demos[i];
+        fprintf(f, "%s\n    {\"name\": \"%s\", \"frames\": %i, ",
+                i ? "," : "", demo->name, demo->frames);
+        if (demo->frames <= 0) {
+            fprintf(f, "\"error\": \"couldn't play\"}");
+            continue;
+        }
+        fprintf(f, "\"seconds\": %.3f, \"fps\": %.2f,\n",
+                demo->seconds, demo->frames / demo->seconds);
+        fprintf(f, "      \"phases\": {");
+        sep = "";
+        for (j = 0; j < TD_NUMPHASES; j++) {
+            if (!demo->phases[j].count)
+                continue;
+            CL_BenchmarkWritePhase(f, sep, j, &demo->phases[j]);
+            sep = ",";
+        }
+        fprintf(f, "\n      }}");
+    }
+    fprintf(f, "\n  ]\n}\n");
+    fclose(f);
+
+    Con_Printf("Wrote benchmark results to %s.\n", bench.output);
+}
+
+/*
+====================
+CL_BenchmarkNext
+
+Queues the next timedemo, or writes the results after the last one
+====================
+*/
+static void CL_BenchmarkNext(void) {
+    bench.current++;
+    if (bench.current < bench.numdemos) {
+        // deferred, this can be called from inside CL_Disconnect
+        Cbuf_AddText(va("timedemo %s\n", bench.demos[bench.current].name));
+        return;
+    }
+
+    bench.active = false;
+    CL_BenchmarkWrite();
+    if (COM_CheckParm("-benchmark"))
+        Cbuf_AddText("quit\n");
+}
+
+/*
+====================
+CL_Benchmark_f
+
+benchmark <results> <demo> [demo ...]
+====================
+*/
+void CL_Benchmark_f(void) {
+    i32 i;
+
+    if (cmd_source != src_command)
+        return;
+
+    if (Cmd_Argc() < 3) {
+        Con_Printf("benchmark <results> <demo> [demo ...] : timedemos the "
+                   "demos and writes the frame times\n");
+        return;
+    }
+    if (Q_strstr(Cmd_Argv(1), "..")) {
+        Con_Printf("Relative pathnames are not allowed.\n");
+        return;
+    }
+
+    Q_memset(&bench, 0, sizeof(bench));
+    Q_strncpy(bench.output, Cmd_Argv(1), sizeof(bench.output) - 6);
+    COM_DefaultExtension(bench.output, ".json");
+
+    bench.numdemos = Cmd_Argc() - 2;
+    if (bench.numdemos > BENCH_MAXDEMOS) {
+        Con_Printf("Only the first %i demos are run.\n", BENCH_MAXDEMOS);
+        bench.numdemos = BENCH_MAXDEMOS;
+    }
+    for (i = 0; i < bench.numdemos; i++)
+        Q_strncpy(bench.demos[i].name, Cmd_Argv(i + 2), MAX_DEMONAME - 1);
+
+    cls.demonum = -1; // stop the demo loop from taking over in between
+    bench.active = true;
+    bench.current = -1;
+    CL_BenchmarkNext();
 }
@@ -427,6 +427,12 @@ void CL_SendMove(usercmd_t* cmd) {
     MSG_WriteByte(&buf, in_impulse);
     in_impulse = 0;
 
+    // let the server delta the entities from what we have
+    if (cl.snapshot) {
+        MSG_WriteByte(&buf, clc_ack);
+        MSG_WriteLong(&buf, cl.snapshot);
+    }
+
     //
     // deliver the message
     //
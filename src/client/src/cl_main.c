@@ -29,6 +29,7 @@
 #include "screen.h"
 #include "server.h"
 #include "sound.h"
+#include "sys.h"
 #include "view.h"
 #include <stdlib.h>
 
@@ -42,6 +43,7 @@ cvar_t cl_color = {"_cl_color", "0", true};
 
 cvar_t cl_shownet = {"cl_shownet", "0"}; // can be 0, 1, or 2
 cvar_t cl_nolerp = {"cl_nolerp", "0"};
+cvar_t cl_delta = {"cl_delta", "1"}; // ask for entity snapshots
 
 cvar_t lookspring = {"lookspring", "0", true};
 cvar_t lookstrafe = {"lookstrafe", "0", true};
@@ -169,6 +171,7 @@ void CL_EstablishConnection(char* host) {
     cls.demonum = -1; // not in the demo loop now
     cls.state = ca_connected;
     cls.signon = 0; // need all the signon messages before playing
+    cls.connecttime = Sys_FloatTime();
 }
 
 /*
@@ -187,6 +190,12 @@ void CL_SignonReply(void) {
         case 1:
             MSG_WriteByte(&cls.message, clc_stringcmd);
             MSG_WriteString(&cls.message, "prespawn");
+
+            // demos keep to the fast updates any client can play
+            if (cl_delta.value && !cls.demorecording) {
+                MSG_WriteByte(&cls.message, clc_stringcmd);
+                MSG_WriteString(&cls.message, "delta");
+            }
             break;
 
         case 2:
@@ -211,6 +220,9 @@ void CL_SignonReply(void) {
 
         case 4:
             SCR_EndLoadingPlaque(); // allow normal screen updates
+            if (!cls.demoplayback)
+                Con_DPrintf("Signon took %.3f seconds\n",
+                            Sys_FloatTime() - cls.connecttime);
             break;
     }
 }
@@ -661,6 +673,7 @@ void CL_Init(void) {
     Cvar_RegisterVariable(&cl_anglespeedkey);
     Cvar_RegisterVariable(&cl_shownet);
     Cvar_RegisterVariable(&cl_nolerp);
+    Cvar_RegisterVariable(&cl_delta);
     Cvar_RegisterVariable(&lookspring);
     Cvar_RegisterVariable(&lookstrafe);
     Cvar_RegisterVariable(&sensitivity);
@@ -678,4 +691,5 @@ void CL_Init(void) {
     Cmd_AddCommand("stop", CL_Stop_f);
     Cmd_AddCommand("playdemo", CL_PlayDemo_f);
     Cmd_AddCommand("timedemo", CL_TimeDemo_f);
+    Cmd_AddCommand("benchmark", CL_Benchmark_f);
 }
@@ -77,10 +77,14 @@ char* svc_strings[] = {
     "svc_finale",  // [string] music [string] text
     "svc_cdtrack", // [byte] track [byte] looptrack
     "svc_sellscreen",
-    "svc_cutscene"
+    "svc_cutscene",
+    "svc_snapshot" // [long] sequence [long] delta from <see code>
 };
 
 
+// the entity snapshots received from the server
+static snaphistory_t cl_snapshots;
+
 //=============================================================================
 
 /*
@@ -221,6 +225,7 @@ void CL_ParseServerInfo(void) {
     // wipe the client_state_t struct
     //
     CL_ClearState();
+    Q_memset(&cl_snapshots, 0, sizeof(cl_snapshots));
 
     // parse protocol version number
     i = MSG_ReadLong();
@@ -315,6 +320,73 @@ void CL_ParseServerInfo(void) {
 }
 
 
+/*
+==================
+CL_SetEntityState
+
+Moves ent to the state the last message had it in
+==================
+*/
+static void CL_SetEntityState(entity_t* ent, const entity_state_t* state,
+                              qboolean nolerp) {
+    model_t* model;
+    qboolean forcelink;
+    i32 i;
+
+    if (ent->msgtime != cl.mtime[1])
+        forcelink = true; // no previous frame to lerp from
+    else
+        forcelink = false;
+
+    ent->msgtime = cl.mtime[0];
+
+    model = cl.model_precache[state->modelindex];
+    if (model != ent->model) {
+        ent->model = model;
+        // automatic animation (torches, etc) can be either all together
+        // or randomized
+        if (model) {
+            if (model->synctype == ST_RAND)
+                ent->syncbase = (float) (rand() & 0x7fff) / 0x7fff;
+            else
+                ent->syncbase = 0.0;
+        } else
+            forcelink = true; // hack to make null model players work
+    }
+
+    ent->frame = state->frame;
+
+    i = state->colormap;
+    if (!i)
+        ent->colormap = vid.colormap;
+    else {
+        if (i > cl.maxclients)
+            Sys_Error("i >= cl.maxclients");
+        ent->colormap = cl.scores[i - 1].translations;
+    }
+
+    ent->skinnum = state->skin;
+    ent->effects = state->effects;
+
+    // shift the known values for interpolation
+    VectorCopy(ent->msg_origins[0], ent->msg_origins[1]);
+    VectorCopy(ent->msg_angles[0], ent->msg_angles[1]);
+
+    VectorCopy(state->origin, ent->msg_origins[0]);
+    VectorCopy(state->angles, ent->msg_angles[0]);
+
+    if (nolerp)
+        ent->forcelink = true;
+
+    if (forcelink) { // didn't have an update last message
+        VectorCopy(ent->msg_origins[0], ent->msg_origins[1]);
+        VectorCopy(ent->msg_origins[0], ent->origin);
+        VectorCopy(ent->msg_angles[0], ent->msg_angles[1]);
+        VectorCopy(ent->msg_angles[0], ent->angles);
+        ent->forcelink = true;
+    }
+}
+
 /*
 ==================
 CL_ParseUpdate
@@ -328,12 +400,9 @@ i32 bitcounts[16];
 
 void CL_ParseUpdate(i32 bits) {
     i32 i;
-    model_t* model;
-    i32 modnum;
-    qboolean forcelink;
     entity_t* ent;
+    entity_state_t state;
     i32 num;
-    i32 skin;
 
     if (cls.signon == SIGNONS - 1) { // first update is the final signon stage
         cls.signon = SIGNONS;
@@ -356,101 +425,234 @@ void CL_ParseUpdate(i32 bits) {
         if (bits & (1 << i))
             bitcounts[i]++;
 
-    if (ent->msgtime != cl.mtime[1])
-        forcelink = true; // no previous frame to lerp from
-    else
-        forcelink = false;
-
-    ent->msgtime = cl.mtime[0];
+    state = ent->baseline;
 
     if (bits & U_MODEL) {
-        modnum = MSG_ReadByte();
-        if (modnum >= MAX_MODELS)
+        state.modelindex = MSG_ReadByte();
+        if (state.modelindex >= MAX_MODELS)
             Host_Error("CL_ParseModel: bad modnum");
-    } else
-        modnum = ent->baseline.modelindex;
-
-    model = cl.model_precache[modnum];
-    if (model != ent->model) {
-        ent->model = model;
-        // automatic animation (torches, etc) can be either all together
-        // or randomized
-        if (model) {
-            if (model->synctype == ST_RAND)
-                ent->syncbase = (float) (rand() & 0x7fff) / 0x7fff;
-            else
-                ent->syncbase = 0.0;
-        } else
-            forcelink = true; // hack to make null model players work
     }
 
     if (bits & U_FRAME)
-        ent->frame = MSG_ReadByte();
-    else
-        ent->frame = ent->baseline.frame;
-
+        state.frame = MSG_ReadByte();
     if (bits & U_COLORMAP)
-        i = MSG_ReadByte();
-    else
-        i = ent->baseline.colormap;
-    if (!i)
-        ent->colormap = vid.colormap;
-    else {
-        if (i > cl.maxclients)
-            Sys_Error("i >= cl.maxclients");
-        ent->colormap = cl.scores[i - 1].translations;
-    }
-
+        state.colormap = MSG_ReadByte();
     if (bits & U_SKIN)
-        ent->skinnum = MSG_ReadByte();
-    else
-        ent->skinnum = ent->baseline.skin;
-
+        state.skin = MSG_ReadByte();
     if (bits & U_EFFECTS)
-        ent->effects = MSG_ReadByte();
-    else
-        ent->effects = ent->baseline.effects;
-
-    // shift the known values for interpolation
-    VectorCopy(ent->msg_origins[0], ent->msg_origins[1]);
-    VectorCopy(ent->msg_angles[0], ent->msg_angles[1]);
+        state.effects = MSG_ReadByte();
 
     if (bits & U_ORIGIN1)
-        ent->msg_origins[0][0] = MSG_ReadCoord();
-    else
-        ent->msg_origins[0][0] = ent->baseline.origin[0];
+        state.origin[0] = MSG_ReadCoord();
     if (bits & U_ANGLE1)
-        ent->msg_angles[0][0] = MSG_ReadAngle();
-    else
-        ent->msg_angles[0][0] = ent->baseline.angles[0];
-
+        state.angles[0] = MSG_ReadAngle();
     if (bits & U_ORIGIN2)
-        ent->msg_origins[0][1] = MSG_ReadCoord();
-    else
-        ent->msg_origins[0][1] = ent->baseline.origin[1];
+        state.origin[1] = MSG_ReadCoord();
     if (bits & U_ANGLE2)
-        ent->msg_angles[0][1] = MSG_ReadAngle();
-    else
-        ent->msg_angles[0][1] = ent->baseline.angles[1];
+        state.angles[1] = MSG_ReadAngle();
+    if (bits & U_ORIGIN3)
+        state.origin[2] = MSG_ReadCoord();
+    if (bits & U_ANGLE3)
+        state.angles[2] = MSG_ReadAngle();
+
+    CL_SetEntityState(ent, &state, (bits & U_NOLERP) != 0);
+}
+
+/*
+==================
+CL_FindSnapshot
+
+The snapshot with this sequence, if it can still be a delta source
+==================
+*/
+static snapshot_t* CL_FindSnapshot(i32 sequence) {
+    snapshot_t* snap;
+
+    snap = &cl_snapshots.snapshots[sequence & (SNAP_BACKUP - 1)];
+    if (snap->sequence != sequence)
+        return NULL;
+
+    // the states of the new snapshot mustn't run over it
+    if (cl_snapshots.numstates - snap->first > SNAP_STATES - MAX_EDICTS)
+        return NULL;
+    return snap;
+}
+
+/*
+==================
+CL_SnapBaseline
 
+The baseline of entity num as the server sends it. Baselines came over
+the wire, so converting them back is exact
+==================
+*/
+static void CL_SnapBaseline(i32 num, snapentity_t* to) {
+    entity_state_t* baseline = &CL_EntityNum(num)->baseline;
+    i32 i;
+
+    for (i = 0; i < 3; i++) {
+        to->origin[i] = (i16) (i32) (baseline->origin[i] * 8);
+        to->angles[i] = (i32) (baseline->angles[i] * 256 / 360) & 255;
+    }
+    to->number = num;
+    to->modelindex = baseline->modelindex;
+    to->frame = baseline->frame;
+    to->colormap = baseline->colormap;
+    to->skin = baseline->skin;
+    to->effects = baseline->effects;
+    to->flags = 0;
+}
+
+/*
+==================
+CL_ParseSnapEntity
+==================
+*/
+static void CL_ParseSnapEntity(snapentity_t* to) {
+    i32 bits;
+
+    bits = MSG_ReadByte();
+    if (bits & U_MOREBITS)
+        bits |= MSG_ReadByte() << 8;
+
+    if (bits & U_MODEL)
+        to->modelindex = MSG_ReadByte();
+    if (bits & U_FRAME)
+        to->frame = MSG_ReadByte();
+    if (bits & U_COLORMAP)
+        to->colormap = MSG_ReadByte();
+    if (bits & U_SKIN)
+        to->skin = MSG_ReadByte();
+    if (bits & U_EFFECTS)
+        to->effects = MSG_ReadByte();
+    if (bits & U_ORIGIN1)
+        to->origin[0] = MSG_ReadShort();
+    if (bits & U_ANGLE1)
+        to->angles[0] = MSG_ReadByte();
+    if (bits & U_ORIGIN2)
+        to->origin[1] = MSG_ReadShort();
+    if (bits & U_ANGLE2)
+        to->angles[1] = MSG_ReadByte();
     if (bits & U_ORIGIN3)
-        ent->msg_origins[0][2] = MSG_ReadCoord();
-    else
-        ent->msg_origins[0][2] = ent->baseline.origin[2];
+        to->origin[2] = MSG_ReadShort();
     if (bits & U_ANGLE3)
-        ent->msg_angles[0][2] = MSG_ReadAngle();
-    else
-        ent->msg_angles[0][2] = ent->baseline.angles[2];
+        to->angles[2] = MSG_ReadByte();
 
-    if (bits & U_NOLERP)
-        ent->forcelink = true;
+    to->flags = (bits & U_NOLERP) ? SNAP_NOLERP : 0;
+}
 
-    if (forcelink) { // didn't have an update last message
-        VectorCopy(ent->msg_origins[0], ent->msg_origins[1]);
-        VectorCopy(ent->msg_origins[0], ent->origin);
-        VectorCopy(ent->msg_angles[0], ent->msg_angles[1]);
-        VectorCopy(ent->msg_angles[0], ent->angles);
-        ent->forcelink = true;
+/*
+==================
+CL_ParseSnapshot
+
+Rebuilds the entities the server sees from the snapshot it deltas against,
+then updates them all like a run of fast updates would
+==================
+*/
+void CL_ParseSnapshot(void) {
+    snapshot_t* base;
+    snapshot_t* snap;
+    snapshot_t parsed;
+    snapentity_t* from;
+    snapentity_t* to;
+    snapentity_t lost;
+    entity_state_t state;
+    i32 sequence, basesequence;
+    i32 num, j, i;
+
+    if (cls.signon == SIGNONS - 1) { // first update is the final signon stage
+        cls.signon = SIGNONS;
+        CL_SignonReply();
+    }
+
+    sequence = MSG_ReadLong();
+    basesequence = MSG_ReadLong();
+    base = basesequence ? CL_FindSnapshot(basesequence) : NULL;
+
+    parsed.sequence = sequence;
+    parsed.first = cl_snapshots.numstates;
+    parsed.count = 0;
+
+    j = 0;
+    while (1) {
+        num = MSG_ReadShort() & 0xffff;
+        if (msg_badread)
+            Host_Error("CL_ParseSnapshot: bad snapshot");
+        if (!num)
+            break;
+
+        // what the server left out didn't change
+        while (base && j < base->count) {
+            from = &cl_snapshots.states[(base->first + j) & (SNAP_STATES - 1)];
+            if (from->number >= (num & ~SNAP_REMOVE))
+                break;
+            to = &cl_snapshots.states[(parsed.first + parsed.count++) &
+                                      (SNAP_STATES - 1)];
+            *to = *from;
+            j++;
+        }
+
+        from = NULL;
+        if (base && j < base->count) {
+            from = &cl_snapshots.states[(base->first + j) & (SNAP_STATES - 1)];
+            if (from->number == (num & ~SNAP_REMOVE))
+                j++;
+            else
+                from = NULL;
+        }
+
+        if (num & SNAP_REMOVE)
+            continue;
+
+        if (basesequence && !base) {
+            // still has to be read past
+            CL_ParseSnapEntity(&lost);
+            continue;
+        }
+
+        to = &cl_snapshots.states[(parsed.first + parsed.count++) &
+                                  (SNAP_STATES - 1)];
+        if (from)
+            *to = *from;
+        else
+            CL_SnapBaseline(num, to);
+        CL_ParseSnapEntity(to);
+    }
+
+    if (basesequence && !base) {
+        Con_DPrintf("snapshot %i against lost snapshot %i\n", sequence,
+                    basesequence);
+        return;
+    }
+
+    while (base && j < base->count) {
+        from = &cl_snapshots.states[(base->first + j) & (SNAP_STATES - 1)];
+        to = &cl_snapshots.states[(parsed.first + parsed.count++) &
+                                  (SNAP_STATES - 1)];
+        *to = *from;
+        j++;
+    }
+
+    snap = &cl_snapshots.snapshots[sequence & (SNAP_BACKUP - 1)];
+    *snap = parsed;
+    cl_snapshots.numstates += parsed.count;
+    cl_snapshots.sequence = sequence;
+    cl.snapshot = sequence;
+
+    for (i = 0; i < snap->count; i++) {
+        to = &cl_snapshots.states[(snap->first + i) & (SNAP_STATES - 1)];
+        for (j = 0; j < 3; j++) {
+            state.origin[j] = (float) to->origin[j] * (1.0f / 8);
+            state.angles[j] = (float) (signed char) to->angles[j] *
+                              (360.0f / 256);
+        }
+        state.modelindex = to->modelindex;
+        state.frame = to->frame;
+        state.colormap = to->colormap;
+        state.skin = to->skin;
+        state.effects = to->effects;
+        CL_SetEntityState(CL_EntityNum(to->number), &state,
+                          (to->flags & SNAP_NOLERP) != 0);
     }
 }
 
@@ -897,6 +1099,10 @@ void CL_ParseServerMessage(void) {
             case svc_sellscreen:
                 Cmd_ExecuteString("help", src_command);
                 break;
+
+            case svc_snapshot:
+                CL_ParseSnapshot();
+                break;
         }
     }
 }
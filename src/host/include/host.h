@@ -74,6 +74,7 @@ extern qboolean noclip_anglehack;
 
 void Host_ClearMemory(void);
 void Host_ServerFrame(void);
+void Host_WaitForFrame(double pending);
 void Host_InitCommands(void);
 void Host_Init(quakeparms_t* parms);
 void Host_Shutdown(void);
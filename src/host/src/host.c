@@ -30,6 +30,7 @@
 #include "keys.h"
 #include "menu.h"
 #include "model.h"
+#include "profiler.h"
 #include "progs.h"
 #include "sbar.h"
 #include "screen.h"
@@ -38,7 +39,9 @@
 #include "sys.h"
 #include "view.h"
 #include "wad.h"
+#include "world.h"
 #include <SDL.h>
+#include <math.h>
 #include <stdarg.h>
 #include <string.h>
 
@@ -98,6 +101,26 @@ cvar_t pausable = {"pausable", "1"};
 
 cvar_t temp1 = {"temp1", "0"};
 
+// sleep between frames instead of spinning
+cvar_t host_sleep = {"host_sleep", "1"};
+
+#define HOST_MAXFPS 72.0
+
+// the scheduler stops sleeping this long before a frame is due and spins
+// for the rest, sleeps can overshoot by about that much
+#define HOST_WAKEMARGIN 0.001
+
+typedef struct {
+    i32 frames;
+    double start;     // Sys_FloatTime when the stats were reset
+    double slept;     // seconds spent in Sys_Sleep
+    double sum;       // of frame intervals
+    double sumsquare; // of frame intervals, for the deviation
+    double worst;     // longest interval
+} framepace_t;
+
+static framepace_t host_pace;
+
 
 /*
 ================
@@ -179,6 +202,7 @@ void Host_FindMaxClients() {
     i32 i = COM_CheckParm("-dedicated");
     if (i) {
         cls.state = ca_dedicated;
+        isDedicated = true;
         if (i != (com_argc - 1)) {
             svs.maxclients = Q_atoi(com_argv[i + 1]);
         } else {
@@ -220,6 +244,64 @@ void Host_FindMaxClients() {
 }
 
 
+/*
+===================
+Host_WaitForFrame
+
+Sleeps until shortly before the next frame is due. pending is the time
+that has passed since the last Host_Frame call, which realtime doesn't
+include yet.
+===================
+*/
+void Host_WaitForFrame(double pending) {
+    double wait;
+    double start;
+
+    if (!host_sleep.value || cls.timedemo || cls.state == ca_dedicated)
+        return;
+
+    wait = oldrealtime + 1.0 / HOST_MAXFPS - (realtime + pending);
+    if (wait <= HOST_WAKEMARGIN)
+        return;
+
+    start = Sys_FloatTime();
+    Sys_Sleep(wait - HOST_WAKEMARGIN);
+    host_pace.slept += Sys_FloatTime() - start;
+}
+
+/*
+===================
+Host_PaceStats_f
+
+Shows how evenly frames have been spaced since the last call
+===================
+*/
+void Host_PaceStats_f(void) {
+    double now = Sys_FloatTime();
+    double mean, deviation;
+
+    if (!host_pace.frames) {
+        Con_Printf("no frames run yet\n");
+        host_pace.start = now;
+        return;
+    }
+
+    mean = host_pace.sum / host_pace.frames;
+    deviation = host_pace.sumsquare / host_pace.frames - mean * mean;
+    deviation = deviation > 0 ? sqrt(deviation) : 0;
+
+    Con_Printf("%i frames, target %.2f ms\n", host_pace.frames,
+               1000.0 / HOST_MAXFPS);
+    Con_Printf("interval %.2f ms mean, %.2f ms jitter, %.2f ms worst\n",
+               mean * 1000, deviation * 1000, host_pace.worst * 1000);
+    if (now > host_pace.start)
+        Con_Printf("asleep %.0f%% of the time\n",
+                   100.0 * host_pace.slept / (now - host_pace.start));
+
+    Q_memset(&host_pace, 0, sizeof(host_pace));
+    host_pace.start = now;
+}
+
 /*
 =======================
 Host_InitLocal
@@ -248,8 +330,15 @@ void Host_InitLocal() {
 
     Cvar_RegisterVariable(&temp1);
 
+    Cvar_RegisterVariable(&host_sleep);
+    Cmd_AddCommand("pacestats", Host_PaceStats_f);
+
     Host_FindMaxClients();
 
+    // -headless draws offscreen without sound, -benchmark implies it
+    isHeadless = isDedicated || COM_CheckParm("-headless") ||
+                 COM_CheckParm("-benchmark");
+
     // so a think at time 0 won't get called
     host_time = 1.0;
 }
@@ -381,6 +470,7 @@ void SV_DropClient(qboolean crash) {
     // free the client (the body stays around)
     host_client->active = false;
     host_client->name[0] = 0;
+    pr_stringstores++; // the body's netname still points at the name
     host_client->old_frags = -999999;
     net_activeconnections--;
 
@@ -502,12 +592,18 @@ Returns false if the time is too short to run a frame
 qboolean Host_FilterTime(float time) {
     realtime += time;
 
-    if (!cls.timedemo && realtime - oldrealtime < 1.0 / 72.0)
+    if (!cls.timedemo && realtime - oldrealtime < 1.0 / HOST_MAXFPS)
         return false; // framerate is too high
 
     host_frametime = realtime - oldrealtime;
     oldrealtime = realtime;
 
+    host_pace.frames++;
+    host_pace.sum += host_frametime;
+    host_pace.sumsquare += host_frametime * host_frametime;
+    if (host_frametime > host_pace.worst)
+        host_pace.worst = host_frametime;
+
     if (host_framerate.value > 0)
         host_frametime = host_framerate.value;
     else {
@@ -547,6 +643,8 @@ Host_ServerFrame
 ==================
 */
 void Host_ServerFrame() {
+    PROF_BEGIN("Host_ServerFrame");
+
     // run the world state
     pr_global_struct->frametime = (float) host_frametime;
 
@@ -565,8 +663,12 @@ void Host_ServerFrame() {
         SV_Physics();
     }
 
-    // send all messages to the clients
+    // send all messages to the clients, each client's in one go
+    NET_BeginBatch();
     SV_SendClientMessages();
+    NET_EndBatch();
+
+    PROF_END();
 }
 
 /*
@@ -596,8 +698,12 @@ void _Host_Frame(float time) {
         return;
     }
 
+    Prof_BeginFrame();
+
     // get new key events
-    Sys_SendKeyEvents();
+    if (cls.state != ca_dedicated) {
+        Sys_SendKeyEvents();
+    }
 
     // process console commands
     Cbuf_Execute();
@@ -645,7 +751,9 @@ void _Host_Frame(float time) {
     if (host_speeds.value)
         time1 = Sys_FloatTime();
 
+    PROF_BEGIN("SCR_UpdateScreen");
     SCR_UpdateScreen();
+    PROF_END();
 
     if (host_speeds.value) {
         time2 = Sys_FloatTime();
@@ -671,6 +779,8 @@ void _Host_Frame(float time) {
     }
 
     host_framecount++;
+
+    Prof_EndFrame();
 }
 
 void Host_Frame(float time) {
@@ -682,6 +792,10 @@ void Host_Frame(float time) {
         return;
     }
 
+    if (timecount == 0) {
+        Q_memset(&sv_movestats, 0, sizeof(sv_movestats));
+    }
+
     double time1 = Sys_FloatTime();
     _Host_Frame(time);
     double time2 = Sys_FloatTime();
@@ -704,6 +818,18 @@ void Host_Frame(float time) {
     }
 
     Con_Printf("serverprofile: %2i clients %2i msec\n", c, m);
+    if (sv_movestats.moves) {
+        Con_Printf("serverprofile: %.1f moves/frame, %.1f nodes %.1f boxes "
+                   "per move\n",
+                   (double) sv_movestats.moves / 1000,
+                   (double) sv_movestats.nodes / sv_movestats.moves,
+                   (double) sv_movestats.boxes / sv_movestats.moves);
+    }
+    if (sv_movestats.traces) {
+        Con_Printf("serverprofile: %.1f hull traces/frame, %.1f%% cached\n",
+                   (double) sv_movestats.traces / 1000,
+                   100.0 * sv_movestats.tracehits / sv_movestats.traces);
+    }
 }
 
 //============================================================================
@@ -810,6 +936,7 @@ void Host_Init(quakeparms_t* parms) {
     Mod_Init();
     NET_Init();
     SV_Init();
+    Prof_Init();
 
     Con_Printf("Exe: " __TIME__ " " __DATE__ "\n");
     Con_Printf("%4.1f megabyte heap\n", parms->memsize / (1024 * 1024.0));
@@ -872,12 +999,13 @@ void Host_Shutdown() {
     Host_WriteConfiguration();
 
     Host_ShutdownTimer();
-    BGMusic_Shutdown();
     NET_Shutdown();
-    S_Shutdown();
-    IN_Shutdown();
 
+    // a dedicated server never brought up audio, input or video
     if (cls.state != ca_dedicated) {
+        BGMusic_Shutdown();
+        S_Shutdown();
+        IN_Shutdown();
         VID_Shutdown();
     }
 
@@ -32,6 +32,7 @@
 
 
 extern cvar_t pausable;
+extern cvar_t sv_delta;
 
 i32 current_skill;
 
@@ -47,7 +48,8 @@ Host_Quit_f
 extern void M_Menu_Quit_f(void);
 
 void Host_Quit_f(void) {
-    if (key_dest != key_console && cls.state != ca_dedicated) {
+    // nobody can answer the prompt when running headless
+    if (key_dest != key_console && !isHeadless) {
         M_Menu_Quit_f();
         return;
     }
@@ -646,6 +648,7 @@ void Host_Name_f(void) {
             Con_Printf("%s renamed to %s\n", host_client->name, newName);
     Q_strcpy(host_client->name, newName);
     host_client->edict->v.netname = PR_SetString(host_client->name);
+    pr_stringstores++;
 
     // send notification to all clients
 
@@ -904,6 +907,26 @@ void Host_PreSpawn_f(void) {
     host_client->sendsignon = true;
 }
 
+/*
+==================
+Host_Delta_f
+
+The client can take its entities as svc_snapshot
+==================
+*/
+void Host_Delta_f(void) {
+    if (cmd_source == src_command) {
+        Con_Printf("delta is not valid from the console\n");
+        return;
+    }
+
+    if (!sv_delta.value)
+        return; // it keeps getting the fast updates
+
+    host_client->delta = true;
+    SV_ClearSnapshots(host_client);
+}
+
 /*
 ==================
 Host_Spawn_f
@@ -936,6 +959,7 @@ void Host_Spawn_f(void) {
         ent->v.colormap = NUM_FOR_EDICT(ent);
         ent->v.team = (host_client->colors & 15) + 1;
         ent->v.netname = PR_SetString(host_client->name);
+        pr_stringstores++;
 
         // copy spawn parms out of the client_t
 
@@ -1477,6 +1501,7 @@ void Host_InitCommands(void) {
     Cmd_AddCommand("spawn", Host_Spawn_f);
     Cmd_AddCommand("begin", Host_Begin_f);
     Cmd_AddCommand("prespawn", Host_PreSpawn_f);
+    Cmd_AddCommand("delta", Host_Delta_f);
     Cmd_AddCommand("kick", Host_Kick_f);
     Cmd_AddCommand("ping", Host_Ping_f);
     Cmd_AddCommand("load", Host_Loadgame_f);
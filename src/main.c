@@ -20,6 +20,7 @@
 
 
 #include "host.h"
+#include "net.h"
 #include "sys.h"
 #include <SDL_main.h>
 
@@ -33,7 +34,14 @@ int main(int argc, char* argv[]) {
     while (true) {
         double new_time = Sys_FloatTime();
         double dt = new_time - old_time;
+        if (isDedicated && dt < sys_ticrate.value) {
+            // not time to run a server only tic yet, packets that come in
+            // meanwhile are read ahead for it
+            NET_Wait(sys_ticrate.value - dt);
+            continue;
+        }
         Host_Frame((float) dt);
         old_time = new_time;
+        Host_WaitForFrame(Sys_FloatTime() - new_time);
     }
 }
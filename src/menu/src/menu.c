@@ -2825,8 +2825,6 @@ void M_Draw(void) {
         return;
 
     if (!m_recursiveDraw) {
-        scr_copyeverything = 1;
-
         if (scr_con_current) {
             Draw_ConsoleBackground(vid.height);
             VID_UnlockBuffer();
@@ -41,6 +41,17 @@ model_t* Mod_LoadModel(model_t* mod, qboolean crash);
 
 byte mod_novis[MAX_MAP_LEAFS / 8];
 
+// decompressed PVS rows, by leaf number; the client and the server ask for
+// the same few leafs frame after frame
+#define MOD_PVSCACHE 64
+
+typedef struct {
+    mleaf_t* leaf;
+    byte row[MAX_MAP_LEAFS / 8];
+} pvsrow_t;
+
+static pvsrow_t mod_pvscache[MOD_PVSCACHE];
+
 #define MAX_MOD_KNOWN 256
 model_t mod_known[MAX_MOD_KNOWN];
 i32 mod_numknown;
@@ -149,10 +160,27 @@ byte* Mod_DecompressVis(byte* in, model_t* model) {
     return decompressed;
 }
 
+/*
+===================
+Mod_LeafPVS
+
+The row stays valid until another leaf takes its cache slot
+===================
+*/
 byte* Mod_LeafPVS(mleaf_t* leaf, model_t* model) {
+    pvsrow_t* cached;
+    byte* row;
+
     if (leaf == model->leafs)
         return mod_novis;
-    return Mod_DecompressVis(leaf->compressed_vis, model);
+
+    cached = &mod_pvscache[(leaf - model->leafs) & (MOD_PVSCACHE - 1)];
+    if (cached->leaf != leaf) {
+        row = Mod_DecompressVis(leaf->compressed_vis, model);
+        Q_memcpy(cached->row, row, (model->numleafs + 7) >> 3);
+        cached->leaf = leaf;
+    }
+    return cached->row;
 }
 
 /*
@@ -165,6 +193,10 @@ void Mod_ClearAll(void) {
     model_t* mod;
 
 
+    // the leafs of the next map can land where these ones were
+    for (i = 0; i < MOD_PVSCACHE; i++)
+        mod_pvscache[i].leaf = NULL;
+
     for (i = 0, mod = mod_known; i < mod_numknown; i++, mod++) {
         mod->needload = NL_UNREFERENCED;
         //FIX FOR CACHE_ALLOC ERRORS:
@@ -34,6 +34,7 @@
 #define NET_MAXMESSAGE   8192
 #define NET_HEADERSIZE   (2 * sizeof(u32))
 #define NET_DATAGRAMSIZE (MAX_DATAGRAM + NET_HEADERSIZE)
+#define NET_WINDOW       32 // reliable fragments in flight, see NET_EXT_WINDOW
 
 // NetHeader flags
 #define NETFLAG_LENGTH_MASK 0x0000ffff
@@ -47,6 +48,10 @@
 
 #define NET_PROTOCOL_VERSION 3
 
+// net protocol extensions, agreed on when connecting
+#define NET_EXT_MAGIC  0x43514558 // "CQEX", not a ProQuake mod byte
+#define NET_EXT_WINDOW 0x00000001 // windowed reliable messages
+
 // This is the network info/connection protocol.  It is used to find Quake
 // servers, get info about them, and connect to them.  Once connected, the
 // Quake game protocol (documented elsewhere) is used.
@@ -59,6 +64,8 @@
 // CCREQ_CONNECT
 //		string	game_name				"QUAKE"
 //		byte	net_protocol_version	NET_PROTOCOL_VERSION
+//		long	magic					NET_EXT_MAGIC, if net_window is set
+//		long	extensions				NET_EXT_ bits the client can use
 //
 // CCREQ_SERVER_INFO
 //		string	game_name				"QUAKE"
@@ -74,6 +81,8 @@
 //
 // CCREP_ACCEPT
 //		long	port
+//		long	magic					NET_EXT_MAGIC, if the client sent it
+//		long	extensions				NET_EXT_ bits both will use
 //
 // CCREP_REJECT
 //		string	reason
@@ -107,6 +116,15 @@
 //		when we reply to the inbound connection request.  The long from is
 //		a full address and port in a string.  It is used for returning the
 //		address of a server that is not running locally.
+//
+//		Servers that don't know the extensions ignore the bytes after the
+//		version, and clients that don't know them the bytes after the port,
+//		so either side falls back to the classic protocol.
+//
+// With NET_EXT_WINDOW, up to NET_WINDOW reliable fragments may be unacked
+// at once instead of one. The ack header carries the first sequence not
+// yet received, and a long follows it: bit i is set when the fragment
+// i + 1 past that one was.
 
 #define CCREQ_CONNECT     0x01
 #define CCREQ_SERVER_INFO 0x02
@@ -216,6 +234,11 @@ i32 NET_SendUnreliableMessage(qsocket_t* sock, sizebuf_t* data);
 i32 NET_SendToAll(sizebuf_t* data, i32 blocktime);
 // This is a reliable *blocking* send to all attached clients.
 
+void NET_BeginBatch(void);
+void NET_EndBatch(void);
+// Messages sent in between may go out together at NET_EndBatch, so nothing
+// that waits for an answer should be called in between.
+
 
 void NET_Close(qsocket_t* sock);
 // if a dead connection is returned by a get or send function, this function
@@ -228,6 +251,10 @@ void NET_Close(qsocket_t* sock);
 
 void NET_Poll(void);
 
+qboolean NET_Wait(double timeout);
+// Sleeps until a packet comes in or timeout seconds have passed, returns
+// true if a packet came in
+
 const char* NET_GetSocketAddr(const qsocket_t* sock);
 
 double NET_GetSocketConnectTime(const qsocket_t* sock);
@@ -138,6 +138,9 @@
 
 #define svc_cutscene 34
 
+#define svc_snapshot 35 // [long] sequence [long] delta from, 0 for baselines
+                        // <see SV_WriteSnapshotToClient>
+
 //
 // client to server
 //
@@ -146,6 +149,50 @@
 #define clc_disconnect 2
 #define clc_move       3 // [usercmd_t]
 #define clc_stringcmd  4 // [string] message
+#define clc_ack        5 // [long] newest svc_snapshot received
+
+
+//
+// entity snapshots, sent instead of the fast updates to clients that asked
+// for them with the "delta" command. Each snapshot lists the entities the
+// client sees, sorted by number, as a delta from a snapshot the client has
+// acked: [short] number, with SNAP_REMOVE set when the entity is gone,
+// then the U_ bits of the fields that changed and those fields. Entities
+// new to the client are a delta from their baseline, entities that didn't
+// change are left out, and a [short] 0 ends the list.
+//
+#define SNAP_REMOVE (1 << 15)
+#define SNAP_NOLERP (1 << 0)
+
+#define SNAP_BACKUP 32   // snapshots either end keeps, a power of two
+#define SNAP_STATES 4096 // entity states they share, a power of two
+
+// an entity as it went over the wire
+typedef struct {
+    i16 origin[3];
+    u16 number;
+    byte angles[3];
+    byte modelindex;
+    byte frame;
+    byte colormap;
+    byte skin;
+    byte effects;
+    byte flags;
+} snapentity_t;
+
+typedef struct {
+    i32 sequence; // 0 for an empty slot
+    u32 first;    // into states, counting every state ever stored
+    i32 count;
+} snapshot_t;
+
+typedef struct {
+    i32 sequence; // of the newest snapshot
+    i32 acked;    // newest snapshot the client has, 0 for none
+    u32 numstates;
+    snapshot_t snapshots[SNAP_BACKUP];
+    snapentity_t states[SNAP_STATES];
+} snaphistory_t;
 
 
 //
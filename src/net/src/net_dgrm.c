@@ -23,6 +23,7 @@
 #include "net_dgrm.h"
 #include "cmd.h"
 #include "console.h"
+#include "host.h"
 #include "keys.h"
 #include "net_socket.h"
 #include "net_poll.h"
@@ -152,11 +153,406 @@ void NET_Ban_f(void) {
 #endif
 
 
+//
+// Puts an unreliable message into net_message, returns false if it is stale
+//
+static qboolean Datagram_ReadUnreliable(
+    qsocket_t* sock,
+    u32 sequence,
+    u32 length
+) {
+    u32 count;
+
+    if (sequence < sock->unreliableReceiveSequence) {
+        Con_DPrintf("Got a stale datagram\n");
+        return false;
+    }
+    if (sequence != sock->unreliableReceiveSequence) {
+        count = sequence - sock->unreliableReceiveSequence;
+        droppedDatagrams += count;
+        Con_DPrintf("Dropped %u datagram(s)\n", count);
+    }
+    sock->unreliableReceiveSequence = sequence + 1;
+
+    length -= NET_HEADERSIZE;
+
+    SZ_Clear(&net_message);
+    SZ_Write(&net_message, packetBuffer.data, length);
+    return true;
+}
+
+
+/*
+================================================================================
+
+WINDOWED RELIABLE MESSAGES
+
+With NET_EXT_WINDOW a reliable message goes out as all its fragments at
+once, and up to NET_WINDOW fragments may wait for acks, so a new message
+can be sent before the last one arrived. Each ack tells which fragments
+came in, and only the missing ones are sent again, after a timeout taken
+from the round trips measured so far.
+
+================================================================================
+*/
+
+// the shortest and longest time a fragment waits for its ack, the longest
+// is the classic resend time
+#define NET_MINRTO 0.1
+#define NET_MAXRTO 1.0
+
+typedef struct {
+    u32 sequence;
+    u32 eom;          // NETFLAG_EOM on the last fragment of a message
+    i32 length;
+    i32 tries;        // times sent
+    double sendtime;  // last time it was sent
+    qboolean pending; // unacked when sending, undelivered when receiving
+    byte data[MAX_DATAGRAM];
+} netfragment_t;
+
+typedef struct netwindow_s {
+    // from ackSequence up to sendSequence, at sequence % NET_WINDOW
+    netfragment_t send[NET_WINDOW];
+    // from receiveSequence on, the fragments that came in
+    netfragment_t receive[NET_WINDOW];
+    qboolean ackpending;
+    double srtt;   // smoothed round trip, 0 until the first one is measured
+    double rttvar; // its mean deviation
+    double rto;    // how long a fragment waits for its ack
+} netwindow_t;
+
+cvar_t net_window = {"net_window", "1"};
+
+
+static qboolean Window_Open(qsocket_t* sock) {
+    netwindow_t* window = Q_malloc(sizeof(*window));
+    if (!window) {
+        return false;
+    }
+    Q_memset(window, 0, sizeof(*window));
+    window->rto = NET_MAXRTO;
+    sock->window = window;
+    return true;
+}
+
+static void Window_Close(qsocket_t* sock) {
+    if (sock->window) {
+        Q_free(sock->window);
+        sock->window = NULL;
+    }
+}
+
+static void Window_UpdateCanSend(qsocket_t* sock) {
+    // there must be room for the longest message
+    const u32 fragments = (NET_MAXMESSAGE + MAX_DATAGRAM - 1) / MAX_DATAGRAM;
+    const u32 inflight = sock->sendSequence - sock->ackSequence;
+    sock->canSend = inflight + fragments <= NET_WINDOW;
+}
+
+static i32 Window_SendFragment(qsocket_t* sock, netfragment_t* frag) {
+    const u32 packetLen = NET_HEADERSIZE + frag->length;
+
+    packetBuffer.length = BigLong(packetLen | (NETFLAG_DATA | frag->eom));
+    packetBuffer.sequence = BigLong(frag->sequence);
+    Q_memcpy(packetBuffer.data, frag->data, frag->length);
+
+    if (frag->tries++ > 0) {
+        packetsReSent++;
+    } else {
+        packetsSent++;
+    }
+    frag->sendtime = net_time;
+    sock->lastSendTime = net_time;
+
+    if (UDP_Write(sock->socket, (byte*) &packetBuffer, packetLen, &sock->addr) == -1) {
+        return -1;
+    }
+    return 1;
+}
+
+static i32 Window_SendMessage(qsocket_t* sock, sizebuf_t* data) {
+    netwindow_t* window = sock->window;
+
+#ifdef PARANOID
+    if (sock->canSend == false) {
+        Sys_Error("Window_SendMessage: called with canSend == false\n");
+    }
+#endif
+
+    const byte* src = data->data;
+    i32 left = data->cursize;
+    while (left > 0) {
+        netfragment_t* frag = &window->send[sock->sendSequence % NET_WINDOW];
+        frag->sequence = sock->sendSequence++;
+        frag->length = left < MAX_DATAGRAM ? left : MAX_DATAGRAM;
+        frag->eom = left == frag->length ? NETFLAG_EOM : 0;
+        frag->tries = 0;
+        frag->pending = true;
+        Q_memcpy(frag->data, src, frag->length);
+        src += frag->length;
+        left -= frag->length;
+
+        if (Window_SendFragment(sock, frag) == -1) {
+            return -1;
+        }
+    }
+
+    // the bytes still unacked, so NET_SendToAll can tell when all arrived
+    sock->sendMessageLength += data->cursize;
+    Window_UpdateCanSend(sock);
+    return 1;
+}
+
+static void Window_MeasureRoundTrip(netwindow_t* window, double rtt) {
+    if (window->srtt == 0) {
+        window->srtt = rtt;
+        window->rttvar = rtt / 2;
+    } else {
+        const double err = rtt - window->srtt;
+        window->rttvar = 0.75 * window->rttvar + 0.25 * (err < 0 ? -err : err);
+        window->srtt = 0.875 * window->srtt + 0.125 * rtt;
+    }
+    window->rto = window->srtt + 4 * window->rttvar;
+    if (window->rto < NET_MINRTO) {
+        window->rto = NET_MINRTO;
+    } else if (window->rto > NET_MAXRTO) {
+        window->rto = NET_MAXRTO;
+    }
+}
+
+static void Window_ReadAck(qsocket_t* sock, u32 sequence, i32 length) {
+    netwindow_t* window = sock->window;
+    u32 received = 0;
+
+    const u32 inflight = sock->sendSequence - sock->ackSequence;
+    if (sequence - sock->ackSequence > inflight) {
+        Con_DPrintf("Stale ACK received\n");
+        return;
+    }
+    if (length >= 4) {
+        Q_memcpy(&received, packetBuffer.data, 4);
+        received = BigLong(received);
+    }
+
+    u32 last = sequence; // past the last fragment acked out of order
+    for (u32 seq = sock->ackSequence; seq != sock->sendSequence; seq++) {
+        if ((i32) (sequence - seq) <= 0) {
+            const u32 bit = seq - sequence - 1;
+            if (bit >= 32 || !(received & (1u << bit))) {
+                continue;
+            }
+            last = seq + 1;
+        }
+        netfragment_t* frag = &window->send[seq % NET_WINDOW];
+        if (!frag->pending) {
+            continue;
+        }
+        frag->pending = false;
+        sock->sendMessageLength -= frag->length;
+        if (frag->tries == 1) {
+            // a resent fragment can't tell which send was acked
+            Window_MeasureRoundTrip(window, net_time - frag->sendtime);
+        }
+    }
+
+    while (sock->ackSequence != sock->sendSequence
+           && !window->send[sock->ackSequence % NET_WINDOW].pending) {
+        sock->ackSequence++;
+    }
+    Window_UpdateCanSend(sock);
+
+    // fragments that later ones overtook are likely lost, they are sent
+    // again once they have had a round trip to arrive
+    for (u32 seq = sock->ackSequence; (i32) (last - seq) > 0; seq++) {
+        netfragment_t* frag = &window->send[seq % NET_WINDOW];
+        if (frag->pending && net_time - frag->sendtime >= window->srtt) {
+            Window_SendFragment(sock, frag);
+        }
+    }
+}
+
+static void Window_Resend(qsocket_t* sock) {
+    netwindow_t* window = sock->window;
+    qboolean timedout = false;
+
+    for (u32 seq = sock->ackSequence; seq != sock->sendSequence; seq++) {
+        netfragment_t* frag = &window->send[seq % NET_WINDOW];
+        if (!frag->pending || net_time - frag->sendtime < window->rto) {
+            continue;
+        }
+        Window_SendFragment(sock, frag);
+        timedout = true;
+    }
+
+    if (timedout) {
+        // wait longer until acks come back
+        window->rto *= 2;
+        if (window->rto > NET_MAXRTO) {
+            window->rto = NET_MAXRTO;
+        }
+    }
+}
+
+static void Window_ReadData(
+    qsocket_t* sock,
+    u32 sequence,
+    u32 flags,
+    i32 length
+) {
+    netwindow_t* window = sock->window;
+
+    window->ackpending = true;
+    if (sequence - sock->receiveSequence >= NET_WINDOW) {
+        // already delivered, or past anything the sender may send
+        receivedDuplicateCount++;
+        return;
+    }
+    netfragment_t* frag = &window->receive[sequence % NET_WINDOW];
+    if (frag->pending) {
+        receivedDuplicateCount++;
+        return;
+    }
+    frag->sequence = sequence;
+    frag->eom = flags & NETFLAG_EOM;
+    frag->length = length;
+    frag->pending = true;
+    Q_memcpy(frag->data, packetBuffer.data, length);
+}
+
+//
+// Puts the next message whose fragments all came in into net_message.
+// Returns 1 if there was one, 0 if not and -1 if it is too long.
+//
+static i32 Window_Deliver(qsocket_t* sock) {
+    netwindow_t* window = sock->window;
+
+    while (true) {
+        const u32 slot = sock->receiveSequence % NET_WINDOW;
+        netfragment_t* frag = &window->receive[slot];
+        if (!frag->pending) {
+            return 0;
+        }
+        if (sock->receiveMessageLength + frag->length > NET_MAXMESSAGE) {
+            Con_Printf("Window_Deliver: message too long\n");
+            return -1;
+        }
+        frag->pending = false;
+        sock->receiveSequence++;
+
+        Q_memcpy(sock->receiveMessage + sock->receiveMessageLength, frag->data, frag->length);
+        sock->receiveMessageLength += frag->length;
+        if (frag->eom) {
+            SZ_Clear(&net_message);
+            SZ_Write(&net_message, sock->receiveMessage, sock->receiveMessageLength);
+            sock->receiveMessageLength = 0;
+            return 1;
+        }
+    }
+}
+
+static void Window_SendAck(qsocket_t* sock) {
+    netwindow_t* window = sock->window;
+
+    // fragments waiting for delivery have come in too
+    u32 sequence = sock->receiveSequence;
+    while (sequence - sock->receiveSequence < NET_WINDOW
+           && window->receive[sequence % NET_WINDOW].pending) {
+        sequence++;
+    }
+
+    u32 received = 0;
+    for (u32 bit = 0; bit < 32; bit++) {
+        const u32 seq = sequence + 1 + bit;
+        if (seq - sock->receiveSequence >= NET_WINDOW) {
+            break;
+        }
+        if (window->receive[seq % NET_WINDOW].pending) {
+            received |= 1u << bit;
+        }
+    }
+    received = BigLong(received);
+
+    const u32 packetLen = NET_HEADERSIZE + 4;
+    packetBuffer.length = BigLong(packetLen | NETFLAG_ACK);
+    packetBuffer.sequence = BigLong(sequence);
+    Q_memcpy(packetBuffer.data, &received, 4);
+    UDP_Write(sock->socket, (byte*) &packetBuffer, packetLen, &sock->addr);
+
+    window->ackpending = false;
+}
+
+static i32 Window_GetMessage(qsocket_t* sock) {
+    u32 length;
+    u32 flags;
+    IPaddress readaddr;
+    u32 sequence;
+
+    Window_Resend(sock);
+
+    i32 ret = Window_Deliver(sock);
+    while (ret == 0) {
+        length = UDP_Read(sock->socket, (byte*) &packetBuffer, NET_DATAGRAMSIZE, &readaddr);
+        if (length == 0) {
+            break;
+        }
+        if (length == -1) {
+            Con_Printf("Read error\n");
+            return -1;
+        }
+        if (UDP_AddrCompare(&readaddr, &sock->addr) != 0) {
+            continue;
+        }
+        if (length < NET_HEADERSIZE) {
+            shortPacketCount++;
+            continue;
+        }
+
+        length = BigLong(packetBuffer.length);
+        flags = length & (~NETFLAG_LENGTH_MASK);
+        length &= NETFLAG_LENGTH_MASK;
+
+        if (flags & NETFLAG_CTL) {
+            continue;
+        }
+        if (length < NET_HEADERSIZE || length > NET_DATAGRAMSIZE) {
+            continue;
+        }
+
+        sequence = BigLong(packetBuffer.sequence);
+        packetsReceived++;
+
+        if (flags & NETFLAG_UNRELIABLE) {
+            ret = Datagram_ReadUnreliable(sock, sequence, length) ? 2 : 0;
+            break;
+        }
+        if (flags & NETFLAG_ACK) {
+            Window_ReadAck(sock, sequence, length - NET_HEADERSIZE);
+            continue;
+        }
+        if (flags & NETFLAG_DATA) {
+            Window_ReadData(sock, sequence, flags, length - NET_HEADERSIZE);
+            ret = Window_Deliver(sock);
+        }
+    }
+
+    // one ack for all the fragments read
+    if (sock->window->ackpending) {
+        Window_SendAck(sock);
+    }
+    return ret;
+}
+
+
 i32 Datagram_SendMessage(qsocket_t* sock, sizebuf_t* data) {
     u32 packetLen;
     u32 dataLen;
     u32 eom;
 
+    if (sock->window) {
+        return Window_SendMessage(sock, data);
+    }
+
 #ifdef PARANOID
     if (data->cursize == 0) {
         Sys_Error("Datagram_SendMessage: zero length message\n");
@@ -301,7 +697,10 @@ i32 Datagram_GetMessage(qsocket_t* sock) {
     i32 ret = 0;
     IPaddress readaddr;
     u32 sequence;
-    u32 count;
+
+    if (sock->window) {
+        return Window_GetMessage(sock);
+    }
 
     if (!sock->canSend && (net_time - sock->lastSendTime) > 1.0) {
         ReSendMessage(sock);
@@ -341,24 +740,7 @@ i32 Datagram_GetMessage(qsocket_t* sock) {
         packetsReceived++;
 
         if (flags & NETFLAG_UNRELIABLE) {
-            if (sequence < sock->unreliableReceiveSequence) {
-                Con_DPrintf("Got a stale datagram\n");
-                ret = 0;
-                break;
-            }
-            if (sequence != sock->unreliableReceiveSequence) {
-                count = sequence - sock->unreliableReceiveSequence;
-                droppedDatagrams += count;
-                Con_DPrintf("Dropped %u datagram(s)\n", count);
-            }
-            sock->unreliableReceiveSequence = sequence + 1;
-
-            length -= NET_HEADERSIZE;
-
-            SZ_Clear(&net_message);
-            SZ_Write(&net_message, packetBuffer.data, length);
-
-            ret = 2;
+            ret = Datagram_ReadUnreliable(sock, sequence, length) ? 2 : 0;
             break;
         }
 
@@ -422,6 +804,18 @@ i32 Datagram_GetMessage(qsocket_t* sock) {
 }
 
 
+static void NET_PrintFrameStats(void) {
+    const double frames = host_framecount > 0 ? host_framecount : 1;
+    Con_Printf("packets read per frame     = %.2f\n",
+               udp_stats.packetsRead / frames);
+    Con_Printf("read syscalls per frame    = %.2f\n",
+               udp_stats.readCalls / frames);
+    Con_Printf("packets written per frame  = %.2f\n",
+               udp_stats.packetsWritten / frames);
+    Con_Printf("write syscalls per frame   = %.2f\n",
+               udp_stats.writeCalls / frames);
+}
+
 static void NET_Stats_f(void) {
     if (Cmd_Argc() == 1) {
         Con_Printf("unreliable messages sent   = %i\n", unreliableMessagesSent);
@@ -434,6 +828,7 @@ static void NET_Stats_f(void) {
         Con_Printf("receivedDuplicateCount     = %i\n", receivedDuplicateCount);
         Con_Printf("shortPacketCount           = %i\n", shortPacketCount);
         Con_Printf("droppedDatagrams           = %i\n", droppedDatagrams);
+        NET_PrintFrameStats();
         return;
     }
     NET_PrintSocketStats(Cmd_Argv(1));
@@ -687,6 +1082,7 @@ JustDoIt:
 i32 Datagram_Init(void) {
     myDriverLevel = net_driverlevel;
     Cmd_AddCommand("net_stats", NET_Stats_f);
+    Cvar_RegisterVariable(&net_window);
 
     if (COM_CheckParm("-nolan")) {
         return -1;
@@ -710,6 +1106,7 @@ void Datagram_Shutdown(void) {
 
 
 void Datagram_Close(qsocket_t* sock) {
+    Window_Close(sock);
     UDP_CloseSocket(sock->socket);
 }
 
@@ -792,9 +1189,10 @@ static void NET_REP_Reject(
 static void NET_REP_Accept(
     UDPsocket acceptsock,
     const IPaddress* addr,
-    UDPsocket newsock
+    const qsocket_t* sock,
+    qboolean extended
 ) {
-    IPaddress newaddr = UDP_GetSocketAddr(newsock);
+    IPaddress newaddr = UDP_GetSocketAddr(sock->socket);
 
     SZ_Clear(&net_message);
 
@@ -802,6 +1200,10 @@ static void NET_REP_Accept(
     MSG_WriteLong(&net_message, 0);
     MSG_WriteByte(&net_message, CCREP_ACCEPT);
     MSG_WriteLong(&net_message, UDP_GetSocketPort(&newaddr));
+    if (extended) {
+        MSG_WriteLong(&net_message, NET_EXT_MAGIC);
+        MSG_WriteLong(&net_message, sock->window ? NET_EXT_WINDOW : 0);
+    }
     // Write header.
     *((i32*) net_message.data) = BigLong(NETFLAG_CTL | (net_message.cursize & NETFLAG_LENGTH_MASK));
 
@@ -812,7 +1214,8 @@ static void NET_REP_Accept(
 
 static qsocket_t* NET_TryConnectClient(
     UDPsocket acceptsock,
-    const IPaddress* addr
+    const IPaddress* addr,
+    i32 extensions
 ) {
     // Allocate a QSocket.
     qsocket_t* sock = NET_NewQSocket();
@@ -834,15 +1237,21 @@ static qsocket_t* NET_TryConnectClient(
     sock->addr = *addr;
     Q_strcpy(sock->address, UDP_AddrToString(addr));
 
+    // Without room for the window, the classic protocol will do.
+    if (extensions != -1 && (extensions & NET_EXT_WINDOW) && net_window.value) {
+        Window_Open(sock);
+    }
+
     // Send him back the info about the server connection he has been allocated.
-    NET_REP_Accept(acceptsock, addr, newsock);
+    NET_REP_Accept(acceptsock, addr, sock, extensions != -1);
 
     return sock;
 }
 
 static qboolean NET_IsAlreadyConnected(
     UDPsocket acceptsock,
-    const IPaddress* addr
+    const IPaddress* addr,
+    qboolean extended
 ) {
     for (qsocket_t* s = net_activeSockets; s; s = s->next) {
         if (s->driver != net_driverlevel) {
@@ -855,7 +1264,7 @@ static qboolean NET_IsAlreadyConnected(
         // Is this a duplicate connection request?
         if (net_time - s->connecttime < 2.0) {
             // Yes, so send a duplicate reply.
-            NET_REP_Accept(acceptsock, addr, s->socket);
+            NET_REP_Accept(acceptsock, addr, s, extended);
             return true;
         }
         // It's somebody coming back in from a crash/disconnect,
@@ -884,10 +1293,15 @@ static qsocket_t* NET_REP_Connect(
         return NULL;
     }
 #endif
-    if (NET_IsAlreadyConnected(acceptsock, addr)) {
+    // The extensions the client can use, -1 if it didn't say.
+    i32 extensions = -1;
+    if (MSG_ReadLong() == NET_EXT_MAGIC) {
+        extensions = MSG_ReadLong() & NET_EXT_WINDOW;
+    }
+    if (NET_IsAlreadyConnected(acceptsock, addr, extensions != -1)) {
         return NULL;
     }
-    return NET_TryConnectClient(acceptsock, addr);
+    return NET_TryConnectClient(acceptsock, addr, extensions);
 }
 
 static void NET_REP_RuleInfo(UDPsocket acceptsock, const IPaddress* addr) {
@@ -1153,6 +1567,10 @@ static void NET_REQ_Connect(UDPsocket sock, const IPaddress* addr) {
     MSG_WriteByte(&net_message, CCREQ_CONNECT);
     MSG_WriteString(&net_message, "QUAKE");
     MSG_WriteByte(&net_message, NET_PROTOCOL_VERSION);
+    if (net_window.value) {
+        MSG_WriteLong(&net_message, NET_EXT_MAGIC);
+        MSG_WriteLong(&net_message, NET_EXT_WINDOW);
+    }
     // Write header.
     *((i32*) net_message.data) = BigLong(NETFLAG_CTL | (net_message.cursize & NETFLAG_LENGTH_MASK));
 
@@ -1168,6 +1586,7 @@ static void NET_ConnectError(qsocket_t* sock) {
         m_return_onerror = false;
     }
     if (sock) {
+        Window_Close(sock);
         UDP_CloseSocket(sock->socket);
         NET_FreeQSocket(sock);
     }
@@ -1189,9 +1608,18 @@ static qsocket_t* NET_HandleConnectResponse(
             NET_ReportConnectError(sock, MSG_ReadString());
             return NULL;
         case CCREP_ACCEPT:
-            Con_Printf("Connection accepted\n");
             Q_memcpy(&sock->addr, sendaddr, sizeof(*sendaddr));
             UDP_SetSocketPort(&sock->addr, MSG_ReadLong());
+            if (MSG_ReadLong() == NET_EXT_MAGIC
+                && (MSG_ReadLong() & NET_EXT_WINDOW) && net_window.value
+                && !Window_Open(sock)) {
+                NET_ReportConnectError(sock, "Out of memory\n");
+                return NULL;
+            }
+            Con_Printf("Connection accepted\n");
+            if (sock->window) {
+                Con_DPrintf("Reliable messages are windowed\n");
+            }
             UDP_GetNameFromAddr(sendaddr, sock->address);
             sock->lastMessageTime = SetNetTime();
             m_return_onerror = false;
@@ -26,6 +26,7 @@
 #include "console.h"
 #include "net_poll.h"
 #include "net_socket.h"
+#include "net_udp.h"
 #include "net_vcr.h"
 #include "server.h"
 #include "sys.h"
@@ -453,7 +454,10 @@ i32 NET_SendToAll(sizebuf_t* data, i32 blocktime) {
             }
 
             if (!state2[i]) {
-                if (NET_CanSendMessage(host_client->netconnection)) {
+                // a windowed connection can send before the last message
+                // arrived, so wait until nothing is left unacked
+                if (NET_CanSendMessage(host_client->netconnection)
+                    && host_client->netconnection->sendMessageLength == 0) {
                     state2[i] = true;
                 } else {
                     NET_GetMessage(host_client->netconnection);
@@ -469,6 +473,23 @@ i32 NET_SendToAll(sizebuf_t* data, i32 blocktime) {
 }
 
 
+/*
+==================
+NET_BeginBatch
+
+Messages sent until NET_EndBatch may be held back and sent together with
+the others going to the same connection
+==================
+*/
+void NET_BeginBatch(void) {
+    UDP_BeginBatch();
+}
+
+void NET_EndBatch(void) {
+    UDP_EndBatch();
+}
+
+
 //=============================================================================
 
 /*
@@ -0,0 +1,329 @@
+/*
+ * Copyright (C) 1996-1997 Id Software, Inc.
+ * Copyright (C) Henrique Barateli, <henriquejb194@gmail.com>, et al.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+// net_mmsg.c -- Linux sockets for net_udp.c, read and written in batches
+//
+// SDL_net spends a select and a recvfrom on every datagram it reads, and one
+// more select to find a socket empty. Here a single recvmmsg brings in up to
+// MMSG_BATCH datagrams that UDP_Read then hands out one by one, and when it
+// brings in fewer the socket is known to be empty without asking again.
+// Sockets are watched by an epoll set, so once a socket is empty nothing is
+// asked of it until MMSG_Wait sees a datagram come in.
+// Datagrams written between MMSG_BeginBatch and MMSG_EndBatch are held by
+// their socket and go out in one sendmmsg each. Every connection has a
+// socket of its own, so a batch is what one client is sent in a frame.
+
+#define _GNU_SOURCE
+
+#include "net_mmsg.h"
+
+#ifdef UDP_MMSG
+
+#include "console.h"
+#include "net.h"
+#include "net_udp.h"
+#include "sys.h"
+#include <errno.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+#define MMSG_BATCH 16
+#define MMSG_EVENTS 32
+
+struct _UDPsocket {
+    i32 fd;
+    IPaddress addr;
+
+    // datagrams the last recvmmsg brought in, from head on still unread
+    i32 head;
+    i32 count;
+    qboolean ready;   // not found empty since it last got a datagram
+    i32 answered;     // the wait it was last found empty without asking
+    IPaddress readaddr[MMSG_BATCH];
+    i32 readlen[MMSG_BATCH];
+    byte readbuf[MMSG_BATCH][NET_DATAGRAMSIZE];
+
+    // datagrams written during a batch, not yet sent
+    i32 numwrites;
+    qboolean queued; // in mmsg_queue
+    struct _UDPsocket* next;
+    struct sockaddr_in writeaddr[MMSG_BATCH];
+    i32 writelen[MMSG_BATCH];
+    byte writebuf[MMSG_BATCH][NET_DATAGRAMSIZE];
+};
+
+static qboolean mmsg_batching = false;
+
+static i32 mmsg_epoll = -1;
+static i32 mmsg_waits = 0;
+
+// the sockets written to during this batch
+static UDPsocket mmsg_queue = NULL;
+
+
+void MMSG_Init(void) {
+    mmsg_epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (mmsg_epoll == -1) {
+        Sys_Error("MMSG_Init: epoll_create1 failed: %s", strerror(errno));
+    }
+}
+
+void MMSG_Shutdown(void) {
+    close(mmsg_epoll);
+    mmsg_epoll = -1;
+}
+
+UDPsocket MMSG_OpenSocket(i32 port) {
+    const i32 fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (fd == -1) {
+        return NULL;
+    }
+
+    // like SDL_net, every socket may broadcast
+    const i32 yes = 1;
+    setsockopt(fd, SOL_SOCKET, SO_BROADCAST, &yes, sizeof(yes));
+
+    struct sockaddr_in addr = {0};
+    socklen_t addrlen = sizeof(addr);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons((u16) port);
+    if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) == -1
+        || getsockname(fd, (struct sockaddr*) &addr, &addrlen) == -1) {
+        close(fd);
+        return NULL;
+    }
+
+    UDPsocket socket = Q_malloc(sizeof(*socket));
+    if (socket == NULL) {
+        close(fd);
+        return NULL;
+    }
+    Q_memset(socket, 0, sizeof(*socket));
+    socket->fd = fd;
+    socket->addr.host = addr.sin_addr.s_addr;
+    socket->addr.port = addr.sin_port;
+
+    // edge triggered, a datagram reports the socket once
+    struct epoll_event event = {0};
+    event.events = EPOLLIN | EPOLLET;
+    event.data.ptr = socket;
+    if (epoll_ctl(mmsg_epoll, EPOLL_CTL_ADD, fd, &event) == -1) {
+        close(fd);
+        Q_free(socket);
+        return NULL;
+    }
+    socket->ready = true; // it may have been sent to before it was added
+    return socket;
+}
+
+static void MMSG_Flush(UDPsocket socket) {
+    struct mmsghdr msgs[MMSG_BATCH];
+    struct iovec iov[MMSG_BATCH];
+
+    Q_memset(msgs, 0, socket->numwrites * sizeof(msgs[0]));
+    for (i32 i = 0; i < socket->numwrites; i++) {
+        iov[i].iov_base = socket->writebuf[i];
+        iov[i].iov_len = socket->writelen[i];
+        msgs[i].msg_hdr.msg_name = &socket->writeaddr[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(socket->writeaddr[i]);
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    i32 sent = 0;
+    while (sent < socket->numwrites) {
+        const i32 ret =
+            sendmmsg(socket->fd, msgs + sent, socket->numwrites - sent, 0);
+        udp_stats.writeCalls++;
+        if (ret == -1 && errno == EINTR) {
+            continue;
+        }
+        if (ret == -1) {
+            // the datagram it stopped at is dropped, like a lost one
+            Con_DPrintf("MMSG_Flush: %s\n", strerror(errno));
+            sent++;
+            continue;
+        }
+        sent += ret;
+        udp_stats.packetsWritten += ret;
+    }
+    socket->numwrites = 0;
+}
+
+void MMSG_CloseSocket(UDPsocket socket) {
+    MMSG_Flush(socket);
+    for (UDPsocket* link = &mmsg_queue; *link; link = &(*link)->next) {
+        if (*link == socket) {
+            *link = socket->next;
+            break;
+        }
+    }
+    close(socket->fd);
+    Q_free(socket);
+}
+
+static i32 MMSG_Fill(UDPsocket socket) {
+    struct mmsghdr msgs[MMSG_BATCH];
+    struct iovec iov[MMSG_BATCH];
+    struct sockaddr_in from[MMSG_BATCH];
+
+    Q_memset(msgs, 0, sizeof(msgs));
+    for (i32 i = 0; i < MMSG_BATCH; i++) {
+        iov[i].iov_base = socket->readbuf[i];
+        iov[i].iov_len = NET_DATAGRAMSIZE;
+        msgs[i].msg_hdr.msg_name = &from[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    i32 ret;
+    do {
+        ret = recvmmsg(socket->fd, msgs, MMSG_BATCH, MSG_DONTWAIT, NULL);
+        udp_stats.readCalls++;
+    } while (ret == -1 && errno == EINTR);
+    if (ret == -1 && (errno == EWOULDBLOCK || errno == ECONNREFUSED)) {
+        socket->ready = false;
+        return 0;
+    }
+    if (ret == -1) {
+        return -1;
+    }
+
+    for (i32 i = 0; i < ret; i++) {
+        socket->readaddr[i].host = from[i].sin_addr.s_addr;
+        socket->readaddr[i].port = from[i].sin_port;
+        socket->readlen[i] = (i32) msgs[i].msg_len;
+    }
+    socket->head = 0;
+    socket->count = ret;
+    socket->ready = ret == MMSG_BATCH;
+    udp_stats.packetsRead += ret;
+    return ret;
+}
+
+i32 MMSG_Read(UDPsocket socket, byte* buf, i32 len, IPaddress* addr) {
+    if (socket->count == 0) {
+        if (!socket->ready && socket->answered != mmsg_waits) {
+            // nothing came in since it was found empty. Only the first
+            // read after a wait is answered that way, loops that wait for
+            // an answer without MMSG_Wait keep asking
+            socket->answered = mmsg_waits;
+            return 0;
+        }
+        // whatever is waited for must have gone out first
+        MMSG_Flush(socket);
+        const i32 ret = MMSG_Fill(socket);
+        if (ret <= 0) {
+            return ret;
+        }
+    }
+
+    const i32 slot = socket->head++;
+    socket->count--;
+    i32 length = socket->readlen[slot];
+    if (length > len) {
+        length = len; // cut short, as recvfrom would
+    }
+    Q_memcpy(buf, socket->readbuf[slot], length);
+    *addr = socket->readaddr[slot];
+    return length;
+}
+
+i32 MMSG_Write(UDPsocket socket, byte* buf, i32 len, const IPaddress* addr) {
+    struct sockaddr_in to = {0};
+    to.sin_family = AF_INET;
+    to.sin_addr.s_addr = addr->host;
+    to.sin_port = addr->port;
+
+    if (!mmsg_batching || len > NET_DATAGRAMSIZE) {
+        MMSG_Flush(socket);
+        const i32 ret = sendto(socket->fd, buf, len, 0,
+                               (struct sockaddr*) &to, sizeof(to));
+        udp_stats.writeCalls++;
+        if (ret == -1) {
+            return -1;
+        }
+        udp_stats.packetsWritten++;
+        return 1;
+    }
+
+    if (socket->numwrites == MMSG_BATCH) {
+        MMSG_Flush(socket);
+    }
+    const i32 slot = socket->numwrites++;
+    socket->writeaddr[slot] = to;
+    socket->writelen[slot] = len;
+    Q_memcpy(socket->writebuf[slot], buf, len);
+    if (!socket->queued) {
+        socket->queued = true;
+        socket->next = mmsg_queue;
+        mmsg_queue = socket;
+    }
+    return 1;
+}
+
+IPaddress MMSG_GetSocketAddr(UDPsocket socket) {
+    return socket->addr;
+}
+
+//
+// Waits up to timeout seconds, rounded up to a millisecond, for a datagram to
+// come in and returns how many sockets got one. Those found while waiting are
+// read right away, so the frame that wants them finds them queued.
+//
+i32 MMSG_Wait(double timeout) {
+    struct epoll_event events[MMSG_EVENTS];
+
+    const i32 ms = timeout > 0 ? (i32) ceil(timeout * 1000.0) : 0;
+    i32 count = epoll_wait(mmsg_epoll, events, MMSG_EVENTS, ms);
+    mmsg_waits++;
+    if (count == -1) {
+        return 0; // interrupted, the caller waits again if it has to
+    }
+    for (i32 i = 0; i < count; i++) {
+        UDPsocket socket = events[i].data.ptr;
+        socket->ready = true;
+        if (timeout > 0 && socket->count == 0) {
+            MMSG_Fill(socket);
+        }
+    }
+    return count;
+}
+
+void MMSG_BeginBatch(void) {
+    mmsg_batching = true;
+}
+
+void MMSG_EndBatch(void) {
+    mmsg_batching = false;
+    for (UDPsocket socket = mmsg_queue; socket; socket = socket->next) {
+        MMSG_Flush(socket);
+        socket->queued = false;
+    }
+    mmsg_queue = NULL;
+}
+
+#endif
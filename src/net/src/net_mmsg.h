@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 1996-1997 Id Software, Inc.
+ * Copyright (C) Henrique Barateli, <henriquejb194@gmail.com>, et al.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+// net_mmsg.h -- Linux sockets for net_udp.c, read and written in batches
+
+
+#ifndef __NET_MMSG__
+#define __NET_MMSG__
+
+#if defined(__linux__) && !defined(UDP_NOMMSG)
+#define UDP_MMSG
+#endif
+
+#ifdef UDP_MMSG
+
+#include "quakedef.h"
+#include <SDL_net.h>
+
+void MMSG_Init(void);
+void MMSG_Shutdown(void);
+UDPsocket MMSG_OpenSocket(i32 port);
+void MMSG_CloseSocket(UDPsocket socket);
+i32 MMSG_Read(UDPsocket socket, byte* buf, i32 len, IPaddress* addr);
+i32 MMSG_Write(UDPsocket socket, byte* buf, i32 len, const IPaddress* addr);
+IPaddress MMSG_GetSocketAddr(UDPsocket socket);
+i32 MMSG_Wait(double timeout);
+void MMSG_BeginBatch(void);
+void MMSG_EndBatch(void);
+
+#endif
+
+#endif
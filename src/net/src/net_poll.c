@@ -23,6 +23,8 @@
 #include "net_poll.h"
 #include "client.h"
 #include "console.h"
+#include "net_udp.h"
+#include "profiler.h"
 #include "server.h"
 #include "sys.h"
 
@@ -206,7 +208,21 @@ static void Slist_Poll(void) {
 //==============================================================================
 
 
+/*
+==================
+NET_Wait
+
+Sleeps until a datagram comes in or timeout seconds have passed. Returns
+true if a datagram came in, which has already been read ahead.
+==================
+*/
+qboolean NET_Wait(double timeout) {
+    return UDP_Wait(timeout);
+}
+
 void NET_Poll(void) {
+    PROF_BEGIN("NET_Poll");
+
     if (!configRestored) {
         if (serialAvailable) {
             qboolean useModem = (config_com_modem.value == 1.0);
@@ -222,6 +238,10 @@ void NET_Poll(void) {
 
     SetNetTime();
 
+    // find the sockets datagrams came in on since the last frame, reading
+    // the others costs nothing until then
+    UDP_Wait(0);
+
     for (poll_procedure_t* pp = pollProcedureList; pp; pp = pp->next) {
         if (pp->nextTime > net_time) {
             break;
@@ -229,4 +249,6 @@ void NET_Poll(void) {
         pollProcedureList = pp->next;
         pp->procedure();
     }
+
+    PROF_END();
 }
@@ -81,6 +81,7 @@ qsocket_t* NET_NewQSocket(void) {
     }
     sock->driver = net_driverlevel;
     sock->driverdata = NULL;
+    sock->window = NULL;
     Q_strcpy(sock->address, "UNSET ADDRESS");
     sock->disconnected = false;
     sock->sendNext = false;
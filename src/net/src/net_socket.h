@@ -40,6 +40,7 @@ typedef struct qsocket_s {
     i32 driver;
     UDPsocket socket;
     void* driverdata;
+    struct netwindow_s* window; // NULL unless NET_EXT_WINDOW was agreed on
 
     u32 ackSequence;
     u32 sendSequence;
@@ -21,6 +21,7 @@
 
 
 #include "net_udp.h"
+#include "net_mmsg.h"
 #include "console.h"
 #include "cvar.h"
 #include "net.h"
@@ -39,6 +40,27 @@
 #define MAXHOSTNAMELEN 256
 #endif
 
+#define UDP_MAXLAGGED 128
+
+// a datagram net_fakelag holds back
+typedef struct {
+    UDPsocket socket;
+    IPaddress addr;
+    double time; // when it goes out
+    i32 len;
+    byte data[NET_DATAGRAMSIZE];
+} laggedpacket_t;
+
+
+udpstats_t udp_stats;
+
+// milliseconds every datagram written waits before it goes out, to see how
+// the protocol does over a slow link
+cvar_t net_fakelag = {"net_fakelag", "0"};
+
+static laggedpacket_t* udp_lagged = NULL; // a ring of UDP_MAXLAGGED
+static i32 udp_laggedhead = 0;
+static i32 udp_laggedcount = 0;
 
 static qboolean initialized = false;
 
@@ -80,6 +102,7 @@ UDPsocket UDP_GetAcceptSocket(void) {
 }
 
 void UDP_Init(void) {
+    Cvar_RegisterVariable(&net_fakelag);
     if (COM_CheckParm("-noudp")) {
         return;
     }
@@ -91,6 +114,10 @@ void UDP_Init(void) {
     // Determine my name and address.
     UDP_FindLocalAddr();
 
+#ifdef UDP_MMSG
+    MMSG_Init();
+#endif
+
     // if the quake hostname isn't set, set it to the machine name
     if (Q_strcmp(hostname.string, "UNNAMED") == 0) {
         char buff[MAXHOSTNAMELEN];
@@ -121,6 +148,14 @@ void UDP_Init(void) {
 void UDP_Shutdown(void) {
     UDP_Listen(false);
     UDP_CloseSocket(control_sock);
+#ifdef UDP_MMSG
+    MMSG_Shutdown();
+#endif
+    if (udp_lagged) {
+        Q_free(udp_lagged);
+        udp_lagged = NULL;
+        udp_laggedcount = 0;
+    }
     initialized = false;
 }
 
@@ -150,21 +185,96 @@ void UDP_Listen(qboolean state) {
 }
 
 UDPsocket UDP_OpenSocket(i32 port) {
+#ifdef UDP_MMSG
+    return MMSG_OpenSocket(port);
+#else
     return SDLNet_UDP_Open((u16) port);
+#endif
 }
 
 void UDP_CloseSocket(UDPsocket socket) {
     if (socket == broadcast_sock) {
         broadcast_sock = NULL;
     }
+    for (i32 i = 0; i < udp_laggedcount; i++) {
+        laggedpacket_t* packet =
+            &udp_lagged[(udp_laggedhead + i) % UDP_MAXLAGGED];
+        if (packet->socket == socket) {
+            packet->socket = NULL;
+        }
+    }
+#ifdef UDP_MMSG
+    MMSG_CloseSocket(socket);
+#else
     SDLNet_UDP_Close(socket);
+#endif
+}
+
+static i32 UDP_WriteNow(
+    UDPsocket socket,
+    byte* buf,
+    i32 len,
+    const IPaddress* addr
+);
+
+static void UDP_SendLagged(qboolean all) {
+    const double now = Sys_FloatTime();
+    while (udp_laggedcount > 0) {
+        laggedpacket_t* packet = &udp_lagged[udp_laggedhead];
+        if (!all && packet->time > now) {
+            return;
+        }
+        if (packet->socket) {
+            UDP_WriteNow(packet->socket, packet->data, packet->len,
+                         &packet->addr);
+        }
+        udp_laggedhead = (udp_laggedhead + 1) % UDP_MAXLAGGED;
+        udp_laggedcount--;
+    }
+}
+
+static i32 UDP_WriteLagged(
+    UDPsocket socket,
+    byte* buf,
+    i32 len,
+    const IPaddress* addr
+) {
+    if (udp_lagged == NULL) {
+        udp_lagged = Q_malloc(UDP_MAXLAGGED * sizeof(*udp_lagged));
+        if (udp_lagged == NULL) {
+            return UDP_WriteNow(socket, buf, len, addr);
+        }
+    }
+    UDP_SendLagged(false);
+    if (udp_laggedcount == UDP_MAXLAGGED) {
+        // early rather than out of order
+        laggedpacket_t* oldest = &udp_lagged[udp_laggedhead];
+        oldest->time = 0;
+        UDP_SendLagged(false);
+    }
+    laggedpacket_t* packet =
+        &udp_lagged[(udp_laggedhead + udp_laggedcount) % UDP_MAXLAGGED];
+    packet->socket = socket;
+    packet->addr = *addr;
+    packet->time = Sys_FloatTime() + net_fakelag.value / 1000.0;
+    packet->len = len;
+    Q_memcpy(packet->data, buf, len);
+    udp_laggedcount++;
+    return 1;
 }
 
 i32 UDP_Read(UDPsocket socket, byte* buf, i32 len, IPaddress* addr) {
+    if (udp_laggedcount > 0) {
+        UDP_SendLagged(false);
+    }
+#ifdef UDP_MMSG
+    return MMSG_Read(socket, buf, len, addr);
+#else
     UDPpacket packet = {0};
     packet.data = buf;
     packet.maxlen = len;
     const i32 ret = SDLNet_UDP_Recv(socket, &packet);
+    udp_stats.readCalls++;
     if (ret == -1 && (errno == EWOULDBLOCK || errno == ECONNREFUSED)) {
         return 0;
     }
@@ -172,8 +282,13 @@ i32 UDP_Read(UDPsocket socket, byte* buf, i32 len, IPaddress* addr) {
         // Is this necessary?
         return -1;
     }
+    if (ret == 0) {
+        return 0;
+    }
+    udp_stats.packetsRead++;
     *addr = packet.address;
     return packet.len;
+#endif
 }
 
 static i32 UDP_MakeSocketBroadcastCapable(UDPsocket socket) {
@@ -192,14 +307,76 @@ i32 UDP_Broadcast(UDPsocket socket, byte* buf, i32 len) {
 }
 
 i32 UDP_Write(UDPsocket socket, byte* buf, i32 len, const IPaddress* addr) {
+    if (net_fakelag.value > 0 && len <= NET_DATAGRAMSIZE) {
+        return UDP_WriteLagged(socket, buf, len, addr);
+    }
+    if (udp_laggedcount > 0) {
+        UDP_SendLagged(true);
+    }
+    return UDP_WriteNow(socket, buf, len, addr);
+}
+
+static i32 UDP_WriteNow(
+    UDPsocket socket,
+    byte* buf,
+    i32 len,
+    const IPaddress* addr
+) {
+#ifdef UDP_MMSG
+    return MMSG_Write(socket, buf, len, addr);
+#else
     UDPpacket packet;
     packet.data = buf;
     packet.len = len;
     packet.address = *addr;
+    udp_stats.writeCalls++;
     if (!SDLNet_UDP_Send(socket, -1, &packet)) {
         return -1;
     }
+    udp_stats.packetsWritten++;
     return 1;
+#endif
+}
+
+//
+// Datagrams written between UDP_BeginBatch and UDP_EndBatch may be held back
+// until UDP_EndBatch, so sockets that get more than one cost a single call.
+// Nothing that waits for an answer should run in between.
+//
+void UDP_BeginBatch(void) {
+#ifdef UDP_MMSG
+    MMSG_BeginBatch();
+#endif
+}
+
+void UDP_EndBatch(void) {
+#ifdef UDP_MMSG
+    MMSG_EndBatch();
+#endif
+}
+
+//
+// Returns once a datagram comes in or timeout seconds have passed, without
+// waiting at all for a timeout of 0. Returns true if a datagram came in.
+//
+qboolean UDP_Wait(double timeout) {
+    if (udp_laggedcount > 0) {
+        UDP_SendLagged(false);
+    }
+    if (udp_laggedcount > 0) {
+        // wake up for the next held back datagram
+        const double due = udp_lagged[udp_laggedhead].time - Sys_FloatTime();
+        if (due < timeout) {
+            timeout = due;
+        }
+    }
+#ifdef UDP_MMSG
+    if (initialized) {
+        return MMSG_Wait(timeout) > 0;
+    }
+#endif
+    Sys_Sleep(timeout);
+    return false;
 }
 
 char* UDP_AddrToString(const IPaddress* addr) {
@@ -217,6 +394,13 @@ char* UDP_AddrToString(const IPaddress* addr) {
 }
 
 IPaddress UDP_GetSocketAddr(UDPsocket socket) {
+#ifdef UDP_MMSG
+    IPaddress addr = MMSG_GetSocketAddr(socket);
+    if (UDP_IsLocalAddr(&addr)) {
+        addr.host = my_addr.host;
+    }
+    return addr;
+#else
     IPaddress addr = {0};
     const IPaddress* sock_addr = SDLNet_UDP_GetPeerAddress(socket, -1);
     addr.host = sock_addr->host;
@@ -225,6 +409,7 @@ IPaddress UDP_GetSocketAddr(UDPsocket socket) {
         addr.host = my_addr.host;
     }
     return addr;
+#endif
 }
 
 void UDP_GetNameFromAddr(const IPaddress* addr, char* name) {
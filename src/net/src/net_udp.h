@@ -26,6 +26,16 @@
 #include "quakedef.h"
 #include <SDL_net.h>
 
+// what the sockets cost, counted by whichever code owns them
+typedef struct {
+    i32 packetsRead;
+    i32 readCalls;
+    i32 packetsWritten;
+    i32 writeCalls;
+} udpstats_t;
+
+extern udpstats_t udp_stats;
+
 qboolean UDP_IsInitialized(void);
 UDPsocket UDP_GetControlSocket(void);
 UDPsocket UDP_GetAcceptSocket(void);
@@ -44,5 +54,8 @@ i32 UDP_GetAddrFromName(char* name, IPaddress* addr);
 i32 UDP_AddrCompare(const IPaddress* addr1, const IPaddress* addr2);
 i32 UDP_GetSocketPort(const IPaddress* addr);
 void UDP_SetSocketPort(IPaddress* addr, i32 port);
+void UDP_BeginBatch(void);
+void UDP_EndBatch(void);
+qboolean UDP_Wait(double timeout);
 
 #endif
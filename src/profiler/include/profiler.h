@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 1996-1997 Id Software, Inc.
+ * Copyright (C) Henrique Barateli, <henriquejb194@gmail.com>, et al.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+// profiler.h -- per frame timing zones
+
+#ifndef __PROFILER__
+#define __PROFILER__
+
+#include "quakedef.h"
+
+//
+// Zones are timed with the performance counter and kept per frame in a
+// ring buffer, "profdump" writes the buffered frames out as a Chrome trace
+// (chrome://tracing, ui.perfetto.dev) and "profstats" summarizes them.
+// Only the main thread may open zones.
+//
+
+// true while prof_enable is set or a hold is taken, only changes between
+// frames
+extern qboolean prof_active;
+
+void Prof_Init(void);
+
+void Prof_Hold(void);
+void Prof_Release(void);
+// keeps the profiler recording from the next frame on regardless of
+// prof_enable, for code that reads zone times back
+
+double Prof_LastFrameZone(const char* name);
+// milliseconds spent in zones with this name during the previous frame,
+// or -1 if that frame wasn't recorded
+
+void Prof_BeginFrame(void);
+void Prof_EndFrame(void);
+
+void Prof_Count(const char* name, double amount);
+// adds to a per frame counter, shown by profstats and written as a counter
+// track by profdump, names are kept like zone names
+
+void Prof_Begin(const char* name);
+// name is stored as is, so it has to outlive the buffered frames
+void Prof_End(void);
+
+// zones nest and every PROF_BEGIN needs a matching PROF_END
+#define PROF_BEGIN(name)                                                       \
+    do {                                                                       \
+        if (prof_active)                                                       \
+            Prof_Begin(name);                                                  \
+    } while (0)
+
+#define PROF_END()                                                             \
+    do {                                                                       \
+        if (prof_active)                                                       \
+            Prof_End();                                                        \
+    } while (0)
+
+#define PROF_COUNT(name, amount)                                               \
+    do {                                                                       \
+        if (prof_active)                                                       \
+            Prof_Count(name, amount);                                          \
+    } while (0)
+
+#endif
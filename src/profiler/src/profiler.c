@@ -0,0 +1,405 @@
+/*
+ * Copyright (C) 1996-1997 Id Software, Inc.
+ * Copyright (C) Henrique Barateli, <henriquejb194@gmail.com>, et al.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+// profiler.c -- per frame timing zones
+
+#include "profiler.h"
+#include "cmd.h"
+#include "common.h"
+#include "console.h"
+#include "cvar.h"
+#include <SDL_timer.h>
+#include <stdio.h>
+#include <string.h>
+
+#define PROF_MAXEVENTS 65536 // must be a power of two
+#define PROF_MAXFRAMES 256
+#define PROF_MAXDEPTH  32
+#define PROF_MAXZONES  64 // distinct names summarized by profstats
+#define PROF_MAXCOUNTS 16 // counters per frame
+
+typedef struct {
+    const char* name;
+    u64 start, end; // performance counter ticks
+    i32 depth;
+} profevent_t;
+
+typedef struct {
+    const char* name;
+    double value;
+} profcount_t;
+
+typedef struct {
+    u64 start, end;
+    u32 firstevent; // absolute event number, see prof_numevents
+    u32 numevents;
+    profcount_t counts[PROF_MAXCOUNTS];
+    i32 numcounts;
+} profframe_t;
+
+qboolean prof_active;
+
+cvar_t prof_enable = {"prof_enable", "0"};
+
+static profevent_t prof_events[PROF_MAXEVENTS];
+static u32 prof_numevents; // ever recorded, wraps around the ring
+
+static profframe_t prof_frames[PROF_MAXFRAMES];
+static u32 prof_numframes; // ever recorded
+
+static u32 prof_stack[PROF_MAXDEPTH];
+static i32 prof_depth;
+static i32 prof_lost; // zones opened past PROF_MAXDEPTH or outside a frame
+static qboolean prof_inframe;
+static qboolean prof_lastkept; // the previous frame was recorded
+static i32 prof_holds;
+
+static u64 prof_frequency;
+
+
+/*
+===================
+Prof_EventKept
+
+True if the event hasn't been overwritten by newer ones yet
+===================
+*/
+static qboolean Prof_EventKept(u32 num) {
+    return prof_numevents - num <= PROF_MAXEVENTS;
+}
+
+/*
+===================
+Prof_FrameKept
+===================
+*/
+static qboolean Prof_FrameKept(const profframe_t* frame) {
+    return Prof_EventKept(frame->firstevent);
+}
+
+static double Prof_Micro(u64 ticks, u64 base) {
+    return (double) (ticks - base) * 1000000.0 / (double) prof_frequency;
+}
+
+/*
+===================
+Prof_CloseZones
+
+Ends every open zone at the given time, for frames left through a longjmp
+===================
+*/
+static void Prof_CloseZones(u64 now) {
+    while (prof_depth > 0) {
+        prof_depth--;
+        prof_events[prof_stack[prof_depth] & (PROF_MAXEVENTS - 1)].end = now;
+    }
+    prof_lost = 0;
+}
+
+void Prof_BeginFrame(void) {
+    profframe_t* frame;
+    u64 now = SDL_GetPerformanceCounter();
+
+    if (prof_inframe)
+        Prof_EndFrame(); // the last frame was aborted
+
+    prof_lastkept = prof_active;
+    prof_active = prof_enable.value != 0 || prof_holds > 0;
+    if (!prof_active)
+        return;
+
+    frame = &prof_frames[prof_numframes % PROF_MAXFRAMES];
+    frame->start = now;
+    frame->end = now;
+    frame->firstevent = prof_numevents;
+    frame->numevents = 0;
+    frame->numcounts = 0;
+    prof_inframe = true;
+}
+
+void Prof_EndFrame(void) {
+    profframe_t* frame;
+    u64 now = SDL_GetPerformanceCounter();
+
+    if (!prof_inframe)
+        return;
+    Prof_CloseZones(now);
+
+    frame = &prof_frames[prof_numframes % PROF_MAXFRAMES];
+    frame->end = now;
+    frame->numevents = prof_numevents - frame->firstevent;
+    prof_numframes++;
+    prof_inframe = false;
+}
+
+void Prof_Begin(const char* name) {
+    profevent_t* ev;
+
+    if (!prof_inframe || prof_depth == PROF_MAXDEPTH) {
+        prof_lost++;
+        return;
+    }
+
+    ev = &prof_events[prof_numevents & (PROF_MAXEVENTS - 1)];
+    ev->name = name;
+    ev->depth = prof_depth;
+    ev->start = SDL_GetPerformanceCounter();
+    ev->end = ev->start;
+    prof_stack[prof_depth++] = prof_numevents++;
+}
+
+void Prof_End(void) {
+    u64 now = SDL_GetPerformanceCounter();
+
+    if (prof_lost) {
+        prof_lost--;
+        return;
+    }
+    if (!prof_depth)
+        return;
+    prof_depth--;
+    prof_events[prof_stack[prof_depth] & (PROF_MAXEVENTS - 1)].end = now;
+}
+
+void Prof_Count(const char* name, double amount) {
+    profframe_t* frame;
+    i32 i;
+
+    if (!prof_inframe)
+        return;
+
+    frame = &prof_frames[prof_numframes % PROF_MAXFRAMES];
+    for (i = 0; i < frame->numcounts; i++) {
+        if (frame->counts[i].name == name ||
+            !Q_strcmp(frame->counts[i].name, name)) {
+            frame->counts[i].value += amount;
+            return;
+        }
+    }
+    if (frame->numcounts == PROF_MAXCOUNTS)
+        return;
+    frame->counts[i].name = name;
+    frame->counts[i].value = amount;
+    frame->numcounts++;
+}
+
+void Prof_Hold(void) {
+    prof_holds++;
+}
+
+void Prof_Release(void) {
+    if (prof_holds > 0)
+        prof_holds--;
+}
+
+double Prof_LastFrameZone(const char* name) {
+    profframe_t* frame;
+    profevent_t* ev;
+    double total;
+    u32 i;
+
+    if (!prof_lastkept || !prof_numframes)
+        return -1;
+    frame = &prof_frames[(prof_numframes - 1) % PROF_MAXFRAMES];
+    if (!Prof_FrameKept(frame))
+        return -1;
+
+    total = 0;
+    for (i = 0; i < frame->numevents; i++) {
+        ev = &prof_events[(frame->firstevent + i) & (PROF_MAXEVENTS - 1)];
+        if (ev->name == name || !Q_strcmp(ev->name, name))
+            total += Prof_Micro(ev->end, ev->start);
+    }
+    return total / 1000;
+}
+
+/*
+===================
+Prof_FirstFrame
+
+Oldest buffered frame whose zones are all still in the event ring
+===================
+*/
+static u32 Prof_FirstFrame(void) {
+    u32 first;
+
+    first = prof_numframes > PROF_MAXFRAMES ? prof_numframes - PROF_MAXFRAMES
+                                            : 0;
+    while (first < prof_numframes &&
+           !Prof_FrameKept(&prof_frames[first % PROF_MAXFRAMES]))
+        first++;
+    return first;
+}
+
+/*
+===================
+Prof_Dump_f
+
+Writes the buffered frames as Chrome trace events
+
+profdump [file]
+===================
+*/
+void Prof_Dump_f(void) {
+    char name[MAX_OSPATH];
+    profframe_t* frame;
+    profevent_t* ev;
+    FILE* f;
+    u32 i, j, first;
+    u64 base;
+    i32 written;
+
+    first = Prof_FirstFrame();
+    if (first == prof_numframes) {
+        Con_Printf("no profiled frames, set prof_enable 1 first\n");
+        return;
+    }
+
+    if (Cmd_Argc() > 1) {
+        Q_strncpy(name, Cmd_Argv(1), sizeof(name) - 6);
+        name[sizeof(name) - 6] = 0;
+    } else {
+        Q_strcpy(name, "profile");
+    }
+    COM_DefaultExtension(name, ".json");
+
+    f = fopen(va("%s/%s", com_gamedir, name), "w");
+    if (!f) {
+        Con_Printf("Couldn't write %s.\n", name);
+        return;
+    }
+
+    base = prof_frames[first % PROF_MAXFRAMES].start;
+    written = 0;
+    fprintf(f, "{\"traceEvents\":[\n");
+    for (i = first; i < prof_numframes; i++) {
+        frame = &prof_frames[i % PROF_MAXFRAMES];
+        fprintf(f,
+                "%s{\"name\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+                "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%u}}",
+                written ? ",\n" : "", Prof_Micro(frame->start, base),
+                Prof_Micro(frame->end, frame->start), i);
+        written++;
+        for (j = 0; j < (u32) frame->numcounts; j++) {
+            fprintf(f,
+                    ",\n{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"tid\":1,"
+                    "\"ts\":%.3f,\"args\":{\"value\":%g}}",
+                    frame->counts[j].name, Prof_Micro(frame->start, base),
+                    frame->counts[j].value);
+            written++;
+        }
+        for (j = 0; j < frame->numevents; j++) {
+            ev = &prof_events[(frame->firstevent + j) & (PROF_MAXEVENTS - 1)];
+            fprintf(f,
+                    ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+                    "\"ts\":%.3f,\"dur\":%.3f}",
+                    ev->name, Prof_Micro(ev->start, base),
+                    Prof_Micro(ev->end, ev->start));
+            written++;
+        }
+    }
+    fprintf(f, "\n],\"displayTimeUnit\":\"ns\"}\n");
+    fclose(f);
+
+    Con_Printf("Wrote %i events from %u frames to %s.\n", written,
+               prof_numframes - first, name);
+}
+
+/*
+===================
+Prof_Stats_f
+
+Average time and calls per frame for every zone in the buffered frames
+===================
+*/
+void Prof_Stats_f(void) {
+    const char* names[PROF_MAXZONES];
+    double times[PROF_MAXZONES];
+    i32 calls[PROF_MAXZONES];
+    i32 numzones;
+    const char* countnames[PROF_MAXZONES];
+    double counts[PROF_MAXZONES];
+    i32 numcounts;
+    profframe_t* frame;
+    profevent_t* ev;
+    double frametime;
+    u32 i, j, first, numframes;
+    i32 z;
+
+    first = Prof_FirstFrame();
+    numframes = prof_numframes - first;
+    if (!numframes) {
+        Con_Printf("no profiled frames, set prof_enable 1 first\n");
+        return;
+    }
+
+    numzones = 0;
+    numcounts = 0;
+    frametime = 0;
+    for (i = first; i < prof_numframes; i++) {
+        frame = &prof_frames[i % PROF_MAXFRAMES];
+        frametime += Prof_Micro(frame->end, frame->start);
+        for (j = 0; j < (u32) frame->numcounts; j++) {
+            for (z = 0; z < numcounts; z++)
+                if (!Q_strcmp(countnames[z], frame->counts[j].name))
+                    break;
+            if (z == numcounts) {
+                if (numcounts == PROF_MAXZONES)
+                    continue;
+                countnames[z] = frame->counts[j].name;
+                counts[z] = 0;
+                numcounts++;
+            }
+            counts[z] += frame->counts[j].value;
+        }
+        for (j = 0; j < frame->numevents; j++) {
+            ev = &prof_events[(frame->firstevent + j) & (PROF_MAXEVENTS - 1)];
+            for (z = 0; z < numzones; z++)
+                if (names[z] == ev->name || !Q_strcmp(names[z], ev->name))
+                    break;
+            if (z == numzones) {
+                if (numzones == PROF_MAXZONES)
+                    continue;
+                names[z] = ev->name;
+                times[z] = 0;
+                calls[z] = 0;
+                numzones++;
+            }
+            times[z] += Prof_Micro(ev->end, ev->start);
+            calls[z]++;
+        }
+    }
+
+    Con_Printf("%u frames, %.3f ms per frame\n", numframes,
+               frametime / numframes / 1000);
+    for (z = 0; z < numzones; z++)
+        Con_Printf("%8.3f ms %7.1f calls %s\n", times[z] / numframes / 1000,
+                   (double) calls[z] / numframes, names[z]);
+    for (z = 0; z < numcounts; z++)
+        Con_Printf("%11.1f per frame %s\n", counts[z] / numframes,
+                   countnames[z]);
+}
+
+void Prof_Init(void) {
+    prof_frequency = SDL_GetPerformanceFrequency();
+
+    Cvar_RegisterVariable(&prof_enable);
+    Cmd_AddCommand("profdump", Prof_Dump_f);
+    Cmd_AddCommand("profstats", Prof_Stats_f);
+}
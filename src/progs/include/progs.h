@@ -52,6 +52,7 @@ typedef struct {
 typedef struct edict_s {
     qboolean free;
     link_t area; // linked to a division node or leaf
+    struct areanode_s* areanode; // the node area is linked into
 
     i32 num_leafs;
     i16 leafnums[MAX_ENT_LEAFS];
@@ -77,6 +78,10 @@ extern float* pr_globals; // same as pr_global_struct
 
 extern i32 pr_edict_size; // in bytes
 
+extern i32 pr_stringstores;
+// bumped whenever a string field of an edict may have changed, anything
+// that writes one from C must bump it too so PF_Find can trust its cache
+
 //============================================================================
 
 void PR_Init(void);
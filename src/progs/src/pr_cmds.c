@@ -19,7 +19,7 @@
  */
 
 
-#include "progs.h"
+#include "pr_local.h"
 #include "cmd.h"
 #include "console.h"
 #include "host.h"
@@ -248,6 +248,7 @@ void PF_setmodel(void) {
 
 
     e->v.model = PR_SetString(m);
+    pr_stringstores++;
     e->v.modelindex = i; //SV_ModelIndex (m);
 
     mod = sv.models[(i32) e->v.modelindex]; // Mod_ForName (m, true);
@@ -801,6 +802,48 @@ void PF_cvar_set(void) {
     Cvar_Set(var, val);
 }
 
+// engine strings such as client names and ftos results change their text in
+// place, so the find cache can go stale without a store
+cvar_t pr_findindex = {"pr_findindex", "0"};
+// the area tree only has edicts as of their last link, so an edict made
+// solid or moved by QuakeC without a setorigin is missed until it's linked
+cvar_t pr_radiusindex = {"pr_radiusindex", "0"};
+
+/*
+=================
+PF_CompareEdicts
+
+qsort callback, orders edicts by number
+=================
+*/
+static i32 PF_CompareEdicts(const void* a, const void* b) {
+    const edict_t* ea = *(const edict_t**) a;
+    const edict_t* eb = *(const edict_t**) b;
+
+    if (ea < eb)
+        return -1;
+    return ea > eb;
+}
+
+/*
+=================
+PF_InRadius
+=================
+*/
+static qboolean PF_InRadius(edict_t* ent, float* org, float rad) {
+    vec3_t eorg;
+    i32 j;
+
+    if (ent->free)
+        return false;
+    if (ent->v.solid == SOLID_NOT)
+        return false;
+    for (j = 0; j < 3; j++)
+        eorg[j] = org[j] - (ent->v.origin[j] +
+                            (ent->v.mins[j] + ent->v.maxs[j]) * 0.5);
+    return Length(eorg) <= rad;
+}
+
 /*
 =================
 PF_findradius
@@ -811,29 +854,44 @@ findradius (origin, radius)
 =================
 */
 void PF_findradius(void) {
+    static edict_t* touched[MAX_EDICTS];
     edict_t *ent, *chain;
     float rad;
     float* org;
-    vec3_t eorg;
-    i32 i, j;
+    vec3_t mins, maxs;
+    i32 i, j, count;
 
     chain = (edict_t*) sv.edicts;
 
     org = G_VECTOR(OFS_PARM0);
     rad = G_FLOAT(OFS_PARM1);
 
-    ent = NEXT_EDICT(sv.edicts);
-    for (i = 1; i < sv.num_edicts; i++, ent = NEXT_EDICT(ent)) {
-        if (ent->free)
-            continue;
-        if (ent->v.solid == SOLID_NOT)
-            continue;
-        for (j = 0; j < 3; j++)
-            eorg[j] = org[j] - (ent->v.origin[j] +
-                                (ent->v.mins[j] + ent->v.maxs[j]) * 0.5);
-        if (Length(eorg) > rad)
-            continue;
+    if (!pr_radiusindex.value || !(rad >= 0)) {
+        ent = NEXT_EDICT(sv.edicts);
+        for (i = 1; i < sv.num_edicts; i++, ent = NEXT_EDICT(ent)) {
+            if (!PF_InRadius(ent, org, rad))
+                continue;
+            ent->v.chain = EDICT_TO_PROG(chain);
+            chain = ent;
+        }
+        RETURN_EDICT(chain);
+        return;
+    }
+
+    // the center of a linked edict is always inside its absolute box, so
+    // only boxes touching the cube around the sphere can match. sort them
+    // back into edict order so the chain comes out the same
+    for (j = 0; j < 3; j++) {
+        mins[j] = org[j] - rad;
+        maxs[j] = org[j] + rad;
+    }
+    count = SV_AreaEdicts(mins, maxs, touched, MAX_EDICTS);
+    qsort(touched, count, sizeof(touched[0]), PF_CompareEdicts);
 
+    for (i = 0; i < count; i++) {
+        ent = touched[i];
+        if (!PF_InRadius(ent, org, rad))
+            continue;
         ent->v.chain = EDICT_TO_PROG(chain);
         chain = ent;
     }
@@ -890,12 +948,78 @@ void PF_Remove(void) {
 }
 
 
+//
+// PF_Find remembers which edicts matched the last few field/string pairs,
+// entries are thrown away as soon as any edict string field is stored to
+// (see pr_stringstores). Engine strings edited in place are missed, which is
+// why pr_findindex is off by default
+//
+#define FIND_CACHE     8
+#define FIND_MAXSTRING 64
+
+typedef struct {
+    edict_t* edicts; // sv.edicts when built
+    i32 stores;      // pr_stringstores when built
+    i32 num_edicts;
+    i32 field;
+    char match[FIND_MAXSTRING];
+    i32 nummatches;
+    i16 matches[MAX_EDICTS]; // ascending edict numbers
+} findcache_t;
+
+static findcache_t find_cache[FIND_CACHE];
+static i32 find_rover;
+
+/*
+=================
+PF_FindCached
+
+Returns the cache entry listing every edict whose field f equals s
+=================
+*/
+static findcache_t* PF_FindCached(i32 f, char* s) {
+    findcache_t* fc;
+    edict_t* ed;
+    const char* t;
+    i32 i;
+
+    for (i = 0, fc = find_cache; i < FIND_CACHE; i++, fc++) {
+        if (fc->edicts == sv.edicts && fc->stores == pr_stringstores &&
+            fc->num_edicts == sv.num_edicts && fc->field == f &&
+            !Q_strcmp(fc->match, s))
+            return fc;
+    }
+
+    fc = &find_cache[find_rover];
+    find_rover = (find_rover + 1) % FIND_CACHE;
+
+    fc->edicts = sv.edicts;
+    fc->stores = pr_stringstores;
+    fc->num_edicts = sv.num_edicts;
+    fc->field = f;
+    Q_strcpy(fc->match, s);
+    fc->nummatches = 0;
+    for (i = 1; i < sv.num_edicts; i++) {
+        ed = EDICT_NUM(i);
+        if (ed->free)
+            continue;
+        t = E_STRING(ed, f);
+        if (!t)
+            continue;
+        if (!Q_strcmp(t, s))
+            fc->matches[fc->nummatches++] = i;
+    }
+    return fc;
+}
+
 // entity (entity start, .string field, string match) find = #5;
 void PF_Find(void) {
     i32 e;
     i32 f;
     char *s, *t;
     edict_t* ed;
+    findcache_t* fc;
+    i32 lo, hi, mid;
 
     e = G_EDICTNUM(OFS_PARM0);
     f = G_INT(OFS_PARM1);
@@ -903,6 +1027,31 @@ void PF_Find(void) {
     if (!s)
         PR_RunError("PF_Find: bad search string");
 
+    if (pr_findindex.value && Q_strlen(s) < FIND_MAXSTRING) {
+        fc = PF_FindCached(f, s);
+
+        // first match after the start edict, freed edicts only drop out
+        // of the list the next time it is built
+        lo = 0;
+        hi = fc->nummatches;
+        while (lo < hi) {
+            mid = (lo + hi) / 2;
+            if (fc->matches[mid] <= e)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        for (; lo < fc->nummatches; lo++) {
+            ed = EDICT_NUM(fc->matches[lo]);
+            if (!ed->free) {
+                RETURN_EDICT(ed);
+                return;
+            }
+        }
+        RETURN_EDICT(sv.edicts);
+        return;
+    }
+
     for (e++; e < sv.num_edicts; e++) {
         ed = EDICT_NUM(e);
         if (ed->free)
@@ -919,6 +1068,117 @@ void PF_Find(void) {
     RETURN_EDICT(sv.edicts);
 }
 
+/*
+=================
+PR_FindBench_f
+
+Fills the free edict slots with boxes scattered over the map and times
+findradius and find with and without pr_radiusindex and pr_findindex
+
+findbench [radius] [calls]
+=================
+*/
+void PR_FindBench_f(void) {
+    static edict_t* spawned[MAX_EDICTS];
+    float saved_index = pr_findindex.value;
+    float saved_radius = pr_radiusindex.value;
+    float saved_globals[OFS_PARM3 - OFS_RETURN];
+    i32 classname_ofs;
+    i32 numspawned, total, calls, finds;
+    i32 sums[2];
+    double times[2][2];
+    double start;
+    float rad;
+    edict_t* ed;
+    i32 i, j, pass;
+
+    if (!sv.active) {
+        Con_Printf("findbench: no server running\n");
+        return;
+    }
+    rad = Cmd_Argc() > 1 ? Q_atof(Cmd_Argv(1)) : 256;
+    calls = Cmd_Argc() > 2 ? Q_atoi(Cmd_Argv(2)) : 10000;
+    if (calls < 1)
+        calls = 1;
+
+    numspawned = 0;
+    while (sv.num_edicts < sv.max_edicts) {
+        ed = ED_Alloc();
+        ed->v.classname = PR_SetString("findbench");
+        ed->v.solid = SOLID_BBOX;
+        for (j = 0; j < 3; j++) {
+            ed->v.origin[j] =
+                sv.worldmodel->mins[j] + (sv.worldmodel->maxs[j] -
+                                          sv.worldmodel->mins[j]) *
+                                             (rand() & 0x7fff) / 0x7fff;
+            ed->v.mins[j] = -16;
+            ed->v.maxs[j] = 16;
+        }
+        VectorSubtract(ed->v.maxs, ed->v.mins, ed->v.size);
+        SV_LinkEdict(ed, false);
+        spawned[numspawned++] = ed;
+    }
+    pr_stringstores++;
+
+    Q_memcpy(saved_globals, &pr_globals[OFS_RETURN], sizeof(saved_globals));
+    classname_ofs =
+        (i32) ((i32*) &sv.edicts->v.classname - (i32*) &sv.edicts->v);
+
+    for (pass = 0; pass < 2; pass++) {
+        pr_findindex.value = pass;
+        pr_radiusindex.value = pass;
+        sums[pass] = 0;
+
+        srand(1);
+        start = Sys_FloatTime();
+        for (i = 0; i < calls; i++) {
+            for (j = 0; j < 3; j++)
+                G_VECTOR(OFS_PARM0)[j] =
+                    sv.worldmodel->mins[j] + (sv.worldmodel->maxs[j] -
+                                              sv.worldmodel->mins[j]) *
+                                                 (rand() & 0x7fff) / 0x7fff;
+            G_FLOAT(OFS_PARM1) = rad;
+            PF_findradius();
+            for (ed = G_EDICT(OFS_RETURN); ed != sv.edicts;
+                 ed = PROG_TO_EDICT(ed->v.chain))
+                sums[pass] += NUM_FOR_EDICT(ed);
+        }
+        times[pass][0] = Sys_FloatTime() - start;
+
+        finds = 0;
+        start = Sys_FloatTime();
+        while (finds < calls) {
+            G_INT(OFS_PARM0) = EDICT_TO_PROG(sv.edicts);
+            do {
+                G_INT(OFS_PARM1) = classname_ofs;
+                G_INT(OFS_PARM2) = PR_SetString("findbench");
+                PF_Find();
+                G_INT(OFS_PARM0) = G_INT(OFS_RETURN);
+                sums[pass] += G_EDICTNUM(OFS_RETURN);
+                finds++;
+            } while (G_INT(OFS_RETURN) != EDICT_TO_PROG(sv.edicts));
+        }
+        times[pass][1] = Sys_FloatTime() - start;
+    }
+
+    total = sv.num_edicts;
+    pr_findindex.value = saved_index;
+    pr_radiusindex.value = saved_radius;
+    Q_memcpy(&pr_globals[OFS_RETURN], saved_globals, sizeof(saved_globals));
+    for (i = 0; i < numspawned; i++)
+        ED_Free(spawned[i]);
+    while (sv.num_edicts > 1 && EDICT_NUM(sv.num_edicts - 1)->free)
+        sv.num_edicts--;
+
+    Con_Printf("%i edicts, %i spawned\n", total, numspawned);
+    Con_Printf("findradius: %8.2f us linear, %8.2f us indexed\n",
+               times[0][0] * 1000000 / calls, times[1][0] * 1000000 / calls);
+    Con_Printf("find      : %8.2f us linear, %8.2f us indexed\n",
+               times[0][1] * 1000000 / finds, times[1][1] * 1000000 / finds);
+    if (sums[0] != sums[1])
+        Con_Printf("findbench: results differ!\n");
+}
+
 void PR_CheckEmptyString(char* s) {
     if (s[0] <= ' ')
         PR_RunError("Bad string");
@@ -0,0 +1,714 @@
+/*
+ * Copyright (C) 1996-1997 Id Software, Inc.
+ * Copyright (C) Henrique Barateli, <henriquejb194@gmail.com>, et al.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+// pr_direct.c -- pre-decoded, direct dispatch QuakeC interpreter
+
+
+#include "pr_local.h"
+#include "cmd.h"
+#include "console.h"
+#include "server.h"
+#include "world.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+/*
+ * At load time every dstatement_t is translated into a prinstr_t whose
+ * operands already point into pr_globals and whose branch targets are
+ * resolved statement numbers. The interpreter loop then only has to jump
+ * to the handler of each instruction.
+ *
+ * Profiling and runaway checks are not done per statement. Execution
+ * between two control transfers is always straight line, so the number
+ * of statements run is the distance from the start of the block, which is
+ * charged to the current function whenever a branch, call or return is
+ * reached. The profile counts match the reference interpreter exactly.
+ */
+
+cvar_t pr_direct = {"pr_direct", "1"};
+
+// internal opcode for anything the reference interpreter would reject
+#define OP_BAD (OP_BITOR + 1)
+
+typedef struct {
+    i32 op;
+    i32 jump; // resolved target of OP_IF, OP_IFNOT and OP_GOTO
+    eval_t* a;
+    eval_t* b;
+    eval_t* c;
+} prinstr_t;
+
+static prinstr_t* pr_instructions;
+
+#if defined(__GNUC__)
+#define PR_COMPUTED_GOTO
+#endif
+
+
+/*
+====================
+PR_DecodeProgs
+====================
+*/
+void PR_DecodeProgs(void) {
+    i32 i;
+    i32 target;
+    dstatement_t* st;
+    prinstr_t* in;
+    prinstr_t* code;
+
+    pr_instructions = NULL;
+
+    // one extra slot so running off the end hits a bad opcode
+    i32 size = (progs->numstatements + 1) * (i32) sizeof(prinstr_t);
+    code = (prinstr_t*) Hunk_AllocName(size, "progcode");
+
+    for (i = 0; i < progs->numstatements; i++) {
+        st = &pr_statements[i];
+        in = &code[i];
+
+        in->op = st->op <= OP_BITOR ? st->op : OP_BAD;
+        in->a = (eval_t*) &pr_globals[st->a];
+        in->b = (eval_t*) &pr_globals[st->b];
+        in->c = (eval_t*) &pr_globals[st->c];
+
+        if (st->op == OP_IF || st->op == OP_IFNOT)
+            target = i + st->b;
+        else if (st->op == OP_GOTO)
+            target = i + st->a;
+        else
+            continue;
+
+        if (target < 0 || target >= progs->numstatements) {
+            Con_DPrintf("PR_DecodeProgs: statement %i branches outside "
+                        "the program, using the reference interpreter\n",
+                        i);
+            return;
+        }
+        in->jump = target;
+    }
+    code[progs->numstatements].op = OP_BAD;
+
+    pr_instructions = code;
+}
+
+/*
+====================
+PR_CanExecuteDirect
+====================
+*/
+qboolean PR_CanExecuteDirect(void) {
+    return pr_instructions != NULL;
+}
+
+
+#ifdef PR_COMPUTED_GOTO
+#define DISPATCH() goto *dispatch[ip->op]
+#define CASE(op)   L_##op
+#else
+#define DISPATCH() continue
+#define CASE(op)   case op
+#endif
+
+#define NEXT()                                                                 \
+    ip++;                                                                      \
+    DISPATCH()
+
+// Records the current statement for PR_RunError and the call stack.
+#define SYNC() pr_xstatement = (i32) (ip - pr_instructions)
+
+// Charges the block ending at ip to the running function.
+#define ACCOUNT()                                                              \
+    do {                                                                       \
+        i32 count = (i32) (ip - block) + 1;                                    \
+        SYNC();                                                                \
+        pr_xfunction->profile += count;                                        \
+        runaway -= count;                                                      \
+        if (runaway <= 0)                                                      \
+            PR_RunError("runaway loop error");                                 \
+    } while (0)
+
+/*
+====================
+PR_ExecuteDirect
+====================
+*/
+void PR_ExecuteDirect(i32 s, i32 exitdepth, i32 runaway) {
+    prinstr_t* ip;
+    prinstr_t* block;
+    dfunction_t* newf;
+    edict_t* ed;
+    eval_t* ptr;
+    i32 i;
+
+#ifdef PR_COMPUTED_GOTO
+    static void* dispatch[OP_BAD + 1] = {
+        [OP_DONE] = &&L_OP_DONE,
+        [OP_MUL_F] = &&L_OP_MUL_F,
+        [OP_MUL_V] = &&L_OP_MUL_V,
+        [OP_MUL_FV] = &&L_OP_MUL_FV,
+        [OP_MUL_VF] = &&L_OP_MUL_VF,
+        [OP_DIV_F] = &&L_OP_DIV_F,
+        [OP_ADD_F] = &&L_OP_ADD_F,
+        [OP_ADD_V] = &&L_OP_ADD_V,
+        [OP_SUB_F] = &&L_OP_SUB_F,
+        [OP_SUB_V] = &&L_OP_SUB_V,
+        [OP_EQ_F] = &&L_OP_EQ_F,
+        [OP_EQ_V] = &&L_OP_EQ_V,
+        [OP_EQ_S] = &&L_OP_EQ_S,
+        [OP_EQ_E] = &&L_OP_EQ_E,
+        [OP_EQ_FNC] = &&L_OP_EQ_FNC,
+        [OP_NE_F] = &&L_OP_NE_F,
+        [OP_NE_V] = &&L_OP_NE_V,
+        [OP_NE_S] = &&L_OP_NE_S,
+        [OP_NE_E] = &&L_OP_NE_E,
+        [OP_NE_FNC] = &&L_OP_NE_FNC,
+        [OP_LE] = &&L_OP_LE,
+        [OP_GE] = &&L_OP_GE,
+        [OP_LT] = &&L_OP_LT,
+        [OP_GT] = &&L_OP_GT,
+        [OP_LOAD_F] = &&L_OP_LOAD_F,
+        [OP_LOAD_V] = &&L_OP_LOAD_V,
+        [OP_LOAD_S] = &&L_OP_LOAD_S,
+        [OP_LOAD_ENT] = &&L_OP_LOAD_ENT,
+        [OP_LOAD_FLD] = &&L_OP_LOAD_FLD,
+        [OP_LOAD_FNC] = &&L_OP_LOAD_FNC,
+        [OP_ADDRESS] = &&L_OP_ADDRESS,
+        [OP_STORE_F] = &&L_OP_STORE_F,
+        [OP_STORE_V] = &&L_OP_STORE_V,
+        [OP_STORE_S] = &&L_OP_STORE_S,
+        [OP_STORE_ENT] = &&L_OP_STORE_ENT,
+        [OP_STORE_FLD] = &&L_OP_STORE_FLD,
+        [OP_STORE_FNC] = &&L_OP_STORE_FNC,
+        [OP_STOREP_F] = &&L_OP_STOREP_F,
+        [OP_STOREP_V] = &&L_OP_STOREP_V,
+        [OP_STOREP_S] = &&L_OP_STOREP_S,
+        [OP_STOREP_ENT] = &&L_OP_STOREP_ENT,
+        [OP_STOREP_FLD] = &&L_OP_STOREP_FLD,
+        [OP_STOREP_FNC] = &&L_OP_STOREP_FNC,
+        [OP_RETURN] = &&L_OP_RETURN,
+        [OP_NOT_F] = &&L_OP_NOT_F,
+        [OP_NOT_V] = &&L_OP_NOT_V,
+        [OP_NOT_S] = &&L_OP_NOT_S,
+        [OP_NOT_ENT] = &&L_OP_NOT_ENT,
+        [OP_NOT_FNC] = &&L_OP_NOT_FNC,
+        [OP_IF] = &&L_OP_IF,
+        [OP_IFNOT] = &&L_OP_IFNOT,
+        [OP_CALL0] = &&L_OP_CALL0,
+        [OP_CALL1] = &&L_OP_CALL1,
+        [OP_CALL2] = &&L_OP_CALL2,
+        [OP_CALL3] = &&L_OP_CALL3,
+        [OP_CALL4] = &&L_OP_CALL4,
+        [OP_CALL5] = &&L_OP_CALL5,
+        [OP_CALL6] = &&L_OP_CALL6,
+        [OP_CALL7] = &&L_OP_CALL7,
+        [OP_CALL8] = &&L_OP_CALL8,
+        [OP_STATE] = &&L_OP_STATE,
+        [OP_GOTO] = &&L_OP_GOTO,
+        [OP_AND] = &&L_OP_AND,
+        [OP_OR] = &&L_OP_OR,
+        [OP_BITAND] = &&L_OP_BITAND,
+        [OP_BITOR] = &&L_OP_BITOR,
+        [OP_BAD] = &&L_OP_BAD,
+    };
+#endif
+
+    ip = &pr_instructions[s + 1];
+    block = ip;
+
+#ifdef PR_COMPUTED_GOTO
+    DISPATCH();
+    {
+#else
+    while (1) {
+        switch (ip->op) {
+#endif
+        CASE(OP_ADD_F):
+            ip->c->_float = ip->a->_float + ip->b->_float;
+            NEXT();
+        CASE(OP_ADD_V):
+            ip->c->vector[0] = ip->a->vector[0] + ip->b->vector[0];
+            ip->c->vector[1] = ip->a->vector[1] + ip->b->vector[1];
+            ip->c->vector[2] = ip->a->vector[2] + ip->b->vector[2];
+            NEXT();
+
+        CASE(OP_SUB_F):
+            ip->c->_float = ip->a->_float - ip->b->_float;
+            NEXT();
+        CASE(OP_SUB_V):
+            ip->c->vector[0] = ip->a->vector[0] - ip->b->vector[0];
+            ip->c->vector[1] = ip->a->vector[1] - ip->b->vector[1];
+            ip->c->vector[2] = ip->a->vector[2] - ip->b->vector[2];
+            NEXT();
+
+        CASE(OP_MUL_F):
+            ip->c->_float = ip->a->_float * ip->b->_float;
+            NEXT();
+        CASE(OP_MUL_V):
+            ip->c->_float = ip->a->vector[0] * ip->b->vector[0] +
+                            ip->a->vector[1] * ip->b->vector[1] +
+                            ip->a->vector[2] * ip->b->vector[2];
+            NEXT();
+        CASE(OP_MUL_FV):
+            ip->c->vector[0] = ip->a->_float * ip->b->vector[0];
+            ip->c->vector[1] = ip->a->_float * ip->b->vector[1];
+            ip->c->vector[2] = ip->a->_float * ip->b->vector[2];
+            NEXT();
+        CASE(OP_MUL_VF):
+            ip->c->vector[0] = ip->b->_float * ip->a->vector[0];
+            ip->c->vector[1] = ip->b->_float * ip->a->vector[1];
+            ip->c->vector[2] = ip->b->_float * ip->a->vector[2];
+            NEXT();
+
+        CASE(OP_DIV_F):
+            ip->c->_float = ip->a->_float / ip->b->_float;
+            NEXT();
+
+        CASE(OP_BITAND):
+            ip->c->_float = (i32) ip->a->_float & (i32) ip->b->_float;
+            NEXT();
+        CASE(OP_BITOR):
+            ip->c->_float = (i32) ip->a->_float | (i32) ip->b->_float;
+            NEXT();
+
+        CASE(OP_GE):
+            ip->c->_float = ip->a->_float >= ip->b->_float;
+            NEXT();
+        CASE(OP_LE):
+            ip->c->_float = ip->a->_float <= ip->b->_float;
+            NEXT();
+        CASE(OP_GT):
+            ip->c->_float = ip->a->_float > ip->b->_float;
+            NEXT();
+        CASE(OP_LT):
+            ip->c->_float = ip->a->_float < ip->b->_float;
+            NEXT();
+        CASE(OP_AND):
+            ip->c->_float = ip->a->_float && ip->b->_float;
+            NEXT();
+        CASE(OP_OR):
+            ip->c->_float = ip->a->_float || ip->b->_float;
+            NEXT();
+
+        CASE(OP_NOT_F):
+            ip->c->_float = !ip->a->_float;
+            NEXT();
+        CASE(OP_NOT_V):
+            ip->c->_float = !ip->a->vector[0] && !ip->a->vector[1] &&
+                            !ip->a->vector[2];
+            NEXT();
+        CASE(OP_NOT_S):
+            ip->c->_float =
+                !ip->a->string || !*PR_GetString(ip->a->string);
+            NEXT();
+        CASE(OP_NOT_FNC):
+            ip->c->_float = !ip->a->function;
+            NEXT();
+        CASE(OP_NOT_ENT):
+            ip->c->_float = (PROG_TO_EDICT(ip->a->edict) == sv.edicts);
+            NEXT();
+
+        CASE(OP_EQ_F):
+            ip->c->_float = ip->a->_float == ip->b->_float;
+            NEXT();
+        CASE(OP_EQ_V):
+            ip->c->_float = (ip->a->vector[0] == ip->b->vector[0]) &&
+                            (ip->a->vector[1] == ip->b->vector[1]) &&
+                            (ip->a->vector[2] == ip->b->vector[2]);
+            NEXT();
+        CASE(OP_EQ_S):
+            ip->c->_float = !Q_strcmp(PR_GetString(ip->a->string),
+                                      PR_GetString(ip->b->string));
+            NEXT();
+        CASE(OP_EQ_E):
+            ip->c->_float = ip->a->_int == ip->b->_int;
+            NEXT();
+        CASE(OP_EQ_FNC):
+            ip->c->_float = ip->a->function == ip->b->function;
+            NEXT();
+
+        CASE(OP_NE_F):
+            ip->c->_float = ip->a->_float != ip->b->_float;
+            NEXT();
+        CASE(OP_NE_V):
+            ip->c->_float = (ip->a->vector[0] != ip->b->vector[0]) ||
+                            (ip->a->vector[1] != ip->b->vector[1]) ||
+                            (ip->a->vector[2] != ip->b->vector[2]);
+            NEXT();
+        CASE(OP_NE_S):
+            ip->c->_float = Q_strcmp(PR_GetString(ip->a->string),
+                                     PR_GetString(ip->b->string));
+            NEXT();
+        CASE(OP_NE_E):
+            ip->c->_float = ip->a->_int != ip->b->_int;
+            NEXT();
+        CASE(OP_NE_FNC):
+            ip->c->_float = ip->a->function != ip->b->function;
+            NEXT();
+
+            //==================
+        CASE(OP_STORE_F):
+        CASE(OP_STORE_ENT):
+        CASE(OP_STORE_FLD): // integers
+        CASE(OP_STORE_S):
+        CASE(OP_STORE_FNC): // pointers
+            ip->b->_int = ip->a->_int;
+            NEXT();
+        CASE(OP_STORE_V):
+            ip->b->vector[0] = ip->a->vector[0];
+            ip->b->vector[1] = ip->a->vector[1];
+            ip->b->vector[2] = ip->a->vector[2];
+            NEXT();
+
+        CASE(OP_STOREP_S):
+            pr_stringstores++;
+            // fall through
+        CASE(OP_STOREP_F):
+        CASE(OP_STOREP_ENT):
+        CASE(OP_STOREP_FLD): // integers
+        CASE(OP_STOREP_FNC): // pointers
+            ptr = (eval_t*) ((byte*) sv.edicts + ip->b->_int);
+            ptr->_int = ip->a->_int;
+            NEXT();
+        CASE(OP_STOREP_V):
+            ptr = (eval_t*) ((byte*) sv.edicts + ip->b->_int);
+            ptr->vector[0] = ip->a->vector[0];
+            ptr->vector[1] = ip->a->vector[1];
+            ptr->vector[2] = ip->a->vector[2];
+            NEXT();
+
+        CASE(OP_ADDRESS):
+            ed = PROG_TO_EDICT(ip->a->edict);
+#ifdef PARANOID
+            NUM_FOR_EDICT(ed); // make sure it's in range
+#endif
+            if (ed == (edict_t*) sv.edicts && sv.state == ss_active) {
+                SYNC();
+                PR_RunError("assignment to world entity");
+            }
+            ip->c->_int =
+                (byte*) ((i32*) &ed->v + ip->b->_int) - (byte*) sv.edicts;
+            NEXT();
+
+        CASE(OP_LOAD_F):
+        CASE(OP_LOAD_FLD):
+        CASE(OP_LOAD_ENT):
+        CASE(OP_LOAD_S):
+        CASE(OP_LOAD_FNC):
+            ed = PROG_TO_EDICT(ip->a->edict);
+#ifdef PARANOID
+            NUM_FOR_EDICT(ed); // make sure it's in range
+#endif
+            ptr = (eval_t*) ((i32*) &ed->v + ip->b->_int);
+            ip->c->_int = ptr->_int;
+            NEXT();
+
+        CASE(OP_LOAD_V):
+            ed = PROG_TO_EDICT(ip->a->edict);
+#ifdef PARANOID
+            NUM_FOR_EDICT(ed); // make sure it's in range
+#endif
+            ptr = (eval_t*) ((i32*) &ed->v + ip->b->_int);
+            ip->c->vector[0] = ptr->vector[0];
+            ip->c->vector[1] = ptr->vector[1];
+            ip->c->vector[2] = ptr->vector[2];
+            NEXT();
+
+            //==================
+
+        CASE(OP_IFNOT):
+            ACCOUNT();
+            if (!ip->a->_int)
+                ip = &pr_instructions[ip->jump];
+            else
+                ip++;
+            block = ip;
+            DISPATCH();
+
+        CASE(OP_IF):
+            ACCOUNT();
+            if (ip->a->_int)
+                ip = &pr_instructions[ip->jump];
+            else
+                ip++;
+            block = ip;
+            DISPATCH();
+
+        CASE(OP_GOTO):
+            ACCOUNT();
+            ip = &pr_instructions[ip->jump];
+            block = ip;
+            DISPATCH();
+
+        CASE(OP_CALL0):
+        CASE(OP_CALL1):
+        CASE(OP_CALL2):
+        CASE(OP_CALL3):
+        CASE(OP_CALL4):
+        CASE(OP_CALL5):
+        CASE(OP_CALL6):
+        CASE(OP_CALL7):
+        CASE(OP_CALL8):
+            ACCOUNT();
+            pr_argc = ip->op - OP_CALL0;
+            if (!ip->a->function)
+                PR_RunError("NULL function");
+
+            newf = &pr_functions[ip->a->function];
+
+            if (newf->first_statement < 0) {
+                // negative statements are built in functions
+                i = -newf->first_statement;
+                if (i >= pr_numbuiltins)
+                    PR_RunError("Bad builtin call number");
+                pr_builtins[i]();
+
+                // traceon switches to the reference interpreter, which
+                // is the only one that prints statements
+                if (pr_trace) {
+                    s = (i32) (ip - pr_instructions);
+                    PR_ExecuteStatements(s, exitdepth, runaway);
+                    return;
+                }
+                ip++;
+                block = ip;
+                DISPATCH();
+            }
+
+            ip = &pr_instructions[PR_EnterFunction(newf) + 1];
+            block = ip;
+            DISPATCH();
+
+        CASE(OP_DONE):
+        CASE(OP_RETURN):
+            ACCOUNT();
+            pr_globals[OFS_RETURN] = ip->a->vector[0];
+            pr_globals[OFS_RETURN + 1] = ip->a->vector[1];
+            pr_globals[OFS_RETURN + 2] = ip->a->vector[2];
+
+            s = PR_LeaveFunction();
+            if (pr_depth == exitdepth)
+                return; // all done
+            ip = &pr_instructions[s + 1];
+            block = ip;
+            DISPATCH();
+
+        CASE(OP_STATE):
+            ed = PROG_TO_EDICT(pr_global_struct->self);
+            ed->v.nextthink = pr_global_struct->time + 0.1;
+            if (ip->a->_float != ed->v.frame) {
+                ed->v.frame = ip->a->_float;
+            }
+            ed->v.think = ip->b->function;
+            NEXT();
+
+        CASE(OP_BAD):
+#ifndef PR_COMPUTED_GOTO
+        default:
+#endif
+            SYNC();
+            PR_RunError("Bad opcode %i", pr_statements[pr_xstatement].op);
+#ifndef PR_COMPUTED_GOTO
+        }
+#endif
+    }
+}
+
+
+/*
+==============================================================================
+
+CONFORMANCE CHECK
+
+Runs a function through both interpreters from the same starting state and
+reports every global and edict field that ended up different.
+
+==============================================================================
+*/
+
+typedef struct {
+    i32 num_edicts;
+    sizebuf_t datagram;
+    sizebuf_t reliable_datagram;
+    sizebuf_t signon;
+    sizebuf_t messages[MAX_SCOREBOARD];
+    byte* globals;
+    byte* edicts;
+} prsnapshot_t;
+
+static byte* pr_snapshotbuf;
+static i32 pr_snapshotsize;
+
+static void PR_SaveSnapshot(prsnapshot_t* snap) {
+    i32 i;
+
+    snap->num_edicts = sv.num_edicts;
+    snap->datagram = sv.datagram;
+    snap->reliable_datagram = sv.reliable_datagram;
+    snap->signon = sv.signon;
+    for (i = 0; i < svs.maxclients; i++)
+        snap->messages[i] = svs.clients[i].message;
+    Q_memcpy(snap->globals, pr_globals, progs->numglobals * 4);
+    Q_memcpy(snap->edicts, sv.edicts, sv.max_edicts * pr_edict_size);
+}
+
+static void PR_RestoreSnapshot(const prsnapshot_t* snap) {
+    i32 i;
+    edict_t* ent;
+
+    sv.num_edicts = snap->num_edicts;
+    sv.datagram = snap->datagram;
+    sv.reliable_datagram = snap->reliable_datagram;
+    sv.signon = snap->signon;
+    for (i = 0; i < svs.maxclients; i++)
+        svs.clients[i].message = snap->messages[i];
+    Q_memcpy(pr_globals, snap->globals, progs->numglobals * 4);
+    Q_memcpy(sv.edicts, snap->edicts, sv.max_edicts * pr_edict_size);
+    pr_stringstores++;
+
+    // the saved area links are stale, so rebuild the world links
+    SV_ClearWorld();
+    for (i = 0; i < sv.num_edicts; i++) {
+        ent = EDICT_NUM(i);
+        ent->area.prev = ent->area.next = NULL;
+        SV_LinkEdict(ent, false);
+    }
+}
+
+static void PR_RunCompared(func_t fnum, i32 self, qboolean direct, i32 seed) {
+    float saved = pr_direct.value;
+
+    pr_global_struct->self = self;
+    pr_global_struct->other = EDICT_TO_PROG(sv.edicts);
+    pr_global_struct->time = sv.time;
+
+    srand(seed);
+    pr_direct.value = direct;
+    PR_ExecuteProgram(fnum);
+    pr_direct.value = saved;
+}
+
+static i32 PR_CompareWords(const i32* ref, const i32* cur, i32 count,
+                           edict_t* ed, i32 differences) {
+    i32 i;
+    ddef_t* def;
+
+    for (i = 0; i < count; i++) {
+        if (ref[i] == cur[i])
+            continue;
+        if (differences < 16) {
+            def = ed ? ED_FieldAtOfs(i) : ED_GlobalAtOfs(i);
+            if (ed)
+                Con_Printf("edict %i ", NUM_FOR_EDICT(ed));
+            Con_Printf("%s: 0x%08x != 0x%08x\n",
+                       def ? PR_GetString(def->s_name) : "???", ref[i],
+                       cur[i]);
+        }
+        differences++;
+    }
+    return differences;
+}
+
+/*
+====================
+PR_Compare_f
+
+progcompare <function> [self edict]
+====================
+*/
+void PR_Compare_f(void) {
+    dfunction_t* func;
+    prsnapshot_t start, reference;
+    i32 globalsize, edictsize;
+    i32 self, seed;
+    i32 i, differences;
+    edict_t *ref, *cur;
+
+    if (Cmd_Argc() < 2) {
+        Con_Printf("progcompare <function> [self edict]\n");
+        return;
+    }
+    if (!sv.active) {
+        Con_Printf("Server is not active\n");
+        return;
+    }
+    if (!PR_CanExecuteDirect()) {
+        Con_Printf("progs could not be decoded\n");
+        return;
+    }
+    func = ED_FindFunction(Cmd_Argv(1));
+    if (!func) {
+        Con_Printf("Can't find function %s\n", Cmd_Argv(1));
+        return;
+    }
+    self = EDICT_TO_PROG(sv.edicts);
+    if (Cmd_Argc() > 2)
+        self = EDICT_TO_PROG(EDICT_NUM(Q_atoi(Cmd_Argv(2))));
+
+    globalsize = progs->numglobals * 4;
+    edictsize = sv.max_edicts * pr_edict_size;
+    if (pr_snapshotsize < 2 * (globalsize + edictsize)) {
+        Q_free(pr_snapshotbuf);
+        pr_snapshotsize = 2 * (globalsize + edictsize);
+        pr_snapshotbuf = (byte*) Q_malloc(pr_snapshotsize);
+        if (!pr_snapshotbuf) {
+            pr_snapshotsize = 0;
+            Con_Printf("Not enough memory for the snapshots\n");
+            return;
+        }
+    }
+    start.globals = pr_snapshotbuf;
+    start.edicts = start.globals + globalsize;
+    reference.globals = start.edicts + edictsize;
+    reference.edicts = reference.globals + globalsize;
+
+    seed = rand();
+    PR_SaveSnapshot(&start);
+    PR_RunCompared(func - pr_functions, self, false, seed);
+    PR_SaveSnapshot(&reference);
+    PR_RestoreSnapshot(&start);
+    PR_RunCompared(func - pr_functions, self, true, seed);
+
+    differences = 0;
+    if (reference.num_edicts != sv.num_edicts) {
+        Con_Printf("num_edicts: %i != %i\n", reference.num_edicts,
+                   sv.num_edicts);
+        differences++;
+    }
+    differences = PR_CompareWords((i32*) reference.globals,
+                                  (i32*) pr_globals, progs->numglobals, NULL,
+                                  differences);
+    for (i = 0; i < sv.num_edicts && i < reference.num_edicts; i++) {
+        ref = (edict_t*) (reference.edicts + i * pr_edict_size);
+        cur = EDICT_NUM(i);
+        if (ref->free != cur->free) {
+            Con_Printf("edict %i: free %i != %i\n", i, ref->free, cur->free);
+            differences++;
+        }
+        differences =
+            PR_CompareWords((i32*) &ref->v, (i32*) &cur->v,
+                            progs->entityfields, cur, differences);
+    }
+
+    if (differences)
+        Con_Printf("%s: %i differences\n", Cmd_Argv(1), differences);
+    else
+        Con_Printf("%s: interpreters agree\n", Cmd_Argv(1));
+}
@@ -21,6 +21,7 @@
 
 
 #include "progs.h"
+#include "pr_local.h"
 #include "cmd.h"
 #include "console.h"
 #include "crc.h"
@@ -38,12 +39,17 @@ static i32 pr_stringssize;
 static const char** pr_knownstrings;
 static i32 pr_maxknownstrings;
 static i32 pr_numknownstrings;
+static i32* pr_stringhash; // slot + 1 keyed by string pointer, 0 if empty
+static i32 pr_stringhashsize;
+static i32 pr_stringlookups;
+static i32 pr_stringprobes;
 ddef_t* pr_fielddefs;
 ddef_t* pr_globaldefs;
 dstatement_t* pr_statements;
 globalvars_t* pr_global_struct;
 float* pr_globals; // same as pr_global_struct
 i32 pr_edict_size; // in bytes
+i32 pr_stringstores;
 
 u16 pr_crc;
 
@@ -58,8 +64,9 @@ i32 type_size[8] = {
     sizeof(void*) / 4,
 };
 
-ddef_t* ED_FieldAtOfs(i32 ofs);
 qboolean ED_ParseEpair(void* base, ddef_t* key, char* s);
+static void PR_ClearKnownStrings(void);
+static void PR_StringStats_f(void);
 
 cvar_t nomonsters = {"nomonsters", "0"};
 cvar_t gamecfg = {"gamecfg", "0"};
@@ -93,6 +100,7 @@ Sets everything to NULL
 void ED_ClearEdict(edict_t* e) {
     Q_memset(&e->v, 0, progs->entityfields * 4);
     e->free = false;
+    pr_stringstores++;
 }
 
 /*
@@ -782,6 +790,7 @@ char* ED_ParseEdict(char* data, edict_t* ent) {
     // clear it
     if (ent != sv.edicts) // hack
         Q_memset(&ent->v, 0, progs->entityfields * 4);
+    pr_stringstores++;
 
     // go through all the dictionary pairs
     while (1) {
@@ -973,12 +982,7 @@ void PR_LoadProgs(void) {
 
     pr_strings = (char*) progs + progs->ofs_strings;
     pr_stringssize = progs->numstrings;
-    pr_numknownstrings = 0;
-    pr_maxknownstrings = 0;
-    if (pr_knownstrings) {
-        Z_Free((void*) pr_knownstrings);
-    }
-    pr_knownstrings = NULL;
+    PR_ClearKnownStrings();
     PR_SetString("");
 
     pr_globaldefs = (ddef_t*) ((byte*) progs + progs->ofs_globaldefs);
@@ -1025,6 +1029,8 @@ void PR_LoadProgs(void) {
 
     for (i = 0; i < progs->numglobals; i++)
         ((i32*) pr_globals)[i] = LittleLong(((i32*) pr_globals)[i]);
+
+    PR_DecodeProgs();
 }
 
 
@@ -1038,6 +1044,12 @@ void PR_Init(void) {
     Cmd_AddCommand("edicts", ED_PrintEdicts);
     Cmd_AddCommand("edictcount", ED_Count);
     Cmd_AddCommand("profile", PR_Profile_f);
+    Cmd_AddCommand("progcompare", PR_Compare_f);
+    Cmd_AddCommand("stringstats", PR_StringStats_f);
+    Cmd_AddCommand("findbench", PR_FindBench_f);
+    Cvar_RegisterVariable(&pr_direct);
+    Cvar_RegisterVariable(&pr_findindex);
+    Cvar_RegisterVariable(&pr_radiusindex);
     Cvar_RegisterVariable(&nomonsters);
     Cvar_RegisterVariable(&gamecfg);
     Cvar_RegisterVariable(&scratch1);
@@ -1069,29 +1081,108 @@ i32 NUM_FOR_EDICT(edict_t* e) {
     return b;
 }
 
-static void PR_ExpandStringSlots() {
+/*
+==============================================================================
+
+KNOWN STRINGS
+
+Engine strings handed to progs get a negative string_t that indexes
+pr_knownstrings. A pointer keyed hash finds the slot of a string that is
+already known, so setting a string costs the same no matter how many have
+been registered.
+
+==============================================================================
+*/
+
+static void PR_ClearKnownStrings(void) {
+    if (pr_knownstrings) {
+        Z_Free((void*) pr_knownstrings);
+    }
+    if (pr_stringhash) {
+        Z_Free(pr_stringhash);
+    }
+    pr_knownstrings = NULL;
+    pr_stringhash = NULL;
+    pr_numknownstrings = 0;
+    pr_maxknownstrings = 0;
+    pr_stringhashsize = 0;
+    pr_stringlookups = 0;
+    pr_stringprobes = 0;
+}
+
+static void PR_ExpandStringSlots(void) {
     pr_maxknownstrings += 256;
     void* prt = (void*) pr_knownstrings;
     i32 size = (i32) (pr_maxknownstrings * sizeof(char*));
     pr_knownstrings = (const char**) Z_Realloc(prt, size);
 }
 
-static string_t PR_FindString(const char* str) {
-    string_t i = 0;
-    for (; i < pr_numknownstrings; i++) {
-        if (pr_knownstrings[i] == str) {
-            break;
+static u32 PR_HashPointer(const char* str) {
+    u64 h = (u64) (uintptr_t) str * 0x9E3779B97F4A7C15ull;
+    return (u32) (h >> 32) & (pr_stringhashsize - 1);
+}
+
+static void PR_InsertHash(i32 idx) {
+    u32 mask = pr_stringhashsize - 1;
+    u32 i = PR_HashPointer(pr_knownstrings[idx]);
+    while (pr_stringhash[i]) {
+        i = (i + 1) & mask;
+    }
+    pr_stringhash[i] = idx + 1;
+}
+
+static void PR_GrowHash(void) {
+    i32 i;
+    i32 size = pr_stringhashsize ? pr_stringhashsize * 2 : 512;
+
+    if (pr_stringhash) {
+        Z_Free(pr_stringhash);
+    }
+    pr_stringhash = (i32*) Z_Malloc(size * (i32) sizeof(i32));
+    pr_stringhashsize = size;
+    for (i = 0; i < pr_numknownstrings; i++) {
+        if (pr_knownstrings[i]) {
+            PR_InsertHash(i);
+        }
+    }
+}
+
+static i32 PR_FindString(const char* str) {
+    u32 mask;
+    u32 i;
+    i32 idx;
+
+    pr_stringlookups++;
+    if (!pr_stringhashsize) {
+        return -1;
+    }
+    mask = pr_stringhashsize - 1;
+    for (i = PR_HashPointer(str); pr_stringhash[i]; i = (i + 1) & mask) {
+        pr_stringprobes++;
+        idx = pr_stringhash[i] - 1;
+        if (pr_knownstrings[idx] == str) {
+            return idx;
         }
     }
-    return i;
+    return -1;
 }
 
-static void PR_SetStringAt(i32 idx, const char* str) {
-    if (idx >= pr_maxknownstrings) {
+static i32 PR_AllocStringSlot(const char* str) {
+    i32 idx;
+
+    if (pr_numknownstrings >= pr_maxknownstrings) {
         PR_ExpandStringSlots();
     }
+    idx = pr_numknownstrings++;
     pr_knownstrings[idx] = str;
-    pr_numknownstrings++;
+
+    // keep the hash at most half full
+    if (pr_numknownstrings * 2 > pr_stringhashsize) {
+        PR_GrowHash();
+    } else {
+        PR_InsertHash(idx);
+    }
+    return idx;
 }
 
 string_t PR_SetString(const char* str) {
@@ -1101,9 +1192,9 @@ string_t PR_SetString(const char* str) {
     if (str >= pr_strings && str <= &pr_strings[pr_stringssize - 2]) {
         return str - pr_strings;
     }
-    string_t i = PR_FindString(str);
-    if (i >= pr_numknownstrings) {
-        PR_SetStringAt(i, str);
+    i32 i = PR_FindString(str);
+    if (i < 0) {
+        i = PR_AllocStringSlot(str);
     }
     return -1 - i;
 }
@@ -1127,12 +1218,26 @@ string_t PR_NewString(i32 size, char** ptr) {
     if (!size) {
         return 0;
     }
-    // Find empty slot.
-    string_t i = PR_FindString(NULL);
     char* str = (char*) Hunk_AllocName(size, "string");
-    PR_SetStringAt(i, str);
+    i32 i = PR_AllocStringSlot(str);
     if (ptr) {
         *ptr = str;
     }
     return -1 - i;
 }
+
+/*
+=============
+PR_StringStats_f
+=============
+*/
+static void PR_StringStats_f(void) {
+    Con_Printf("known strings: %i\n", pr_numknownstrings);
+    Con_Printf("max slots    : %i\n", pr_maxknownstrings);
+    Con_Printf("hash size    : %i\n", pr_stringhashsize);
+    Con_Printf("lookups      : %i\n", pr_stringlookups);
+    if (pr_stringlookups) {
+        Con_Printf("probes/lookup: %.2f\n",
+                   (float) pr_stringprobes / pr_stringlookups);
+    }
+}
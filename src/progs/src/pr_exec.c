@@ -20,8 +20,10 @@
 
 
 #include "progs.h"
+#include "pr_local.h"
 #include "console.h"
 #include "host.h"
+#include "profiler.h"
 #include "server.h"
 #include "sys.h"
 #include <stdarg.h>
@@ -337,36 +339,20 @@ i32 PR_LeaveFunction(void) {
 
 /*
 ====================
-PR_ExecuteProgram
+PR_ExecuteStatements
+
+The reference interpreter. Every statement is decoded, accounted and
+dispatched on its own; PR_ExecuteDirect must stay in step with it.
 ====================
 */
-void PR_ExecuteProgram(func_t fnum) {
+void PR_ExecuteStatements(i32 s, i32 exitdepth, i32 runaway) {
     eval_t *a, *b, *c;
-    i32 s;
     dstatement_t* st;
-    dfunction_t *f, *newf;
-    i32 runaway;
+    dfunction_t* newf;
     i32 i;
     edict_t* ed;
-    i32 exitdepth;
     eval_t* ptr;
 
-    if (!fnum || fnum >= progs->numfunctions) {
-        if (pr_global_struct->self)
-            ED_Print(PROG_TO_EDICT(pr_global_struct->self));
-        Host_Error("PR_ExecuteProgram: NULL function");
-    }
-
-    f = &pr_functions[fnum];
-
-    runaway = 100000;
-    pr_trace = false;
-
-    // make a stack frame
-    exitdepth = pr_depth;
-
-    s = PR_EnterFunction(f);
-
     while (1) {
         s++; // next statement
 
@@ -523,10 +509,12 @@ void PR_ExecuteProgram(func_t fnum) {
                 b->vector[2] = a->vector[2];
                 break;
 
+            case OP_STOREP_S:
+                pr_stringstores++;
+                // fall through
             case OP_STOREP_F:
             case OP_STOREP_ENT:
             case OP_STOREP_FLD: // integers
-            case OP_STOREP_S:
             case OP_STOREP_FNC: // pointers
                 ptr = (eval_t*) ((byte*) sv.edicts + b->_int);
                 ptr->_int = a->_int;
@@ -640,3 +628,39 @@ void PR_ExecuteProgram(func_t fnum) {
         }
     }
 }
+
+
+/*
+====================
+PR_ExecuteProgram
+====================
+*/
+void PR_ExecuteProgram(func_t fnum) {
+    i32 s;
+    dfunction_t* f;
+    i32 exitdepth;
+
+    if (!fnum || fnum >= progs->numfunctions) {
+        if (pr_global_struct->self)
+            ED_Print(PROG_TO_EDICT(pr_global_struct->self));
+        Host_Error("PR_ExecuteProgram: NULL function");
+    }
+
+    f = &pr_functions[fnum];
+
+    PROF_BEGIN("PR_ExecuteProgram");
+
+    pr_trace = false;
+
+    // make a stack frame
+    exitdepth = pr_depth;
+
+    s = PR_EnterFunction(f);
+
+    if (pr_direct.value && PR_CanExecuteDirect())
+        PR_ExecuteDirect(s, exitdepth, 100000);
+    else
+        PR_ExecuteStatements(s, exitdepth, 100000);
+
+    PROF_END();
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 1996-1997 Id Software, Inc.
+ * Copyright (C) Henrique Barateli, <henriquejb194@gmail.com>, et al.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+// pr_local.h -- private progs definitions
+
+
+#ifndef __PR_LOCAL__
+#define __PR_LOCAL__
+
+#include "progs.h"
+#include "cvar.h"
+
+//
+// pr_exec.c
+//
+extern i32 pr_depth;
+
+i32 PR_EnterFunction(dfunction_t* f);
+i32 PR_LeaveFunction(void);
+
+void PR_ExecuteStatements(i32 s, i32 exitdepth, i32 runaway);
+// runs the reference interpreter starting after statement s until the
+// stack unwinds back to exitdepth
+
+//
+// pr_edict.c
+//
+ddef_t* ED_GlobalAtOfs(i32 ofs);
+ddef_t* ED_FieldAtOfs(i32 ofs);
+dfunction_t* ED_FindFunction(char* name);
+
+//
+// pr_direct.c
+//
+extern cvar_t pr_direct;
+
+void PR_DecodeProgs(void);
+// translates pr_statements into the pre-decoded instruction stream,
+// called once the globals have been byte swapped by PR_LoadProgs
+
+qboolean PR_CanExecuteDirect(void);
+
+void PR_ExecuteDirect(i32 s, i32 exitdepth, i32 runaway);
+// same contract as PR_ExecuteStatements
+
+void PR_Compare_f(void);
+
+//
+// pr_cmds.c
+//
+extern cvar_t pr_findindex;
+extern cvar_t pr_radiusindex;
+
+void PR_FindBench_f(void);
+
+#endif
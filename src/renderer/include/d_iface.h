@@ -29,6 +29,15 @@
 #include "model.h"
 #include "vid.h"
 
+// the span drawing and surface building state is per thread so r_threads
+// can rasterize bands of the screen and build surfaces in parallel, see
+// d_bands.c
+#ifdef _MSC_VER
+#define D_THREADLOCAL __declspec(thread)
+#else
+#define D_THREADLOCAL __thread
+#endif
+
 #define WARP_WIDTH  320
 #define WARP_HEIGHT 200
 
@@ -51,18 +60,20 @@ typedef enum {
     pt_blob2
 } ptype_t;
 
-// !!! if this is changed, it must be changed in d_ifacea.h too !!!
-typedef struct particle_s {
+// the live particles, one array per field so every pass over them only
+// streams through the fields it uses
+typedef struct {
+    i32 count;
+    i32 max;
     // driver-usable fields
-    vec3_t org;
-    float color;
+    float* org[3];
+    byte* color;
     // drivers never touch the following fields
-    struct particle_s* next;
-    vec3_t vel;
-    float ramp;
-    float die;
-    ptype_t type;
-} particle_t;
+    float* vel[3];
+    float* ramp;
+    float* die;
+    byte* type;
+} particles_t;
 
 #define PARTICLE_Z_CLIP 8.0
 
@@ -160,7 +171,7 @@ void D_DisableBackBufferAccess(void);
 void D_EndDirectRect(i32 x, i32 y, i32 width, i32 height);
 void D_PolysetDraw(void);
 void D_PolysetDrawFinalVerts(finalvert_t* fv, i32 numverts);
-void D_DrawParticle(particle_t* pparticle);
+void D_DrawParticles(const particles_t* parts);
 void D_DrawPoly(void);
 void D_DrawSprite(void);
 void D_DrawSurfaces(void);
@@ -212,7 +223,7 @@ typedef struct {
     i32 surfheight;     // in mipmapped texels
 } drawsurf_t;
 
-extern drawsurf_t r_drawsurf;
+extern D_THREADLOCAL drawsurf_t r_drawsurf;
 
 void R_DrawSurface(void);
 void R_GenTile(msurface_t* psurf, void* pdest);
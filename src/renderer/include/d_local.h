@@ -42,8 +42,12 @@
 #define SURFCACHE_SIZE_AT_320X200 600 * 1024
 
 typedef struct surfcache_s {
-    struct surfcache_s* next;
-    struct surfcache_s** owner; // NULL is an empty chunk of memory
+    struct surfcache_s *next, *prev; // neighbours in memory
+    struct surfcache_s *lrunext, *lruprev; // use order, or the free bin
+    struct surfcache_s** owner;
+    qboolean used;              // false for free memory
+    qboolean queued;            // claimed by a parallel build
+    i32 lastframe;              // r_framecount the surface was last drawn
     i32 lightadj[MAXLIGHTMAPS]; // checked for strobe flush
     i32 dlight;
     i32 size; // including header
@@ -63,16 +67,16 @@ extern cvar_t d_subdiv16;
 
 extern float scale_for_mip;
 
-extern qboolean d_roverwrapped;
-extern surfcache_t* sc_rover;
-extern surfcache_t* d_initial_rover;
+extern cvar_t d_surfcachesize;
+extern cvar_t d_prebuild; // 1 build missing surfaces in parallel, 2 also
+                          // off screen ones of the potentially visible set
 
-extern float d_sdivzstepu, d_tdivzstepu, d_zistepu;
-extern float d_sdivzstepv, d_tdivzstepv, d_zistepv;
-extern float d_sdivzorigin, d_tdivzorigin, d_ziorigin;
+extern D_THREADLOCAL float d_sdivzstepu, d_tdivzstepu, d_zistepu;
+extern D_THREADLOCAL float d_sdivzstepv, d_tdivzstepv, d_zistepv;
+extern D_THREADLOCAL float d_sdivzorigin, d_tdivzorigin, d_ziorigin;
 
-extern fixed16_t sadjust, tadjust;
-extern fixed16_t bbextents, bbextentt;
+extern D_THREADLOCAL fixed16_t sadjust, tadjust;
+extern D_THREADLOCAL fixed16_t bbextents, bbextentt;
 
 
 void D_DrawSpans8(espan_t* pspans);
@@ -86,6 +90,51 @@ void D_DrawSkyScans16(espan_t* pspan);
 
 void R_ShowSubDiv(void);
 surfcache_t* D_CacheSurface(msurface_t* surface, i32 miplevel);
+qboolean D_SurfaceCached(msurface_t* surface, i32 miplevel);
+void D_CheckCacheSize(void);
+void D_QueueSurfaceBuild(msurface_t* surface, i32 miplevel);
+void D_BuildQueuedSurfaces(void);
+// builds the queued surfaces across the r_threads threads
+i32 D_log2(i32 num);
+void D_EndCacheFrame(void);
+void D_SurfCache_f(void);
+
+// how D_RasterizeSurface fills a surface's spans
+#define DS_SPANS 0 // texture mapped from the surface cache
+#define DS_SOLID 1
+#define DS_SKY   2
+#define DS_TURB  3
+
+void D_RasterizeSurface(espan_t* pspan, i32 kind, i32 color);
+
+//
+// d_bands.c
+//
+extern cvar_t r_threads;
+extern qboolean d_bandsactive; // D_DrawSurfaces queues instead of drawing
+
+void D_InitBands(void);
+void D_BeginBands(void);
+void D_RecordSurface(espan_t* pspan, i32 kind, i32 color);
+void D_FlushBands(void);
+// splits the queued spans into bands of screen rows and rasterizes the
+// bands across the worker threads, returns when all are drawn
+void D_EndBands(void);
+
+i32 D_ThreadCount(void);
+void D_RunWorkers(void (*job)(void), i32 threads);
+
+//
+// d_simd.c
+//
+extern cvar_t d_simd; // 0 C drawers, 1 fastest the CPU has, 2 no AVX2
+extern qboolean d_spancompare; // checking the drawers against the C ones
+
+void D_InitSIMD(void);
+void D_SelectSpanDrawers(void);
+// points the drawer pointers below at the vector drawers when the CPU has
+// them and d_simd allows it, at the C ones otherwise
+void D_CompareSpans(espan_t* pspan, i32 kind);
 
 extern i32 D_MipLevelForScale(float scale);
 
@@ -107,5 +156,6 @@ extern i32 d_minmip;
 extern float d_scalemip[3];
 
 extern void (*d_drawspans)(espan_t* pspan);
+extern void (*d_drawzspans)(espan_t* pspan);
 
 #endif
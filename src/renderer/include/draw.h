@@ -25,8 +25,11 @@
 #define __DRAW__
 
 #include "quakedef.h"
+#include "vid.h"
 #include "wad.h"
 
+#define MAX_DIRTYRECTS 8
+
 extern qpic_t* draw_disc; // also used on sbar
 
 void Draw_Init(void);
@@ -44,5 +47,7 @@ void Draw_FadeScreen(void);
 void Draw_String(i32 x, i32 y, char* str);
 qpic_t* Draw_PicFromWad(char* name);
 qpic_t* Draw_CachePic(char* path);
+void Draw_MarkDirty(i32 x, i32 y, i32 w, i32 h);
+i32 Draw_GetDirty(vrect_t* rects);
 
 #endif
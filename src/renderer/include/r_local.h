@@ -76,6 +76,8 @@ extern cvar_t r_numsurfs;
 extern cvar_t r_reportedgeout;
 extern cvar_t r_maxedges;
 extern cvar_t r_numedges;
+extern cvar_t r_numspans;
+extern cvar_t r_numnodes;
 
 #define XCENTERING (1.0 / 2.0)
 #define YCENTERING (1.0 / 2.0)
@@ -118,6 +120,42 @@ extern float xOrigin, yOrigin;
 
 extern i32 r_visframecount;
 
+//
+// the potentially visible set, r_vis.c
+//
+
+// r_cullvisnode answers for each frustum plane in clipflags, shifted left
+// by the plane number; a box with neither bit of a plane crosses it
+#define R_CULL_OUTSIDE 0x01 // box entirely behind the plane
+#define R_CULL_INSIDE  0x10 // box entirely in front of it
+
+typedef struct {
+    float mins[4]; // the minmaxs of node as floats, w unused
+    float maxs[4];
+    mnode_t* node; // or a leaf
+    i32 children[2]; // slots of the children in the set, -1 if not drawn
+} visnode_t;
+
+typedef struct {
+    visnode_t* nodes; // nodes and leafs the view leaf can see, each
+                      // followed by its children[0] and then children[1]
+    i32 count;
+    mleaf_t** leafs; // just the leafs, in leaf order
+    i32 numleafs;
+} visset_t;
+
+extern visset_t r_visset;
+
+extern i32 (*r_cullvisnode)(const visnode_t* vn, i32 clipflags);
+
+void R_NewVisibleSet(void);
+void R_BuildVisibleSet(void);
+void R_SetupVisibleSetCull(void);
+void R_SelectVisibleSetCull(qboolean vector);
+// picks the vector r_cullvisnode when vector is set
+
+extern i32 r_nodeswalked, r_leafswalked, r_surfswalked;
+
 //=============================================================================
 
 extern i32 vstartscan;
@@ -134,6 +172,7 @@ extern vec3_t r_worldmodelorg;
 
 
 void R_DrawSprite(void);
+void R_DrawEntitiesOnList(void);
 void R_RenderFace(msurface_t* fa, i32 clipflags);
 void R_RenderPoly(msurface_t* fa, i32 clipflags);
 void R_RenderBmodelFace(bedge_t* pedges, msurface_t* psurf);
@@ -144,6 +183,25 @@ void R_DrawSurfaceBlock16(void);
 void R_DrawSurfaceBlock8(void);
 texture_t* R_TextureAnimation(texture_t* base);
 
+extern D_THREADLOCAL u32 blocklights[18 * 18];
+extern D_THREADLOCAL u32* r_lightptr;
+extern D_THREADLOCAL i32 r_lightwidth, r_numvblocks;
+extern D_THREADLOCAL void* prowdestbase;
+extern D_THREADLOCAL byte *pbasesource, *r_sourcemax;
+extern D_THREADLOCAL i32 sourcetstep, surfrowbytes, r_stepback;
+extern void (*r_buildlightmap)(void);
+extern void (*r_surfblockdrawers[MIPLEVELS])(void);
+
+void R_BuildLightMap(void);
+void R_DrawSurfaceBlock8_mip0(void);
+void R_DrawSurfaceBlock8_mip1(void);
+void R_DrawSurfaceBlock8_mip2(void);
+void R_DrawSurfaceBlock8_mip3(void);
+
+void R_InitSurfaceSIMD(void);
+void R_SelectSurfaceDrawers(qboolean vector);
+// picks the r_simd.c lightmap builder and surface blocks when vector is set
+
 void R_GenSkyTile(void* pdest);
 void R_GenSkyTile16(void* pdest);
 void R_Surf8Patch(void);
@@ -184,8 +242,8 @@ extern i32* pfrustum_indexes[4];
 extern i32 ubasestep, errorterm, erroradjustup, erroradjustdown;
 extern i32 vstartscan;
 
-extern fixed16_t sadjust, tadjust;
-extern fixed16_t bbextents, bbextentt;
+extern D_THREADLOCAL fixed16_t sadjust, tadjust;
+extern D_THREADLOCAL fixed16_t bbextents, bbextentt;
 
 #define MAXBVERTINDEXES                                                        \
     1000 // new clipped vertices when clipping bmodels                         \
@@ -217,7 +275,7 @@ void R_ZDrawSubmodelPolys(model_t* clmodel);
 // Alias models
 //=========================================================
 
-#define MAXALIASVERTS      2000 // TODO: tune this
+#define MAXALIASVERTS      65536 // the vertex buffers grow to the model
 #define ALIAS_Z_CLIP_PLANE 5
 
 extern i32 numverts;
@@ -230,8 +288,34 @@ extern float leftclip, topclip, rightclip, bottomclip;
 extern i32 r_acliptype;
 extern finalvert_t* pfinalverts;
 extern auxvert_t* pauxverts;
+extern trivertx_t* r_apverts;
+extern i32 r_anumverts;
+extern float ziscale;
+extern float aliastransform[3][4];
+extern i32 r_anormallight[256];
 
 qboolean R_AliasCheckBBox(void);
+void R_AliasSetUpTransform(i32 trivial_accept);
+void R_AliasSetupLighting(alight_t* plighting);
+void R_AliasSetupFrame(void);
+void R_AliasSetClipFlags(finalvert_t* fv);
+void R_AliasTransformFinalVert(finalvert_t* fv, auxvert_t* av,
+                               trivertx_t* pverts, stvert_t* pstverts);
+void R_AliasTransformFinalVerts(finalvert_t* fv, auxvert_t* av,
+                                trivertx_t* pverts, stvert_t* pstverts,
+                                i32 numverts);
+void R_AliasTransformAndProjectFinalVerts(finalvert_t* fv, trivertx_t* pverts,
+                                          stvert_t* pstverts, i32 numverts);
+
+extern void (*r_aliasprojectverts)(finalvert_t* fv, trivertx_t* pverts,
+                                   stvert_t* pstverts, i32 numverts);
+extern void (*r_aliastransformverts)(finalvert_t* fv, auxvert_t* av,
+                                     trivertx_t* pverts, stvert_t* pstverts,
+                                     i32 numverts);
+
+void R_InitAliasSIMD(void);
+void R_SelectAliasDrawers(qboolean vector);
+// picks the r_asimd.c vertex transforms when vector is set
 
 //=========================================================
 // turbulence stuff
@@ -250,9 +334,13 @@ void R_ReadPointFile_f(void);
 void R_SurfacePatch(void);
 
 extern i32 r_amodels_drawn;
-extern edge_t* auxedges;
 extern i32 r_numallocatededges;
 extern edge_t *r_edges, *edge_p, *edge_max;
+extern i32 r_numallocatedspans;
+extern i32 r_maxspansseen, r_spansused;
+
+void R_SizeEdgePools(void);
+void R_RecordEdgeUsage(void);
 
 extern edge_t* newedges[MAXHEIGHT];
 extern edge_t* removeedges[MAXHEIGHT];
@@ -282,7 +370,6 @@ extern float dp_time1, dp_time2, db_time1, db_time2, rw_time1, rw_time2;
 extern float se_time1, se_time2, de_time1, de_time2, dv_time1, dv_time2;
 extern i32 r_frustum_indexes[4 * 6];
 extern i32 r_maxsurfsseen, r_maxedgesseen, r_cnumsurfs;
-extern qboolean r_surfsonstack;
 extern cshift_t cshift_water;
 extern qboolean r_dowarpold, r_viewchanged;
 
@@ -52,8 +52,8 @@
 
 extern void R_DrawLine(polyvert_t* polyvert0, polyvert_t* polyvert1);
 
-extern i32 cachewidth;
-extern pixel_t* cacheblock;
+extern D_THREADLOCAL i32 cachewidth;
+extern D_THREADLOCAL pixel_t* cacheblock;
 extern i32 screenwidth;
 
 extern float pixelAspect;
@@ -70,11 +70,10 @@ extern vec3_t vpn, base_vpn;
 extern vec3_t vright, base_vright;
 extern entity_t* currententity;
 
-#define NUMSTACKEDGES    2400
-#define MINEDGES         NUMSTACKEDGES
-#define NUMSTACKSURFACES 800
-#define MINSURFACES      NUMSTACKSURFACES
-#define MAXSPANS         3000
+// the edge pools start at these and grow to what the frames need
+#define MINEDGES    2400
+#define MINSURFACES 800
+#define MINSPANS    3000
 
 // !!! if this is changed, it must be changed in asm_draw.h too !!!
 typedef struct espan_s {
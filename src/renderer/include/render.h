@@ -154,7 +154,7 @@ extern qboolean r_cache_thrash; // set if thrashing the surface cache
 i32 D_SurfaceCacheForRes(i32 width, i32 height);
 void D_FlushCaches(void);
 void D_DeleteSurfaceCache(void);
-void D_InitCaches(void* buffer, i32 size);
+void D_InitCaches(void);
 void R_SetVrect(vrect_t* pvrect, vrect_t* pvrectin, i32 lineadj);
 
 #endif
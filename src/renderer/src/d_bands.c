@@ -0,0 +1,406 @@
+/*
+ * Copyright (C) 1996-1997 Id Software, Inc.
+ * Copyright (C) Henrique Barateli, <henriquejb194@gmail.com>, et al.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+// d_bands.c -- parallel span rasterization in bands of screen rows
+//
+// The edge scan still runs on the main thread: the order of the active
+// edge list depends on every scan line above, so scanning bands on their
+// own would not give the same spans. D_DrawSurfaces queues each surface
+// with a copy of its gradients, and the queued spans are bucketed by row
+// into bands that the worker threads and the main thread draw in parallel.
+// Spans never overlap, so every pixel is written by exactly one thread with
+// exactly the single threaded values.
+
+
+#include "d_local.h"
+#include "r_local.h"
+#include "console.h"
+#include "sys.h"
+#include <SDL_atomic.h>
+#include <SDL_mutex.h>
+#include <SDL_thread.h>
+
+
+#define D_MAXTHREADS     16
+#define D_BANDSPERTHREAD 4 // more bands than threads evens out the load
+#define D_MAXBANDS       (D_MAXTHREADS * D_BANDSPERTHREAD)
+
+typedef struct {
+    espan_t* spans;
+    i32 kind;
+    i32 color;
+    float sdivzstepu, tdivzstepu, zistepu;
+    float sdivzstepv, tdivzstepv, zistepv;
+    float sdivzorigin, tdivzorigin, ziorigin;
+    fixed16_t sadjust, tadjust, bbextents, bbextentt;
+    pixel_t* cacheblock;
+    i32 cachewidth;
+} bandsurf_t;
+
+cvar_t r_threads = {"r_threads", "0"};
+
+qboolean d_bandsactive;
+
+static bandsurf_t* d_drawsurfs;
+static i32 d_numdrawsurfs;
+static i32 d_maxdrawsurfs;
+
+// band major, d_bandspans[band * d_maxdrawsurfs + surf]
+static espan_t** d_bandspans;
+
+static i32 d_numthreads; // including the main thread
+static i32 d_numbands;
+static byte d_rowband[MAXHEIGHT];
+static i32 d_rowtop, d_rowheight, d_rowbands; // d_rowband is built for
+
+static i32 d_numworkers; // worker threads started, they never exit
+static void (*d_workerjob)(void);
+static SDL_sem* d_startsem;
+static SDL_sem* d_donesem;
+static SDL_atomic_t d_nextband;
+
+
+/*
+=============
+D_SaveState
+=============
+*/
+static void D_SaveState(bandsurf_t* ds) {
+    ds->sdivzstepu = d_sdivzstepu;
+    ds->tdivzstepu = d_tdivzstepu;
+    ds->zistepu = d_zistepu;
+    ds->sdivzstepv = d_sdivzstepv;
+    ds->tdivzstepv = d_tdivzstepv;
+    ds->zistepv = d_zistepv;
+    ds->sdivzorigin = d_sdivzorigin;
+    ds->tdivzorigin = d_tdivzorigin;
+    ds->ziorigin = d_ziorigin;
+    ds->sadjust = sadjust;
+    ds->tadjust = tadjust;
+    ds->bbextents = bbextents;
+    ds->bbextentt = bbextentt;
+    ds->cacheblock = cacheblock;
+    ds->cachewidth = cachewidth;
+}
+
+/*
+=============
+D_LoadState
+=============
+*/
+static void D_LoadState(const bandsurf_t* ds) {
+    d_sdivzstepu = ds->sdivzstepu;
+    d_tdivzstepu = ds->tdivzstepu;
+    d_zistepu = ds->zistepu;
+    d_sdivzstepv = ds->sdivzstepv;
+    d_tdivzstepv = ds->tdivzstepv;
+    d_zistepv = ds->zistepv;
+    d_sdivzorigin = ds->sdivzorigin;
+    d_tdivzorigin = ds->tdivzorigin;
+    d_ziorigin = ds->ziorigin;
+    sadjust = ds->sadjust;
+    tadjust = ds->tadjust;
+    bbextents = ds->bbextents;
+    bbextentt = ds->bbextentt;
+    cacheblock = ds->cacheblock;
+    cachewidth = ds->cachewidth;
+}
+
+/*
+=============
+D_DrawBand
+=============
+*/
+static void D_DrawBand(i32 band) {
+    espan_t** bandspans;
+    bandsurf_t* ds;
+    i32 i;
+
+    bandspans = &d_bandspans[band * d_maxdrawsurfs];
+    for (i = 0; i < d_numdrawsurfs; i++) {
+        if (!bandspans[i])
+            continue;
+        ds = &d_drawsurfs[i];
+        D_LoadState(ds);
+        D_RasterizeSurface(bandspans[i], ds->kind, ds->color);
+    }
+}
+
+/*
+=============
+D_DrawBands
+
+Draws bands until none are left
+=============
+*/
+static void D_DrawBands(void) {
+    i32 band;
+
+    while ((band = SDL_AtomicAdd(&d_nextband, 1)) < d_numbands)
+        D_DrawBand(band);
+}
+
+static int SDLCALL D_WorkerThread(void* unused) {
+    for (;;) {
+        SDL_SemWait(d_startsem);
+        (*d_workerjob)();
+        SDL_SemPost(d_donesem);
+    }
+    return 0;
+}
+
+/*
+=============
+D_StartWorkers
+
+Returns how many worker threads are running, which can be fewer than asked
+for if the system refuses to create more
+=============
+*/
+static i32 D_StartWorkers(i32 count) {
+    SDL_Thread* thread;
+
+    if (!d_startsem) {
+        d_startsem = SDL_CreateSemaphore(0);
+        d_donesem = SDL_CreateSemaphore(0);
+        if (!d_startsem || !d_donesem) {
+            Con_Printf("Couldn't create band semaphores: %s\n",
+                       SDL_GetError());
+            return 0;
+        }
+    }
+
+    while (d_numworkers < count) {
+        thread = SDL_CreateThread(D_WorkerThread, "bands", NULL);
+        if (!thread) {
+            Con_Printf("Couldn't start band thread: %s\n", SDL_GetError());
+            Cvar_SetValue("r_threads", (float) (d_numworkers + 1));
+            break;
+        }
+        SDL_DetachThread(thread);
+        d_numworkers++;
+    }
+
+    // idle workers are left waiting when r_threads is lowered
+    return d_numworkers < count ? d_numworkers : count;
+}
+
+/*
+=============
+D_ThreadCount
+
+How many threads r_threads asks for and can have, the main thread included
+=============
+*/
+i32 D_ThreadCount(void) {
+    i32 threads;
+
+    threads = (i32) r_threads.value;
+    if (threads > D_MAXTHREADS)
+        threads = D_MAXTHREADS;
+    if (threads < 2)
+        return 1;
+    return D_StartWorkers(threads - 1) + 1;
+}
+
+/*
+=============
+D_RunWorkers
+
+Runs job on threads threads, the main thread being one of them, and waits
+for all of them to return. job takes its own work items until none are left
+=============
+*/
+void D_RunWorkers(void (*job)(void), i32 threads) {
+    i32 i;
+
+    d_workerjob = job;
+    for (i = 1; i < threads; i++)
+        SDL_SemPost(d_startsem);
+    (*job)();
+    for (i = 1; i < threads; i++)
+        SDL_SemWait(d_donesem);
+}
+
+/*
+=============
+D_SetupRowBands
+
+Splits the view rows evenly into d_numbands bands
+=============
+*/
+static void D_SetupRowBands(void) {
+    i32 top, height, v;
+
+    top = r_refdef.vrect.y;
+    height = r_refdef.vrectbottom - top;
+    if (top == d_rowtop && height == d_rowheight && d_numbands == d_rowbands)
+        return;
+
+    for (v = 0; v < MAXHEIGHT; v++) {
+        if (v < top)
+            d_rowband[v] = 0;
+        else if (v >= top + height)
+            d_rowband[v] = d_numbands - 1;
+        else
+            d_rowband[v] = (v - top) * d_numbands / height;
+    }
+
+    d_rowtop = top;
+    d_rowheight = height;
+    d_rowbands = d_numbands;
+}
+
+/*
+=============
+D_ReserveSurfaces
+
+Room for every surface the edge list can hold
+=============
+*/
+static void D_ReserveSurfaces(void) {
+    i32 count = surf_max - surfaces;
+
+    if (count <= d_maxdrawsurfs)
+        return;
+
+    Q_free(d_drawsurfs);
+    Q_free(d_bandspans);
+    d_drawsurfs = Q_malloc(count * sizeof(*d_drawsurfs));
+    d_bandspans = Q_malloc(count * D_MAXBANDS * sizeof(*d_bandspans));
+    if (!d_drawsurfs || !d_bandspans)
+        Sys_Error("D_ReserveSurfaces: couldn't allocate %i surfaces", count);
+    d_maxdrawsurfs = count;
+}
+
+/*
+=============
+D_BeginBands
+
+Called by D_DrawSurfaces before the surfaces are set up
+=============
+*/
+void D_BeginBands(void) {
+    i32 height;
+
+    d_bandsactive = false;
+    d_numdrawsurfs = 0;
+
+    if (d_spancompare) // comparing swaps the buffers
+        return;
+
+    d_numthreads = D_ThreadCount();
+    if (d_numthreads < 2)
+        return;
+
+    height = r_refdef.vrectbottom - r_refdef.vrect.y;
+    d_numbands = d_numthreads * D_BANDSPERTHREAD;
+    if (d_numbands > height)
+        d_numbands = height;
+    if (d_numbands < 2)
+        return;
+
+    D_SetupRowBands();
+    D_ReserveSurfaces();
+    d_bandsactive = true;
+}
+
+/*
+=============
+D_RecordSurface
+
+Queues the spans with the gradients and texture that are set up now
+=============
+*/
+void D_RecordSurface(espan_t* pspan, i32 kind, i32 color) {
+    bandsurf_t* ds;
+
+    ds = &d_drawsurfs[d_numdrawsurfs++];
+    D_SaveState(ds);
+    ds->spans = pspan;
+    ds->kind = kind;
+    ds->color = color;
+}
+
+/*
+=============
+D_BucketSpans
+
+Relinks the spans of every queued surface into one list per band
+=============
+*/
+static void D_BucketSpans(void) {
+    espan_t* tails[D_MAXBANDS];
+    espan_t* span;
+    espan_t* next;
+    i32 i, band;
+
+    for (i = 0; i < d_numdrawsurfs; i++) {
+        for (band = 0; band < d_numbands; band++) {
+            d_bandspans[band * d_maxdrawsurfs + i] = NULL;
+            tails[band] = NULL;
+        }
+
+        for (span = d_drawsurfs[i].spans; span; span = next) {
+            next = span->pnext;
+            span->pnext = NULL;
+            band = d_rowband[span->v];
+            if (tails[band])
+                tails[band]->pnext = span;
+            else
+                d_bandspans[band * d_maxdrawsurfs + i] = span;
+            tails[band] = span;
+        }
+    }
+}
+
+void D_FlushBands(void) {
+    bandsurf_t saved;
+
+    if (!d_numdrawsurfs)
+        return;
+
+    D_BucketSpans();
+
+    // the main thread draws bands too, keep the state of the surface
+    // D_DrawSurfaces is in the middle of setting up
+    D_SaveState(&saved);
+
+    SDL_AtomicSet(&d_nextband, 0);
+    D_RunWorkers(D_DrawBands, d_numthreads);
+
+    D_LoadState(&saved);
+    d_numdrawsurfs = 0;
+}
+
+/*
+=============
+D_EndBands
+=============
+*/
+void D_EndBands(void) {
+    if (!d_bandsactive)
+        return;
+    D_FlushBands();
+    d_bandsactive = false;
+}
+
+void D_InitBands(void) {
+    Cvar_RegisterVariable(&r_threads);
+}
@@ -22,6 +22,7 @@
 
 #include "d_local.h"
 #include "client.h"
+#include "profiler.h"
 
 
 static i32 miplevel;
@@ -81,13 +82,13 @@ D_DrawSolidSurface
 
 // FIXME: clean this up
 
-void D_DrawSolidSurface(surf_t* surf, i32 color) {
+void D_DrawSolidSurface(espan_t* pspan, i32 color) {
     espan_t* span;
     byte* pdest;
     i32 u, u2, pix;
 
     pix = (color << 24) | (color << 16) | (color << 8) | color;
-    for (span = surf->spans; span; span = span->pnext) {
+    for (span = pspan; span; span = span->pnext) {
         pdest = (byte*) d_viewbuffer + screenwidth * span->v;
         u = span->u;
         u2 = span->u + span->count - 1;
@@ -161,6 +162,85 @@ void D_CalcGradients(msurface_t* pface) {
 }
 
 
+/*
+==============
+D_RasterizeSurface
+
+Draws the spans of one surface with the current gradients and texture
+==============
+*/
+void D_RasterizeSurface(espan_t* pspan, i32 kind, i32 color) {
+    switch (kind) {
+        case DS_SOLID:
+            D_DrawSolidSurface(pspan, color);
+            break;
+        case DS_SKY:
+            D_DrawSkyScans8(pspan);
+            break;
+        case DS_TURB:
+            Turbulent8(pspan);
+            break;
+        default:
+            (*d_drawspans)(pspan);
+            break;
+    }
+    (*d_drawzspans)(pspan);
+
+    if (d_spancompare)
+        D_CompareSpans(pspan, kind);
+}
+
+/*
+==============
+D_EmitSurface
+
+Draws now, or queues for the band threads when r_threads is on
+==============
+*/
+static void D_EmitSurface(espan_t* pspan, i32 kind, i32 color) {
+    if (d_bandsactive)
+        D_RecordSurface(pspan, kind, color);
+    else
+        D_RasterizeSurface(pspan, kind, color);
+}
+
+
+/*
+==============
+D_PrebuildSurfaces
+
+Queues every textured surface with spans, so the ones missing from the
+surface cache get built in parallel before any is drawn
+==============
+*/
+static void D_PrebuildSurfaces(void) {
+    surf_t* s;
+    msurface_t* pface;
+    i32 miplevel;
+
+    if (!d_prebuild.value || r_drawflat.value || D_ThreadCount() < 2)
+        return;
+
+    for (s = &surfaces[1]; s < surface_p; s++) {
+        if (!s->spans || (s->flags & (SURF_DRAWSKY | SURF_DRAWBACKGROUND |
+                                      SURF_DRAWTURB))) {
+            continue;
+        }
+
+        pface = s->data;
+        miplevel = D_MipLevelForScale(s->nearzi * scale_for_mip *
+                                      pface->texinfo->mipadjust);
+
+        // the texture animation frame comes from the entity
+        currententity = s->insubmodel ? s->entity : &cl_entities[0];
+        D_QueueSurfaceBuild(pface, miplevel);
+    }
+    currententity = &cl_entities[0];
+
+    D_BuildQueuedSurfaces();
+}
+
+
 /*
 ==============
 D_DrawSurfaces
@@ -173,6 +253,11 @@ void D_DrawSurfaces(void) {
     vec3_t world_transformed_modelorg;
     vec3_t local_modelorg;
 
+    PROF_BEGIN("D_DrawSurfaces");
+
+    D_BeginBands();
+    D_PrebuildSurfaces();
+
     currententity = &cl_entities[0];
     TransformVector(modelorg, transformed_modelorg);
     VectorCopy(transformed_modelorg, world_transformed_modelorg);
@@ -187,8 +272,7 @@ void D_DrawSurfaces(void) {
             d_zistepv = s->d_zistepv;
             d_ziorigin = s->d_ziorigin;
 
-            D_DrawSolidSurface(s, (intptr_t) s->data & 0xFF);
-            D_DrawZSpans(s->spans);
+            D_EmitSurface(s->spans, DS_SOLID, (intptr_t) s->data & 0xFF);
         }
     } else {
         for (s = &surfaces[1]; s < surface_p; s++) {
@@ -206,8 +290,7 @@ void D_DrawSurfaces(void) {
                     R_MakeSky();
                 }
 
-                D_DrawSkyScans8(s->spans);
-                D_DrawZSpans(s->spans);
+                D_EmitSurface(s->spans, DS_SKY, 0);
             } else if (s->flags & SURF_DRAWBACKGROUND) {
                 // set up a gradient for the background surface that places it
                 // effectively at infinity distance from the viewpoint
@@ -215,8 +298,8 @@ void D_DrawSurfaces(void) {
                 d_zistepv = 0;
                 d_ziorigin = -0.9;
 
-                D_DrawSolidSurface(s, (i32) r_clearcolor.value & 0xFF);
-                D_DrawZSpans(s->spans);
+                D_EmitSurface(s->spans, DS_SOLID,
+                              (i32) r_clearcolor.value & 0xFF);
             } else if (s->flags & SURF_DRAWTURB) {
                 pface = s->data;
                 miplevel = 0;
@@ -238,8 +321,7 @@ void D_DrawSurfaces(void) {
                 }
 
                 D_CalcGradients(pface);
-                Turbulent8(s->spans);
-                D_DrawZSpans(s->spans);
+                D_EmitSurface(s->spans, DS_TURB, 0);
 
                 if (s->insubmodel) {
                     //
@@ -257,6 +339,20 @@ void D_DrawSurfaces(void) {
                     R_TransformFrustum();
                 }
             } else {
+                pface = s->data;
+                miplevel = D_MipLevelForScale(s->nearzi * scale_for_mip *
+                                              pface->texinfo->mipadjust);
+
+                if (d_bandsactive) {
+                    // queued spans may still read the cache blocks that
+                    // building this one could overwrite, so draw them first.
+                    // checked before the rotation, sky spans use vpn
+                    if (s->insubmodel)
+                        currententity = s->entity;
+                    if (!D_SurfaceCached(pface, miplevel))
+                        D_FlushBands();
+                }
+
                 if (s->insubmodel) {
                     // FIXME: we don't want to do all this for every polygon!
                     // TODO: store once at start of frame
@@ -270,10 +366,6 @@ void D_DrawSurfaces(void) {
                                       // make entity passed in
                 }
 
-                pface = s->data;
-                miplevel = D_MipLevelForScale(s->nearzi * scale_for_mip *
-                                              pface->texinfo->mipadjust);
-
                 // FIXME: make this passed in to D_CacheSurface
                 pcurrentcache = D_CacheSurface(pface, miplevel);
 
@@ -282,9 +374,7 @@ void D_DrawSurfaces(void) {
 
                 D_CalcGradients(pface);
 
-                (*d_drawspans)(s->spans);
-
-                D_DrawZSpans(s->spans);
+                D_EmitSurface(s->spans, DS_SPANS, 0);
 
                 if (s->insubmodel) {
                     //
@@ -304,4 +394,9 @@ void D_DrawSurfaces(void) {
             }
         }
     }
+
+    D_EndBands();
+    D_EndCacheFrame();
+
+    PROF_END();
 }
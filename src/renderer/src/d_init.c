@@ -21,6 +21,7 @@
 
 
 #include "d_local.h"
+#include "cmd.h"
 
 
 #define NUM_MIPS 4
@@ -29,8 +30,6 @@ cvar_t d_subdiv16 = {"d_subdiv16", "1"};
 cvar_t d_mipcap = {"d_mipcap", "0"};
 cvar_t d_mipscale = {"d_mipscale", "1"};
 
-surfcache_t* d_initial_rover;
-qboolean d_roverwrapped;
 i32 d_minmip;
 float d_scalemip[NUM_MIPS - 1];
 
@@ -39,6 +38,7 @@ static float basemip[NUM_MIPS - 1] = {1.0, 0.5 * 0.8, 0.25 * 0.8};
 extern i32 d_aflatcolor;
 
 void (*d_drawspans)(espan_t* pspan);
+void (*d_drawzspans)(espan_t* pspan);
 
 
 /*
@@ -53,6 +53,11 @@ void D_Init(void) {
     Cvar_RegisterVariable(&d_subdiv16);
     Cvar_RegisterVariable(&d_mipcap);
     Cvar_RegisterVariable(&d_mipscale);
+    Cvar_RegisterVariable(&d_surfcachesize);
+    Cvar_RegisterVariable(&d_prebuild);
+    Cmd_AddCommand("surfcache", D_SurfCache_f);
+    D_InitBands();
+    D_InitSIMD();
 
     r_drawpolys = false;
     r_worldpolysbacktofront = false;
@@ -127,8 +132,7 @@ void D_SetupFrame(void) {
     else
         screenwidth = vid.width;
 
-    d_roverwrapped = false;
-    d_initial_rover = sc_rover;
+    D_CheckCacheSize();
 
     d_minmip = d_mipcap.value;
     if (d_minmip > 3)
@@ -138,7 +142,7 @@ void D_SetupFrame(void) {
 
     for (i = 0; i < (NUM_MIPS - 1); i++)
         d_scalemip[i] = basemip[i] * d_mipscale.value;
-    d_drawspans = D_DrawSpans8;
+    D_SelectSpanDrawers();
 
     d_aflatcolor = 0;
 }
@@ -42,49 +42,86 @@ void D_StartParticles(void) {
     // not used by software driver
 }
 
+// particles projected at a time, before any of them is drawn
+#define D_PARTICLEBATCH 64
+
+typedef struct {
+    i32 u, v;
+    i32 izi;
+    i32 pix;
+    i32 color;
+} drawparticle_t;
+
 /*
 ==============
-D_DrawParticle
+D_ProjectParticles
+
+Projects particles first to first + count - 1, returns how many are on screen
 ==============
 */
-void D_DrawParticle(particle_t* pparticle) {
+static i32 D_ProjectParticles(const particles_t* parts, i32 first, i32 count,
+                              drawparticle_t* out) {
     vec3_t local, transformed;
     float zi;
-    byte* pdest;
-    i16* pz;
-    i32 i, izi, pix, count, u, v;
-
-    // transform point
-    VectorSubtract(pparticle->org, r_origin, local);
-
-    transformed[0] = DotProduct(local, r_pright);
-    transformed[1] = DotProduct(local, r_pup);
-    transformed[2] = DotProduct(local, r_ppn);
-
-    if (transformed[2] < PARTICLE_Z_CLIP)
-        return;
-
-    // project the point
-    // FIXME: preadjust xcenter and ycenter
-    zi = 1.0 / transformed[2];
-    u = (i32) (xcenter + zi * transformed[0] + 0.5);
-    v = (i32) (ycenter - zi * transformed[1] + 0.5);
-
-    if ((v > d_vrectbottom_particle) || (u > d_vrectright_particle) ||
-        (v < d_vrecty) || (u < d_vrectx)) {
-        return;
+    i32 i, n, u, v, pix;
+
+    n = 0;
+    for (i = first; i < first + count; i++) {
+        // transform point
+        local[0] = parts->org[0][i] - r_origin[0];
+        local[1] = parts->org[1][i] - r_origin[1];
+        local[2] = parts->org[2][i] - r_origin[2];
+
+        transformed[0] = DotProduct(local, r_pright);
+        transformed[1] = DotProduct(local, r_pup);
+        transformed[2] = DotProduct(local, r_ppn);
+
+        if (transformed[2] < PARTICLE_Z_CLIP)
+            continue;
+
+        // project the point
+        // FIXME: preadjust xcenter and ycenter
+        zi = 1.0 / transformed[2];
+        u = (i32) (xcenter + zi * transformed[0] + 0.5);
+        v = (i32) (ycenter - zi * transformed[1] + 0.5);
+
+        if ((v > d_vrectbottom_particle) || (u > d_vrectright_particle) ||
+            (v < d_vrecty) || (u < d_vrectx)) {
+            continue;
+        }
+
+        out[n].u = u;
+        out[n].v = v;
+        out[n].izi = (i32) (zi * 0x8000);
+
+        pix = out[n].izi >> d_pix_shift;
+        if (pix < d_pix_min)
+            pix = d_pix_min;
+        else if (pix > d_pix_max)
+            pix = d_pix_max;
+        out[n].pix = pix;
+
+        out[n].color = parts->color[i];
+        n++;
     }
+    return n;
+}
 
-    pz = d_pzbuffer + (d_zwidth * v) + u;
-    pdest = d_viewbuffer + d_scantable[v] + u;
-    izi = (i32) (zi * 0x8000);
-
-    pix = izi >> d_pix_shift;
+/*
+==============
+D_DrawParticle
+==============
+*/
+static void D_DrawParticle(const drawparticle_t* dp) {
+    byte* pdest;
+    i16* pz;
+    i32 i, izi, pix, count, color;
 
-    if (pix < d_pix_min)
-        pix = d_pix_min;
-    else if (pix > d_pix_max)
-        pix = d_pix_max;
+    pz = d_pzbuffer + (d_zwidth * dp->v) + dp->u;
+    pdest = d_viewbuffer + d_scantable[dp->v] + dp->u;
+    izi = dp->izi;
+    pix = dp->pix;
+    color = dp->color;
 
     switch (pix) {
         case 1:
@@ -93,7 +130,7 @@ void D_DrawParticle(particle_t* pparticle) {
             for (; count; count--, pz += d_zwidth, pdest += screenwidth) {
                 if (pz[0] <= izi) {
                     pz[0] = izi;
-                    pdest[0] = pparticle->color;
+                    pdest[0] = color;
                 }
             }
             break;
@@ -104,12 +141,12 @@ void D_DrawParticle(particle_t* pparticle) {
             for (; count; count--, pz += d_zwidth, pdest += screenwidth) {
                 if (pz[0] <= izi) {
                     pz[0] = izi;
-                    pdest[0] = pparticle->color;
+                    pdest[0] = color;
                 }
 
                 if (pz[1] <= izi) {
                     pz[1] = izi;
-                    pdest[1] = pparticle->color;
+                    pdest[1] = color;
                 }
             }
             break;
@@ -120,17 +157,17 @@ void D_DrawParticle(particle_t* pparticle) {
             for (; count; count--, pz += d_zwidth, pdest += screenwidth) {
                 if (pz[0] <= izi) {
                     pz[0] = izi;
-                    pdest[0] = pparticle->color;
+                    pdest[0] = color;
                 }
 
                 if (pz[1] <= izi) {
                     pz[1] = izi;
-                    pdest[1] = pparticle->color;
+                    pdest[1] = color;
                 }
 
                 if (pz[2] <= izi) {
                     pz[2] = izi;
-                    pdest[2] = pparticle->color;
+                    pdest[2] = color;
                 }
             }
             break;
@@ -141,22 +178,22 @@ void D_DrawParticle(particle_t* pparticle) {
             for (; count; count--, pz += d_zwidth, pdest += screenwidth) {
                 if (pz[0] <= izi) {
                     pz[0] = izi;
-                    pdest[0] = pparticle->color;
+                    pdest[0] = color;
                 }
 
                 if (pz[1] <= izi) {
                     pz[1] = izi;
-                    pdest[1] = pparticle->color;
+                    pdest[1] = color;
                 }
 
                 if (pz[2] <= izi) {
                     pz[2] = izi;
-                    pdest[2] = pparticle->color;
+                    pdest[2] = color;
                 }
 
                 if (pz[3] <= izi) {
                     pz[3] = izi;
-                    pdest[3] = pparticle->color;
+                    pdest[3] = color;
                 }
             }
             break;
@@ -168,10 +205,31 @@ void D_DrawParticle(particle_t* pparticle) {
                 for (i = 0; i < pix; i++) {
                     if (pz[i] <= izi) {
                         pz[i] = izi;
-                        pdest[i] = pparticle->color;
+                        pdest[i] = color;
                     }
                 }
             }
             break;
     }
 }
+
+/*
+==============
+D_DrawParticles
+
+Projects a batch of particles and then z tests and splats the visible ones.
+Goes from the newest particle back to the oldest, the order they were always
+drawn in
+==============
+*/
+void D_DrawParticles(const particles_t* parts) {
+    drawparticle_t batch[D_PARTICLEBATCH];
+    i32 first, count, n;
+
+    for (first = parts->count; first > 0; first -= count) {
+        count = first < D_PARTICLEBATCH ? first : D_PARTICLEBATCH;
+        n = D_ProjectParticles(parts, first - count, count, batch);
+        while (n--)
+            D_DrawParticle(&batch[n]);
+    }
+}
@@ -26,10 +26,11 @@
 #include "r_local.h"
 
 
-byte *r_turb_pbase, *r_turb_pdest;
-fixed16_t r_turb_s, r_turb_t, r_turb_sstep, r_turb_tstep;
-i32* r_turb_turb;
-i32 r_turb_spancount;
+static D_THREADLOCAL byte *r_turb_pbase, *r_turb_pdest;
+static D_THREADLOCAL fixed16_t r_turb_s, r_turb_t;
+static D_THREADLOCAL fixed16_t r_turb_sstep, r_turb_tstep;
+static D_THREADLOCAL i32* r_turb_turb;
+static D_THREADLOCAL i32 r_turb_spancount;
 
 void D_DrawTurbulent8Span(void);
 
@@ -0,0 +1,557 @@
+/*
+ * Copyright (C) 1996-1997 Id Software, Inc.
+ * Copyright (C) Henrique Barateli, <henriquejb194@gmail.com>, et al.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+// d_simd.c -- vector versions of the span drawers in d_scan.c
+//
+// These must write exactly what the C drawers write. s/z, t/z and 1/z are
+// still accumulated one subspan at a time in the same order, only the
+// divides at the subspan ends are done four at a time, and the fixed point
+// stepping across a subspan is done in integer lanes, which wrap the same
+// way the scalar adds do. The texel fetches stay scalar loads.
+//
+// Turbulent8 has no vector version: every pixel is three dependent table
+// lookups, and doing its subspan divides four at a time bought nothing.
+//
+// The kernels only read the per thread drawing state, so the band threads
+// can run them too.
+
+
+#include "d_local.h"
+#include "r_local.h"
+#include "client.h"
+#include "cmd.h"
+#include "console.h"
+#include "zone.h"
+#include "simd.h"
+#include <SDL_cpuinfo.h>
+
+
+cvar_t d_simd = {"d_simd", "1"};
+
+qboolean d_spancompare;
+
+static qboolean d_hasavx2;
+static const char* d_drawersname = "C";
+
+static pixel_t* d_compareview;
+static i16* d_comparez;
+static i32 d_comparepixels, d_comparediffs;
+static i32 d_comparezpixels, d_comparezdiffs;
+
+
+#ifdef SIMD_VECTOR
+
+// the start of a span, the end of each of its subspans and room to fill
+// out the last vector
+#define D_MAXENDS (1 + (MAXWIDTH >> 3) + 3)
+
+
+/*
+=============
+D_SpanEnds
+
+Fixed point s and t at the start of the span and at the far end of each
+8 pixel subspan, clamped the way D_DrawSpans8 clamps them. Returns the
+number of subspans.
+=============
+*/
+static i32 D_SpanEnds(espan_t* pspan, fixed16_t* sends, fixed16_t* tends) {
+    float sdivzs[D_MAXENDS], tdivzs[D_MAXENDS], zis[D_MAXENDS];
+    float sdivz, tdivz, zi, du, dv, spancountminus1;
+    float sdivz8stepu, tdivz8stepu, zi8stepu;
+    vec4f_t z;
+    i32 count, spancount, numends, i;
+    fixed16_t s, t, smin;
+
+    sdivz8stepu = d_sdivzstepu * 8;
+    tdivz8stepu = d_tdivzstepu * 8;
+    zi8stepu = d_zistepu * 8;
+
+    du = (float) pspan->u;
+    dv = (float) pspan->v;
+
+    sdivz = d_sdivzorigin + dv * d_sdivzstepv + du * d_sdivzstepu;
+    tdivz = d_tdivzorigin + dv * d_tdivzstepv + du * d_tdivzstepu;
+    zi = d_ziorigin + dv * d_zistepv + du * d_zistepu;
+    sdivzs[0] = sdivz;
+    tdivzs[0] = tdivz;
+    zis[0] = zi;
+    numends = 1;
+
+    count = pspan->count;
+    do {
+        if (count >= 8)
+            spancount = 8;
+        else
+            spancount = count;
+
+        count -= spancount;
+
+        if (count) {
+            sdivz += sdivz8stepu;
+            tdivz += tdivz8stepu;
+            zi += zi8stepu;
+        } else {
+            spancountminus1 = (float) (spancount - 1);
+            sdivz += d_sdivzstepu * spancountminus1;
+            tdivz += d_tdivzstepu * spancountminus1;
+            zi += d_zistepu * spancountminus1;
+        }
+        sdivzs[numends] = sdivz;
+        tdivzs[numends] = tdivz;
+        zis[numends] = zi;
+        numends++;
+    } while (count > 0);
+
+    // keep the unused lanes of the last vector harmless
+    for (i = numends; i < numends + 3; i++) {
+        sdivzs[i] = 0;
+        tdivzs[i] = 0;
+        zis[i] = 1;
+    }
+
+    for (i = 0; i < numends; i += 4) {
+        z = V4_Div(V4_SplatF((float) 0x10000), V4_LoadF(&zis[i]));
+        V4_Store(&sends[i], V4_Add(V4_Trunc(V4_Mul(V4_LoadF(&sdivzs[i]), z)),
+                                   V4_Splat(sadjust)));
+        V4_Store(&tends[i], V4_Add(V4_Trunc(V4_Mul(V4_LoadF(&tdivzs[i]), z)),
+                                   V4_Splat(tadjust)));
+    }
+
+    // the start may go down to 0, the subspan ends are kept 8 in so
+    // round-off on <0 steps can't run off the edge of the texture
+    smin = 0;
+    for (i = 0; i < numends; i++) {
+        s = sends[i];
+        if (s > bbextents)
+            s = bbextents;
+        else if (s < smin)
+            s = smin;
+        sends[i] = s;
+
+        t = tends[i];
+        if (t > bbextentt)
+            t = bbextentt;
+        else if (t < smin)
+            t = smin;
+        tends[i] = t;
+
+        smin = 8;
+    }
+
+    return numends - 1;
+}
+
+/*
+=============
+D_DrawSubspan8
+
+8 pixels of a span
+=============
+*/
+static inline void D_DrawSubspan8(byte* pdest, const byte* pbase, fixed16_t s,
+                                  fixed16_t t, fixed16_t sstep,
+                                  fixed16_t tstep) {
+    i32 offsets[8];
+    vec4i_t sv, tv, width;
+
+    width = V4_Splat(cachewidth);
+    sv = V4_Ramp(s, sstep);
+    tv = V4_Ramp(t, tstep);
+    V4_Store(&offsets[0],
+             V4_Add(V4_Shr16(sv), V4_MulSmall(V4_Shr16(tv), width)));
+    sv = V4_Add(sv, V4_Splat((i32) ((u32) sstep * 4)));
+    tv = V4_Add(tv, V4_Splat((i32) ((u32) tstep * 4)));
+    V4_Store(&offsets[4],
+             V4_Add(V4_Shr16(sv), V4_MulSmall(V4_Shr16(tv), width)));
+
+    pdest[0] = pbase[offsets[0]];
+    pdest[1] = pbase[offsets[1]];
+    pdest[2] = pbase[offsets[2]];
+    pdest[3] = pbase[offsets[3]];
+    pdest[4] = pbase[offsets[4]];
+    pdest[5] = pbase[offsets[5]];
+    pdest[6] = pbase[offsets[6]];
+    pdest[7] = pbase[offsets[7]];
+}
+
+/*
+=============
+D_DrawSpans8V
+
+D_DrawSpans8 with vector subspan divides and texel addressing
+=============
+*/
+static void D_DrawSpans8V(espan_t* pspan) {
+    fixed16_t sends[D_MAXENDS], tends[D_MAXENDS];
+    i32 count, spancount, numsubspans, i;
+    byte *pbase, *pdest;
+    fixed16_t s, t, sstep, tstep;
+
+    sstep = 0; // keep compiler happy
+    tstep = 0; // ditto
+
+    pbase = (byte*) cacheblock;
+
+    do {
+        pdest = (byte*) d_viewbuffer + (screenwidth * pspan->v) + pspan->u;
+        count = pspan->count;
+        numsubspans = D_SpanEnds(pspan, sends, tends);
+        s = sends[0];
+        t = tends[0];
+
+        for (i = 1; i <= numsubspans; i++) {
+            if (count >= 8)
+                spancount = 8;
+            else
+                spancount = count;
+
+            count -= spancount;
+
+            if (count) {
+                sstep = (sends[i] - s) >> 3;
+                tstep = (tends[i] - t) >> 3;
+            } else if (spancount > 1) {
+                sstep = (sends[i] - s) / (spancount - 1);
+                tstep = (tends[i] - t) / (spancount - 1);
+            }
+
+            if (spancount == 8) {
+                D_DrawSubspan8(pdest, pbase, s, t, sstep, tstep);
+                pdest += 8;
+            } else {
+                // the short end of the span, not worth setting up lanes
+                do {
+                    *pdest++ = *(pbase + (s >> 16) + (t >> 16) * cachewidth);
+                    s += sstep;
+                    t += tstep;
+                } while (--spancount > 0);
+            }
+
+            s = sends[i];
+            t = tends[i];
+        }
+
+    } while ((pspan = pspan->pnext) != NULL);
+}
+
+/*
+=============
+D_ZSpanPairs
+
+The end of a z span the way D_DrawZSpans writes it, in 32 bit pairs
+=============
+*/
+static inline void D_ZSpanPairs(i16* pdest, i32 izi, i32 izistep,
+                                i32 count) {
+    i32 doublecount;
+    u32 ltemp;
+
+    if ((doublecount = count >> 1) > 0) {
+        do {
+            ltemp = izi >> 16;
+            izi += izistep;
+            ltemp |= izi & 0xFFFF0000;
+            izi += izistep;
+            *(i32*) pdest = ltemp;
+            pdest += 2;
+        } while (--doublecount > 0);
+    }
+
+    if (count & 1)
+        *pdest = (i16) (izi >> 16);
+}
+
+/*
+=============
+D_DrawZSpansV
+=============
+*/
+static void D_DrawZSpansV(espan_t* pspan) {
+    i32 count, izistep;
+    i32 izi;
+    i16* pdest;
+    double zi;
+    float du, dv;
+    vec4i_t lo, hi, step;
+
+    // FIXME: check for clamping/range problems
+    // we count on FP exceptions being turned off to avoid range problems
+    izistep = (i32) (d_zistepu * 0x8000 * 0x10000);
+    step = V4_Splat((i32) ((u32) izistep * 8));
+
+    do {
+        pdest = d_pzbuffer + (d_zwidth * pspan->v) + pspan->u;
+
+        count = pspan->count;
+
+        // calculate the initial 1/z
+        du = (float) pspan->u;
+        dv = (float) pspan->v;
+
+        zi = d_ziorigin + dv * d_zistepv + du * d_zistepu;
+        // we count on FP exceptions being turned off to avoid range problems
+        izi = (i32) (zi * 0x8000 * 0x10000);
+
+        if ((intptr_t) pdest & 0x02) {
+            *pdest++ = (i16) (izi >> 16);
+            izi += izistep;
+            count--;
+        }
+
+        if (count >= 8) {
+            lo = V4_Ramp(izi, izistep);
+            hi = V4_Add(lo, V4_Splat((i32) ((u32) izistep * 4)));
+            do {
+                V4_StoreZ8(pdest, lo, hi);
+                lo = V4_Add(lo, step);
+                hi = V4_Add(hi, step);
+                izi = (i32) ((u32) izi + (u32) izistep * 8);
+                pdest += 8;
+                count -= 8;
+            } while (count >= 8);
+        }
+
+        D_ZSpanPairs(pdest, izi, izistep, count);
+
+    } while ((pspan = pspan->pnext) != NULL);
+}
+
+#endif // SIMD_VECTOR
+
+
+#ifdef SIMD_SSE2
+
+/*
+=============
+D_DrawZSpansAVX2
+
+Sixteen z values per store. The span drawers get nothing out of eight
+lanes, their texel fetches are scalar loads either way.
+=============
+*/
+static SIMD_AVX2 void D_DrawZSpansAVX2(espan_t* pspan) {
+    i32 count, izistep;
+    i32 izi;
+    i16* pdest;
+    double zi;
+    float du, dv;
+    __m256i lo, hi, z, step;
+
+    // FIXME: check for clamping/range problems
+    // we count on FP exceptions being turned off to avoid range problems
+    izistep = (i32) (d_zistepu * 0x8000 * 0x10000);
+    step = _mm256_set1_epi32((i32) ((u32) izistep * 16));
+
+    do {
+        pdest = d_pzbuffer + (d_zwidth * pspan->v) + pspan->u;
+
+        count = pspan->count;
+
+        // calculate the initial 1/z
+        du = (float) pspan->u;
+        dv = (float) pspan->v;
+
+        zi = d_ziorigin + dv * d_zistepv + du * d_zistepu;
+        // we count on FP exceptions being turned off to avoid range problems
+        izi = (i32) (zi * 0x8000 * 0x10000);
+
+        if ((intptr_t) pdest & 0x02) {
+            *pdest++ = (i16) (izi >> 16);
+            izi += izistep;
+            count--;
+        }
+
+        if (count >= 16) {
+            // packs works within 128 bit halves, so lo holds pixels 0-3 and
+            // 8-11, hi holds 4-7 and 12-15
+            lo = _mm256_setr_epi32(0, 1, 2, 3, 8, 9, 10, 11);
+            lo = _mm256_mullo_epi32(lo, _mm256_set1_epi32(izistep));
+            lo = _mm256_add_epi32(lo, _mm256_set1_epi32(izi));
+            hi = _mm256_add_epi32(
+                lo, _mm256_set1_epi32((i32) ((u32) izistep * 4)));
+            do {
+                z = _mm256_packs_epi32(_mm256_srai_epi32(lo, 16),
+                                       _mm256_srai_epi32(hi, 16));
+                z = _mm256_or_si256(
+                    z, _mm256_srai_epi32(_mm256_slli_epi32(z, 16), 16));
+                _mm256_storeu_si256((__m256i*) pdest, z);
+                lo = _mm256_add_epi32(lo, step);
+                hi = _mm256_add_epi32(hi, step);
+                izi = (i32) ((u32) izi + (u32) izistep * 16);
+                pdest += 16;
+                count -= 16;
+            } while (count >= 16);
+        }
+
+        if (count >= 8) {
+            V4_StoreZ8(pdest,
+                       V4_Ramp(izi, izistep),
+                       V4_Ramp((i32) ((u32) izi + (u32) izistep * 4), izistep));
+            izi = (i32) ((u32) izi + (u32) izistep * 8);
+            pdest += 8;
+            count -= 8;
+        }
+
+        D_ZSpanPairs(pdest, izi, izistep, count);
+
+    } while ((pspan = pspan->pnext) != NULL);
+}
+
+#endif // SIMD_SSE2
+
+
+/*
+=============
+D_SelectSpanDrawers
+=============
+*/
+void D_SelectSpanDrawers(void) {
+    d_drawspans = D_DrawSpans8;
+    d_drawzspans = D_DrawZSpans;
+    d_drawersname = "C";
+    R_SelectSurfaceDrawers(d_simd.value != 0);
+    R_SelectAliasDrawers(d_simd.value != 0);
+    R_SelectVisibleSetCull(d_simd.value != 0);
+
+    if (!d_simd.value)
+        return;
+
+#ifdef SIMD_VECTOR
+    d_drawspans = D_DrawSpans8V;
+    d_drawzspans = D_DrawZSpansV;
+#if defined(SIMD_SSE2)
+    d_drawersname = "SSE2";
+    if (d_hasavx2 && d_simd.value != 2) {
+        d_drawzspans = D_DrawZSpansAVX2;
+        d_drawersname = "AVX2";
+    }
+#else
+    d_drawersname = "NEON";
+#endif
+#endif
+}
+
+/*
+=============
+D_CompareSpans
+
+Draws the spans again with the C drawers into the compare buffers and
+counts the pixels that came out different
+=============
+*/
+void D_CompareSpans(espan_t* pspan, i32 kind) {
+    pixel_t* viewbuffer;
+    i16* zbuffer;
+    i32 i, offset;
+
+    viewbuffer = d_viewbuffer;
+    zbuffer = d_pzbuffer;
+    d_viewbuffer = d_compareview;
+    d_pzbuffer = d_comparez;
+
+    if (kind == DS_SPANS)
+        D_DrawSpans8(pspan);
+    D_DrawZSpans(pspan);
+
+    d_viewbuffer = viewbuffer;
+    d_pzbuffer = zbuffer;
+
+    for (; pspan; pspan = pspan->pnext) {
+        if (kind == DS_SPANS) {
+            offset = screenwidth * pspan->v + pspan->u;
+            for (i = 0; i < pspan->count; i++) {
+                if (d_viewbuffer[offset + i] != d_compareview[offset + i])
+                    d_comparediffs++;
+            }
+            d_comparepixels += pspan->count;
+        }
+
+        offset = d_zwidth * pspan->v + pspan->u;
+        for (i = 0; i < pspan->count; i++) {
+            if (d_pzbuffer[offset + i] != d_comparez[offset + i])
+                d_comparezdiffs++;
+        }
+        d_comparezpixels += pspan->count;
+    }
+}
+
+/*
+=============
+D_SpanCompare_f
+
+Renders a turn around the current view with the span drawers checked
+against the C ones
+=============
+*/
+static void D_SpanCompare_f(void) {
+    float startangle;
+    i32 i;
+
+    if (cls.state != ca_connected || cls.signon != SIGNONS) {
+        Con_Printf("Not playing a map\n");
+        return;
+    }
+
+    d_compareview = Q_malloc(MAXWIDTH * MAXHEIGHT * sizeof(*d_compareview));
+    d_comparez = Q_malloc(MAXWIDTH * MAXHEIGHT * sizeof(*d_comparez));
+    if (!d_compareview || !d_comparez) {
+        Con_Printf("Not enough memory for the compare buffers\n");
+        Q_free(d_compareview);
+        Q_free(d_comparez);
+        return;
+    }
+
+    d_comparepixels = 0;
+    d_comparediffs = 0;
+    d_comparezpixels = 0;
+    d_comparezdiffs = 0;
+
+    startangle = r_refdef.viewangles[1];
+    d_spancompare = true;
+    for (i = 0; i < 16; i++) {
+        r_refdef.viewangles[1] = i / 16.0 * 360.0;
+        VID_LockBuffer();
+        R_RenderView();
+        VID_UnlockBuffer();
+    }
+    d_spancompare = false;
+    r_refdef.viewangles[1] = startangle;
+
+    Q_free(d_compareview);
+    Q_free(d_comparez);
+
+    Con_Printf("%s span drawers against C:\n", d_drawersname);
+    Con_Printf("textured: %i pixels, %i differ\n", d_comparepixels,
+               d_comparediffs);
+    Con_Printf("z: %i pixels, %i differ\n", d_comparezpixels,
+               d_comparezdiffs);
+}
+
+/*
+=============
+D_InitSIMD
+=============
+*/
+void D_InitSIMD(void) {
+    Cvar_RegisterVariable(&d_simd);
+    Cmd_AddCommand("spancompare", D_SpanCompare_f);
+
+    d_hasavx2 = SDL_HasAVX2() == SDL_TRUE;
+}
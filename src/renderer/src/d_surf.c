@@ -18,39 +18,112 @@
  * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
  */
 // d_surf.c: rasterization driver surface heap manager
+//
+// The surface cache is a heap of blocks, every block owned by one surface
+// mip level or free. Free blocks are kept coalesced and sorted into size
+// class bins, so allocation takes the first block that fits from the
+// smallest bin that can hold it. When none fits, blocks are evicted in
+// least recently drawn order until enough room frees up next to each
+// other. Surfaces drawn this frame only go once everything older is gone,
+// and that is what sets r_cache_thrash.
 
 
 #include "d_local.h"
 #include "r_local.h"
+#include "cmd.h"
 #include "console.h"
+#include "profiler.h"
 #include "sys.h"
+#include "zone.h"
+#include <SDL_atomic.h>
+#include <math.h>
 
 
+#define GUARDSIZE 4
+
+#define SC_MINFRAGMENT 256 // smaller leftovers stay with the block
+#define SC_BINSHIFT    2   // four bins per power of two
+#define SC_NUMBINS     96
+#define SC_MINSIZE     (256 * 1024)
+#define SC_MAXSIZE     (1024 * 1024 * 1024)
+
+// what D_SCTake may evict to make room
+#define SC_EVICTANY  0
+#define SC_EVICTOLD  1 // only blocks not drawn this frame
+#define SC_EVICTNONE 2 // nothing, and the block goes last in use order
+
+#define D_MAXBUILDS   1024 // surfaces built in parallel at once
+#define D_AHEADBUILDS 16   // off screen surfaces built per frame
+
+typedef struct {
+    i32 hits;      // surfaces found in the cache
+    i32 misses;    // surfaces built when they were drawn
+    i32 prebuilt;  // surfaces built in parallel before drawing
+    i32 ahead;     // off screen surfaces built in parallel
+    i32 evictions; // blocks taken from other surfaces
+    i32 thrashed;  // of those, blocks drawn earlier in the same frame
+} scstats_t;
+
+typedef struct {
+    msurface_t* surface;
+    i32 miplevel;
+    surfcache_t* cache; // NULL if it isn't built after all
+    texture_t* texture;
+    i32 lightadj[MAXLIGHTMAPS];
+    qboolean ahead;
+} surfbuild_t;
+
 float surfscale;
 qboolean r_cache_thrash; // set if surface cache is thrashing
 
+cvar_t d_surfcachesize = {"d_surfcachesize", "0", true};
+cvar_t d_prebuild = {"d_prebuild", "1"};
+
 i32 sc_size;
-surfcache_t *sc_rover, *sc_base;
+surfcache_t* sc_base;
 
-#define GUARDSIZE 4
+static i32 sc_allocsize; // what D_SurfaceCacheForRes asked for
+static surfcache_t* sc_bins[SC_NUMBINS];
+static surfcache_t sc_lru; // lrunext is the most recently drawn
 
+static scstats_t sc_frame; // being counted
+static scstats_t sc_last;  // the last whole frame
+static scstats_t sc_total;
 
-i32 D_SurfaceCacheForRes(i32 width, i32 height) {
-    i32 size, pix;
+static surfbuild_t d_builds[D_MAXBUILDS];
+static i32 d_numbuilds;
+static SDL_atomic_t d_nextbuild;
+static i32 d_aheadframe;
 
-    if (COM_CheckParm("-surfcachesize")) {
-        size = Q_atoi(com_argv[COM_CheckParm("-surfcachesize") + 1]) * 1024;
-        return size;
-    }
 
-    size = SURFCACHE_SIZE_AT_320X200;
+/*
+================
+D_SurfaceCacheForRes
 
-    pix = width * height;
-    if (pix > 64000)
-        size += (pix - 64000) * 3;
+d_surfcachesize or -surfcachesize in kilobytes if set, otherwise the
+320x200 size scaled with the number of pixels
+================
+*/
+i32 D_SurfaceCacheForRes(i32 width, i32 height) {
+    double size;
+    i32 pix;
 
+    if (d_surfcachesize.value > 0) {
+        size = d_surfcachesize.value * 1024;
+    } else if (COM_CheckParm("-surfcachesize")) {
+        size = Q_atoi(com_argv[COM_CheckParm("-surfcachesize") + 1]) * 1024;
+    } else {
+        size = SURFCACHE_SIZE_AT_320X200;
+        pix = width * height;
+        if (pix > 64000)
+            size = size * pix / 64000;
+    }
 
-    return size;
+    if (size < SC_MINSIZE)
+        size = SC_MINSIZE;
+    if (size > SC_MAXSIZE)
+        size = SC_MAXSIZE;
+    return (i32) size;
 }
 
 void D_CheckCacheGuard(void) {
@@ -75,26 +148,209 @@ void D_ClearCacheGuard(void) {
 
 /*
 ================
-D_InitCaches
+D_SCBin
 
+Bins split every power of two into four, the first one takes every block
+smaller than SC_MINFRAGMENT
 ================
 */
-void D_InitCaches(void* buffer, i32 size) {
+static i32 D_SCBin(i32 size) {
+    i32 shift, bin;
+
+    if (size < SC_MINFRAGMENT)
+        return 0;
+    shift = D_log2(size) - SC_BINSHIFT;
+    bin = ((shift - 6) << SC_BINSHIFT) + ((size >> shift) & 3);
+    return bin < SC_NUMBINS ? bin : SC_NUMBINS - 1;
+}
 
-    if (!msg_suppress_1)
-        Con_Printf("%ik surface cache\n", size / 1024);
+static void D_SCLinkFree(surfcache_t* block) {
+    i32 bin = D_SCBin(block->size);
 
-    sc_size = size - GUARDSIZE;
-    sc_base = (surfcache_t*) buffer;
-    sc_rover = sc_base;
+    block->lruprev = NULL;
+    block->lrunext = sc_bins[bin];
+    if (sc_bins[bin])
+        sc_bins[bin]->lruprev = block;
+    sc_bins[bin] = block;
+}
+
+static void D_SCUnlinkFree(surfcache_t* block) {
+    if (block->lruprev)
+        block->lruprev->lrunext = block->lrunext;
+    else
+        sc_bins[D_SCBin(block->size)] = block->lrunext;
+    if (block->lrunext)
+        block->lrunext->lruprev = block->lruprev;
+}
+
+// puts block next to after in use order, after being the more recent
+static void D_SCLinkUsed(surfcache_t* after, surfcache_t* block) {
+    block->lruprev = after;
+    block->lrunext = after->lrunext;
+    after->lrunext->lruprev = block;
+    after->lrunext = block;
+}
+
+static void D_SCUnlinkUsed(surfcache_t* block) {
+    block->lruprev->lrunext = block->lrunext;
+    block->lrunext->lruprev = block->lruprev;
+}
+
+/*
+================
+D_SCMerge
+
+Joins block with the one after it in memory
+================
+*/
+static void D_SCMerge(surfcache_t* block) {
+    surfcache_t* next = block->next;
+
+    block->size += next->size;
+    block->next = next->next;
+    if (block->next)
+        block->next->prev = block;
+}
+
+/*
+================
+D_SCRelease
+
+Frees a block and joins it with free neighbours, returns the free block it
+ends up in
+================
+*/
+static surfcache_t* D_SCRelease(surfcache_t* block) {
+    block->used = false;
+    block->owner = NULL;
+
+    if (block->next && !block->next->used) {
+        D_SCUnlinkFree(block->next);
+        D_SCMerge(block);
+    }
+    if (block->prev && !block->prev->used) {
+        block = block->prev;
+        D_SCUnlinkFree(block);
+        D_SCMerge(block);
+    }
+
+    D_SCLinkFree(block);
+    return block;
+}
+
+/*
+================
+D_SCFindFree
+================
+*/
+static surfcache_t* D_SCFindFree(i32 size) {
+    surfcache_t* block;
+    i32 bin;
+
+    // the first bin can hold blocks that are too small
+    bin = D_SCBin(size);
+    for (block = sc_bins[bin]; block; block = block->lrunext)
+        if (block->size >= size)
+            return block;
+
+    for (bin++; bin < SC_NUMBINS; bin++)
+        if (sc_bins[bin])
+            return sc_bins[bin];
+    return NULL;
+}
+
+/*
+================
+D_SCEvict
+
+Frees the least recently drawn block, returns the free block it ends up in
+or NULL if there was nothing left to evict
+================
+*/
+static surfcache_t* D_SCEvict(void) {
+    surfcache_t* block = sc_lru.lruprev;
+
+    if (block == &sc_lru)
+        return NULL;
+
+    D_SCUnlinkUsed(block);
+    if (block->owner)
+        *block->owner = NULL;
+
+    sc_frame.evictions++;
+    if (block->lastframe == r_framecount) {
+        sc_frame.thrashed++;
+        r_cache_thrash = true;
+    }
+
+    return D_SCRelease(block);
+}
+
+/*
+================
+D_SCReset
+
+Makes the whole cache one free block
+================
+*/
+static void D_SCReset(void) {
+    i32 i;
+
+    for (i = 0; i < SC_NUMBINS; i++)
+        sc_bins[i] = NULL;
+    sc_lru.lrunext = &sc_lru;
+    sc_lru.lruprev = &sc_lru;
 
     sc_base->next = NULL;
+    sc_base->prev = NULL;
     sc_base->owner = NULL;
+    sc_base->used = false;
     sc_base->size = sc_size;
+    D_SCLinkFree(sc_base);
+}
+
+
+/*
+================
+D_InitCaches
+
+(Re)allocates the surface cache at the size D_SurfaceCacheForRes gives for
+the current mode
+================
+*/
+void D_InitCaches(void) {
+    i32 size;
+
+    D_FlushCaches();
+    Q_free(sc_base);
+
+    size = D_SurfaceCacheForRes(vid.width, vid.height);
+    sc_base = Q_malloc(size);
+    if (!sc_base)
+        Sys_Error("Not enough memory for a %ik surface cache", size / 1024);
+
+    if (!msg_suppress_1)
+        Con_Printf("%ik surface cache\n", size / 1024);
 
+    sc_allocsize = size;
+    sc_size = size - GUARDSIZE;
+    D_SCReset();
     D_ClearCacheGuard();
 }
 
+/*
+================
+D_CheckCacheSize
+
+Follows changes to d_surfcachesize, called at the start of a frame when no
+cached surface is in use
+================
+*/
+void D_CheckCacheSize(void) {
+    if (D_SurfaceCacheForRes(vid.width, vid.height) != sc_allocsize)
+        D_InitCaches();
+}
+
 
 /*
 ==================
@@ -112,20 +368,20 @@ void D_FlushCaches(void) {
             *c->owner = NULL;
     }
 
-    sc_rover = sc_base;
-    sc_base->next = NULL;
-    sc_base->owner = NULL;
-    sc_base->size = sc_size;
+    D_SCReset();
 }
 
 /*
 =================
-D_SCAlloc
+D_SCTake
+
+Takes a block for size bytes of surface, evicting what the policy allows,
+returns NULL if that isn't enough
 =================
 */
-surfcache_t* D_SCAlloc(i32 width, i32 size) {
+static surfcache_t* D_SCTake(i32 width, i32 size, i32 evict) {
     surfcache_t* new;
-    qboolean wrapped_this_time;
+    surfcache_t* rest;
 
     if ((width < 0) || (width > 256))
         Sys_Error("D_SCAlloc: bad cache width %d\n", width);
@@ -133,49 +389,51 @@ surfcache_t* D_SCAlloc(i32 width, i32 size) {
     if ((size <= 0) || (size > 0x10000))
         Sys_Error("D_SCAlloc: bad cache size %d\n", size);
 
-    size = (i32) &((surfcache_t*) 0)->data[size];
-    size = (size + 3) & ~3;
+    size = (i32) (intptr_t) &((surfcache_t*) 0)->data[size];
+    size = (size + 7) & ~7; // keeps the headers aligned
     if (size > sc_size)
         Sys_Error("D_SCAlloc: %i > cache size", size);
 
-    // if there is not size bytes after the rover, reset to the start
-    wrapped_this_time = false;
-
-    if (!sc_rover || (byte*) sc_rover - (byte*) sc_base > sc_size - size) {
-        if (sc_rover) {
-            wrapped_this_time = true;
-        }
-        sc_rover = sc_base;
-    }
-
-    // colect and free surfcache_t blocks until the rover block is large enough
-    new = sc_rover;
-    if (sc_rover->owner)
-        *sc_rover->owner = NULL;
-
-    while (new->size < size) {
-        // free another
-        sc_rover = sc_rover->next;
-        if (!sc_rover)
+    // evict until something is big enough
+    new = D_SCFindFree(size);
+    while (!new) {
+        if (evict == SC_EVICTNONE)
+            return NULL;
+        if (evict == SC_EVICTOLD && sc_lru.lruprev->lastframe == r_framecount)
+            return NULL;
+        new = D_SCEvict();
+        if (!new)
             Sys_Error("D_SCAlloc: hit the end of memory");
-        if (sc_rover->owner)
-            *sc_rover->owner = NULL;
-
-        new->size += sc_rover->size;
-        new->next = sc_rover->next;
+        if (new->size < size)
+            new = NULL;
     }
-
-    // create a fragment out of any leftovers
-    if (new->size - size > 256) {
-        sc_rover = (surfcache_t*) ((byte*) new + size);
-        sc_rover->size = new->size - size;
-        sc_rover->next = new->next;
-        sc_rover->width = 0;
-        sc_rover->owner = NULL;
-        new->next = sc_rover;
+    D_SCUnlinkFree(new);
+
+    // create a fragment out of any leftovers, its neighbours are in use
+    if (new->size - size > SC_MINFRAGMENT) {
+        rest = (surfcache_t*) ((byte*) new + size);
+        rest->size = new->size - size;
+        rest->next = new->next;
+        rest->prev = new;
+        rest->owner = NULL;
+        rest->used = false;
+        if (rest->next)
+            rest->next->prev = rest;
+        new->next = rest;
         new->size = size;
-    } else
-        sc_rover = new->next;
+        D_SCLinkFree(rest);
+    }
+
+    new->used = true;
+    new->queued = false;
+    if (evict == SC_EVICTNONE) {
+        // built ahead of time, the first to go until it is drawn
+        new->lastframe = 0;
+        D_SCLinkUsed(sc_lru.lruprev, new);
+    } else {
+        new->lastframe = r_framecount;
+        D_SCLinkUsed(&sc_lru, new);
+    }
 
     new->width = width;
     // DEBUG
@@ -184,17 +442,110 @@ surfcache_t* D_SCAlloc(i32 width, i32 size) {
 
     new->owner = NULL; // should be set properly after return
 
-    if (d_roverwrapped) {
-        if (wrapped_this_time || (sc_rover >= d_initial_rover))
-            r_cache_thrash = true;
-    } else if (wrapped_this_time) {
-        d_roverwrapped = true;
-    }
-
     D_CheckCacheGuard(); // DEBUG
     return new;
 }
 
+/*
+=================
+D_SCAlloc
+=================
+*/
+surfcache_t* D_SCAlloc(i32 width, i32 size) {
+    return D_SCTake(width, size, SC_EVICTANY);
+}
+
+/*
+=================
+D_SCTouch
+
+Makes the block the most recently drawn
+=================
+*/
+static void D_SCTouch(surfcache_t* cache) {
+    cache->lastframe = r_framecount;
+    if (sc_lru.lrunext == cache)
+        return;
+    D_SCUnlinkUsed(cache);
+    D_SCLinkUsed(&sc_lru, cache);
+}
+
+
+/*
+=================
+D_EndCacheFrame
+
+Called once the surfaces of a frame are drawn
+=================
+*/
+void D_EndCacheFrame(void) {
+    PROF_COUNT("surfcache hits", sc_frame.hits);
+    PROF_COUNT("surfcache misses", sc_frame.misses);
+    PROF_COUNT("surfcache prebuilt", sc_frame.prebuilt);
+    PROF_COUNT("surfcache ahead", sc_frame.ahead);
+    PROF_COUNT("surfcache evictions", sc_frame.evictions);
+
+    sc_last = sc_frame;
+    sc_total.hits += sc_frame.hits;
+    sc_total.misses += sc_frame.misses;
+    sc_total.prebuilt += sc_frame.prebuilt;
+    sc_total.ahead += sc_frame.ahead;
+    sc_total.evictions += sc_frame.evictions;
+    sc_total.thrashed += sc_frame.thrashed;
+    memset(&sc_frame, 0, sizeof(sc_frame));
+}
+
+static void D_PrintCacheStats(const char* name, const scstats_t* stats) {
+    i32 looked = stats->hits + stats->misses;
+
+    Con_Printf("%s: %i hits, %i misses (%.1f%% hit), %i evicted, "
+               "%i of them drawn the same frame\n",
+               name, stats->hits, stats->misses,
+               looked ? stats->hits * 100.0 / looked : 0.0, stats->evictions,
+               stats->thrashed);
+    Con_Printf("%s: %i built in parallel, %i of them ahead\n", name,
+               stats->prebuilt + stats->ahead, stats->ahead);
+}
+
+/*
+=================
+D_SurfCache_f
+
+Prints how full the cache is and its hit counts, "surfcache reset" starts
+the totals over
+=================
+*/
+void D_SurfCache_f(void) {
+    surfcache_t* c;
+    i32 used, numused, avail, numavail, largest;
+
+    if (Cmd_Argc() > 1 && !Q_strcmp(Cmd_Argv(1), "reset")) {
+        memset(&sc_total, 0, sizeof(sc_total));
+        return;
+    }
+    if (!sc_base)
+        return;
+
+    used = numused = avail = numavail = largest = 0;
+    for (c = sc_base; c; c = c->next) {
+        if (c->used) {
+            used += c->size;
+            numused++;
+        } else {
+            avail += c->size;
+            numavail++;
+            if (c->size > largest)
+                largest = c->size;
+        }
+    }
+
+    Con_Printf("%ik surface cache\n", sc_size / 1024);
+    Con_Printf("%ik in %i surfaces, %ik free in %i blocks, largest %ik\n",
+               used / 1024, numused, avail / 1024, numavail, largest / 1024);
+    D_PrintCacheStats("last frame", &sc_last);
+    D_PrintCacheStats("total", &sc_total);
+}
+
 
 /*
 =================
@@ -205,9 +556,8 @@ void D_SCDump(void) {
     surfcache_t* test;
 
     for (test = sc_base; test; test = test->next) {
-        if (test == sc_rover)
-            Sys_Printf("ROVER:\n");
-        printf("%p : %i bytes     %i width\n", test, test->size, test->width);
+        printf("%p : %i bytes     %i width     %s %i\n", test, test->size,
+               test->width, test->used ? "drawn" : "free", test->lastframe);
     }
 }
 
@@ -241,12 +591,35 @@ i32 D_log2(i32 num) {
 
 /*
 ================
-D_CacheSurface
+D_CacheValid
+
+True if the cached copy matches the texture and light levels in r_drawsurf
 ================
 */
-surfcache_t* D_CacheSurface(msurface_t* surface, i32 miplevel) {
-    surfcache_t* cache;
+static qboolean D_CacheValid(msurface_t* surface, surfcache_t* cache) {
+    if (!cache || cache->texture != r_drawsurf.texture ||
+        cache->lightadj[0] != r_drawsurf.lightadj[0] ||
+        cache->lightadj[1] != r_drawsurf.lightadj[1] ||
+        cache->lightadj[2] != r_drawsurf.lightadj[2] ||
+        cache->lightadj[3] != r_drawsurf.lightadj[3]) {
+        return false;
+    }
 
+    // dynamic lights are only good for the frame they were built in
+    if (surface->dlightframe == r_framecount)
+        return cache->dlight == r_framecount;
+    return !cache->dlight;
+}
+
+/*
+================
+D_CacheFresh
+
+Sets up the texture and light levels of r_drawsurf and checks them against
+the cached copy
+================
+*/
+static qboolean D_CacheFresh(msurface_t* surface, surfcache_t* cache) {
     //
     // if the surface is animating or flashing, flush the cache
     //
@@ -259,57 +632,265 @@ surfcache_t* D_CacheSurface(msurface_t* surface, i32 miplevel) {
     //
     // see if the cache holds apropriate data
     //
-    cache = surface->cachespots[miplevel];
+    return D_CacheValid(surface, cache);
+}
 
-    if (cache && !cache->dlight && surface->dlightframe != r_framecount &&
-        cache->texture == r_drawsurf.texture &&
-        cache->lightadj[0] == r_drawsurf.lightadj[0] &&
-        cache->lightadj[1] == r_drawsurf.lightadj[1] &&
-        cache->lightadj[2] == r_drawsurf.lightadj[2] &&
-        cache->lightadj[3] == r_drawsurf.lightadj[3])
-        return cache;
+/*
+================
+D_SurfaceCached
 
-    //
-    // determine shape of surface
-    //
-    surfscale = 1.0 / (1 << miplevel);
-    r_drawsurf.surfmip = miplevel;
-    r_drawsurf.surfwidth = surface->extents[0] >> miplevel;
-    r_drawsurf.rowbytes = r_drawsurf.surfwidth;
-    r_drawsurf.surfheight = surface->extents[1] >> miplevel;
+True if D_CacheSurface can return the surface without writing to the cache
+================
+*/
+qboolean D_SurfaceCached(msurface_t* surface, i32 miplevel) {
+    return D_CacheFresh(surface, surface->cachespots[miplevel]);
+}
 
-    //
-    // allocate memory if needed
-    //
+/*
+================
+D_SetupCache
+
+Gets the block for the surface, reusing the one it has, and stamps it with
+the texture and light levels in r_drawsurf. NULL if evict doesn't allow
+taking one
+================
+*/
+static surfcache_t* D_SetupCache(msurface_t* surface, i32 miplevel,
+                                 i32 evict) {
+    surfcache_t* cache;
+    i32 width, height;
+
+    cache = surface->cachespots[miplevel];
     if (!cache) // if a texture just animated, don't reallocate it
     {
-        cache = D_SCAlloc(r_drawsurf.surfwidth,
-                          r_drawsurf.surfwidth * r_drawsurf.surfheight);
+        width = surface->extents[0] >> miplevel;
+        height = surface->extents[1] >> miplevel;
+        cache = D_SCTake(width, width * height, evict);
+        if (!cache)
+            return NULL;
         surface->cachespots[miplevel] = cache;
         cache->owner = &surface->cachespots[miplevel];
-        cache->mipscale = surfscale;
+        cache->mipscale = 1.0 / (1 << miplevel);
+    } else {
+        D_SCTouch(cache);
     }
 
     if (surface->dlightframe == r_framecount)
-        cache->dlight = 1;
+        cache->dlight = r_framecount;
     else
         cache->dlight = 0;
 
-    r_drawsurf.surfdat = (pixel_t*) cache->data;
-
     cache->texture = r_drawsurf.texture;
     cache->lightadj[0] = r_drawsurf.lightadj[0];
     cache->lightadj[1] = r_drawsurf.lightadj[1];
     cache->lightadj[2] = r_drawsurf.lightadj[2];
     cache->lightadj[3] = r_drawsurf.lightadj[3];
 
-    //
-    // draw and light the surface texture
-    //
+    return cache;
+}
+
+/*
+================
+D_DrawCache
+
+Lights and draws the surface texture into its block, on any thread
+================
+*/
+static void D_DrawCache(msurface_t* surface, i32 miplevel,
+                        surfcache_t* cache) {
     r_drawsurf.surf = surface;
+    r_drawsurf.surfmip = miplevel;
+    r_drawsurf.surfwidth = surface->extents[0] >> miplevel;
+    r_drawsurf.rowbytes = r_drawsurf.surfwidth;
+    r_drawsurf.surfheight = surface->extents[1] >> miplevel;
+    r_drawsurf.surfdat = (pixel_t*) cache->data;
+    r_drawsurf.texture = cache->texture;
+    r_drawsurf.lightadj[0] = cache->lightadj[0];
+    r_drawsurf.lightadj[1] = cache->lightadj[1];
+    r_drawsurf.lightadj[2] = cache->lightadj[2];
+    r_drawsurf.lightadj[3] = cache->lightadj[3];
 
-    c_surf++;
     R_DrawSurface();
+}
+
+/*
+================
+D_CacheSurface
+================
+*/
+surfcache_t* D_CacheSurface(msurface_t* surface, i32 miplevel) {
+    surfcache_t* cache;
+
+    cache = surface->cachespots[miplevel];
+    if (D_CacheFresh(surface, cache)) {
+        sc_frame.hits++;
+        D_SCTouch(cache);
+        return cache;
+    }
+    sc_frame.misses++;
+
+    surfscale = 1.0 / (1 << miplevel);
+    cache = D_SetupCache(surface, miplevel, SC_EVICTANY);
+
+    c_surf++;
+    D_DrawCache(surface, miplevel, cache);
+
+    return cache;
+}
+
+static void D_AddBuild(msurface_t* surface, i32 miplevel, qboolean ahead) {
+    surfbuild_t* build;
+
+    build = &d_builds[d_numbuilds++];
+    build->surface = surface;
+    build->miplevel = miplevel;
+    build->cache = NULL;
+    build->texture = r_drawsurf.texture;
+    build->lightadj[0] = r_drawsurf.lightadj[0];
+    build->lightadj[1] = r_drawsurf.lightadj[1];
+    build->lightadj[2] = r_drawsurf.lightadj[2];
+    build->lightadj[3] = r_drawsurf.lightadj[3];
+    build->ahead = ahead;
+}
+
+/*
+================
+D_QueueSurfaceBuild
+
+Queues the surface for D_BuildQueuedSurfaces unless it is cached, with the
+texture of the current entity
+================
+*/
+void D_QueueSurfaceBuild(msurface_t* surface, i32 miplevel) {
+    surfcache_t* cache;
+
+    cache = surface->cachespots[miplevel];
+    if (D_CacheFresh(surface, cache)) {
+        // keep it from being evicted for the missing ones
+        D_SCTouch(cache);
+        return;
+    }
+    if (d_numbuilds < D_MAXBUILDS)
+        D_AddBuild(surface, miplevel, false);
+    // otherwise D_CacheSurface will build it
+}
+
+/*
+================
+D_QueueAheadSurfaces
+
+Queues world surfaces of the potentially visible set that are off screen,
+at the mip level their distance suggests, so they are ready when the view
+turns to them. They only go into free cache memory
+================
+*/
+static void D_QueueAheadSurfaces(void) {
+    msurface_t** mark;
+    msurface_t* surf;
+    mleaf_t* leaf;
+    i32 queued, i, c, miplevel;
+    float dist;
+
+    currententity = &cl_entities[0];
+    queued = 0;
+    for (i = 0; i < r_visset.numleafs; i++) {
+        leaf = r_visset.leafs[i];
+        mark = leaf->firstmarksurface;
+        for (c = leaf->nummarksurfaces; c; c--, mark++) {
+            surf = *mark;
+            if (surf->visframe == r_framecount || // walked this frame
+                surf->dlightframe == r_framecount ||
+                (surf->flags & (SURF_DRAWSKY | SURF_DRAWTURB))) {
+                continue;
+            }
+
+            dist = DotProduct(r_origin, surf->plane->normal) -
+                   surf->plane->dist;
+            dist = fabs(dist);
+            if (dist < 1)
+                dist = 1;
+            miplevel = D_MipLevelForScale(scale_for_mip *
+                                          surf->texinfo->mipadjust / dist);
+
+            if (D_CacheFresh(surf, surf->cachespots[miplevel]))
+                continue;
+            D_AddBuild(surf, miplevel, true);
+            if (++queued == D_AHEADBUILDS || d_numbuilds == D_MAXBUILDS)
+                return;
+        }
+    }
+}
+
+static void D_BuildSurfaces(void) {
+    surfbuild_t* build;
+    i32 i;
+
+    while ((i = SDL_AtomicAdd(&d_nextbuild, 1)) < d_numbuilds) {
+        build = &d_builds[i];
+        if (build->cache)
+            D_DrawCache(build->surface, build->miplevel, build->cache);
+    }
+}
+
+/*
+================
+D_BuildQueuedSurfaces
+
+Gives the queued surfaces cache blocks and builds them on every thread.
+Blocks drawn this frame are never evicted for them, the surfaces that don't
+fit are left for D_CacheSurface
+================
+*/
+void D_BuildQueuedSurfaces(void) {
+    surfbuild_t* build;
+    surfcache_t* cache;
+    i32 threads, i;
+
+    threads = D_ThreadCount();
+    if (threads < 2) {
+        d_numbuilds = 0;
+        return;
+    }
+
+    if (d_prebuild.value >= 2 && d_aheadframe != r_framecount) {
+        d_aheadframe = r_framecount;
+        D_QueueAheadSurfaces();
+    }
+    if (!d_numbuilds)
+        return;
+
+    for (i = 0; i < d_numbuilds; i++) {
+        build = &d_builds[i];
+
+        // a surface queued twice is built once, by the first
+        cache = build->surface->cachespots[build->miplevel];
+        if (cache && cache->queued)
+            continue;
+
+        r_drawsurf.texture = build->texture;
+        r_drawsurf.lightadj[0] = build->lightadj[0];
+        r_drawsurf.lightadj[1] = build->lightadj[1];
+        r_drawsurf.lightadj[2] = build->lightadj[2];
+        r_drawsurf.lightadj[3] = build->lightadj[3];
+        build->cache = D_SetupCache(build->surface, build->miplevel,
+                                    build->ahead ? SC_EVICTNONE
+                                                 : SC_EVICTOLD);
+        if (!build->cache)
+            continue;
+
+        build->cache->queued = true;
+        if (build->ahead)
+            sc_frame.ahead++;
+        else
+            sc_frame.prebuilt++;
+        c_surf++;
+    }
+
+    SDL_AtomicSet(&d_nextbuild, 0);
+    D_RunWorkers(D_BuildSurfaces, threads);
 
-    return surface->cachespots[miplevel];
+    for (i = 0; i < d_numbuilds; i++)
+        if (d_builds[i].cache)
+            d_builds[i].cache->queued = false;
+    d_numbuilds = 0;
 }
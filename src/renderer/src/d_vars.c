@@ -33,14 +33,14 @@
 // FIXME: make into one big structure, like cl or sv
 // FIXME: do separately for refresh engine and driver
 
-float d_sdivzstepu, d_tdivzstepu, d_zistepu;
-float d_sdivzstepv, d_tdivzstepv, d_zistepv;
-float d_sdivzorigin, d_tdivzorigin, d_ziorigin;
+D_THREADLOCAL float d_sdivzstepu, d_tdivzstepu, d_zistepu;
+D_THREADLOCAL float d_sdivzstepv, d_tdivzstepv, d_zistepv;
+D_THREADLOCAL float d_sdivzorigin, d_tdivzorigin, d_ziorigin;
 
-fixed16_t sadjust, tadjust, bbextents, bbextentt;
+D_THREADLOCAL fixed16_t sadjust, tadjust, bbextents, bbextentt;
 
-pixel_t* cacheblock;
-i32 cachewidth;
+D_THREADLOCAL pixel_t* cacheblock;
+D_THREADLOCAL i32 cachewidth;
 pixel_t* d_viewbuffer;
 i16* d_pzbuffer;
 u32 d_zrowbytes;
@@ -40,6 +40,10 @@ typedef struct {
 
 static rectdesc_t r_rectdesc;
 
+// the parts of the screen drawn since the last Draw_GetDirty
+static vrect_t draw_dirty[MAX_DIRTYRECTS];
+static i32 draw_numdirty;
+
 byte* draw_chars; // 8*8 graphic characters
 qpic_t* draw_disc;
 qpic_t* draw_backtile;
@@ -122,6 +126,144 @@ void Draw_Init(void) {
 }
 
 
+/*
+================
+Draw_RectsTouch
+
+True if the rects overlap or share an edge
+================
+*/
+static qboolean Draw_RectsTouch(const vrect_t* a, const vrect_t* b) {
+    return a->x <= b->x + b->width && b->x <= a->x + a->width &&
+           a->y <= b->y + b->height && b->y <= a->y + a->height;
+}
+
+static i32 Draw_RectArea(const vrect_t* r) {
+    return r->width * r->height;
+}
+
+/*
+================
+Draw_UnionRect
+================
+*/
+static void Draw_UnionRect(vrect_t* dst, const vrect_t* src) {
+    i32 right, bottom;
+
+    right = dst->x + dst->width;
+    if (right < src->x + src->width)
+        right = src->x + src->width;
+    bottom = dst->y + dst->height;
+    if (bottom < src->y + src->height)
+        bottom = src->y + src->height;
+    if (dst->x > src->x)
+        dst->x = src->x;
+    if (dst->y > src->y)
+        dst->y = src->y;
+    dst->width = right - dst->x;
+    dst->height = bottom - dst->y;
+}
+
+/*
+================
+Draw_FindMerge
+
+The dirty rect that r should be merged into: one it touches, or when the
+list is full the one that grows the least. -1 if r can be added as it is
+================
+*/
+static i32 Draw_FindMerge(const vrect_t* r) {
+    vrect_t u;
+    i32 i, best, grow, bestgrow;
+
+    for (i = 0; i < draw_numdirty; i++) {
+        if (Draw_RectsTouch(&draw_dirty[i], r))
+            return i;
+    }
+    if (draw_numdirty < MAX_DIRTYRECTS)
+        return -1;
+
+    best = 0;
+    bestgrow = 0x7fffffff;
+    for (i = 0; i < draw_numdirty; i++) {
+        u = draw_dirty[i];
+        Draw_UnionRect(&u, r);
+        grow = Draw_RectArea(&u) - Draw_RectArea(&draw_dirty[i]);
+        if (grow < bestgrow) {
+            bestgrow = grow;
+            best = i;
+        }
+    }
+    return best;
+}
+
+/*
+================
+Draw_MarkDirty
+
+Records that a rect of the screen was drawn, so only the changed parts are
+sent to the video texture. Touching rects are merged, so a line of text or
+a row of status bar pics ends up as a single rect
+================
+*/
+void Draw_MarkDirty(i32 x, i32 y, i32 w, i32 h) {
+    vrect_t r;
+    vrect_t* d;
+    i32 i;
+
+    if (x < 0) {
+        w += x;
+        x = 0;
+    }
+    if (y < 0) {
+        h += y;
+        y = 0;
+    }
+    if (x + w > (i32) vid.width)
+        w = vid.width - x;
+    if (y + h > (i32) vid.height)
+        h = vid.height - y;
+    if (w <= 0 || h <= 0)
+        return;
+
+    // drawn over a rect that is dirty already
+    for (i = 0; i < draw_numdirty; i++) {
+        d = &draw_dirty[i];
+        if (x >= d->x && y >= d->y && x + w <= d->x + d->width &&
+            y + h <= d->y + d->height)
+            return;
+    }
+
+    r.x = x;
+    r.y = y;
+    r.width = w;
+    r.height = h;
+
+    // a merged rect can touch others it didn't before
+    while ((i = Draw_FindMerge(&r)) >= 0) {
+        Draw_UnionRect(&r, &draw_dirty[i]);
+        draw_dirty[i] = draw_dirty[--draw_numdirty];
+    }
+    draw_dirty[draw_numdirty++] = r;
+}
+
+/*
+================
+Draw_GetDirty
+
+Copies out the rects drawn since the last call and starts over, returns
+how many there are
+================
+*/
+i32 Draw_GetDirty(vrect_t* rects) {
+    i32 count;
+
+    count = draw_numdirty;
+    Q_memcpy(rects, draw_dirty, count * sizeof(*rects));
+    draw_numdirty = 0;
+    return count;
+}
+
 /*
 ================
 Draw_Character
@@ -161,6 +303,7 @@ void Draw_Character(i32 x, i32 y, i32 num) {
     } else
         drawline = 8;
 
+    Draw_MarkDirty(x, y, 8, drawline);
     dest = vid.buffer + y * vid.width + x;
 
     while (drawline--) {
@@ -223,6 +366,7 @@ void Draw_DebugChar(char num) {
     col = num & 15;
     source = draw_chars + (row << 10) + (col << 3);
 
+    Draw_MarkDirty(312, 0, 8, 8);
     dest = vid.buffer + 312;
 
     while (drawline--) {
@@ -254,6 +398,7 @@ void Draw_Pic(i32 x, i32 y, qpic_t* pic) {
         Sys_Error("Draw_Pic: bad coordinates");
     }
 
+    Draw_MarkDirty(x, y, pic->width, pic->height);
     source = pic->data;
 
     dest = vid.buffer + y * vid.width + x;
@@ -281,6 +426,7 @@ void Draw_TransPic(i32 x, i32 y, qpic_t* pic) {
         Sys_Error("Draw_TransPic: bad coordinates");
     }
 
+    Draw_MarkDirty(x, y, pic->width, pic->height);
     source = pic->data;
 
     dest = vid.buffer + y * vid.width + x;
@@ -335,6 +481,7 @@ void Draw_TransPicTranslate(i32 x, i32 y, qpic_t* pic, byte* translation) {
         Sys_Error("Draw_TransPic: bad coordinates");
     }
 
+    Draw_MarkDirty(x, y, pic->width, pic->height);
     source = pic->data;
 
     dest = vid.buffer + y * vid.width + x;
@@ -420,6 +567,7 @@ void Draw_ConsoleBackground(i32 lines) {
         Draw_CharToConback(ver[x], dest + (x << 3));
 
     // draw the pic
+    Draw_MarkDirty(0, 0, vid.width, lines);
     dest = vid.buffer;
 
     for (y = 0; y < lines; y++, dest += vid.width) {
@@ -497,6 +645,8 @@ void Draw_TileClear(i32 x, i32 y, i32 w, i32 h) {
     byte* psrc;
     vrect_t vr;
 
+    Draw_MarkDirty(x, y, w, h);
+
     r_rectdesc.rect.x = x;
     r_rectdesc.rect.y = y;
     r_rectdesc.rect.width = w;
@@ -558,6 +708,7 @@ void Draw_Fill(i32 x, i32 y, i32 w, i32 h, i32 c) {
     byte* dest;
     i32 u, v;
 
+    Draw_MarkDirty(x, y, w, h);
     dest = vid.buffer + y * vid.width + x;
     for (v = 0; v < h; v++, dest += vid.width)
         for (u = 0; u < w; u++)
@@ -579,6 +730,7 @@ void Draw_FadeScreen(void) {
     S_ExtraUpdate();
     VID_LockBuffer();
 
+    Draw_MarkDirty(0, 0, vid.width, vid.height);
     for (y = 0; y < vid.height; y++) {
         i32 t;
 
@@ -43,7 +43,7 @@ float r_shadelight;
 aliashdr_t* paliashdr;
 finalvert_t* pfinalverts;
 auxvert_t* pauxverts;
-static float ziscale;
+float ziscale;
 static model_t* pmodel;
 
 static vec3_t alias_forward, alias_right, alias_up;
@@ -70,11 +70,19 @@ float r_avertexnormals[NUMVERTEXNORMALS][3] = {
 #include "anorms.h"
 };
 
-void R_AliasTransformAndProjectFinalVerts(finalvert_t* fv, stvert_t* pstverts);
-void R_AliasSetUpTransform(i32 trivial_accept);
+// the light of a vertex by its normal index, set up for the model being
+// drawn; indices past the last normal get no shading
+i32 r_anormallight[256];
+
+// switched to the r_asimd.c versions by R_SelectAliasDrawers
+void (*r_aliasprojectverts)(finalvert_t* fv, trivertx_t* pverts,
+                            stvert_t* pstverts, i32 numverts) =
+    R_AliasTransformAndProjectFinalVerts;
+void (*r_aliastransformverts)(finalvert_t* fv, auxvert_t* av,
+                              trivertx_t* pverts, stvert_t* pstverts,
+                              i32 numverts) = R_AliasTransformFinalVerts;
+
 void R_AliasTransformVector(vec3_t in, vec3_t out);
-void R_AliasTransformFinalVert(finalvert_t* fv, auxvert_t* av,
-                               trivertx_t* pverts, stvert_t* pstverts);
 void R_AliasProjectFinalVert(finalvert_t* fv, auxvert_t* av);
 
 
@@ -250,33 +258,14 @@ General clipped case
 void R_AliasPreparePoints(void) {
     i32 i;
     stvert_t* pstverts;
-    finalvert_t* fv;
-    auxvert_t* av;
     mtriangle_t* ptri;
     finalvert_t* pfv[3];
 
     pstverts = (stvert_t*) ((byte*) paliashdr + paliashdr->stverts);
     r_anumverts = pmdl->numverts;
-    fv = pfinalverts;
-    av = pauxverts;
 
-    for (i = 0; i < r_anumverts; i++, fv++, av++, r_apverts++, pstverts++) {
-        R_AliasTransformFinalVert(fv, av, r_apverts, pstverts);
-        if (av->fv[2] < ALIAS_Z_CLIP_PLANE)
-            fv->flags |= ALIAS_Z_CLIP;
-        else {
-            R_AliasProjectFinalVert(fv, av);
-
-            if (fv->v[0] < r_refdef.aliasvrect.x)
-                fv->flags |= ALIAS_LEFT_CLIP;
-            if (fv->v[1] < r_refdef.aliasvrect.y)
-                fv->flags |= ALIAS_TOP_CLIP;
-            if (fv->v[0] > r_refdef.aliasvrectright)
-                fv->flags |= ALIAS_RIGHT_CLIP;
-            if (fv->v[1] > r_refdef.aliasvrectbottom)
-                fv->flags |= ALIAS_BOTTOM_CLIP;
-        }
-    }
+    (*r_aliastransformverts)(pfinalverts, pauxverts, r_apverts, pstverts,
+                             r_anumverts);
 
     //
     // clip and draw all triangles
@@ -385,9 +374,6 @@ R_AliasTransformFinalVert
 */
 void R_AliasTransformFinalVert(finalvert_t* fv, auxvert_t* av,
                                trivertx_t* pverts, stvert_t* pstverts) {
-    i32 temp;
-    float lightcos, *plightnormal;
-
     av->fv[0] = DotProduct(pverts->v, aliastransform[0]) + aliastransform[0][3];
     av->fv[1] = DotProduct(pverts->v, aliastransform[1]) + aliastransform[1][3];
     av->fv[2] = DotProduct(pverts->v, aliastransform[2]) + aliastransform[2][3];
@@ -396,22 +382,49 @@ void R_AliasTransformFinalVert(finalvert_t* fv, auxvert_t* av,
     fv->v[3] = pstverts->t;
 
     fv->flags = pstverts->onseam;
+    fv->v[4] = r_anormallight[pverts->lightnormalindex];
+}
 
-    // lighting
-    plightnormal = r_avertexnormals[pverts->lightnormalindex];
-    lightcos = DotProduct(plightnormal, r_plightvec);
-    temp = r_ambientlight;
+/*
+================
+R_AliasSetClipFlags
 
-    if (lightcos < 0) {
-        temp += (i32) (r_shadelight * lightcos);
+Flags a projected vertex for each side of the view it is off
+================
+*/
+void R_AliasSetClipFlags(finalvert_t* fv) {
+    if (fv->v[0] < r_refdef.aliasvrect.x)
+        fv->flags |= ALIAS_LEFT_CLIP;
+    if (fv->v[1] < r_refdef.aliasvrect.y)
+        fv->flags |= ALIAS_TOP_CLIP;
+    if (fv->v[0] > r_refdef.aliasvrectright)
+        fv->flags |= ALIAS_RIGHT_CLIP;
+    if (fv->v[1] > r_refdef.aliasvrectbottom)
+        fv->flags |= ALIAS_BOTTOM_CLIP;
+}
 
-        // clamp; because we limited the minimum ambient and shading light, we
-        // don't have to clamp low light, just bright
-        if (temp < 0)
-            temp = 0;
-    }
+/*
+================
+R_AliasTransformFinalVerts
 
-    fv->v[4] = temp;
+General clipped case: the vertices in front of the z clip plane are
+projected, the rest are only flagged
+================
+*/
+void R_AliasTransformFinalVerts(finalvert_t* fv, auxvert_t* av,
+                                trivertx_t* pverts, stvert_t* pstverts,
+                                i32 numverts) {
+    i32 i;
+
+    for (i = 0; i < numverts; i++, fv++, av++, pverts++, pstverts++) {
+        R_AliasTransformFinalVert(fv, av, pverts, pstverts);
+        if (av->fv[2] < ALIAS_Z_CLIP_PLANE)
+            fv->flags |= ALIAS_Z_CLIP;
+        else {
+            R_AliasProjectFinalVert(fv, av);
+            R_AliasSetClipFlags(fv);
+        }
+    }
 }
 
 /*
@@ -419,14 +432,12 @@ void R_AliasTransformFinalVert(finalvert_t* fv, auxvert_t* av,
 R_AliasTransformAndProjectFinalVerts
 ================
 */
-void R_AliasTransformAndProjectFinalVerts(finalvert_t* fv, stvert_t* pstverts) {
-    i32 i, temp;
-    float lightcos, *plightnormal, zi;
-    trivertx_t* pverts;
-
-    pverts = r_apverts;
+void R_AliasTransformAndProjectFinalVerts(finalvert_t* fv, trivertx_t* pverts,
+                                          stvert_t* pstverts, i32 numverts) {
+    i32 i;
+    float zi;
 
-    for (i = 0; i < r_anumverts; i++, fv++, pverts++, pstverts++) {
+    for (i = 0; i < numverts; i++, fv++, pverts++, pstverts++) {
         // transform and project
         zi = 1.0 /
              (DotProduct(pverts->v, aliastransform[2]) + aliastransform[2][3]);
@@ -448,22 +459,7 @@ void R_AliasTransformAndProjectFinalVerts(finalvert_t* fv, stvert_t* pstverts) {
         fv->v[2] = pstverts->s;
         fv->v[3] = pstverts->t;
         fv->flags = pstverts->onseam;
-
-        // lighting
-        plightnormal = r_avertexnormals[pverts->lightnormalindex];
-        lightcos = DotProduct(plightnormal, r_plightvec);
-        temp = r_ambientlight;
-
-        if (lightcos < 0) {
-            temp += (i32) (r_shadelight * lightcos);
-
-            // clamp; because we limited the minimum ambient and shading light, we
-            // don't have to clamp low light, just bright
-            if (temp < 0)
-                temp = 0;
-        }
-
-        fv->v[4] = temp;
+        fv->v[4] = r_anormallight[pverts->lightnormalindex];
     }
 }
 
@@ -499,7 +495,7 @@ void R_AliasPrepareUnclippedPoints(void) {
     // FIXME: just use pfinalverts directly?
     fv = pfinalverts;
 
-    R_AliasTransformAndProjectFinalVerts(fv, pstverts);
+    (*r_aliasprojectverts)(fv, r_apverts, pstverts, r_anumverts);
 
     if (r_affinetridesc.drawtype)
         D_PolysetDrawFinalVerts(fv, r_anumverts);
@@ -565,6 +561,38 @@ void R_AliasSetupSkin(void) {
     r_affinetridesc.skinheight = pmdl->skinheight;
 }
 
+/*
+================
+R_AliasSetupNormalLight
+
+Lights each vertex normal once, the vertices only look up the light of
+their normal
+================
+*/
+static void R_AliasSetupNormalLight(void) {
+    i32 i, temp;
+    float lightcos;
+
+    for (i = 0; i < NUMVERTEXNORMALS; i++) {
+        lightcos = DotProduct(r_avertexnormals[i], r_plightvec);
+        temp = r_ambientlight;
+
+        if (lightcos < 0) {
+            temp += (i32) (r_shadelight * lightcos);
+
+            // clamp; because we limited the minimum ambient and shading light, we
+            // don't have to clamp low light, just bright
+            if (temp < 0)
+                temp = 0;
+        }
+
+        r_anormallight[i] = temp;
+    }
+
+    for (; i < 256; i++)
+        r_anormallight[i] = r_ambientlight;
+}
+
 /*
 ================
 R_AliasSetupLighting
@@ -595,6 +623,8 @@ void R_AliasSetupLighting(alight_t* plighting) {
     r_plightvec[0] = DotProduct(plighting->plightvec, alias_forward);
     r_plightvec[1] = -DotProduct(plighting->plightvec, alias_right);
     r_plightvec[2] = DotProduct(plighting->plightvec, alias_up);
+
+    R_AliasSetupNormalLight();
 }
 
 /*
@@ -648,24 +678,46 @@ void R_AliasSetupFrame(void) {
 
 /*
 ================
-R_AliasDrawModel
+R_AliasReserveVerts
+
+Grows the vertex buffers to fit numverts, they are kept for the next models
 ================
 */
-void R_AliasDrawModel(alight_t* plighting) {
-    finalvert_t finalverts[MAXALIASVERTS +
-                           ((CACHE_SIZE - 1) / sizeof(finalvert_t)) + 1];
-    auxvert_t auxverts[MAXALIASVERTS];
+static void R_AliasReserveVerts(i32 numverts) {
+    static void* finalbuffer;
+    static i32 maxverts;
 
-    r_amodels_drawn++;
+    if (numverts <= maxverts)
+        return;
+
+    Q_free(finalbuffer);
+    Q_free(pauxverts);
+    finalbuffer = Q_malloc(numverts * sizeof(finalvert_t) + CACHE_SIZE - 1);
+    pauxverts = Q_malloc(numverts * sizeof(auxvert_t));
+    if (!finalbuffer || !pauxverts)
+        Sys_Error("R_AliasReserveVerts: couldn't allocate %i vertices",
+                  numverts);
 
     // cache align
-    pfinalverts = (finalvert_t*) (((intptr_t) &finalverts[0] + CACHE_SIZE - 1) &
+    pfinalverts = (finalvert_t*) (((intptr_t) finalbuffer + CACHE_SIZE - 1) &
                                   ~(CACHE_SIZE - 1));
-    pauxverts = &auxverts[0];
+    maxverts = numverts;
+}
+
+
+/*
+================
+R_AliasDrawModel
+================
+*/
+void R_AliasDrawModel(alight_t* plighting) {
+    r_amodels_drawn++;
 
     paliashdr = (aliashdr_t*) Mod_Extradata(currententity->model);
     pmdl = (mdl_t*) ((byte*) paliashdr + paliashdr->model);
 
+    R_AliasReserveVerts(pmdl->numverts);
+
     R_AliasSetupSkin();
     R_AliasSetUpTransform(currententity->trivial_accept);
     R_AliasSetupLighting(plighting);
@@ -0,0 +1,351 @@
+/*
+ * Copyright (C) 1996-1997 Id Software, Inc.
+ * Copyright (C) Henrique Barateli, <henriquejb194@gmail.com>, et al.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+// r_asimd.c -- vector versions of the alias model vertex transforms
+//
+// Four vertices go through the transform and projection at once, one per
+// lane. The trivertx_t of a vertex is four bytes, so one load brings in
+// four of them and the coordinates and normal index are picked out of each
+// lane. The lanes repeat the float operations of r_alias.c in the same
+// order, and the lighting comes from the same r_anormallight table, so the
+// final vertices match the C ones exactly.
+
+
+#include "d_local.h"
+#include "r_local.h"
+#include "client.h"
+#include "cmd.h"
+#include "console.h"
+#include "sys.h"
+#include "simd.h"
+#include <string.h>
+
+
+#ifdef SIMD_VECTOR
+
+typedef struct {
+    vec4f_t x, y, z;
+    vec4i_t normal;
+} vertlanes_t;
+
+/*
+================
+R_LoadVertLanes
+
+Unpacks four trivertx_t
+================
+*/
+static inline void R_LoadVertLanes(const trivertx_t* pverts,
+                                   vertlanes_t* lanes) {
+    vec4i_t t, mask;
+
+    mask = V4_Splat(0xFF);
+    t = V4_Load(pverts);
+    lanes->x = V4_ToFloat(V4_And(t, mask));
+    lanes->y = V4_ToFloat(V4_And(V4_Shr(t, 8), mask));
+    lanes->z = V4_ToFloat(V4_And(V4_Shr(t, 16), mask));
+    lanes->normal = V4_And(V4_Shr(t, 24), mask);
+}
+
+/*
+================
+R_TransformLanes
+
+DotProduct(pverts->v, m) + m[3] for each lane
+================
+*/
+static inline vec4f_t R_TransformLanes(const vertlanes_t* lanes,
+                                       const float m[4]) {
+    vec4f_t d;
+
+    d = V4_AddF(V4_Mul(lanes->x, V4_SplatF(m[0])),
+                V4_Mul(lanes->y, V4_SplatF(m[1])));
+    d = V4_AddF(d, V4_Mul(lanes->z, V4_SplatF(m[2])));
+    return V4_AddF(d, V4_SplatF(m[3]));
+}
+
+/*
+================
+R_AliasTransformAndProjectFinalVertsV
+================
+*/
+static void R_AliasTransformAndProjectFinalVertsV(finalvert_t* fv,
+                                                  trivertx_t* pverts,
+                                                  stvert_t* pstverts,
+                                                  i32 numverts) {
+    vertlanes_t lanes;
+    vec4f_t zi;
+    i32 u[4], v[4], izi[4], normal[4];
+    i32 i, k;
+
+    for (i = 0; i + 4 <= numverts; i += 4) {
+        R_LoadVertLanes(pverts, &lanes);
+
+        // x, y, and z are scaled down by 1/2**31 in the transform, so 1/z is
+        // scaled up by 1/2**31, and the scaling cancels out for x and y in
+        // the projection
+        zi = V4_Div(V4_SplatF(1.0f),
+                    R_TransformLanes(&lanes, aliastransform[2]));
+        V4_Store(izi, V4_Trunc(zi));
+        V4_Store(u, V4_Trunc(V4_AddF(
+                        V4_Mul(R_TransformLanes(&lanes, aliastransform[0]), zi),
+                        V4_SplatF(aliasxcenter))));
+        V4_Store(v, V4_Trunc(V4_AddF(
+                        V4_Mul(R_TransformLanes(&lanes, aliastransform[1]), zi),
+                        V4_SplatF(aliasycenter))));
+        V4_Store(normal, lanes.normal);
+
+        for (k = 0; k < 4; k++, fv++, pstverts++) {
+            fv->v[0] = u[k];
+            fv->v[1] = v[k];
+            fv->v[2] = pstverts->s;
+            fv->v[3] = pstverts->t;
+            fv->v[4] = r_anormallight[normal[k]];
+            fv->v[5] = izi[k];
+            fv->flags = pstverts->onseam;
+        }
+        pverts += 4;
+    }
+
+    R_AliasTransformAndProjectFinalVerts(fv, pverts, pstverts, numverts - i);
+}
+
+/*
+================
+R_AliasTransformFinalVertsV
+================
+*/
+static void R_AliasTransformFinalVertsV(finalvert_t* fv, auxvert_t* av,
+                                        trivertx_t* pverts, stvert_t* pstverts,
+                                        i32 numverts) {
+    vertlanes_t lanes;
+    vec4f_t x, y, z, zi;
+    float ax[4], ay[4], az[4];
+    i32 u[4], v[4], izi[4], normal[4];
+    i32 i, k;
+
+    for (i = 0; i + 4 <= numverts; i += 4) {
+        R_LoadVertLanes(pverts, &lanes);
+        x = R_TransformLanes(&lanes, aliastransform[0]);
+        y = R_TransformLanes(&lanes, aliastransform[1]);
+        z = R_TransformLanes(&lanes, aliastransform[2]);
+        V4_StoreF(ax, x);
+        V4_StoreF(ay, y);
+        V4_StoreF(az, z);
+        V4_Store(normal, lanes.normal);
+
+        // projected in every lane, only the lanes in front of the z clip
+        // plane keep it
+        zi = V4_Div(V4_SplatF(1.0f), z);
+        V4_Store(izi, V4_Trunc(V4_Mul(zi, V4_SplatF(ziscale))));
+        x = V4_Mul(V4_Mul(x, V4_SplatF(aliasxscale)), zi);
+        y = V4_Mul(V4_Mul(y, V4_SplatF(aliasyscale)), zi);
+        V4_Store(u, V4_Trunc(V4_AddF(x, V4_SplatF(aliasxcenter))));
+        V4_Store(v, V4_Trunc(V4_AddF(y, V4_SplatF(aliasycenter))));
+
+        for (k = 0; k < 4; k++, fv++, av++, pstverts++) {
+            av->fv[0] = ax[k];
+            av->fv[1] = ay[k];
+            av->fv[2] = az[k];
+            fv->v[2] = pstverts->s;
+            fv->v[3] = pstverts->t;
+            fv->v[4] = r_anormallight[normal[k]];
+            fv->flags = pstverts->onseam;
+
+            if (az[k] < ALIAS_Z_CLIP_PLANE) {
+                fv->flags |= ALIAS_Z_CLIP;
+                continue;
+            }
+            fv->v[0] = u[k];
+            fv->v[1] = v[k];
+            fv->v[5] = izi[k];
+            R_AliasSetClipFlags(fv);
+        }
+        pverts += 4;
+    }
+
+    R_AliasTransformFinalVerts(fv, av, pverts, pstverts, numverts - i);
+}
+
+#endif
+
+
+/*
+=============
+R_SelectAliasDrawers
+=============
+*/
+void R_SelectAliasDrawers(qboolean vector) {
+    r_aliasprojectverts = R_AliasTransformAndProjectFinalVerts;
+    r_aliastransformverts = R_AliasTransformFinalVerts;
+
+    if (!vector)
+        return;
+
+#ifdef SIMD_VECTOR
+    r_aliasprojectverts = R_AliasTransformAndProjectFinalVertsV;
+    r_aliastransformverts = R_AliasTransformFinalVertsV;
+#endif
+}
+
+/*
+=============
+R_SetupBenchEntity
+
+Puts copy number index of model in a grid in front of the view, eight to a
+row, turned and animated differently from its neighbours
+=============
+*/
+static void R_SetupBenchEntity(entity_t* ent, model_t* model, i32 index) {
+    float forward, right;
+
+    memset(ent, 0, sizeof(*ent));
+    ent->model = model;
+    ent->frame = index % model->numframes;
+    ent->colormap = vid.colormap;
+    ent->angles[YAW] = index * 45;
+
+    forward = 96 + 64 * (index / 8);
+    right = 64 * (index % 8) - 224;
+    VectorMA(r_origin, forward, vpn, ent->origin);
+    VectorMA(ent->origin, right, vright, ent->origin);
+}
+
+/*
+=============
+R_BenchViewSum
+
+Checksum of the pixels in the view
+=============
+*/
+static u32 R_BenchViewSum(void) {
+    vrect_t* vr = &r_refdef.vrect;
+    pixel_t* row;
+    u32 sum;
+    i32 x, y;
+
+    sum = 0;
+    for (y = vr->y; y < vr->y + vr->height; y++) {
+        row = d_viewbuffer + y * screenwidth;
+        for (x = vr->x; x < vr->x + vr->width; x++)
+            sum = sum * 31 + row[x];
+    }
+    return sum;
+}
+
+/*
+=============
+R_AliasBench_f
+
+aliasbench [copies] [reps]
+Draws copies of every alias model the map uses in front of the current
+view through R_DrawEntitiesOnList, reps times with the C transforms and
+reps times with the vector ones, and checks both left the same pixels
+=============
+*/
+static void R_AliasBench_f(void) {
+    static entity_t ents[MAX_VISEDICTS];
+    entity_t* savevisedicts[MAX_VISEDICTS];
+    i32 savenumvisedicts;
+    double time[2];
+    double start;
+    u32 sum[2];
+    vrect_t vr;
+    model_t* model;
+    i32 i, k, r, count, copies, reps;
+
+    if (cls.state != ca_connected || cls.signon != SIGNONS) {
+        Con_Printf("Not playing a map\n");
+        return;
+    }
+
+    copies = Cmd_Argc() > 1 ? Q_atoi(Cmd_Argv(1)) : 32;
+    if (copies < 1)
+        copies = 1;
+    reps = Cmd_Argc() > 2 ? Q_atoi(Cmd_Argv(2)) : 100;
+    if (reps < 1)
+        reps = 1;
+
+    count = 0;
+    for (i = 1; i < MAX_MODELS && cl.model_precache[i]; i++) {
+        model = cl.model_precache[i];
+        if (model->type != mod_alias)
+            continue;
+        for (k = 0; k < copies && count < MAX_VISEDICTS; k++)
+            R_SetupBenchEntity(&ents[count++], model, k);
+    }
+
+    savenumvisedicts = cl_numvisedicts;
+    Q_memcpy(savevisedicts, cl_visedicts, sizeof(savevisedicts));
+
+    for (k = 0; k < 2; k++) {
+        // the world alone, so both passes draw over the same frame
+        cl_numvisedicts = 0;
+        VID_LockBuffer();
+        R_RenderView();
+        if (r_dowarp) {
+            // the warp buffer went with R_RenderView
+            VID_UnlockBuffer();
+            break;
+        }
+
+        // R_RenderView picked the drawers d_simd asks for
+        R_SelectAliasDrawers(k == 1);
+        for (i = 0; i < count; i++)
+            cl_visedicts[i] = &ents[i];
+        cl_numvisedicts = count;
+        r_amodels_drawn = 0;
+
+        start = Sys_FloatTime();
+        for (r = 0; r < reps; r++)
+            R_DrawEntitiesOnList();
+        time[k] = Sys_FloatTime() - start;
+        sum[k] = R_BenchViewSum();
+
+        VID_UnlockBuffer();
+        vr.x = r_refdef.vrect.x;
+        vr.y = r_refdef.vrect.y;
+        vr.width = r_refdef.vrect.width;
+        vr.height = r_refdef.vrect.height;
+        VID_Update(&vr);
+    }
+
+    cl_numvisedicts = savenumvisedicts;
+    Q_memcpy(cl_visedicts, savevisedicts, sizeof(savevisedicts));
+    R_SelectAliasDrawers(d_simd.value != 0);
+
+    if (k < 2) {
+        Con_Printf("aliasbench: not while under water\n");
+        return;
+    }
+    Con_Printf("%i models, %i drawn: C %.2f ms, vector %.2f ms per pass\n",
+               count, r_amodels_drawn / reps, time[0] * 1000.0 / reps,
+               time[1] * 1000.0 / reps);
+    if (sum[0] != sum[1])
+        Con_Printf("aliasbench: the views differ!\n");
+}
+
+/*
+=============
+R_InitAliasSIMD
+=============
+*/
+void R_InitAliasSIMD(void) {
+    Cmd_AddCommand("aliasbench", R_AliasBench_f);
+}
@@ -22,6 +22,7 @@
 
 #include "r_local.h"
 #include "console.h"
+#include "profiler.h"
 #include "sys.h"
 #include <math.h>
 
@@ -56,6 +57,18 @@ static mvertex_t *pfrontenter, *pfrontexit;
 
 static qboolean makeclippededge;
 
+// a node whose front side R_WalkWorldNodes is walking
+typedef struct {
+    const visnode_t* vn;
+    double dot; // of the viewer against the node plane
+    i32 clipflags;
+} worldnode_t;
+
+static worldnode_t* r_worldstack;
+static i32 r_maxworlddepth;
+
+i32 r_nodeswalked, r_leafswalked, r_surfswalked;
+
 
 //===========================================================================
 
@@ -412,167 +425,205 @@ void R_DrawSubmodelPolygons(model_t* pmodel, i32 clipflags) {
 
 /*
 ================
-R_RecursiveWorldNode
+R_DrawWorldLeaf
 ================
 */
-void R_RecursiveWorldNode(mnode_t* node, i32 clipflags) {
-    i32 i, c, side, *pindex;
-    vec3_t acceptpt, rejectpt;
-    mplane_t* plane;
-    msurface_t *surf, **mark;
-    mleaf_t* pleaf;
-    double d, dot;
+static void R_DrawWorldLeaf(mleaf_t* pleaf) {
+    msurface_t** mark;
+    i32 c;
+
+    mark = pleaf->firstmarksurface;
+    c = pleaf->nummarksurfaces;
+
+    if (c) {
+        do {
+            (*mark)->visframe = r_framecount;
+            mark++;
+        } while (--c);
+    }
 
-    if (node->contents == CONTENTS_SOLID)
-        return; // solid
+    // deal with model fragments in this leaf
+    if (pleaf->efrags) {
+        R_StoreEfrags(&pleaf->efrags);
+    }
 
-    if (node->visframe != r_visframecount)
-        return;
+    pleaf->key = r_currentkey;
+    r_currentkey++; // all bmodels in a leaf share the same key
+}
 
-    // cull the clipping planes if not trivial accept
-    // FIXME: the compiler is doing a lousy job of optimizing here; it could be
-    //  twice as fast in ASM
-    if (clipflags) {
-        for (i = 0; i < 4; i++) {
-            if (!(clipflags & (1 << i)))
-                continue; // don't need to clip against it
 
-            // generate accept and reject points
-            // FIXME: do with fast look-ups or integer tests based on the sign bit
-            // of the floating point values
+/*
+================
+R_DrawWorldSurface
+================
+*/
+static void R_DrawWorldSurface(msurface_t* surf, i32 clipflags) {
+    r_surfswalked++;
+
+    if (r_drawpolys) {
+        if (r_worldpolysbacktofront) {
+            if (numbtofpolys < MAX_BTOFPOLYS) {
+                pbtofpolys[numbtofpolys].clipflags = clipflags;
+                pbtofpolys[numbtofpolys].psurf = surf;
+                numbtofpolys++;
+            }
+        } else {
+            R_RenderPoly(surf, clipflags);
+        }
+    } else {
+        R_RenderFace(surf, clipflags);
+    }
+}
+
 
-            pindex = pfrustum_indexes[i];
+/*
+================
+R_DrawNodeSurfaces
 
-            rejectpt[0] = (float) node->minmaxs[pindex[0]];
-            rejectpt[1] = (float) node->minmaxs[pindex[1]];
-            rejectpt[2] = (float) node->minmaxs[pindex[2]];
+Draws the surfaces of the node that face the viewer, dot being how far in
+front of the node plane the viewer is
+================
+*/
+static void R_DrawNodeSurfaces(mnode_t* node, double dot, i32 clipflags) {
+    msurface_t* surf;
+    i32 c;
 
-            d = DotProduct(rejectpt, view_clipplanes[i].normal);
-            d -= view_clipplanes[i].dist;
+    c = node->numsurfaces;
+    if (!c)
+        return;
 
-            if (d <= 0)
-                return;
+    surf = cl.worldmodel->surfaces + node->firstsurface;
 
-            acceptpt[0] = (float) node->minmaxs[pindex[3 + 0]];
-            acceptpt[1] = (float) node->minmaxs[pindex[3 + 1]];
-            acceptpt[2] = (float) node->minmaxs[pindex[3 + 2]];
+    if (dot < -BACKFACE_EPSILON) {
+        do {
+            if ((surf->flags & SURF_PLANEBACK) &&
+                (surf->visframe == r_framecount)) {
+                R_DrawWorldSurface(surf, clipflags);
+            }
 
-            d = DotProduct(acceptpt, view_clipplanes[i].normal);
-            d -= view_clipplanes[i].dist;
+            surf++;
+        } while (--c);
+    } else if (dot > BACKFACE_EPSILON) {
+        do {
+            if (!(surf->flags & SURF_PLANEBACK) &&
+                (surf->visframe == r_framecount)) {
+                R_DrawWorldSurface(surf, clipflags);
+            }
 
-            if (d >= 0)
-                clipflags &= ~(1 << i); // node is entirely on screen
-        }
+            surf++;
+        } while (--c);
     }
 
-    // if a leaf node, draw stuff
-    if (node->contents < 0) {
-        pleaf = (mleaf_t*) node;
+    // all surfaces on the same node share the same sequence number
+    r_currentkey++;
+}
 
-        mark = pleaf->firstmarksurface;
-        c = pleaf->nummarksurfaces;
 
-        if (c) {
-            do {
-                (*mark)->visframe = r_framecount;
-                mark++;
-            } while (--c);
-        }
+/*
+================
+R_ReserveWorldStack
 
-        // deal with model fragments in this leaf
-        if (pleaf->efrags) {
-            R_StoreEfrags(&pleaf->efrags);
-        }
+A node can be on the stack only once, so the visible set bounds the depth
+================
+*/
+static void R_ReserveWorldStack(i32 depth) {
+    if (depth <= r_maxworlddepth)
+        return;
 
-        pleaf->key = r_currentkey;
-        r_currentkey++; // all bmodels in a leaf share the same key
-    } else {
-        // node is just a decision point, so go down the apropriate sides
+    Q_free(r_worldstack);
+    r_worldstack = Q_malloc(depth * sizeof(worldnode_t));
+    if (!r_worldstack)
+        Sys_Error("R_ReserveWorldStack: couldn't allocate %i nodes", depth);
+    r_maxworlddepth = depth;
+}
 
-        // find which side of the node we are on
-        plane = node->plane;
 
-        switch (plane->type) {
-            case PLANE_X:
-                dot = modelorg[0] - plane->dist;
-                break;
-            case PLANE_Y:
-                dot = modelorg[1] - plane->dist;
-                break;
-            case PLANE_Z:
-                dot = modelorg[2] - plane->dist;
-                break;
-            default:
-                dot = DotProduct(modelorg, plane->normal) - plane->dist;
-                break;
-        }
+/*
+================
+R_WalkWorldNodes
 
-        if (dot >= 0)
-            side = 0;
-        else
-            side = 1;
+Goes down the front side of every node first, draws its surfaces on the way
+back up and then goes down the back side, the order the keys of the edge
+sort depend on. Walks the visible set from the root, keeping its own stack
+of the nodes whose front side is being walked instead of recursing
+================
+*/
+static void R_WalkWorldNodes(void) {
+    const visnode_t* vn;
+    worldnode_t* top;
+    mplane_t* plane;
+    mnode_t* node;
+    i32 slot, clipflags, depth, code;
+    double dot;
 
-        // recurse down the children, front side first
-        R_RecursiveWorldNode(node->children[side], clipflags);
-
-        // draw stuff
-        c = node->numsurfaces;
-
-        if (c) {
-            surf = cl.worldmodel->surfaces + node->firstsurface;
-
-            if (dot < -BACKFACE_EPSILON) {
-                do {
-                    if ((surf->flags & SURF_PLANEBACK) &&
-                        (surf->visframe == r_framecount)) {
-                        if (r_drawpolys) {
-                            if (r_worldpolysbacktofront) {
-                                if (numbtofpolys < MAX_BTOFPOLYS) {
-                                    pbtofpolys[numbtofpolys].clipflags =
-                                        clipflags;
-                                    pbtofpolys[numbtofpolys].psurf = surf;
-                                    numbtofpolys++;
-                                }
-                            } else {
-                                R_RenderPoly(surf, clipflags);
-                            }
-                        } else {
-                            R_RenderFace(surf, clipflags);
-                        }
-                    }
+    if (!r_visset.count)
+        return;
 
-                    surf++;
-                } while (--c);
-            } else if (dot > BACKFACE_EPSILON) {
-                do {
-                    if (!(surf->flags & SURF_PLANEBACK) &&
-                        (surf->visframe == r_framecount)) {
-                        if (r_drawpolys) {
-                            if (r_worldpolysbacktofront) {
-                                if (numbtofpolys < MAX_BTOFPOLYS) {
-                                    pbtofpolys[numbtofpolys].clipflags =
-                                        clipflags;
-                                    pbtofpolys[numbtofpolys].psurf = surf;
-                                    numbtofpolys++;
-                                }
-                            } else {
-                                R_RenderPoly(surf, clipflags);
-                            }
-                        } else {
-                            R_RenderFace(surf, clipflags);
-                        }
-                    }
+    R_ReserveWorldStack(r_visset.count);
+    R_SetupVisibleSetCull();
+    depth = 0;
+    slot = 0; // the root
+    clipflags = 15;
+
+    for (;;) {
+        // slots of nodes that aren't drawn are -1
+        while (slot >= 0) {
+            vn = &r_visset.nodes[slot];
+
+            // cull the clipping planes if not trivial accept
+            if (clipflags) {
+                code = (*r_cullvisnode)(vn, clipflags);
+                if (code & 15)
+                    break; // off screen
+                clipflags &= ~(code >> 4); // entirely on screen for those
+            }
 
-                    surf++;
-                } while (--c);
+            // if a leaf node, draw stuff
+            node = vn->node;
+            if (node->contents < 0) {
+                r_leafswalked++;
+                R_DrawWorldLeaf((mleaf_t*) node);
+                break;
+            }
+
+            // node is just a decision point, so go down the apropriate sides
+            r_nodeswalked++;
+
+            // find which side of the node we are on
+            plane = node->plane;
+
+            switch (plane->type) {
+                case PLANE_X:
+                    dot = modelorg[0] - plane->dist;
+                    break;
+                case PLANE_Y:
+                    dot = modelorg[1] - plane->dist;
+                    break;
+                case PLANE_Z:
+                    dot = modelorg[2] - plane->dist;
+                    break;
+                default:
+                    dot = DotProduct(modelorg, plane->normal) - plane->dist;
+                    break;
             }
 
-            // all surfaces on the same node share the same sequence number
-            r_currentkey++;
+            top = &r_worldstack[depth++];
+            top->vn = vn;
+            top->dot = dot;
+            top->clipflags = clipflags;
+
+            // front side first
+            slot = vn->children[dot >= 0 ? 0 : 1];
         }
 
-        // recurse down the back side
-        R_RecursiveWorldNode(node->children[!side], clipflags);
+        if (!depth)
+            break;
+
+        // the front side is done, draw stuff and go down the back side
+        top = &r_worldstack[--depth];
+        R_DrawNodeSurfaces(top->vn->node, top->dot, top->clipflags);
+        slot = top->vn->children[top->dot >= 0 ? 1 : 0];
+        clipflags = top->clipflags;
     }
 }
 
@@ -594,7 +645,15 @@ void R_RenderWorld(void) {
     clmodel = currententity->model;
     r_pcurrentvertbase = clmodel->vertexes;
 
-    R_RecursiveWorldNode(clmodel->nodes, 15);
+    r_nodeswalked = 0;
+    r_leafswalked = 0;
+    r_surfswalked = 0;
+
+    R_WalkWorldNodes();
+
+    PROF_COUNT("world nodes", r_nodeswalked);
+    PROF_COUNT("world leafs", r_leafswalked);
+    PROF_COUNT("world surfs", r_surfswalked);
 
     // if the driver wants the polygons back to front, play the visible ones back
     // in that order
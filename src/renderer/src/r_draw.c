@@ -370,7 +370,7 @@ void R_RenderFace(msurface_t* fa, i32 clipflags) {
         return;
     }
 
-    // ditto if not enough edges left, or switch to auxedges if possible
+    // ditto if not enough edges left, the pools grow for the next frame
     if ((edge_p + fa->numedges + 4) >= edge_max) {
         r_outofedges += fa->numedges;
         return;
@@ -545,7 +545,7 @@ void R_RenderBmodelFace(bedge_t* pedges, msurface_t* psurf) {
         return;
     }
 
-    // ditto if not enough edges left, or switch to auxedges if possible
+    // ditto if not enough edges left, the pools grow for the next frame
     if ((edge_p + psurf->numedges + 4) >= edge_max) {
         r_outofedges += psurf->numedges;
         return;
@@ -21,7 +21,9 @@
 
 
 #include "r_local.h"
+#include "console.h"
 #include "sound.h"
+#include "sys.h"
 
 
 #if 0
@@ -36,7 +38,6 @@ have a sentinal at both ends?
 #endif
 
 
-edge_t* auxedges;
 edge_t *r_edges, *edge_p, *edge_max;
 
 surf_t *surfaces, *surface_p, *surf_max;
@@ -50,6 +51,17 @@ edge_t* removeedges[MAXHEIGHT];
 
 espan_t *span_p, *max_span_p;
 
+// the edges, surfaces and spans of a frame share one block, which
+// R_SizeEdgePools sizes from the most the frames before needed
+static byte* r_edgepools;
+static espan_t* r_basespans;
+i32 r_numallocatedspans;
+i32 r_maxspansseen;
+i32 r_spansused; // this frame, counting the ones already flushed
+
+#define CACHE_ALIGN(p) \
+    ((byte*) (((intptr_t) (p) + CACHE_SIZE - 1) & ~(CACHE_SIZE - 1)))
+
 i32 r_currentkey;
 
 extern i32 screenwidth;
@@ -113,6 +125,117 @@ void R_DrawCulledPolys(void) {
 }
 
 
+/*
+==============
+R_PoolNeed
+
+The most a frame has needed so far, and no less than wanted or minimum
+==============
+*/
+static i32 R_PoolNeed(i32 wanted, i32 minimum, i32 seen) {
+    if (seen < wanted)
+        seen = wanted;
+    if (seen < minimum)
+        seen = minimum;
+    return seen;
+}
+
+/*
+==============
+R_PoolFits
+
+Keeps a pool that has room for need and isn't more than twice as big
+==============
+*/
+static qboolean R_PoolFits(i32 need, i32 allocated) {
+    return need <= allocated && allocated <= need * 2;
+}
+
+/*
+==============
+R_SizeEdgePools
+
+Called before the edges of a frame are set up. The pools grow after a frame
+ran out of room, and shrink back when the high-water marks are reset for a
+new map
+==============
+*/
+void R_SizeEdgePools(void) {
+    i32 edges, surfs, spans;
+    size_t size;
+    byte* p;
+
+    edges = R_PoolNeed((i32) r_maxedges.value, MINEDGES, r_maxedgesseen);
+    surfs = R_PoolNeed((i32) r_maxsurfs.value, MINSURFACES, r_maxsurfsseen);
+    // room for one more scan line of spans before they are flushed
+    spans = R_PoolNeed(0, MINSPANS, r_maxspansseen) + r_refdef.vrect.width;
+
+    if (r_edgepools && R_PoolFits(edges, r_numallocatededges) &&
+        R_PoolFits(surfs, r_cnumsurfs) &&
+        R_PoolFits(spans, r_numallocatedspans)) {
+        return;
+    }
+
+    // a quarter more than the high-water marks, so a view that needs a bit
+    // more than the last ones doesn't grow the pools again
+    if (edges == r_maxedgesseen)
+        edges += edges / 4;
+    if (surfs == r_maxsurfsseen)
+        surfs += surfs / 4;
+    if (spans - r_refdef.vrect.width == r_maxspansseen)
+        spans += r_maxspansseen / 4;
+
+    size = edges * sizeof(edge_t) + surfs * sizeof(surf_t) +
+           spans * sizeof(espan_t) + 3 * CACHE_SIZE;
+    Q_free(r_edgepools);
+    r_edgepools = Q_malloc(size);
+    if (!r_edgepools)
+        Sys_Error("R_SizeEdgePools: couldn't allocate %i bytes", (i32) size);
+
+    p = CACHE_ALIGN(r_edgepools);
+    r_edges = (edge_t*) p;
+    p = CACHE_ALIGN(p + edges * sizeof(edge_t));
+
+    surfaces = (surf_t*) p;
+    surf_max = &surfaces[surfs];
+    // surface 0 doesn't really exist; it's just a dummy because index 0
+    // is used to indicate no edge attached to surface
+    surfaces--;
+    R_SurfacePatch();
+    p = CACHE_ALIGN(p + surfs * sizeof(surf_t));
+
+    r_basespans = (espan_t*) p;
+
+    r_numallocatededges = edges;
+    r_cnumsurfs = surfs;
+    r_numallocatedspans = spans;
+
+    Con_DPrintf("Edge pools: %d edges, %d surfs, %d spans\n", edges, surfs,
+                spans);
+}
+
+/*
+==============
+R_RecordEdgeUsage
+
+Raises the high-water marks to what this frame used, counting what it was
+short of
+==============
+*/
+void R_RecordEdgeUsage(void) {
+    i32 edges, surfs;
+
+    edges = (edge_p - r_edges) + r_outofedges;
+    surfs = (surface_p - surfaces) + r_outofsurfaces;
+
+    if (edges > r_maxedgesseen)
+        r_maxedgesseen = edges;
+    if (surfs > r_maxsurfsseen)
+        r_maxsurfsseen = surfs;
+    if (r_spansused > r_maxspansseen)
+        r_maxspansseen = r_spansused;
+}
+
 /*
 ==============
 R_BeginEdgeFrame
@@ -123,6 +246,7 @@ void R_BeginEdgeFrame(void) {
 
     edge_p = r_edges;
     edge_max = &r_edges[r_numallocatededges];
+    r_spansused = 0;
 
     surface_p = &surfaces[2]; // background is surface 1,
                               //  surface 0 is a dummy
@@ -591,13 +715,11 @@ Each surface has a linked list of its visible spans
 */
 void R_ScanEdges(void) {
     i32 iv, bottom;
-    byte basespans[MAXSPANS * sizeof(espan_t) + CACHE_SIZE];
     espan_t* basespan_p;
     surf_t* s;
 
-    basespan_p = (espan_t*) ((intptr_t) (basespans + CACHE_SIZE - 1) &
-                             ~(CACHE_SIZE - 1));
-    max_span_p = &basespan_p[MAXSPANS - r_refdef.vrect.width];
+    basespan_p = r_basespans;
+    max_span_p = &basespan_p[r_numallocatedspans - r_refdef.vrect.width];
 
     span_p = basespan_p;
 
@@ -663,6 +785,7 @@ void R_ScanEdges(void) {
             for (s = &surfaces[1]; s < surface_p; s++)
                 s->spans = NULL;
 
+            r_spansused += span_p - basespan_p;
             span_p = basespan_p;
         }
 
@@ -686,6 +809,8 @@ void R_ScanEdges(void) {
 
     (*pdrawfunc)();
 
+    r_spansused += span_p - basespan_p;
+
     // draw whatever's left in the span list
     if (r_drawculledpolys)
         R_DrawCulledPolys();
@@ -23,6 +23,7 @@
 #include "r_local.h"
 #include "cmd.h"
 #include "console.h"
+#include "profiler.h"
 #include "screen.h"
 #include "sound.h"
 #include "sys.h"
@@ -53,7 +54,6 @@ mvertex_t* r_pcurrentvertbase;
 
 i32 c_surf;
 i32 r_maxsurfsseen, r_maxedgesseen, r_cnumsurfs;
-qboolean r_surfsonstack;
 i32 r_clipflags;
 
 byte* r_warpbuffer;
@@ -141,6 +141,8 @@ cvar_t r_numsurfs = {"r_numsurfs", "0"};
 cvar_t r_reportedgeout = {"r_reportedgeout", "0"};
 cvar_t r_maxedges = {"r_maxedges", "0"};
 cvar_t r_numedges = {"r_numedges", "0"};
+cvar_t r_numspans = {"r_numspans", "0"};
+cvar_t r_numnodes = {"r_numnodes", "0"};
 cvar_t r_aliastransbase = {"r_aliastransbase", "200"};
 cvar_t r_aliastransadj = {"r_aliastransadj", "100"};
 
@@ -192,6 +194,8 @@ void R_Init(void) {
     r_stack_start = (byte*) &dummy;
 
     R_InitTurb();
+    R_InitSurfaceSIMD();
+    R_InitAliasSIMD();
 
     Cmd_AddCommand("timerefresh", R_TimeRefresh_f);
     Cmd_AddCommand("pointfile", R_ReadPointFile_f);
@@ -215,11 +219,13 @@ void R_Init(void) {
     Cvar_RegisterVariable(&r_reportedgeout);
     Cvar_RegisterVariable(&r_maxedges);
     Cvar_RegisterVariable(&r_numedges);
+    Cvar_RegisterVariable(&r_numspans);
+    Cvar_RegisterVariable(&r_numnodes);
     Cvar_RegisterVariable(&r_aliastransbase);
     Cvar_RegisterVariable(&r_aliastransadj);
 
-    Cvar_SetValue("r_maxedges", (float) NUMSTACKEDGES);
-    Cvar_SetValue("r_maxsurfs", (float) NUMSTACKSURFACES);
+    Cvar_SetValue("r_maxedges", (float) MINEDGES);
+    Cvar_SetValue("r_maxsurfs", (float) MINSURFACES);
 
     view_clipplanes[0].leftedge = true;
     view_clipplanes[1].rightedge = true;
@@ -251,39 +257,12 @@ void R_NewMap(void) {
 
     r_viewleaf = NULL;
     R_ClearParticles();
+    R_NewVisibleSet();
 
-    r_cnumsurfs = r_maxsurfs.value;
-
-    if (r_cnumsurfs <= MINSURFACES)
-        r_cnumsurfs = MINSURFACES;
-
-    if (r_cnumsurfs > NUMSTACKSURFACES) {
-        surfaces = Hunk_AllocName(r_cnumsurfs * sizeof(surf_t), "surfaces");
-        surface_p = surfaces;
-        surf_max = &surfaces[r_cnumsurfs];
-        r_surfsonstack = false;
-        // surface 0 doesn't really exist; it's just a dummy because index 0
-        // is used to indicate no edge attached to surface
-        surfaces--;
-        R_SurfacePatch();
-    } else {
-        r_surfsonstack = true;
-    }
-
+    // the edge pools size themselves again for the new map
     r_maxedgesseen = 0;
     r_maxsurfsseen = 0;
-
-    r_numallocatededges = r_maxedges.value;
-
-    if (r_numallocatededges < MINEDGES)
-        r_numallocatededges = MINEDGES;
-
-    if (r_numallocatededges <= NUMSTACKEDGES) {
-        auxedges = NULL;
-    } else {
-        auxedges =
-            Hunk_AllocName(r_numallocatededges * sizeof(edge_t), "edges");
-    }
+    r_maxspansseen = 0;
 
     r_dowarpold = false;
     r_viewchanged = false;
@@ -480,6 +459,8 @@ void R_MarkLeaves(void) {
             } while (node);
         }
     }
+
+    R_BuildVisibleSet();
 }
 
 
@@ -803,26 +784,9 @@ R_EdgeDrawing
 ================
 */
 void R_EdgeDrawing(void) {
-    edge_t ledges[NUMSTACKEDGES + ((CACHE_SIZE - 1) / sizeof(edge_t)) + 1];
-    surf_t lsurfs[NUMSTACKSURFACES + ((CACHE_SIZE - 1) / sizeof(surf_t)) + 1];
-
-    if (auxedges) {
-        r_edges = auxedges;
-    } else {
-        r_edges = (edge_t*) (((intptr_t) &ledges[0] + CACHE_SIZE - 1) &
-                             ~(CACHE_SIZE - 1));
-    }
-
-    if (r_surfsonstack) {
-        surfaces = (surf_t*) (((intptr_t) &lsurfs[0] + CACHE_SIZE - 1) &
-                              ~(CACHE_SIZE - 1));
-        surf_max = &surfaces[r_cnumsurfs];
-        // surface 0 doesn't really exist; it's just a dummy because index 0
-        // is used to indicate no edge attached to surface
-        surfaces--;
-        R_SurfacePatch();
-    }
+    PROF_BEGIN("R_EdgeDrawing");
 
+    R_SizeEdgePools();
     R_BeginEdgeFrame();
 
     if (r_dspeeds.value) {
@@ -858,6 +822,10 @@ void R_EdgeDrawing(void) {
 
     if (!(r_drawpolys | r_drawculledpolys))
         R_ScanEdges();
+
+    R_RecordEdgeUsage();
+
+    PROF_END();
 }
 
 
@@ -876,6 +844,7 @@ void R_RenderView_(void) {
     if (r_timegraph.value || r_speeds.value || r_dspeeds.value)
         r_time1 = Sys_FloatTime();
 
+    PROF_BEGIN("R_SetupFrame");
     R_SetupFrame();
 
 #ifdef PASSAGES
@@ -883,6 +852,7 @@ void R_RenderView_(void) {
 #else
     R_MarkLeaves(); // done here so we know if we're in water
 #endif
+    PROF_END();
 
     // make FDIV fast. This reduces timing precision after we've been running for a
     // while, so we don't do it globally.  This also sets chop mode, and we do it
@@ -912,27 +882,36 @@ void R_RenderView_(void) {
         de_time1 = se_time2;
     }
 
+    PROF_BEGIN("R_DrawEntitiesOnList");
     R_DrawEntitiesOnList();
+    PROF_END();
 
     if (r_dspeeds.value) {
         de_time2 = Sys_FloatTime();
         dv_time1 = de_time2;
     }
 
+    PROF_BEGIN("R_DrawViewModel");
     R_DrawViewModel();
+    PROF_END();
 
     if (r_dspeeds.value) {
         dv_time2 = Sys_FloatTime();
         dp_time1 = Sys_FloatTime();
     }
 
+    PROF_BEGIN("R_DrawParticles");
     R_DrawParticles();
+    PROF_END();
 
     if (r_dspeeds.value)
         dp_time2 = Sys_FloatTime();
 
-    if (r_dowarp)
+    if (r_dowarp) {
+        PROF_BEGIN("D_WarpScreen");
         D_WarpScreen();
+        PROF_END();
+    }
 
     V_SetContentsColor(r_viewleaf->contents);
 
@@ -975,7 +954,9 @@ void R_RenderView(void) {
     if ((intptr_t) (&r_warpbuffer) & 3)
         Sys_Error("Globals are missaligned");
 
+    PROF_BEGIN("R_RenderView");
     R_RenderView_();
+    PROF_END();
 }
 
 /*
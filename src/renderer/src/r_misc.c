@@ -347,24 +347,29 @@ void R_SetupFrame(void) {
         Cvar_Set("r_drawflat", "0");
     }
 
+    // the high-water marks are raised by R_RecordEdgeUsage
     if (r_numsurfs.value) {
-        if ((surface_p - surfaces) > r_maxsurfsseen)
-            r_maxsurfsseen = surface_p - surfaces;
-
         Con_Printf("Used %d of %d surfs; %d max\n", surface_p - surfaces,
                    surf_max - surfaces, r_maxsurfsseen);
     }
 
     if (r_numedges.value) {
         edgecount = edge_p - r_edges;
-
-        if (edgecount > r_maxedgesseen)
-            r_maxedgesseen = edgecount;
-
         Con_Printf("Used %d of %d edges; %d max\n", edgecount,
                    r_numallocatededges, r_maxedgesseen);
     }
 
+    if (r_numspans.value) {
+        Con_Printf("Used %d of %d spans; %d max\n", r_spansused,
+                   r_numallocatedspans, r_maxspansseen);
+    }
+
+    if (r_numnodes.value) {
+        Con_Printf("Walked %d nodes, %d leafs, %d surfs; %d visible\n",
+                   r_nodeswalked, r_leafswalked, r_surfswalked,
+                   r_visset.count);
+    }
+
     r_refdef.ambientlight = r_ambient.value;
 
     if (r_refdef.ambientlight < 0)
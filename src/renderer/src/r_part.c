@@ -21,9 +21,13 @@
 
 #include "r_local.h"
 #include "console.h"
+#include "profiler.h"
 #include "server.h"
+#include "simd.h"
+#include "sys.h"
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 
 // default max # of particles at one time
@@ -31,18 +35,94 @@
 // no fewer than this no matter what's on the command line
 #define ABSOLUTE_MIN_PARTICLES 512
 
+// a particle being spawned, R_AddParticle copies it into the arrays
+typedef struct {
+    vec3_t org;
+    vec3_t vel;
+    i32 color;
+    float ramp;
+    float die;
+    ptype_t type;
+} particle_t;
+
 i32 ramp1[8] = {0x6f, 0x6d, 0x6b, 0x69, 0x67, 0x65, 0x63, 0x61};
 i32 ramp2[8] = {0x6f, 0x6e, 0x6d, 0x6c, 0x6b, 0x6a, 0x68, 0x66};
 i32 ramp3[8] = {0x6d, 0x6b, 6, 5, 4, 3};
 
-particle_t *active_particles, *free_particles;
+particles_t r_particles;
+i32 r_numparticles; // -particles, or MAX_PARTICLES
 
-particle_t* particles;
-i32 r_numparticles;
+// 0 keeps r_numparticles, otherwise the pool is resized to this many
+cvar_t r_maxparticles = {"r_maxparticles", "0"};
 
 vec3_t r_pright, r_pup, r_ppn;
 
 
+/*
+===============
+R_AllocParticles
+
+Resizes the arrays, keeping the newest particles that still fit
+===============
+*/
+static void R_AllocParticles(i32 max) {
+    particles_t old;
+    byte* block;
+    float* f;
+    i32 i, count, first;
+
+    old = r_particles;
+    block = Q_malloc(max * (8 * sizeof(float) + 2));
+    if (!block)
+        Sys_Error("R_AllocParticles: couldn't allocate %i particles", max);
+
+    f = (float*) block;
+    for (i = 0; i < 3; i++, f += max)
+        r_particles.org[i] = f;
+    for (i = 0; i < 3; i++, f += max)
+        r_particles.vel[i] = f;
+    r_particles.ramp = f;
+    f += max;
+    r_particles.die = f;
+    f += max;
+    r_particles.color = (byte*) f;
+    r_particles.type = r_particles.color + max;
+    r_particles.max = max;
+
+    count = old.count < max ? old.count : max;
+    first = old.count - count;
+    for (i = 0; i < 3; i++) {
+        Q_memcpy(r_particles.org[i], old.org[i] + first, count * 4);
+        Q_memcpy(r_particles.vel[i], old.vel[i] + first, count * 4);
+    }
+    Q_memcpy(r_particles.ramp, old.ramp + first, count * 4);
+    Q_memcpy(r_particles.die, old.die + first, count * 4);
+    Q_memcpy(r_particles.color, old.color + first, count);
+    Q_memcpy(r_particles.type, old.type + first, count);
+    r_particles.count = count;
+
+    // the org array starts the block
+    Q_free(old.org[0]);
+}
+
+/*
+===============
+R_CheckParticles
+===============
+*/
+static void R_CheckParticles(void) {
+    i32 max;
+
+    max = r_numparticles;
+    if (r_maxparticles.value) {
+        max = (i32) r_maxparticles.value;
+        if (max < ABSOLUTE_MIN_PARTICLES)
+            max = ABSOLUTE_MIN_PARTICLES;
+    }
+    if (max != r_particles.max)
+        R_AllocParticles(max);
+}
+
 /*
 ===============
 R_InitParticles
@@ -61,8 +141,41 @@ void R_InitParticles(void) {
         r_numparticles = MAX_PARTICLES;
     }
 
-    particles = (particle_t*) Hunk_AllocName(
-        r_numparticles * sizeof(particle_t), "particles");
+    Cvar_RegisterVariable(&r_maxparticles);
+    R_CheckParticles();
+}
+
+/*
+===============
+R_ParticlesFull
+===============
+*/
+static qboolean R_ParticlesFull(void) {
+    return r_particles.count == r_particles.max;
+}
+
+/*
+===============
+R_AddParticle
+
+The caller checks R_ParticlesFull first
+===============
+*/
+static void R_AddParticle(const particle_t* p) {
+    i32 i;
+
+    i = r_particles.count++;
+
+    r_particles.org[0][i] = p->org[0];
+    r_particles.org[1][i] = p->org[1];
+    r_particles.org[2][i] = p->org[2];
+    r_particles.vel[0][i] = p->vel[0];
+    r_particles.vel[1][i] = p->vel[1];
+    r_particles.vel[2][i] = p->vel[2];
+    r_particles.color[i] = p->color;
+    r_particles.ramp[i] = p->ramp;
+    r_particles.die[i] = p->die;
+    r_particles.type[i] = p->type;
 }
 
 /*
@@ -82,7 +195,7 @@ float timescale = 0.01;
 void R_EntityParticles(entity_t* ent) {
     i32 count;
     i32 i;
-    particle_t* p;
+    particle_t p = {0};
     float angle;
     float sr, sp, sy, cr, cp, cy;
     vec3_t forward;
@@ -112,23 +225,20 @@ void R_EntityParticles(entity_t* ent) {
         forward[1] = cp * sy;
         forward[2] = -sp;
 
-        if (!free_particles)
+        if (R_ParticlesFull())
             return;
-        p = free_particles;
-        free_particles = p->next;
-        p->next = active_particles;
-        active_particles = p;
-
-        p->die = cl.time + 0.01;
-        p->color = 0x6f;
-        p->type = pt_explode;
-
-        p->org[0] = ent->origin[0] + r_avertexnormals[i][0] * dist +
-                    forward[0] * beamlength;
-        p->org[1] = ent->origin[1] + r_avertexnormals[i][1] * dist +
-                    forward[1] * beamlength;
-        p->org[2] = ent->origin[2] + r_avertexnormals[i][2] * dist +
-                    forward[2] * beamlength;
+        p.die = cl.time + 0.01;
+        p.color = 0x6f;
+        p.type = pt_explode;
+
+        p.org[0] = ent->origin[0] + r_avertexnormals[i][0] * dist +
+                   forward[0] * beamlength;
+        p.org[1] = ent->origin[1] + r_avertexnormals[i][1] * dist +
+                   forward[1] * beamlength;
+        p.org[2] = ent->origin[2] + r_avertexnormals[i][2] * dist +
+                   forward[2] * beamlength;
+
+        R_AddParticle(&p);
     }
 }
 
@@ -139,14 +249,7 @@ R_ClearParticles
 ===============
 */
 void R_ClearParticles(void) {
-    i32 i;
-
-    free_particles = &particles[0];
-    active_particles = NULL;
-
-    for (i = 0; i < r_numparticles; i++)
-        particles[i].next = &particles[i + 1];
-    particles[r_numparticles - 1].next = NULL;
+    r_particles.count = 0;
 }
 
 
@@ -155,7 +258,7 @@ void R_ReadPointFile_f(void) {
     vec3_t org;
     i32 r;
     i32 c;
-    particle_t* p;
+    particle_t p = {0};
     char name[MAX_OSPATH];
 
     sprintf(name, "maps/%s.pts", sv.name);
@@ -174,20 +277,17 @@ void R_ReadPointFile_f(void) {
             break;
         c++;
 
-        if (!free_particles) {
+        if (R_ParticlesFull()) {
             Con_Printf("Not enough free particles\n");
             break;
         }
-        p = free_particles;
-        free_particles = p->next;
-        p->next = active_particles;
-        active_particles = p;
-
-        p->die = 99999;
-        p->color = (-c) & 15;
-        p->type = pt_static;
-        VectorCopy(vec3_origin, p->vel);
-        VectorCopy(org, p->org);
+
+        p.die = 99999;
+        p.color = (-c) & 15;
+        p.type = pt_static;
+        VectorCopy(org, p.org);
+
+        R_AddParticle(&p);
     }
 
     fclose(f);
@@ -228,32 +328,29 @@ R_ParticleExplosion
 */
 void R_ParticleExplosion(vec3_t org) {
     i32 i, j;
-    particle_t* p;
+    particle_t p = {0};
 
     for (i = 0; i < 1024; i++) {
-        if (!free_particles)
+        if (R_ParticlesFull())
             return;
-        p = free_particles;
-        free_particles = p->next;
-        p->next = active_particles;
-        active_particles = p;
-
-        p->die = cl.time + 5;
-        p->color = ramp1[0];
-        p->ramp = rand() & 3;
+        p.die = cl.time + 5;
+        p.color = ramp1[0];
+        p.ramp = rand() & 3;
         if (i & 1) {
-            p->type = pt_explode;
+            p.type = pt_explode;
             for (j = 0; j < 3; j++) {
-                p->org[j] = org[j] + ((rand() % 32) - 16);
-                p->vel[j] = (rand() % 512) - 256;
+                p.org[j] = org[j] + ((rand() % 32) - 16);
+                p.vel[j] = (rand() % 512) - 256;
             }
         } else {
-            p->type = pt_explode2;
+            p.type = pt_explode2;
             for (j = 0; j < 3; j++) {
-                p->org[j] = org[j] + ((rand() % 32) - 16);
-                p->vel[j] = (rand() % 512) - 256;
+                p.org[j] = org[j] + ((rand() % 32) - 16);
+                p.vel[j] = (rand() % 512) - 256;
             }
         }
+
+        R_AddParticle(&p);
     }
 }
 
@@ -265,26 +362,23 @@ R_ParticleExplosion2
 */
 void R_ParticleExplosion2(vec3_t org, i32 colorStart, i32 colorLength) {
     i32 i, j;
-    particle_t* p;
+    particle_t p = {0};
     i32 colorMod = 0;
 
     for (i = 0; i < 512; i++) {
-        if (!free_particles)
+        if (R_ParticlesFull())
             return;
-        p = free_particles;
-        free_particles = p->next;
-        p->next = active_particles;
-        active_particles = p;
-
-        p->die = cl.time + 0.3;
-        p->color = colorStart + (colorMod % colorLength);
+        p.die = cl.time + 0.3;
+        p.color = colorStart + (colorMod % colorLength);
         colorMod++;
 
-        p->type = pt_blob;
+        p.type = pt_blob;
         for (j = 0; j < 3; j++) {
-            p->org[j] = org[j] + ((rand() % 32) - 16);
-            p->vel[j] = (rand() % 512) - 256;
+            p.org[j] = org[j] + ((rand() % 32) - 16);
+            p.vel[j] = (rand() % 512) - 256;
         }
+
+        R_AddParticle(&p);
     }
 }
 
@@ -296,33 +390,30 @@ R_BlobExplosion
 */
 void R_BlobExplosion(vec3_t org) {
     i32 i, j;
-    particle_t* p;
+    particle_t p = {0};
 
     for (i = 0; i < 1024; i++) {
-        if (!free_particles)
+        if (R_ParticlesFull())
             return;
-        p = free_particles;
-        free_particles = p->next;
-        p->next = active_particles;
-        active_particles = p;
-
-        p->die = cl.time + 1 + (rand() & 8) * 0.05;
+        p.die = cl.time + 1 + (rand() & 8) * 0.05;
 
         if (i & 1) {
-            p->type = pt_blob;
-            p->color = 66 + rand() % 6;
+            p.type = pt_blob;
+            p.color = 66 + rand() % 6;
             for (j = 0; j < 3; j++) {
-                p->org[j] = org[j] + ((rand() % 32) - 16);
-                p->vel[j] = (rand() % 512) - 256;
+                p.org[j] = org[j] + ((rand() % 32) - 16);
+                p.vel[j] = (rand() % 512) - 256;
             }
         } else {
-            p->type = pt_blob2;
-            p->color = 150 + rand() % 6;
+            p.type = pt_blob2;
+            p.color = 150 + rand() % 6;
             for (j = 0; j < 3; j++) {
-                p->org[j] = org[j] + ((rand() % 32) - 16);
-                p->vel[j] = (rand() % 512) - 256;
+                p.org[j] = org[j] + ((rand() % 32) - 16);
+                p.vel[j] = (rand() % 512) - 256;
             }
         }
+
+        R_AddParticle(&p);
     }
 }
 
@@ -334,42 +425,39 @@ R_RunParticleEffect
 */
 void R_RunParticleEffect(vec3_t org, vec3_t dir, i32 color, i32 count) {
     i32 i, j;
-    particle_t* p;
+    particle_t p = {0};
 
     for (i = 0; i < count; i++) {
-        if (!free_particles)
+        if (R_ParticlesFull())
             return;
-        p = free_particles;
-        free_particles = p->next;
-        p->next = active_particles;
-        active_particles = p;
-
         if (count == 1024) { // rocket explosion
-            p->die = cl.time + 5;
-            p->color = ramp1[0];
-            p->ramp = rand() & 3;
+            p.die = cl.time + 5;
+            p.color = ramp1[0];
+            p.ramp = rand() & 3;
             if (i & 1) {
-                p->type = pt_explode;
+                p.type = pt_explode;
                 for (j = 0; j < 3; j++) {
-                    p->org[j] = org[j] + ((rand() % 32) - 16);
-                    p->vel[j] = (rand() % 512) - 256;
+                    p.org[j] = org[j] + ((rand() % 32) - 16);
+                    p.vel[j] = (rand() % 512) - 256;
                 }
             } else {
-                p->type = pt_explode2;
+                p.type = pt_explode2;
                 for (j = 0; j < 3; j++) {
-                    p->org[j] = org[j] + ((rand() % 32) - 16);
-                    p->vel[j] = (rand() % 512) - 256;
+                    p.org[j] = org[j] + ((rand() % 32) - 16);
+                    p.vel[j] = (rand() % 512) - 256;
                 }
             }
         } else {
-            p->die = cl.time + 0.1 * (rand() % 5);
-            p->color = (color & ~7) + (rand() & 7);
-            p->type = pt_slowgrav;
+            p.die = cl.time + 0.1 * (rand() % 5);
+            p.color = (color & ~7) + (rand() & 7);
+            p.type = pt_slowgrav;
             for (j = 0; j < 3; j++) {
-                p->org[j] = org[j] + ((rand() & 15) - 8);
-                p->vel[j] = dir[j] * 15; // + (rand()%300)-150;
+                p.org[j] = org[j] + ((rand() & 15) - 8);
+                p.vel[j] = dir[j] * 15; // + (rand()%300)-150;
             }
         }
+
+        R_AddParticle(&p);
     }
 }
 
@@ -382,35 +470,32 @@ R_LavaSplash
 */
 void R_LavaSplash(vec3_t org) {
     i32 i, j, k;
-    particle_t* p;
+    particle_t p = {0};
     float vel;
     vec3_t dir;
 
     for (i = -16; i < 16; i++)
         for (j = -16; j < 16; j++)
             for (k = 0; k < 1; k++) {
-                if (!free_particles)
+                if (R_ParticlesFull())
                     return;
-                p = free_particles;
-                free_particles = p->next;
-                p->next = active_particles;
-                active_particles = p;
-
-                p->die = cl.time + 2 + (rand() & 31) * 0.02;
-                p->color = 224 + (rand() & 7);
-                p->type = pt_slowgrav;
+                p.die = cl.time + 2 + (rand() & 31) * 0.02;
+                p.color = 224 + (rand() & 7);
+                p.type = pt_slowgrav;
 
                 dir[0] = j * 8 + (rand() & 7);
                 dir[1] = i * 8 + (rand() & 7);
                 dir[2] = 256;
 
-                p->org[0] = org[0] + dir[0];
-                p->org[1] = org[1] + dir[1];
-                p->org[2] = org[2] + (rand() & 63);
+                p.org[0] = org[0] + dir[0];
+                p.org[1] = org[1] + dir[1];
+                p.org[2] = org[2] + (rand() & 63);
 
                 VectorNormalize(dir);
                 vel = 50 + (rand() & 63);
-                VectorScale(dir, vel, p->vel);
+                VectorScale(dir, vel, p.vel);
+
+                R_AddParticle(&p);
             }
 }
 
@@ -422,35 +507,32 @@ R_TeleportSplash
 */
 void R_TeleportSplash(vec3_t org) {
     i32 i, j, k;
-    particle_t* p;
+    particle_t p = {0};
     float vel;
     vec3_t dir;
 
     for (i = -16; i < 16; i += 4)
         for (j = -16; j < 16; j += 4)
             for (k = -24; k < 32; k += 4) {
-                if (!free_particles)
+                if (R_ParticlesFull())
                     return;
-                p = free_particles;
-                free_particles = p->next;
-                p->next = active_particles;
-                active_particles = p;
-
-                p->die = cl.time + 0.2 + (rand() & 7) * 0.02;
-                p->color = 7 + (rand() & 7);
-                p->type = pt_slowgrav;
+                p.die = cl.time + 0.2 + (rand() & 7) * 0.02;
+                p.color = 7 + (rand() & 7);
+                p.type = pt_slowgrav;
 
                 dir[0] = j * 8;
                 dir[1] = i * 8;
                 dir[2] = k * 8;
 
-                p->org[0] = org[0] + i + (rand() & 3);
-                p->org[1] = org[1] + j + (rand() & 3);
-                p->org[2] = org[2] + k + (rand() & 3);
+                p.org[0] = org[0] + i + (rand() & 3);
+                p.org[1] = org[1] + j + (rand() & 3);
+                p.org[2] = org[2] + k + (rand() & 3);
 
                 VectorNormalize(dir);
                 vel = 50 + (rand() & 63);
-                VectorScale(dir, vel, p->vel);
+                VectorScale(dir, vel, p.vel);
+
+                R_AddParticle(&p);
             }
 }
 
@@ -458,7 +540,7 @@ void R_RocketTrail(vec3_t start, vec3_t end, i32 type) {
     vec3_t vec;
     float len;
     i32 j;
-    particle_t* p;
+    particle_t p = {0};
     i32 dec;
     static i32 tracercount;
 
@@ -474,194 +556,272 @@ void R_RocketTrail(vec3_t start, vec3_t end, i32 type) {
     while (len > 0) {
         len -= dec;
 
-        if (!free_particles)
+        if (R_ParticlesFull())
             return;
-        p = free_particles;
-        free_particles = p->next;
-        p->next = active_particles;
-        active_particles = p;
 
-        VectorCopy(vec3_origin, p->vel);
-        p->die = cl.time + 2;
+        VectorCopy(vec3_origin, p.vel);
+        p.die = cl.time + 2;
 
         switch (type) {
             case 0: // rocket trail
-                p->ramp = (rand() & 3);
-                p->color = ramp3[(i32) p->ramp];
-                p->type = pt_fire;
+                p.ramp = (rand() & 3);
+                p.color = ramp3[(i32) p.ramp];
+                p.type = pt_fire;
                 for (j = 0; j < 3; j++)
-                    p->org[j] = start[j] + ((rand() % 6) - 3);
+                    p.org[j] = start[j] + ((rand() % 6) - 3);
                 break;
 
             case 1: // smoke smoke
-                p->ramp = (rand() & 3) + 2;
-                p->color = ramp3[(i32) p->ramp];
-                p->type = pt_fire;
+                p.ramp = (rand() & 3) + 2;
+                p.color = ramp3[(i32) p.ramp];
+                p.type = pt_fire;
                 for (j = 0; j < 3; j++)
-                    p->org[j] = start[j] + ((rand() % 6) - 3);
+                    p.org[j] = start[j] + ((rand() % 6) - 3);
                 break;
 
             case 2: // blood
-                p->type = pt_grav;
-                p->color = 67 + (rand() & 3);
+                p.type = pt_grav;
+                p.color = 67 + (rand() & 3);
                 for (j = 0; j < 3; j++)
-                    p->org[j] = start[j] + ((rand() % 6) - 3);
+                    p.org[j] = start[j] + ((rand() % 6) - 3);
                 break;
 
             case 3:
             case 5: // tracer
-                p->die = cl.time + 0.5;
-                p->type = pt_static;
+                p.die = cl.time + 0.5;
+                p.type = pt_static;
                 if (type == 3)
-                    p->color = 52 + ((tracercount & 4) << 1);
+                    p.color = 52 + ((tracercount & 4) << 1);
                 else
-                    p->color = 230 + ((tracercount & 4) << 1);
+                    p.color = 230 + ((tracercount & 4) << 1);
 
                 tracercount++;
 
-                VectorCopy(start, p->org);
+                VectorCopy(start, p.org);
                 if (tracercount & 1) {
-                    p->vel[0] = 30 * vec[1];
-                    p->vel[1] = 30 * -vec[0];
+                    p.vel[0] = 30 * vec[1];
+                    p.vel[1] = 30 * -vec[0];
                 } else {
-                    p->vel[0] = 30 * -vec[1];
-                    p->vel[1] = 30 * vec[0];
+                    p.vel[0] = 30 * -vec[1];
+                    p.vel[1] = 30 * vec[0];
                 }
                 break;
 
             case 4: // slight blood
-                p->type = pt_grav;
-                p->color = 67 + (rand() & 3);
+                p.type = pt_grav;
+                p.color = 67 + (rand() & 3);
                 for (j = 0; j < 3; j++)
-                    p->org[j] = start[j] + ((rand() % 6) - 3);
+                    p.org[j] = start[j] + ((rand() % 6) - 3);
                 len -= 3;
                 break;
 
             case 6: // voor trail
-                p->color = 9 * 16 + 8 + (rand() & 3);
-                p->type = pt_static;
-                p->die = cl.time + 0.3;
+                p.color = 9 * 16 + 8 + (rand() & 3);
+                p.type = pt_static;
+                p.die = cl.time + 0.3;
                 for (j = 0; j < 3; j++)
-                    p->org[j] = start[j] + ((rand() & 15) - 8);
+                    p.org[j] = start[j] + ((rand() & 15) - 8);
                 break;
         }
 
+        R_AddParticle(&p);
 
         VectorAdd(start, vec, start);
     }
 }
 
 
+extern cvar_t sv_gravity;
+
 /*
 ===============
-R_DrawParticles
+R_MoveRun
+
+Moves count particles from index from down to index to
 ===============
 */
-extern cvar_t sv_gravity;
+static void R_MoveRun(i32 to, i32 from, i32 count) {
+    particles_t* pt;
+    i32 k;
+
+    pt = &r_particles;
+    for (k = 0; k < 3; k++) {
+        memmove(&pt->org[k][to], &pt->org[k][from], count * sizeof(float));
+        memmove(&pt->vel[k][to], &pt->vel[k][from], count * sizeof(float));
+    }
+    memmove(&pt->color[to], &pt->color[from], count);
+    memmove(&pt->ramp[to], &pt->ramp[from], count * sizeof(float));
+    memmove(&pt->die[to], &pt->die[from], count * sizeof(float));
+    memmove(&pt->type[to], &pt->type[from], count);
+}
 
-void R_DrawParticles(void) {
-    particle_t *p, *kill;
-    float grav;
-    i32 i;
-    float time2, time3;
-    float time1;
-    float dvel;
-    float frametime;
+/*
+===============
+R_KillParticles
 
-    D_StartParticles();
+Drops the particles whose time is up by moving each run of live ones down,
+which keeps them in the order they were spawned
+===============
+*/
+static void R_KillParticles(void) {
+    float* die;
+    i32 count, i, j, start;
+
+    die = r_particles.die;
+    count = r_particles.count;
+    for (i = 0; i < count && die[i] >= cl.time; i++)
+        ;
+    j = i;
+    while (i < count) {
+        while (i < count && die[i] < cl.time)
+            i++;
+        start = i;
+        while (i < count && die[i] >= cl.time)
+            i++;
+        if (i > start) {
+            R_MoveRun(j, start, i - start);
+            j += i - start;
+        }
+    }
+    r_particles.count = j;
+}
 
-    VectorScale(vright, xscaleshrink, r_pright);
-    VectorScale(vup, yscaleshrink, r_pup);
-    VectorCopy(vpn, r_ppn);
+/*
+===============
+R_MoveParticles
+===============
+*/
+static void R_MoveParticles(float frametime) {
+    float* org;
+    float* vel;
+    i32 i, k, count;
+
+    count = r_particles.count;
+    for (k = 0; k < 3; k++) {
+        org = r_particles.org[k];
+        vel = r_particles.vel[k];
+        i = 0;
+#ifdef SIMD_VECTOR
+        for (; i + 4 <= count; i += 4) {
+            vec4f_t v = V4_Mul(V4_LoadArrayF(&vel[i]), V4_SplatF(frametime));
+            V4_StoreF(&org[i], V4_AddF(V4_LoadArrayF(&org[i]), v));
+        }
+#endif
+        for (; i < count; i++)
+            org[i] += vel[i] * frametime;
+    }
+}
+
+/*
+===============
+R_AccelerateParticles
+
+Drag and gravity for every type at once, from tables indexed by the type.
+A zero drag leaves the velocity as it is, so the types without drag need no
+branch
+===============
+*/
+static void R_AccelerateParticles(float frametime) {
+    float dragxy[pt_blob2 + 1], dragz[pt_blob2 + 1], gravity[pt_blob2 + 1];
+    float grav, dvel, k;
+    float *vx, *vy, *vz;
+    byte* type;
+    i32 i, t;
 
-    frametime = cl.time - cl.oldtime;
-    time3 = frametime * 15;
-    time2 = frametime * 10; // 15;
-    time1 = frametime * 5;
     grav = frametime * sv_gravity.value * 0.05;
     dvel = 4 * frametime;
 
-    for (;;) {
-        kill = active_particles;
-        if (kill && kill->die < cl.time) {
-            active_particles = kill->next;
-            kill->next = free_particles;
-            free_particles = kill;
-            continue;
-        }
-        break;
+    for (t = 0; t <= pt_blob2; t++) {
+        dragxy[t] = 0;
+        dragz[t] = 0;
+        gravity[t] = -grav;
+    }
+    gravity[pt_static] = 0;
+    gravity[pt_fire] = grav;
+    dragxy[pt_explode] = dragz[pt_explode] = dvel;
+    dragxy[pt_explode2] = dragz[pt_explode2] = -frametime;
+    dragxy[pt_blob] = dragz[pt_blob] = dvel;
+    dragxy[pt_blob2] = -dvel;
+
+    vx = r_particles.vel[0];
+    vy = r_particles.vel[1];
+    vz = r_particles.vel[2];
+    type = r_particles.type;
+    for (i = 0; i < r_particles.count; i++) {
+        t = type[i];
+        k = dragxy[t];
+        vx[i] += vx[i] * k;
+        vy[i] += vy[i] * k;
+        vz[i] += vz[i] * dragz[t];
+        vz[i] += gravity[t];
     }
+}
 
-    for (p = active_particles; p; p = p->next) {
-        for (;;) {
-            kill = p->next;
-            if (kill && kill->die < cl.time) {
-                p->next = kill->next;
-                kill->next = free_particles;
-                free_particles = kill;
-                continue;
-            }
-            break;
-        }
+/*
+===============
+R_RampParticles
 
-        D_DrawParticle(p);
+Steps the color ramps of fire and explosions, a particle dies at the end of
+its ramp
+===============
+*/
+static void R_RampParticles(float frametime) {
+    const i32* ramps[pt_blob2 + 1] = {NULL};
+    float speed[pt_blob2 + 1];
+    float end[pt_blob2 + 1];
+    float* ramp;
+    i32 i, t;
+
+    ramps[pt_fire] = ramp3;
+    speed[pt_fire] = frametime * 5;
+    end[pt_fire] = 6;
+    ramps[pt_explode] = ramp1;
+    speed[pt_explode] = frametime * 10;
+    end[pt_explode] = 8;
+    ramps[pt_explode2] = ramp2;
+    speed[pt_explode2] = frametime * 15;
+    end[pt_explode2] = 8;
+
+    ramp = r_particles.ramp;
+    for (i = 0; i < r_particles.count; i++) {
+        t = r_particles.type[i];
+        if (!ramps[t])
+            continue;
+        ramp[i] += speed[t];
+        if (ramp[i] >= end[t])
+            r_particles.die[i] = -1;
+        else
+            r_particles.color[i] = ramps[t][(i32) ramp[i]];
+    }
+}
 
-        p->org[0] += p->vel[0] * frametime;
-        p->org[1] += p->vel[1] * frametime;
-        p->org[2] += p->vel[2] * frametime;
+/*
+===============
+R_DrawParticles
 
-        switch (p->type) {
-            case pt_static:
-                break;
-            case pt_fire:
-                p->ramp += time1;
-                if (p->ramp >= 6)
-                    p->die = -1;
-                else
-                    p->color = ramp3[(i32) p->ramp];
-                p->vel[2] += grav;
-                break;
+Each step is a pass over all the particles: the dead ones are dropped, the
+rest drawn, then moved and accelerated
+===============
+*/
+void R_DrawParticles(void) {
+    float frametime;
 
-            case pt_explode:
-                p->ramp += time2;
-                if (p->ramp >= 8)
-                    p->die = -1;
-                else
-                    p->color = ramp1[(i32) p->ramp];
-                for (i = 0; i < 3; i++)
-                    p->vel[i] += p->vel[i] * dvel;
-                p->vel[2] -= grav;
-                break;
+    R_CheckParticles();
 
-            case pt_explode2:
-                p->ramp += time3;
-                if (p->ramp >= 8)
-                    p->die = -1;
-                else
-                    p->color = ramp2[(i32) p->ramp];
-                for (i = 0; i < 3; i++)
-                    p->vel[i] -= p->vel[i] * frametime;
-                p->vel[2] -= grav;
-                break;
+    D_StartParticles();
 
-            case pt_blob:
-                for (i = 0; i < 3; i++)
-                    p->vel[i] += p->vel[i] * dvel;
-                p->vel[2] -= grav;
-                break;
+    VectorScale(vright, xscaleshrink, r_pright);
+    VectorScale(vup, yscaleshrink, r_pup);
+    VectorCopy(vpn, r_ppn);
 
-            case pt_blob2:
-                for (i = 0; i < 2; i++)
-                    p->vel[i] -= p->vel[i] * dvel;
-                p->vel[2] -= grav;
-                break;
+    frametime = cl.time - cl.oldtime;
 
-            case pt_grav:
-            case pt_slowgrav:
-                p->vel[2] -= grav;
-                break;
-        }
-    }
+    R_KillParticles();
+    PROF_COUNT("particles", r_particles.count);
+    D_DrawParticles(&r_particles);
+    R_MoveParticles(frametime);
+    R_AccelerateParticles(frametime);
+    R_RampParticles(frametime);
 
     D_EndParticles();
 }
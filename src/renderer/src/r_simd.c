@@ -0,0 +1,510 @@
+/*
+ * Copyright (C) 1996-1997 Id Software, Inc.
+ * Copyright (C) Henrique Barateli, <henriquejb194@gmail.com>, et al.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+// r_simd.c -- vector versions of the lightmap builder and surface blocks
+//
+// Like the span drawers in d_simd.c these must build exactly the surfaces
+// the C code in r_surf.c builds. The dynamic light falloff is worked out in
+// float lanes with the same conversions the scalar expressions make, and
+// the block drawers only keep the low 16 bits of each light value, which
+// is all the (light & 0xFF00) colormap row needs.
+//
+// The mip 2 and mip 3 blocks are 4 and 2 texels wide, too narrow to be worth
+// a vector, and stay in C.
+
+
+#include "r_local.h"
+#include "client.h"
+#include "cmd.h"
+#include "console.h"
+#include "sys.h"
+#include "zone.h"
+#include "simd.h"
+#include <math.h>
+
+
+#ifdef SIMD_VECTOR
+
+/*
+===============
+R_FillBlockLights
+===============
+*/
+static void R_FillBlockLights(i32 size, u32 value) {
+    vec4i_t v;
+    i32 i;
+
+    v = V4_Splat(value);
+    for (i = 0; i + 4 <= size; i += 4)
+        V4_Store(&blocklights[i], v);
+    for (; i < size; i++)
+        blocklights[i] = value;
+}
+
+/*
+===============
+R_AddLightmap
+===============
+*/
+static void R_AddLightmap(const byte* lightmap, i32 size, u32 scale) {
+    vec4i_t vscale, bl;
+    i32 i;
+
+    vscale = V4_Splat(scale);
+    for (i = 0; i + 4 <= size; i += 4) {
+        bl = V4_Load(&blocklights[i]);
+        bl = V4_Add(bl, V4_MulLow(V4_LoadBytes(lightmap + i), vscale));
+        V4_Store(&blocklights[i], bl);
+    }
+    for (; i < size; i++)
+        blocklights[i] += lightmap[i] * scale;
+}
+
+/*
+===============
+R_AddLightRow
+
+One row of R_AddDynamicLights, four lightmap samples at a time
+===============
+*/
+static void R_AddLightRow(u32* bl, i32 smax, float local, i32 td, float rad,
+                          float minlight) {
+    vec4f_t vlocal, vrad, vminlight, v256, dist;
+    vec4i_t vtd, halftd, vsd, old, lit, sum;
+    i32 s, sd;
+    float d;
+
+    vlocal = V4_SplatF(local);
+    vrad = V4_SplatF(rad);
+    vminlight = V4_SplatF(minlight);
+    v256 = V4_SplatF(256.0f);
+    vtd = V4_Splat(td);
+    halftd = V4_Splat(td >> 1);
+
+    for (s = 0; s + 4 <= smax; s += 4) {
+        vsd = V4_Trunc(V4_SubF(vlocal, V4_ToFloat(V4_Ramp(s * 16, 16))));
+        vsd = V4_Abs(vsd);
+        dist = V4_ToFloat(V4_Select(V4_Greater(vsd, vtd), V4_Add(vsd, halftd),
+                                    V4_Add(vtd, V4_Shr(vsd, 1))));
+        lit = V4_LessF(dist, vminlight);
+
+        old = V4_Load(bl + s);
+        sum = V4_TruncUnsigned(V4_AddF(V4_FromUnsigned(old),
+                                       V4_Mul(V4_SubF(vrad, dist), v256)));
+        V4_Store(bl + s, V4_Select(lit, sum, old));
+    }
+
+    for (; s < smax; s++) {
+        sd = local - s * 16;
+        if (sd < 0)
+            sd = -sd;
+        if (sd > td)
+            d = sd + (td >> 1);
+        else
+            d = td + (sd >> 1);
+        if (d < minlight)
+            bl[s] += (rad - d) * 256;
+    }
+}
+
+/*
+===============
+R_AddDynamicLightsV
+===============
+*/
+static void R_AddDynamicLightsV(void) {
+    msurface_t* surf;
+    i32 lnum;
+    i32 td;
+    float dist, rad, minlight;
+    vec3_t impact, local;
+    i32 t;
+    i32 i;
+    i32 smax, tmax;
+    mtexinfo_t* tex;
+
+    surf = r_drawsurf.surf;
+    smax = (surf->extents[0] >> 4) + 1;
+    tmax = (surf->extents[1] >> 4) + 1;
+    tex = surf->texinfo;
+
+    for (lnum = 0; lnum < MAX_DLIGHTS; lnum++) {
+        if (!(surf->dlightbits & (1 << lnum)))
+            continue; // not lit by this light
+
+        rad = cl_dlights[lnum].radius;
+        dist = DotProduct(cl_dlights[lnum].origin, surf->plane->normal) -
+               surf->plane->dist;
+        rad -= fabs(dist);
+        minlight = cl_dlights[lnum].minlight;
+        if (rad < minlight)
+            continue;
+        minlight = rad - minlight;
+
+        for (i = 0; i < 3; i++) {
+            impact[i] =
+                cl_dlights[lnum].origin[i] - surf->plane->normal[i] * dist;
+        }
+
+        local[0] = DotProduct(impact, tex->vecs[0]) + tex->vecs[0][3];
+        local[1] = DotProduct(impact, tex->vecs[1]) + tex->vecs[1][3];
+
+        local[0] -= surf->texturemins[0];
+        local[1] -= surf->texturemins[1];
+
+        for (t = 0; t < tmax; t++) {
+            td = local[1] - t * 16;
+            if (td < 0)
+                td = -td;
+            R_AddLightRow(&blocklights[t * smax], smax, local[0], td, rad,
+                          minlight);
+        }
+    }
+}
+
+/*
+===============
+R_BuildLightMapV
+===============
+*/
+static void R_BuildLightMapV(void) {
+    i32 smax, tmax;
+    i32 i, size;
+    byte* lightmap;
+    i32 maps;
+    msurface_t* surf;
+    vec4i_t top, floor, bl;
+    i32 t;
+
+    surf = r_drawsurf.surf;
+
+    smax = (surf->extents[0] >> 4) + 1;
+    tmax = (surf->extents[1] >> 4) + 1;
+    size = smax * tmax;
+    lightmap = surf->samples;
+
+    if (r_fullbright.value || !cl.worldmodel->lightdata) {
+        R_FillBlockLights(size, 0);
+        return;
+    }
+
+    // clear to ambient
+    R_FillBlockLights(size, r_refdef.ambientlight << 8);
+
+    // add all the lightmaps
+    if (lightmap)
+        for (maps = 0; maps < MAXLIGHTMAPS && surf->styles[maps] != 255;
+             maps++) {
+            R_AddLightmap(lightmap, size, r_drawsurf.lightadj[maps]);
+            lightmap += size; // skip to next lightmap
+        }
+
+    // add all the dynamic lights
+    if (surf->dlightframe == r_framecount)
+        R_AddDynamicLightsV();
+
+    // bound, invert, and shift
+    top = V4_Splat(255 * 256);
+    floor = V4_Splat(1 << 6);
+    for (i = 0; i + 4 <= size; i += 4) {
+        bl = V4_Shr(V4_Sub(top, V4_Load(&blocklights[i])), 8 - VID_CBITS);
+        V4_Store(&blocklights[i], V4_Max(bl, floor));
+    }
+    for (; i < size; i++) {
+        t = (255 * 256 - (i32) blocklights[i]) >> (8 - VID_CBITS);
+        if (t < (1 << 6))
+            t = (1 << 6);
+        blocklights[i] = t;
+    }
+}
+
+/*
+================
+R_DrawBlockRow8
+
+Pixel b of the row gets light + (count - 1 - b) * lightstep, count is 8 or 16
+================
+*/
+static inline void R_DrawBlockRow8(byte* prowdest, const byte* psource,
+                                   u32 light, u32 lightstep, u32 count) {
+    const byte* colormap = (byte*) vid.colormap;
+    u16 index[16];
+    vec8s_t mask, ramp;
+    u32 b;
+
+    mask = V8_Splat((i16) 0xFF00);
+    light += (count - 1) * lightstep;
+    for (b = 0; b < count; b += 8) {
+        ramp = V8_Ramp((i16) (light - b * lightstep), (i16) -lightstep);
+        V8_Store(&index[b],
+                 V8_Add(V8_And(ramp, mask), V8_LoadBytes(psource + b)));
+    }
+    for (b = 0; b < count; b++)
+        prowdest[b] = colormap[index[b]];
+}
+
+/*
+================
+R_DrawSurfaceBlock8V_mip0
+================
+*/
+static void R_DrawSurfaceBlock8V_mip0(void) {
+    i32 v, i, leftstep, rightstep, left, right;
+    byte *psource, *prowdest;
+
+    psource = pbasesource;
+    prowdest = prowdestbase;
+
+    for (v = 0; v < r_numvblocks; v++) {
+        left = r_lightptr[0];
+        right = r_lightptr[1];
+        r_lightptr += r_lightwidth;
+        leftstep = (r_lightptr[0] - left) >> 4;
+        rightstep = (r_lightptr[1] - right) >> 4;
+
+        for (i = 0; i < 16; i++) {
+            R_DrawBlockRow8(prowdest, psource, right, (left - right) >> 4,
+                            16);
+            psource += sourcetstep;
+            right += rightstep;
+            left += leftstep;
+            prowdest += surfrowbytes;
+        }
+
+        if (psource >= r_sourcemax)
+            psource -= r_stepback;
+    }
+}
+
+/*
+================
+R_DrawSurfaceBlock8V_mip1
+================
+*/
+static void R_DrawSurfaceBlock8V_mip1(void) {
+    i32 v, i, leftstep, rightstep, left, right;
+    byte *psource, *prowdest;
+
+    psource = pbasesource;
+    prowdest = prowdestbase;
+
+    for (v = 0; v < r_numvblocks; v++) {
+        left = r_lightptr[0];
+        right = r_lightptr[1];
+        r_lightptr += r_lightwidth;
+        leftstep = (r_lightptr[0] - left) >> 3;
+        rightstep = (r_lightptr[1] - right) >> 3;
+
+        for (i = 0; i < 8; i++) {
+            R_DrawBlockRow8(prowdest, psource, right, (left - right) >> 3, 8);
+            psource += sourcetstep;
+            right += rightstep;
+            left += leftstep;
+            prowdest += surfrowbytes;
+        }
+
+        if (psource >= r_sourcemax)
+            psource -= r_stepback;
+    }
+}
+
+#endif
+
+
+/*
+=============
+R_SelectSurfaceDrawers
+=============
+*/
+void R_SelectSurfaceDrawers(qboolean vector) {
+    r_buildlightmap = R_BuildLightMap;
+    r_surfblockdrawers[0] = R_DrawSurfaceBlock8_mip0;
+    r_surfblockdrawers[1] = R_DrawSurfaceBlock8_mip1;
+
+    if (!vector)
+        return;
+
+#ifdef SIMD_VECTOR
+    r_buildlightmap = R_BuildLightMapV;
+    r_surfblockdrawers[0] = R_DrawSurfaceBlock8V_mip0;
+    r_surfblockdrawers[1] = R_DrawSurfaceBlock8V_mip1;
+#endif
+}
+
+/*
+=============
+R_SetupBenchSurface
+
+Sets up r_drawsurf the way D_CacheSurface does, drawing into dest
+=============
+*/
+static void R_SetupBenchSurface(msurface_t* surf, i32 miplevel, byte* dest) {
+    i32 i;
+
+    r_drawsurf.surf = surf;
+    r_drawsurf.surfmip = miplevel;
+    r_drawsurf.surfwidth = surf->extents[0] >> miplevel;
+    r_drawsurf.rowbytes = r_drawsurf.surfwidth;
+    r_drawsurf.surfheight = surf->extents[1] >> miplevel;
+    r_drawsurf.surfdat = dest;
+    r_drawsurf.texture = R_TextureAnimation(surf->texinfo->texture);
+    for (i = 0; i < MAXLIGHTMAPS; i++)
+        r_drawsurf.lightadj[i] = d_lightstylevalue[surf->styles[i]];
+}
+
+/*
+=============
+R_LightBenchSurface
+
+Puts dynamic light 0 just in front of the first corner of the surface
+=============
+*/
+static void R_LightBenchSurface(msurface_t* surf) {
+    model_t* model = cl.worldmodel;
+    i32 lindex;
+    medge_t* edge;
+    float* corner;
+
+    lindex = model->surfedges[surf->firstedge];
+    edge = &model->edges[lindex > 0 ? lindex : -lindex];
+    corner = model->vertexes[edge->v[0]].position;
+
+    VectorMA(corner, 16, surf->plane->normal, cl_dlights[0].origin);
+    cl_dlights[0].radius = 300;
+    cl_dlights[0].minlight = 0;
+    surf->dlightframe = r_framecount;
+    surf->dlightbits = 1;
+}
+
+/*
+=============
+R_BenchSurfaces
+
+Builds every mip level of every lightmapped world surface with the C and
+the vector drawers, and prints the times and how many came out different
+=============
+*/
+static void R_BenchSurfaces(byte* dest[2], qboolean dlit, i32 reps) {
+    msurface_t* surf;
+    i32 saveframe, savebits;
+    i32 i, k, r, mip, count, diffs;
+    double time[2], start;
+
+    time[0] = time[1] = 0;
+    count = 0;
+    diffs = 0;
+
+    for (i = 0; i < cl.worldmodel->numsurfaces; i++) {
+        surf = &cl.worldmodel->surfaces[i];
+        if (surf->flags & (SURF_DRAWSKY | SURF_DRAWTURB))
+            continue;
+
+        saveframe = surf->dlightframe;
+        savebits = surf->dlightbits;
+        if (dlit)
+            R_LightBenchSurface(surf);
+
+        for (mip = 0; mip < MIPLEVELS; mip++) {
+            for (k = 0; k < 2; k++) {
+                R_SelectSurfaceDrawers(k == 1);
+                R_SetupBenchSurface(surf, mip, dest[k]);
+                start = Sys_FloatTime();
+                for (r = 0; r < reps; r++)
+                    R_DrawSurface();
+                time[k] += Sys_FloatTime() - start;
+            }
+            if (memcmp(dest[0], dest[1],
+                       r_drawsurf.surfwidth * r_drawsurf.surfheight)) {
+                diffs++;
+            }
+        }
+
+        surf->dlightframe = saveframe;
+        surf->dlightbits = savebits;
+        count++;
+    }
+
+    Con_Printf("%s: %i surfaces, C %.1f ms, vector %.1f ms, %i differ\n",
+               dlit ? "dynamic light" : "static light", count,
+               time[0] * 1000.0, time[1] * 1000.0, diffs);
+}
+
+/*
+=============
+R_SurfBench_f
+
+surfbench [reps]
+Replays the surfaces of the current map through both lightmap builders
+=============
+*/
+static void R_SurfBench_f(void) {
+    void (*buildlightmap)(void);
+    void (*blockdrawers[2])(void);
+    entity_t* saveentity;
+    dlight_t savelight;
+    byte* dest[2];
+    i32 reps;
+
+    if (cls.state != ca_connected || cls.signon != SIGNONS) {
+        Con_Printf("Not playing a map\n");
+        return;
+    }
+
+    reps = Cmd_Argc() > 1 ? Q_atoi(Cmd_Argv(1)) : 1;
+    if (reps < 1)
+        reps = 1;
+
+    // surfaces are at most 256 texels on a side
+    dest[0] = Q_malloc(256 * 256);
+    dest[1] = Q_malloc(256 * 256);
+    if (!dest[0] || !dest[1]) {
+        Con_Printf("Not enough memory for the bench surfaces\n");
+        Q_free(dest[0]);
+        Q_free(dest[1]);
+        return;
+    }
+
+    buildlightmap = r_buildlightmap;
+    blockdrawers[0] = r_surfblockdrawers[0];
+    blockdrawers[1] = r_surfblockdrawers[1];
+    saveentity = currententity;
+    savelight = cl_dlights[0];
+    currententity = &cl_entities[0];
+
+    R_BenchSurfaces(dest, false, reps);
+    R_BenchSurfaces(dest, true, reps);
+
+    r_buildlightmap = buildlightmap;
+    r_surfblockdrawers[0] = blockdrawers[0];
+    r_surfblockdrawers[1] = blockdrawers[1];
+    currententity = saveentity;
+    cl_dlights[0] = savelight;
+
+    Q_free(dest[0]);
+    Q_free(dest[1]);
+}
+
+/*
+=============
+R_InitSurfaceSIMD
+=============
+*/
+void R_InitSurfaceSIMD(void) {
+    Cmd_AddCommand("surfbench", R_SurfBench_f);
+}
@@ -25,34 +25,32 @@
 #include <math.h>
 
 
-drawsurf_t r_drawsurf;
-
-i32 lightleft, sourcesstep, blocksize, sourcetstep;
-i32 lightdelta, lightdeltastep;
-i32 lightright, lightleftstep, lightrightstep, blockdivshift;
-u32 blockdivmask;
-void* prowdestbase;
-byte* pbasesource;
-i32 surfrowbytes; // used by ASM files
-u32* r_lightptr;
-i32 r_stepback;
-i32 r_lightwidth;
-i32 r_numhblocks, r_numvblocks;
-byte *r_source, *r_sourcemax;
-
-void R_DrawSurfaceBlock8_mip0(void);
-void R_DrawSurfaceBlock8_mip1(void);
-void R_DrawSurfaceBlock8_mip2(void);
-void R_DrawSurfaceBlock8_mip3(void);
-
-static void (*surfmiptable[4])(void) = {
+// per thread, D_BuildSurfaces runs R_DrawSurface on the band threads
+D_THREADLOCAL drawsurf_t r_drawsurf;
+
+D_THREADLOCAL i32 lightleft, sourcesstep, blocksize, sourcetstep;
+D_THREADLOCAL i32 lightdelta, lightdeltastep;
+D_THREADLOCAL i32 lightright, lightleftstep, lightrightstep, blockdivshift;
+D_THREADLOCAL u32 blockdivmask;
+D_THREADLOCAL void* prowdestbase;
+D_THREADLOCAL byte* pbasesource;
+D_THREADLOCAL i32 surfrowbytes; // used by ASM files
+D_THREADLOCAL u32* r_lightptr;
+D_THREADLOCAL i32 r_stepback;
+D_THREADLOCAL i32 r_lightwidth;
+D_THREADLOCAL i32 r_numhblocks, r_numvblocks;
+D_THREADLOCAL byte *r_source, *r_sourcemax;
+
+// switched to the r_simd.c versions by R_SelectSurfaceDrawers
+void (*r_buildlightmap)(void) = R_BuildLightMap;
+void (*r_surfblockdrawers[MIPLEVELS])(void) = {
     R_DrawSurfaceBlock8_mip0,
     R_DrawSurfaceBlock8_mip1,
     R_DrawSurfaceBlock8_mip2,
     R_DrawSurfaceBlock8_mip3
 };
 
-u32 blocklights[18 * 18];
+D_THREADLOCAL u32 blocklights[18 * 18];
 
 
 /*
@@ -229,7 +227,7 @@ void R_DrawSurface(void) {
     texture_t* mt;
 
     // calculate the lightings
-    R_BuildLightMap();
+    (*r_buildlightmap)();
 
     surfrowbytes = r_drawsurf.rowbytes;
 
@@ -253,7 +251,7 @@ void R_DrawSurface(void) {
 
     //==============================
 
-    pblockdrawer = surfmiptable[r_drawsurf.surfmip];
+    pblockdrawer = r_surfblockdrawers[r_drawsurf.surfmip];
     // TODO: only needs to be set when there is a display settings change
     horzblockstep = blocksize;
 
@@ -0,0 +1,268 @@
+/*
+ * Copyright (C) 1996-1997 Id Software, Inc.
+ * Copyright (C) Henrique Barateli, <henriquejb194@gmail.com>, et al.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+// r_vis.c -- the potentially visible set of the world
+//
+// When the view leaf changes, R_BuildVisibleSet flattens the nodes and
+// leafs R_MarkLeaves marked into r_visset, with their boxes as floats and
+// the slots of their visible children, so R_WalkWorldNodes never touches a
+// node it won't draw. As the walk reaches a box, r_cullvisnode tests it
+// against the frustum planes, all four at once with vector units. Boxes
+// closer to a plane than float rounding can be trusted for get the old
+// test, so the walk culls exactly what it always did.
+
+
+#include "r_local.h"
+#include "zone.h"
+#include "simd.h"
+
+
+// far above the float rounding of a box plane distance inside the map
+// limits, boxes closer to a plane than this are tested exactly
+#define R_CULLMARGIN 0.5f
+
+visset_t r_visset;
+
+i32 (*r_cullvisnode)(const visnode_t* vn, i32 clipflags);
+
+// the frustum planes of this frame with each normal split in its positive
+// and negative parts, so the corner of a box farthest along the normal is
+// maxs * pos + mins * neg
+static float r_cullpos[3][4];
+static float r_cullneg[3][4];
+static float r_culldist[4];
+
+
+/*
+===============
+R_NewVisibleSet
+
+Room for every node and leaf of the new world
+===============
+*/
+void R_NewVisibleSet(void) {
+    model_t* world = cl.worldmodel;
+    i32 count;
+
+    count = world->numnodes + world->numleafs + 1;
+    r_visset.nodes = Hunk_AllocName(count * sizeof(visnode_t), "visset");
+    r_visset.leafs =
+        Hunk_AllocName((world->numleafs + 1) * sizeof(mleaf_t*), "visset");
+    r_visset.count = 0;
+    r_visset.numleafs = 0;
+}
+
+/*
+===============
+R_AddVisibleNode
+
+Returns the slot of node, or -1 if it isn't drawn
+===============
+*/
+static i32 R_AddVisibleNode(mnode_t* node) {
+    visnode_t* vn;
+    i32 slot, i;
+
+    if (node->contents == CONTENTS_SOLID)
+        return -1;
+    if (node->visframe != r_visframecount)
+        return -1;
+
+    slot = r_visset.count++;
+    vn = &r_visset.nodes[slot];
+    vn->node = node;
+    for (i = 0; i < 3; i++) {
+        vn->mins[i] = (float) node->minmaxs[i];
+        vn->maxs[i] = (float) node->minmaxs[3 + i];
+    }
+    vn->mins[3] = 0;
+    vn->maxs[3] = 0;
+
+    if (node->contents < 0) {
+        vn->children[0] = -1;
+        vn->children[1] = -1;
+    } else {
+        // the set has room for the whole world, so vn stays put
+        vn->children[0] = R_AddVisibleNode(node->children[0]);
+        vn->children[1] = R_AddVisibleNode(node->children[1]);
+    }
+    return slot;
+}
+
+/*
+===============
+R_BuildVisibleSet
+
+Called by R_MarkLeaves once it has marked the new PVS
+===============
+*/
+void R_BuildVisibleSet(void) {
+    model_t* world = cl.worldmodel;
+    mleaf_t* leaf;
+    i32 i;
+
+    r_visset.count = 0;
+    R_AddVisibleNode(world->nodes);
+
+    r_visset.numleafs = 0;
+    for (i = 1; i <= world->numleafs; i++) {
+        leaf = &world->leafs[i];
+        if (leaf->visframe == r_visframecount)
+            r_visset.leafs[r_visset.numleafs++] = leaf;
+    }
+}
+
+/*
+===============
+R_SetupVisibleSetCull
+
+Called every frame once the frustum is set up
+===============
+*/
+void R_SetupVisibleSetCull(void) {
+    float n;
+    i32 i, j;
+
+    for (i = 0; i < 4; i++) {
+        for (j = 0; j < 3; j++) {
+            n = view_clipplanes[i].normal[j];
+            r_cullpos[j][i] = n >= 0 ? n : 0;
+            r_cullneg[j][i] = n >= 0 ? 0 : n;
+        }
+        r_culldist[i] = view_clipplanes[i].dist;
+    }
+}
+
+/*
+===============
+R_CullVisNode
+
+Returns the R_CULL_ bits of the box of vn for the planes in clipflags, with
+the accept and reject points the walk has always used
+===============
+*/
+static i32 R_CullVisNode(const visnode_t* vn, i32 clipflags) {
+    i32 i, code, *pindex;
+    vec3_t acceptpt, rejectpt;
+    mnode_t* node = vn->node;
+    double d;
+
+    code = 0;
+    for (i = 0; i < 4; i++) {
+        if (!(clipflags & (1 << i)))
+            continue; // don't need to clip against it
+
+        pindex = pfrustum_indexes[i];
+
+        rejectpt[0] = (float) node->minmaxs[pindex[0]];
+        rejectpt[1] = (float) node->minmaxs[pindex[1]];
+        rejectpt[2] = (float) node->minmaxs[pindex[2]];
+
+        d = DotProduct(rejectpt, view_clipplanes[i].normal);
+        d -= view_clipplanes[i].dist;
+
+        if (d <= 0)
+            return code | (R_CULL_OUTSIDE << i);
+
+        acceptpt[0] = (float) node->minmaxs[pindex[3 + 0]];
+        acceptpt[1] = (float) node->minmaxs[pindex[3 + 1]];
+        acceptpt[2] = (float) node->minmaxs[pindex[3 + 2]];
+
+        d = DotProduct(acceptpt, view_clipplanes[i].normal);
+        d -= view_clipplanes[i].dist;
+
+        if (d >= 0)
+            code |= R_CULL_INSIDE << i; // node is entirely on screen
+    }
+    return code;
+}
+
+#ifdef SIMD_VECTOR
+
+/*
+===============
+R_CullVisNodeV
+
+R_CullVisNode with a plane in each lane, as quick as testing one. One
+product of each pair is zero, so the pairs add no rounding of their own.
+Planes the box is too close to for float rounding to decide get
+R_CullVisNode
+===============
+*/
+static i32 R_CullVisNodeV(const visnode_t* vn, i32 clipflags) {
+    vec4f_t pos[3], neg[3], lo[3], hi[3];
+    vec4f_t d, margin, negmargin;
+    vec4i_t far, below;
+    i32 j, code, near;
+
+    margin = V4_SplatF(R_CULLMARGIN);
+    negmargin = V4_SplatF(-R_CULLMARGIN);
+    for (j = 0; j < 3; j++) {
+        pos[j] = V4_LoadArrayF(r_cullpos[j]);
+        neg[j] = V4_LoadArrayF(r_cullneg[j]);
+        lo[j] = V4_SplatF(vn->mins[j]);
+        hi[j] = V4_SplatF(vn->maxs[j]);
+    }
+
+    // the reject points, the corners farthest in front of the planes
+    d = V4_AddF(V4_AddF(V4_Mul(hi[0], pos[0]), V4_Mul(lo[0], neg[0])),
+                V4_AddF(V4_Mul(hi[1], pos[1]), V4_Mul(lo[1], neg[1])));
+    d = V4_SubF(
+        V4_AddF(d, V4_AddF(V4_Mul(hi[2], pos[2]), V4_Mul(lo[2], neg[2]))),
+        V4_LoadArrayF(r_culldist));
+    far = V4_LessF(d, negmargin);
+    below = V4_LessF(d, margin);
+    code = V4_SignBits(far) * R_CULL_OUTSIDE;
+    near = V4_SignBits(below) & ~V4_SignBits(far);
+
+    // the accept points, the corners farthest behind them
+    d = V4_AddF(V4_AddF(V4_Mul(lo[0], pos[0]), V4_Mul(hi[0], neg[0])),
+                V4_AddF(V4_Mul(lo[1], pos[1]), V4_Mul(hi[1], neg[1])));
+    d = V4_SubF(
+        V4_AddF(d, V4_AddF(V4_Mul(lo[2], pos[2]), V4_Mul(hi[2], neg[2]))),
+        V4_LoadArrayF(r_culldist));
+    far = V4_LessF(d, negmargin);
+    below = V4_LessF(d, margin);
+    code |= (~V4_SignBits(below) & 15) * R_CULL_INSIDE;
+    near |= V4_SignBits(below) & ~V4_SignBits(far);
+
+    code &= clipflags * (R_CULL_OUTSIDE | R_CULL_INSIDE);
+    near &= clipflags;
+    if ((code & 15) || !near)
+        return code; // being outside of one plane decides anyway
+    return (code & ~(near * R_CULL_INSIDE)) | R_CullVisNode(vn, near);
+}
+
+#endif
+
+/*
+===============
+R_SelectVisibleSetCull
+===============
+*/
+void R_SelectVisibleSetCull(qboolean vector) {
+    r_cullvisnode = R_CullVisNode;
+
+    if (!vector)
+        return;
+
+#ifdef SIMD_VECTOR
+    r_cullvisnode = R_CullVisNodeV;
+#endif
+}
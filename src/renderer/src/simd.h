@@ -0,0 +1,278 @@
+/*
+ * Copyright (C) 1996-1997 Id Software, Inc.
+ * Copyright (C) Henrique Barateli, <henriquejb194@gmail.com>, et al.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+// simd.h -- the vector operations the renderer kernels are written in
+//
+// Four 32 bit lanes (V4_) and eight 16 bit lanes (V8_), mapped to SSE2 on
+// x86-64 and NEON on AArch64. Every operation gives the same bits a lane
+// of the C code would, so the vector kernels can match the C ones exactly.
+// Targets with neither leave SIMD_VECTOR undefined and keep the C code.
+
+
+#ifndef __SIMD__
+#define __SIMD__
+
+#include "common.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SIMD_SSE2 // always there on x86-64, and float math is done in SSE
+#include <immintrin.h>
+#if defined(__GNUC__)
+#define SIMD_AVX2 __attribute__((target("avx2")))
+#else
+#define SIMD_AVX2
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(SIMD_SSE2) || defined(SIMD_NEON)
+#define SIMD_VECTOR
+#endif
+
+
+#if defined(SIMD_SSE2)
+
+typedef __m128 vec4f_t;
+typedef __m128i vec4i_t;
+typedef __m128i vec8s_t;
+
+// scalar loads, a vector load right after scalar stores can't be forwarded
+#define V4_LoadF(p)    _mm_setr_ps((p)[0], (p)[1], (p)[2], (p)[3])
+#define V4_SplatF(x)   _mm_set1_ps(x)
+#define V4_AddF(a, b)  _mm_add_ps(a, b)
+#define V4_SubF(a, b)  _mm_sub_ps(a, b)
+#define V4_Mul(a, b)   _mm_mul_ps(a, b)
+#define V4_Div(a, b)   _mm_div_ps(a, b)
+#define V4_LessF(a, b) _mm_castps_si128(_mm_cmplt_ps(a, b))
+#define V4_Trunc(a)    _mm_cvttps_epi32(a)
+#define V4_ToFloat(a)  _mm_cvtepi32_ps(a)
+
+// arrays that weren't just written a lane at a time
+#define V4_LoadArrayF(p) _mm_loadu_ps(p)
+#define V4_StoreF(p, a)  _mm_storeu_ps(p, a)
+
+#define V4_Load(p)       _mm_loadu_si128((const __m128i*) (p))
+#define V4_Store(p, a)   _mm_storeu_si128((__m128i*) (p), a)
+#define V4_Splat(x)      _mm_set1_epi32(x)
+#define V4_Add(a, b)     _mm_add_epi32(a, b)
+#define V4_Sub(a, b)     _mm_sub_epi32(a, b)
+#define V4_And(a, b)     _mm_and_si128(a, b)
+#define V4_Shr(a, n)     _mm_srai_epi32(a, n)
+#define V4_Shr16(a)      _mm_srai_epi32(a, 16)
+#define V4_Greater(a, b) _mm_cmpgt_epi32(a, b)
+
+// a * b for a and b in 0..32767, which texel rows and cache widths are
+#define V4_MulSmall(a, b) _mm_madd_epi16(a, b)
+
+#define V8_Splat(x)    _mm_set1_epi16(x)
+#define V8_Add(a, b)   _mm_add_epi16(a, b)
+#define V8_And(a, b)   _mm_and_si128(a, b)
+#define V8_Mul(a, b)   _mm_mullo_epi16(a, b)
+#define V8_Store(p, a) _mm_storeu_si128((__m128i*) (p), a)
+
+// lanes of m set pick a, clear pick b
+static inline vec4i_t V4_Select(vec4i_t m, vec4i_t a, vec4i_t b) {
+    return _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b));
+}
+
+static inline vec4i_t V4_Max(vec4i_t a, vec4i_t b) {
+    return V4_Select(_mm_cmpgt_epi32(a, b), a, b);
+}
+
+static inline vec4i_t V4_Abs(vec4i_t a) {
+    __m128i sign = _mm_srai_epi32(a, 31);
+
+    return _mm_sub_epi32(_mm_xor_si128(a, sign), sign);
+}
+
+// low 32 bits of the product, like a scalar multiply
+static inline vec4i_t V4_MulLow(vec4i_t a, vec4i_t b) {
+    __m128i even, odd;
+
+    even = _mm_mul_epu32(a, b);
+    odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// bit i set where lane i is negative, as all ones masks are
+#define V4_SignBits(a) _mm_movemask_ps(_mm_castsi128_ps(a))
+
+// four bytes, one per lane
+static inline vec4i_t V4_LoadBytes(const byte* p) {
+    __m128i zero = _mm_setzero_si128();
+    i32 x;
+
+    memcpy(&x, p, 4);
+    return _mm_unpacklo_epi16(
+        _mm_unpacklo_epi8(_mm_cvtsi32_si128(x), zero), zero);
+}
+
+// eight bytes, one per lane
+static inline vec8s_t V8_LoadBytes(const byte* p) {
+    return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) p),
+                             _mm_setzero_si128());
+}
+
+// (float) of an unsigned lane, rounded once like the scalar conversion
+static inline vec4f_t V4_FromUnsigned(vec4i_t a) {
+    __m128 hi, lo;
+
+    hi = _mm_cvtepi32_ps(_mm_srli_epi32(a, 16));
+    lo = _mm_cvtepi32_ps(_mm_and_si128(a, _mm_set1_epi32(0xFFFF)));
+    return _mm_add_ps(_mm_mul_ps(hi, _mm_set1_ps(65536.0f)), lo);
+}
+
+// (u32) of a float lane in 0..2^32
+static inline vec4i_t V4_TruncUnsigned(vec4f_t a) {
+    __m128 big = _mm_set1_ps(2147483648.0f);
+    __m128i high;
+
+    high = _mm_castps_si128(_mm_cmpge_ps(a, big));
+    a = _mm_sub_ps(a, _mm_and_ps(_mm_castsi128_ps(high), big));
+    return _mm_xor_si128(_mm_cvttps_epi32(a),
+                         _mm_slli_epi32(high, 31));
+}
+
+/*
+=============
+V4_Ramp
+
+base, base + step, base + 2 * step, base + 3 * step
+=============
+*/
+static inline vec4i_t V4_Ramp(i32 base, i32 step) {
+    __m128i st = _mm_set1_epi32(step);
+    __m128i r;
+
+    r = _mm_and_si128(st, _mm_set_epi32(-1, 0, -1, 0));
+    st = _mm_add_epi32(st, st);
+    r = _mm_add_epi32(r, _mm_and_si128(st, _mm_set_epi32(-1, -1, 0, 0)));
+    return _mm_add_epi32(r, _mm_set1_epi32(base));
+}
+
+// base, base + step ... base + 7 * step
+static inline vec8s_t V8_Ramp(i16 base, i16 step) {
+    return _mm_add_epi16(
+        _mm_set1_epi16(base),
+        _mm_mullo_epi16(_mm_set1_epi16(step),
+                        _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7)));
+}
+
+// the high halves of a and then b as eight z values, with the sign of each
+// even one spilling into the odd one after it the way the pair writes of
+// D_DrawZSpans do it
+static inline void V4_StoreZ8(i16* p, vec4i_t a, vec4i_t b) {
+    __m128i z;
+
+    z = _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+    z = _mm_or_si128(z, _mm_srai_epi32(_mm_slli_epi32(z, 16), 16));
+    _mm_storeu_si128((__m128i*) p, z);
+}
+
+#elif defined(SIMD_NEON)
+
+typedef float32x4_t vec4f_t;
+typedef int32x4_t vec4i_t;
+typedef int16x8_t vec8s_t;
+
+#define V4_LoadF(p)    vld1q_f32(p)
+#define V4_SplatF(x)   vdupq_n_f32(x)
+#define V4_AddF(a, b)  vaddq_f32(a, b)
+#define V4_SubF(a, b)  vsubq_f32(a, b)
+#define V4_Mul(a, b)   vmulq_f32(a, b)
+#define V4_Div(a, b)   vdivq_f32(a, b)
+#define V4_LessF(a, b) vreinterpretq_s32_u32(vcltq_f32(a, b))
+#define V4_Trunc(a)    vcvtq_s32_f32(a)
+#define V4_ToFloat(a)  vcvtq_f32_s32(a)
+
+#define V4_LoadArrayF(p) vld1q_f32(p)
+#define V4_StoreF(p, a)  vst1q_f32(p, a)
+
+#define V4_Load(p)       vld1q_s32((const i32*) (p))
+#define V4_Store(p, a)   vst1q_s32((i32*) (p), a)
+#define V4_Splat(x)      vdupq_n_s32(x)
+#define V4_Add(a, b)     vaddq_s32(a, b)
+#define V4_Sub(a, b)     vsubq_s32(a, b)
+#define V4_And(a, b)     vandq_s32(a, b)
+#define V4_Shr(a, n)     vshrq_n_s32(a, n)
+#define V4_Shr16(a)      vshrq_n_s32(a, 16)
+#define V4_Greater(a, b) vreinterpretq_s32_u32(vcgtq_s32(a, b))
+#define V4_Max(a, b)     vmaxq_s32(a, b)
+#define V4_Abs(a)        vabsq_s32(a)
+#define V4_MulLow(a, b)  vmulq_s32(a, b)
+
+#define V4_MulSmall(a, b) vmulq_s32(a, b)
+
+#define V4_Select(m, a, b) vbslq_s32(vreinterpretq_u32_s32(m), a, b)
+
+#define V4_FromUnsigned(a)  vcvtq_f32_u32(vreinterpretq_u32_s32(a))
+#define V4_TruncUnsigned(a) vreinterpretq_s32_u32(vcvtq_u32_f32(a))
+
+#define V8_Splat(x)    vdupq_n_s16(x)
+#define V8_Add(a, b)   vaddq_s16(a, b)
+#define V8_And(a, b)   vandq_s16(a, b)
+#define V8_Mul(a, b)   vmulq_s16(a, b)
+#define V8_Store(p, a) vst1q_s16((i16*) (p), a)
+
+static inline i32 V4_SignBits(vec4i_t a) {
+    static const i32 bits[4] = {1, 2, 4, 8};
+
+    return vaddvq_s32(vandq_s32(vshrq_n_s32(a, 31), vld1q_s32(bits)));
+}
+
+static inline vec4i_t V4_LoadBytes(const byte* p) {
+    u32 x;
+
+    memcpy(&x, p, 4);
+    return vreinterpretq_s32_u32(
+        vmovl_u16(vget_low_u16(vmovl_u8(vcreate_u8(x)))));
+}
+
+static inline vec8s_t V8_LoadBytes(const byte* p) {
+    return vreinterpretq_s16_u16(vmovl_u8(vld1_u8(p)));
+}
+
+static inline vec4i_t V4_Ramp(i32 base, i32 step) {
+    static const i32 lanes[4] = {0, 1, 2, 3};
+
+    return vmlaq_n_s32(vdupq_n_s32(base), vld1q_s32(lanes), step);
+}
+
+static inline vec8s_t V8_Ramp(i16 base, i16 step) {
+    static const i16 lanes[8] = {0, 1, 2, 3, 4, 5, 6, 7};
+
+    return vmlaq_n_s16(vdupq_n_s16(base), vld1q_s16(lanes), step);
+}
+
+static inline void V4_StoreZ8(i16* p, vec4i_t a, vec4i_t b) {
+    int32x4_t z;
+
+    z = vreinterpretq_s32_s16(
+        vcombine_s16(vshrn_n_s32(a, 16), vshrn_n_s32(b, 16)));
+    z = vorrq_s32(z, vshrq_n_s32(vshlq_n_s32(z, 16), 16));
+    vst1q_s32((i32*) p, z);
+}
+
+#endif
+
+#endif
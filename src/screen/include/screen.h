@@ -54,10 +54,6 @@ extern cvar_t scr_viewsize;
 
 extern cvar_t scr_viewsize;
 
-// only the refresh window will be updated unless these variables are flagged
-extern i32 scr_copytop;
-extern i32 scr_copyeverything;
-
 extern qboolean block_drawing;
 
 void SCR_UpdateWholeScreen(void);
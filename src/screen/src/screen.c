@@ -39,10 +39,6 @@
 #include <string.h>
 
 
-// only the refresh window will be updated unless these variables are flagged
-i32 scr_copytop;
-i32 scr_copyeverything;
-
 float scr_con_current;
 float scr_conlines; // lines of console to display
 
@@ -131,7 +127,6 @@ void SCR_EraseCenterString(void) {
     else
         y = 48;
 
-    scr_copytop = 1;
     Draw_TileClear(0, y, vid.width, 8 * scr_erase_lines);
 }
 
@@ -180,7 +175,6 @@ void SCR_DrawCenterString(void) {
 }
 
 void SCR_CheckDrawCenterString(void) {
-    scr_copytop = 1;
     if (scr_center_lines > scr_erase_lines)
         scr_erase_lines = scr_center_lines;
 
@@ -468,12 +462,10 @@ void SCR_SetUpToDrawConsole(void) {
     }
 
     if (clearconsole++ < vid.numpages) {
-        scr_copytop = 1;
         Draw_TileClear(0, (i32) scr_con_current, vid.width,
                        vid.height - (i32) scr_con_current);
         Sbar_Changed();
     } else if (clearnotify++ < vid.numpages) {
-        scr_copytop = 1;
         Draw_TileClear(0, 0, vid.width, con_notifylines);
     } else
         con_notifylines = 0;
@@ -486,7 +478,6 @@ SCR_DrawConsole
 */
 void SCR_DrawConsole(void) {
     if (scr_con_current) {
-        scr_copyeverything = 1;
         Con_DrawConsole(scr_con_current, true);
         clearconsole = 0;
     } else {
@@ -784,14 +775,12 @@ needs almost the entire 256k of stack space!
 void SCR_UpdateScreen(void) {
     static float oldscr_viewsize;
     static float oldlcd_x;
-    vrect_t vrect;
+    vrect_t rects[MAX_DIRTYRECTS];
+    i32 count;
 
     if (scr_skipupdate || block_drawing)
         return;
 
-    scr_copytop = 0;
-    scr_copyeverything = 0;
-
     if (scr_disabled_for_loading) {
         if (realtime - scr_disabled_time > 60) {
             scr_disabled_for_loading = false;
@@ -840,7 +829,6 @@ void SCR_UpdateScreen(void) {
     D_EnableBackBufferAccess(); // of all overlay stuff if drawing directly
 
     if (scr_fullupdate++ < vid.numpages) { // clear the entire screen
-        scr_copyeverything = 1;
         Draw_TileClear(0, 0, vid.width, vid.height);
         Sbar_Changed();
     }
@@ -866,7 +854,6 @@ void SCR_UpdateScreen(void) {
         Sbar_Draw();
         Draw_FadeScreen();
         SCR_DrawNotifyString();
-        scr_copyeverything = true;
     } else if (scr_drawloading) {
         SCR_DrawLoading();
         Sbar_Draw();
@@ -897,31 +884,10 @@ void SCR_UpdateScreen(void) {
     V_UpdatePalette();
 
     //
-    // update one of three areas
+    // update only the parts of the screen that were drawn
     //
-
-    if (scr_copyeverything) {
-        vrect.x = 0;
-        vrect.y = 0;
-        vrect.width = vid.width;
-        vrect.height = vid.height;
-
-        VID_Update(&vrect);
-    } else if (scr_copytop) {
-        vrect.x = 0;
-        vrect.y = 0;
-        vrect.width = vid.width;
-        vrect.height = vid.height - sb_lines;
-
-        VID_Update(&vrect);
-    } else {
-        vrect.x = scr_vrect.x;
-        vrect.y = scr_vrect.y;
-        vrect.width = scr_vrect.width;
-        vrect.height = scr_vrect.height;
-
-        VID_Update(&vrect);
-    }
+    count = Draw_GetDirty(rects);
+    VID_UpdateRects(rects, count);
 }
 
 
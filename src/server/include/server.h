@@ -82,6 +82,17 @@ typedef struct {
 #define NUM_PING_TIMES  16
 #define NUM_SPAWN_PARMS 16
 
+// what went out to a client since the last bandwidth report
+typedef struct {
+    i32 datagrams;
+    i32 datagrambytes;
+    i32 entitybytes;
+    i32 fullbytes; // the entities as updates against their baselines
+    i32 visible;   // entities the client could see
+    i32 sent;      // entities that went out
+    i32 overflows;
+} clientstats_t;
+
 typedef struct client_s {
     qboolean active;     // false = client is free
     qboolean spawned;    // false = don't send datagrams
@@ -111,6 +122,11 @@ typedef struct client_s {
 
     // client known data for deltas
     i32 old_frags;
+
+    qboolean delta; // entities go out as svc_snapshot
+    snaphistory_t snapshots;
+
+    clientstats_t stats;
 } client_t;
 
 
@@ -223,6 +239,10 @@ qboolean SV_CheckBottom(edict_t* ent);
 qboolean SV_movestep(edict_t* ent, vec3_t move, qboolean relink);
 
 void SV_WriteClientdataToMessage(edict_t* ent, sizebuf_t* msg);
+void SV_ClearSnapshots(client_t* client);
+void SV_AckSnapshot(client_t* client, i32 sequence);
+void SV_Bandwidth_f(void);
+void SV_VisBench_f(void);
 
 void SV_MoveToGoal(void);
 
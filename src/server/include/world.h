@@ -23,6 +23,7 @@
 #define __WORLD__
 
 #include "quakedef.h"
+#include "cvar.h"
 #include "mathlib.h"
 #include "model.h"
 #include "progs.h"
@@ -43,6 +44,21 @@ typedef struct {
 } trace_t;
 
 
+typedef struct {
+    u64 moves; // calls to SV_Move
+    u64 nodes; // area nodes visited while clipping to entities
+    u64 boxes; // entity boxes tested against the move bounds
+    u64 traces;    // brush model hull traces that went through the cache
+    u64 tracehits; // of those, the ones answered from it
+} movestats_t;
+
+extern movestats_t sv_movestats;
+
+extern cvar_t sv_areadepth;
+extern cvar_t sv_areasplitz;
+extern cvar_t sv_tracecache;
+
+
 #define MOVE_NORMAL     0
 #define MOVE_NOMONSTERS 1
 #define MOVE_MISSILE    2
@@ -51,6 +67,8 @@ typedef struct {
 void SV_ClearWorld(void);
 // called after the world model has been loaded, before linking any entities
 
+void SV_AreaStats_f(void);
+
 void SV_UnlinkEdict(edict_t* ent);
 // call before removing an entity, and before trying to move one,
 // so it doesn't clip against itself
@@ -62,6 +80,14 @@ void SV_LinkEdict(edict_t* ent, qboolean touch_triggers);
 // sets ent->v.absmin and ent->v.absmax
 // if touchtriggers, calls prog functions for the intersected triggers
 
+void SV_MarkEdictsInPVS(const byte* pvs, u32* marks);
+// sets bit NUM_FOR_EDICT of marks for every edict linked into a leaf of pvs
+
+i32 SV_AreaEdicts(vec3_t mins, vec3_t maxs, edict_t** edicts, i32 maxcount);
+// fills edicts with the linked edicts whose absmin/absmax touch the box and
+// returns how many were found, stopping at maxcount
+// edicts that were moved without being relinked are not seen
+
 i32 SV_PointContents(vec3_t p);
 i32 SV_TruePointContents(vec3_t p);
 // returns the CONTENTS_* value from the world at the given point.
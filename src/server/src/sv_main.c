@@ -23,6 +23,7 @@
 #include "server.h"
 #include "cmd.h"
 #include "console.h"
+#include "profiler.h"
 #include "sound.h"
 #include "sys.h"
 #include "world.h"
@@ -53,6 +54,8 @@ void SV_Init(void) {
     extern cvar_t sv_accelerate;
     extern cvar_t sv_idealpitchscale;
     extern cvar_t sv_aim;
+    extern cvar_t sv_delta;
+    extern cvar_t sv_pvsindex;
 
     Cvar_RegisterVariable(&sv_maxvelocity);
     Cvar_RegisterVariable(&sv_gravity);
@@ -64,6 +67,15 @@ void SV_Init(void) {
     Cvar_RegisterVariable(&sv_idealpitchscale);
     Cvar_RegisterVariable(&sv_aim);
     Cvar_RegisterVariable(&sv_nostep);
+    Cvar_RegisterVariable(&sv_areadepth);
+    Cvar_RegisterVariable(&sv_areasplitz);
+    Cvar_RegisterVariable(&sv_tracecache);
+    Cvar_RegisterVariable(&sv_delta);
+    Cvar_RegisterVariable(&sv_pvsindex);
+
+    Cmd_AddCommand("areastats", SV_AreaStats_f);
+    Cmd_AddCommand("bandwidth", SV_Bandwidth_f);
+    Cmd_AddCommand("visbench", SV_VisBench_f);
 
     for (i = 0; i < MAX_MODELS; i++)
         sprintf(localmodels[i], "*%i", i);
@@ -234,6 +246,10 @@ void SV_SendServerinfo(client_t* client) {
 
     client->sendsignon = true;
     client->spawned = false; // need prespawn, spawn, etc
+
+    // the client asks again for snapshots of the new level
+    client->delta = false;
+    SV_ClearSnapshots(client);
 }
 
 /*
@@ -269,6 +285,7 @@ void SV_ConnectClient(i32 clientnum) {
     client->netconnection = netconnection;
 
     Q_strcpy(client->name, "unconnected");
+    pr_stringstores++; // the body's netname still points at the name
     client->active = true;
     client->spawned = false;
     client->edict = ent;
@@ -356,6 +373,30 @@ crosses a waterline.
 i32 fatbytes;
 byte fatpvs[MAX_MAP_LEAFS / 8];
 
+// find visible entities through the leaf index and cached fat PVSs
+cvar_t sv_pvsindex = {"sv_pvsindex", "1"};
+
+// the leafs within 8 pixels of the point
+#define FAT_LEAFS 8
+static mleaf_t* sv_fatleafs[FAT_LEAFS];
+static i32 sv_numfatleafs; // more than FAT_LEAFS if they didn't all fit
+
+// fat PVSs of the leafs clients stand in, by the first of their leafs
+#define FAT_CACHE 32
+typedef struct {
+    i32 numleafs; // 0 for an empty slot
+    mleaf_t* leafs[FAT_LEAFS];
+    qboolean sparse; // sees few enough leafs for the index to pay
+    byte pvs[MAX_MAP_LEAFS / 8];
+} fatpvs_t;
+static fatpvs_t sv_fatcache[FAT_CACHE];
+
+// past a PVS of 1/FAT_SPARSE of the leafs, most edicts are in it and
+// walking them all is quicker
+#define FAT_SPARSE 8
+static const byte sv_nibblebits[16] = {0, 1, 1, 2, 1, 2, 2, 3,
+                                       1, 2, 2, 3, 2, 3, 3, 4};
+
 void SV_AddToFatPVS(vec3_t org, mnode_t* node) {
     i32 i;
     byte* pvs;
@@ -386,6 +427,40 @@ void SV_AddToFatPVS(vec3_t org, mnode_t* node) {
     }
 }
 
+/*
+=============
+SV_FindFatLeafs
+
+The leafs SV_AddToFatPVS would accumulate, in the same order
+=============
+*/
+static void SV_FindFatLeafs(vec3_t org, mnode_t* node) {
+    mplane_t* plane;
+    float d;
+
+    while (1) {
+        if (node->contents < 0) {
+            if (node->contents != CONTENTS_SOLID) {
+                if (sv_numfatleafs < FAT_LEAFS)
+                    sv_fatleafs[sv_numfatleafs] = (mleaf_t*) node;
+                sv_numfatleafs++;
+            }
+            return;
+        }
+
+        plane = node->plane;
+        d = DotProduct(org, plane->normal) - plane->dist;
+        if (d > 8)
+            node = node->children[0];
+        else if (d < -8)
+            node = node->children[1];
+        else { // go down both
+            SV_FindFatLeafs(org, node->children[0]);
+            node = node->children[1];
+        }
+    }
+}
+
 /*
 =============
 SV_FatPVS
@@ -401,26 +476,113 @@ byte* SV_FatPVS(vec3_t org) {
     return fatpvs;
 }
 
+/*
+=============
+SV_CachedFatPVS
+
+SV_FatPVS out of the cache, or NULL if the point touches too many leafs
+=============
+*/
+static fatpvs_t* SV_CachedFatPVS(vec3_t org) {
+    fatpvs_t* cached;
+    byte* pvs;
+    i32 i, j;
+    i32 visible, bits;
+
+    fatbytes = (sv.worldmodel->numleafs + 31) >> 3;
+
+    sv_numfatleafs = 0;
+    SV_FindFatLeafs(org, sv.worldmodel->nodes);
+    if (!sv_numfatleafs || sv_numfatleafs > FAT_LEAFS)
+        return NULL;
+
+    // clients mostly stand where one of them stood last frame
+    i = (i32) (sv_fatleafs[0] - sv.worldmodel->leafs);
+    cached = &sv_fatcache[i & (FAT_CACHE - 1)];
+    if (cached->numleafs == sv_numfatleafs &&
+        !memcmp(cached->leafs, sv_fatleafs, sv_numfatleafs * sizeof(mleaf_t*)))
+        return cached;
+
+    Q_memset(cached->pvs, 0, fatbytes);
+    for (i = 0; i < sv_numfatleafs; i++) {
+        pvs = Mod_LeafPVS(sv_fatleafs[i], sv.worldmodel);
+        for (j = 0; j < fatbytes; j++)
+            cached->pvs[j] |= pvs[j];
+    }
+    cached->numleafs = sv_numfatleafs;
+    Q_memcpy(cached->leafs, sv_fatleafs, sv_numfatleafs * sizeof(mleaf_t*));
+
+    visible = 0;
+    for (j = 0; j < fatbytes; j++) {
+        bits = cached->pvs[j];
+        visible += sv_nibblebits[bits & 15] + sv_nibblebits[bits >> 4];
+    }
+    cached->sparse = visible <= sv.worldmodel->numleafs / FAT_SPARSE;
+    return cached;
+}
+
 //=============================================================================
 
 
+// entities the client sees this frame, in edict order
+static edict_t* sv_visible[MAX_EDICTS];
+
+// room a snapshot entry and the end of the list need
+#define SNAP_ENTRYSIZE 20
+
+cvar_t sv_delta = {"sv_delta", "1"}; // let clients ask for snapshots
+
 /*
 =============
-SV_WriteEntitiesToClient
+SV_VisibleEdicts
 
+Fills sv_visible and returns how many entities are in it
 =============
 */
-void SV_WriteEntitiesToClient(edict_t* clent, sizebuf_t* msg) {
+static i32 SV_VisibleEdicts(edict_t* clent) {
     i32 e, i;
-    i32 bits;
+    i32 count;
     byte* pvs;
     vec3_t org;
-    float miss;
     edict_t* ent;
+    fatpvs_t* cached;
+    u32 marks[(MAX_EDICTS + 31) >> 5];
+    i32 marked[MAX_EDICTS];
+    i32 num;
+
+    PROF_BEGIN("SV_VisibleEdicts");
 
     // find the client's PVS
     VectorAdd(clent->v.origin, clent->v.view_ofs, org);
-    pvs = SV_FatPVS(org);
+    cached = sv_pvsindex.value ? SV_CachedFatPVS(org) : NULL;
+    pvs = cached ? cached->pvs : SV_FatPVS(org);
+
+    count = 0;
+    if (cached && cached->sparse) {
+        // only the edicts in leafs the PVS has, in edict order
+        Q_memset(marks, 0, sizeof(marks));
+        SV_MarkEdictsInPVS(pvs, marks);
+        e = NUM_FOR_EDICT(clent);
+        marks[e >> 5] |= 1u << (e & 31); // clent is ALLWAYS sent
+
+        // without a branch on the bits, they'd mispredict half the time
+        num = 0;
+        for (e = 0; e < sv.num_edicts; e++) {
+            marked[num] = e;
+            num += (marks[e >> 5] >> (e & 31)) & 1;
+        }
+
+        for (i = 0; i < num; i++) {
+            ent = (edict_t*) ((byte*) sv.edicts + marked[i] * pr_edict_size);
+            if (ent != clent &&
+                (!ent->v.modelindex || !*PR_GetString(ent->v.model)))
+                continue;
+            sv_visible[count++] = ent;
+        }
+
+        PROF_END();
+        return count;
+    }
 
     // send over all entities (excpet the client) that touch the pvs
     ent = NEXT_EDICT(sv.edicts);
@@ -441,52 +603,136 @@ void SV_WriteEntitiesToClient(edict_t* clent, sizebuf_t* msg) {
                 continue; // not visible
         }
 
-        if (msg->maxsize - msg->cursize < 16) {
-            Con_Printf("packet overflow\n");
-            return;
-        }
+        sv_visible[count++] = ent;
+    }
 
-        // send an update
-        bits = 0;
+    PROF_END();
+    return count;
+}
 
-        for (i = 0; i < 3; i++) {
-            miss = ent->v.origin[i] - ent->baseline.origin[i];
-            if (miss < -0.1 || miss > 0.1)
-                bits |= U_ORIGIN1 << i;
-        }
+/*
+=============
+SV_BaselineBits
+
+The U_ bits of an update of entity e against its baseline
+=============
+*/
+static i32 SV_BaselineBits(edict_t* ent, i32 e) {
+    i32 i;
+    i32 bits;
+    float miss;
+
+    bits = 0;
+
+    for (i = 0; i < 3; i++) {
+        miss = ent->v.origin[i] - ent->baseline.origin[i];
+        if (miss < -0.1 || miss > 0.1)
+            bits |= U_ORIGIN1 << i;
+    }
+
+    if (ent->v.angles[0] != ent->baseline.angles[0])
+        bits |= U_ANGLE1;
+
+    if (ent->v.angles[1] != ent->baseline.angles[1])
+        bits |= U_ANGLE2;
+
+    if (ent->v.angles[2] != ent->baseline.angles[2])
+        bits |= U_ANGLE3;
+
+    if (ent->v.movetype == MOVETYPE_STEP)
+        bits |= U_NOLERP; // don't mess up the step animation
+
+    if (ent->baseline.colormap != ent->v.colormap)
+        bits |= U_COLORMAP;
+
+    if (ent->baseline.skin != ent->v.skin)
+        bits |= U_SKIN;
+
+    if (ent->baseline.frame != ent->v.frame)
+        bits |= U_FRAME;
+
+    if (ent->baseline.effects != ent->v.effects)
+        bits |= U_EFFECTS;
+
+    if (ent->baseline.modelindex != ent->v.modelindex)
+        bits |= U_MODEL;
+
+    if (e >= 256)
+        bits |= U_LONGENTITY;
 
-        if (ent->v.angles[0] != ent->baseline.angles[0])
-            bits |= U_ANGLE1;
+    if (bits >= 256)
+        bits |= U_MOREBITS;
 
-        if (ent->v.angles[1] != ent->baseline.angles[1])
-            bits |= U_ANGLE2;
+    return bits;
+}
 
-        if (ent->v.angles[2] != ent->baseline.angles[2])
-            bits |= U_ANGLE3;
+/*
+=============
+SV_UpdateSize
 
-        if (ent->v.movetype == MOVETYPE_STEP)
-            bits |= U_NOLERP; // don't mess up the step animation
+How many bytes an update with these bits takes
+=============
+*/
+static i32 SV_UpdateSize(i32 bits) {
+    i32 size;
+    i32 i;
 
-        if (ent->baseline.colormap != ent->v.colormap)
-            bits |= U_COLORMAP;
+    size = 2;
+    if (bits & U_MOREBITS)
+        size++;
+    if (bits & U_LONGENTITY)
+        size++;
+    if (bits & U_MODEL)
+        size++;
+    if (bits & U_FRAME)
+        size++;
+    if (bits & U_COLORMAP)
+        size++;
+    if (bits & U_SKIN)
+        size++;
+    if (bits & U_EFFECTS)
+        size++;
+    for (i = 0; i < 3; i++) {
+        if (bits & (U_ORIGIN1 << i))
+            size += 2;
+    }
+    if (bits & U_ANGLE1)
+        size++;
+    if (bits & U_ANGLE2)
+        size++;
+    if (bits & U_ANGLE3)
+        size++;
+    return size;
+}
 
-        if (ent->baseline.skin != ent->v.skin)
-            bits |= U_SKIN;
+/*
+=============
+SV_WriteEntitiesToClient
 
-        if (ent->baseline.frame != ent->v.frame)
-            bits |= U_FRAME;
+=============
+*/
+void SV_WriteEntitiesToClient(client_t* client, sizebuf_t* msg) {
+    i32 e, i;
+    i32 bits;
+    i32 count;
+    edict_t* ent;
 
-        if (ent->baseline.effects != ent->v.effects)
-            bits |= U_EFFECTS;
+    count = SV_VisibleEdicts(client->edict);
+    client->stats.visible += count;
 
-        if (ent->baseline.modelindex != ent->v.modelindex)
-            bits |= U_MODEL;
+    for (i = 0; i < count; i++) {
+        ent = sv_visible[i];
+        e = NUM_FOR_EDICT(ent);
 
-        if (e >= 256)
-            bits |= U_LONGENTITY;
+        if (msg->maxsize - msg->cursize < 16) {
+            Con_Printf("packet overflow\n");
+            client->stats.overflows++;
+            return;
+        }
 
-        if (bits >= 256)
-            bits |= U_MOREBITS;
+        // send an update
+        bits = SV_BaselineBits(ent, e);
+        client->stats.sent++;
 
         //
         // write the message
@@ -525,6 +771,274 @@ void SV_WriteEntitiesToClient(edict_t* clent, sizebuf_t* msg) {
     }
 }
 
+/*
+=============
+SV_ClearSnapshots
+
+Forgets what the client has, the next snapshot goes against the baselines.
+The sequence carries on, so acks still on their way match nothing
+=============
+*/
+void SV_ClearSnapshots(client_t* client) {
+    snaphistory_t* history = &client->snapshots;
+
+    Q_memset(history->snapshots, 0, sizeof(history->snapshots));
+    history->acked = 0;
+}
+
+/*
+=============
+SV_AckSnapshot
+=============
+*/
+void SV_AckSnapshot(client_t* client, i32 sequence) {
+    snaphistory_t* history = &client->snapshots;
+
+    if (!client->delta)
+        return;
+    if (sequence <= history->acked || sequence > history->sequence)
+        return;
+    history->acked = sequence;
+}
+
+/*
+=============
+SV_AckedSnapshot
+
+The snapshot the client acked last, if it can still be a delta source
+=============
+*/
+static snapshot_t* SV_AckedSnapshot(snaphistory_t* history) {
+    snapshot_t* snap;
+
+    if (!history->acked || history->sequence - history->acked >= SNAP_BACKUP)
+        return NULL;
+    snap = &history->snapshots[history->acked & (SNAP_BACKUP - 1)];
+    if (snap->sequence != history->acked)
+        return NULL;
+
+    // the states of the new snapshot mustn't run over it
+    if (history->numstates - snap->first > SNAP_STATES - MAX_EDICTS)
+        return NULL;
+    return snap;
+}
+
+/*
+=============
+SV_SnapEntity
+
+The entity as MSG_WriteCoord and MSG_WriteAngle would send it
+=============
+*/
+static void SV_SnapEntity(edict_t* ent, snapentity_t* to) {
+    i32 i;
+
+    for (i = 0; i < 3; i++) {
+        to->origin[i] = (i16) (i32) (ent->v.origin[i] * 8);
+        to->angles[i] = ((i32) ent->v.angles[i] * 256 / 360) & 255;
+    }
+    to->number = NUM_FOR_EDICT(ent);
+    to->modelindex = (i32) ent->v.modelindex;
+    to->frame = (i32) ent->v.frame;
+    to->colormap = (i32) ent->v.colormap;
+    to->skin = (i32) ent->v.skin;
+    to->effects = (i32) ent->v.effects;
+    to->flags = 0;
+    if (ent->v.movetype == MOVETYPE_STEP)
+        to->flags |= SNAP_NOLERP; // don't mess up the step animation
+}
+
+/*
+=============
+SV_SnapBaseline
+=============
+*/
+static void SV_SnapBaseline(edict_t* ent, snapentity_t* to) {
+    i32 i;
+
+    for (i = 0; i < 3; i++) {
+        to->origin[i] = (i16) (i32) (ent->baseline.origin[i] * 8);
+        to->angles[i] = ((i32) ent->baseline.angles[i] * 256 / 360) & 255;
+    }
+    to->number = NUM_FOR_EDICT(ent);
+    to->modelindex = ent->baseline.modelindex;
+    to->frame = ent->baseline.frame;
+    to->colormap = ent->baseline.colormap;
+    to->skin = ent->baseline.skin;
+    to->effects = ent->baseline.effects;
+    to->flags = 0;
+}
+
+/*
+=============
+SV_WriteSnapEntity
+
+Writes the fields of to that differ from from, or nothing if none do and
+the client already has the entity
+=============
+*/
+static void SV_WriteSnapEntity(const snapentity_t* from,
+                               const snapentity_t* to, qboolean force,
+                               sizebuf_t* msg) {
+    i32 bits;
+    i32 i;
+
+    bits = 0;
+    for (i = 0; i < 3; i++) {
+        if (to->origin[i] != from->origin[i])
+            bits |= U_ORIGIN1 << i;
+    }
+    if (to->angles[0] != from->angles[0])
+        bits |= U_ANGLE1;
+    if (to->angles[1] != from->angles[1])
+        bits |= U_ANGLE2;
+    if (to->angles[2] != from->angles[2])
+        bits |= U_ANGLE3;
+    if (to->modelindex != from->modelindex)
+        bits |= U_MODEL;
+    if (to->frame != from->frame)
+        bits |= U_FRAME;
+    if (to->colormap != from->colormap)
+        bits |= U_COLORMAP;
+    if (to->skin != from->skin)
+        bits |= U_SKIN;
+    if (to->effects != from->effects)
+        bits |= U_EFFECTS;
+
+    if (!bits && !force && to->flags == from->flags)
+        return;
+
+    if (to->flags & SNAP_NOLERP)
+        bits |= U_NOLERP;
+    if (bits >= 256)
+        bits |= U_MOREBITS;
+
+    MSG_WriteShort(msg, to->number);
+    MSG_WriteByte(msg, bits);
+    if (bits & U_MOREBITS)
+        MSG_WriteByte(msg, bits >> 8);
+
+    if (bits & U_MODEL)
+        MSG_WriteByte(msg, to->modelindex);
+    if (bits & U_FRAME)
+        MSG_WriteByte(msg, to->frame);
+    if (bits & U_COLORMAP)
+        MSG_WriteByte(msg, to->colormap);
+    if (bits & U_SKIN)
+        MSG_WriteByte(msg, to->skin);
+    if (bits & U_EFFECTS)
+        MSG_WriteByte(msg, to->effects);
+    if (bits & U_ORIGIN1)
+        MSG_WriteShort(msg, to->origin[0]);
+    if (bits & U_ANGLE1)
+        MSG_WriteByte(msg, to->angles[0]);
+    if (bits & U_ORIGIN2)
+        MSG_WriteShort(msg, to->origin[1]);
+    if (bits & U_ANGLE2)
+        MSG_WriteByte(msg, to->angles[1]);
+    if (bits & U_ORIGIN3)
+        MSG_WriteShort(msg, to->origin[2]);
+    if (bits & U_ANGLE3)
+        MSG_WriteByte(msg, to->angles[2]);
+}
+
+/*
+=============
+SV_WriteSnapshotToClient
+
+Sends what the client sees as a delta from the last snapshot it acked,
+walking the new entities and the acked ones together in number order.
+The new snapshot remembers only what went out: when the datagram fills up,
+the entities left keep the state the client already has
+=============
+*/
+void SV_WriteSnapshotToClient(client_t* client, sizebuf_t* msg) {
+    snaphistory_t* history = &client->snapshots;
+    snapshot_t* base;
+    snapshot_t* snap;
+    const snapentity_t* from;
+    snapentity_t* to;
+    snapentity_t baseline;
+    edict_t* ent;
+    i32 count, newnum, oldnum;
+    i32 i, j;
+    qboolean overflow;
+
+    count = SV_VisibleEdicts(client->edict);
+    client->stats.visible += count;
+
+    base = SV_AckedSnapshot(history);
+    history->sequence++;
+    snap = &history->snapshots[history->sequence & (SNAP_BACKUP - 1)];
+    snap->sequence = history->sequence;
+    snap->first = history->numstates;
+    snap->count = 0;
+
+    MSG_WriteByte(msg, svc_snapshot);
+    MSG_WriteLong(msg, snap->sequence);
+    MSG_WriteLong(msg, base ? base->sequence : 0);
+
+    overflow = false;
+    i = j = 0;
+    while (i < count || (base && j < base->count)) {
+        ent = i < count ? sv_visible[i] : NULL;
+        newnum = ent ? NUM_FOR_EDICT(ent) : MAX_EDICTS;
+        from = NULL;
+        oldnum = MAX_EDICTS;
+        if (base && j < base->count) {
+            from = &history->states[(base->first + j) & (SNAP_STATES - 1)];
+            oldnum = from->number;
+        }
+        to = &history->states[history->numstates & (SNAP_STATES - 1)];
+
+        if (!overflow && msg->maxsize - msg->cursize < SNAP_ENTRYSIZE) {
+            Con_Printf("packet overflow\n");
+            client->stats.overflows++;
+            overflow = true;
+        }
+
+        if (ent) {
+            client->stats.fullbytes +=
+                SV_UpdateSize(SV_BaselineBits(ent, newnum));
+        }
+
+        if (newnum == oldnum) {
+            // the client has it, send what changed
+            if (overflow) {
+                *to = *from;
+            } else {
+                SV_SnapEntity(ent, to);
+                SV_WriteSnapEntity(from, to, false, msg);
+            }
+            i++;
+            j++;
+        } else if (newnum < oldnum) {
+            // new to the client, send it against its baseline
+            i++;
+            if (overflow)
+                continue;
+            SV_SnapBaseline(ent, &baseline);
+            SV_SnapEntity(ent, to);
+            SV_WriteSnapEntity(&baseline, to, true, msg);
+        } else {
+            // the client had it but doesn't see it anymore
+            j++;
+            if (overflow) {
+                *to = *from;
+            } else {
+                MSG_WriteShort(msg, oldnum | SNAP_REMOVE);
+                continue;
+            }
+        }
+
+        history->numstates++;
+        snap->count++;
+    }
+    MSG_WriteShort(msg, 0);
+
+    client->stats.sent += snap->count;
+}
+
 /*
 =============
 SV_CleanupEnts
@@ -680,6 +1194,7 @@ SV_SendClientDatagram
 qboolean SV_SendClientDatagram(client_t* client) {
     byte buf[MAX_DATAGRAM];
     sizebuf_t msg;
+    i32 start;
 
     msg.data = buf;
     msg.maxsize = sizeof(buf);
@@ -691,12 +1206,22 @@ qboolean SV_SendClientDatagram(client_t* client) {
     // add the client specific data to the datagram
     SV_WriteClientdataToMessage(client->edict, &msg);
 
-    SV_WriteEntitiesToClient(client->edict, &msg);
+    start = msg.cursize;
+    if (client->delta) {
+        SV_WriteSnapshotToClient(client, &msg);
+    } else {
+        SV_WriteEntitiesToClient(client, &msg);
+        client->stats.fullbytes += msg.cursize - start;
+    }
+    client->stats.entitybytes += msg.cursize - start;
 
     // copy the server datagram if there is space
     if (msg.cursize + sv.datagram.cursize < msg.maxsize)
         SZ_Write(&msg, sv.datagram.data, sv.datagram.cursize);
 
+    client->stats.datagrams++;
+    client->stats.datagrambytes += msg.cursize;
+
     // send the datagram
     if (NET_SendUnreliableMessage(client->netconnection, &msg) == -1) {
         SV_DropClient(true); // if the message couldn't send, kick off
@@ -706,6 +1231,161 @@ qboolean SV_SendClientDatagram(client_t* client) {
     return true;
 }
 
+/*
+=======================
+SV_Bandwidth_f
+
+Prints what went out to each client since the last report
+=======================
+*/
+void SV_Bandwidth_f(void) {
+    client_t* client;
+    clientstats_t* stats;
+    i32 i, n;
+
+    if (!sv.active) {
+        Con_Printf("bandwidth: no server running\n");
+        return;
+    }
+
+    Con_Printf("bytes per datagram   total entity  full  seen  sent\n");
+    for (i = 0, client = svs.clients; i < svs.maxclients; i++, client++) {
+        if (!client->active)
+            continue;
+        stats = &client->stats;
+        n = stats->datagrams ? stats->datagrams : 1;
+        Con_Printf("%-16.16s %-5s %5i %6i %5i %5i %5i\n", client->name,
+                   client->delta ? "delta" : "full", stats->datagrambytes / n,
+                   stats->entitybytes / n, stats->fullbytes / n,
+                   stats->visible / n, stats->sent / n);
+        if (stats->overflows)
+            Con_Printf("%i of %i datagrams overflowed\n", stats->overflows,
+                       stats->datagrams);
+        Q_memset(stats, 0, sizeof(*stats));
+    }
+}
+
+#define MAX_BENCHVIEWS 64
+
+/*
+=======================
+SV_VisBench_f
+
+visbench [views] [frames] [fill]
+Finds what each of the first views clients or monsters can see, frames
+times over without and with sv_pvsindex, and checks both found the same.
+With fill, the free edict slots are taken by copies of the edicts
+that have a model, scattered around them, until the benchmark ends
+=======================
+*/
+void SV_VisBench_f(void) {
+    static edict_t* views[MAX_BENCHVIEWS];
+    static edict_t* models[MAX_EDICTS];
+    static edict_t* spawned[MAX_EDICTS];
+    static edict_t* lists[MAX_BENCHVIEWS][MAX_EDICTS];
+    static i32 counts[MAX_BENCHVIEWS];
+    float saved_index = sv_pvsindex.value;
+    double times[2];
+    double start;
+    i32 numviews, maxviews, nummodels, numspawned, frames, visible, diffs;
+    i32 i, j, f, n, pass;
+    edict_t *ent, *from;
+
+    if (!sv.active) {
+        Con_Printf("visbench: no server running\n");
+        return;
+    }
+    maxviews = Cmd_Argc() > 1 ? Q_atoi(Cmd_Argv(1)) : 16;
+    if (maxviews < 1 || maxviews > MAX_BENCHVIEWS)
+        maxviews = MAX_BENCHVIEWS;
+    frames = Cmd_Argc() > 2 ? Q_atoi(Cmd_Argv(2)) : 100;
+    if (frames < 1)
+        frames = 1;
+
+    // clients first, then monsters
+    numviews = 0;
+    for (i = 0; i < svs.maxclients && numviews < maxviews; i++) {
+        if (svs.clients[i].active)
+            views[numviews++] = svs.clients[i].edict;
+    }
+    ent = NEXT_EDICT(sv.edicts);
+    for (i = 1; i < sv.num_edicts && numviews < maxviews;
+         i++, ent = NEXT_EDICT(ent)) {
+        if (!ent->free && ((i32) ent->v.flags & FL_MONSTER))
+            views[numviews++] = ent;
+    }
+    if (!numviews) {
+        Con_Printf("visbench: no clients or monsters to look from\n");
+        return;
+    }
+
+    nummodels = 0;
+    numspawned = 0;
+    if (Cmd_Argc() > 3 && Q_atoi(Cmd_Argv(3))) {
+        ent = NEXT_EDICT(sv.edicts);
+        for (i = 1; i < sv.num_edicts; i++, ent = NEXT_EDICT(ent)) {
+            if (!ent->free && ent->v.modelindex &&
+                *PR_GetString(ent->v.model) && ent->v.solid != SOLID_BSP)
+                models[nummodels++] = ent;
+        }
+    }
+    if (nummodels) {
+        while (sv.num_edicts < sv.max_edicts) {
+            from = models[rand() % nummodels];
+            ent = ED_Alloc();
+            ent->v.classname = PR_SetString("visbench");
+            ent->v.model = from->v.model;
+            ent->v.modelindex = from->v.modelindex;
+            VectorCopy(from->v.mins, ent->v.mins);
+            VectorCopy(from->v.maxs, ent->v.maxs);
+            for (j = 0; j < 2; j++)
+                ent->v.origin[j] =
+                    from->v.origin[j] + (rand() & 255) - 128;
+            ent->v.origin[2] = from->v.origin[2];
+            SV_LinkEdict(ent, false);
+            spawned[numspawned++] = ent;
+        }
+    }
+
+    visible = 0;
+    diffs = 0;
+    for (pass = 0; pass < 2; pass++) {
+        sv_pvsindex.value = pass;
+        start = Sys_FloatTime();
+        for (f = 0; f < frames; f++) {
+            for (i = 0; i < numviews; i++) {
+                n = SV_VisibleEdicts(views[i]);
+                if (f)
+                    continue;
+                if (!pass) {
+                    counts[i] = n;
+                    Q_memcpy(lists[i], sv_visible, n * sizeof(edict_t*));
+                    visible += n;
+                } else if (n != counts[i] ||
+                           memcmp(lists[i], sv_visible,
+                                  n * sizeof(edict_t*))) {
+                    diffs++;
+                }
+            }
+        }
+        times[pass] = Sys_FloatTime() - start;
+    }
+    sv_pvsindex.value = saved_index;
+
+    n = sv.num_edicts;
+    for (i = 0; i < numspawned; i++)
+        ED_Free(spawned[i]);
+    while (sv.num_edicts > 1 && EDICT_NUM(sv.num_edicts - 1)->free)
+        sv.num_edicts--;
+
+    Con_Printf("%i views, %i edicts, %i spawned, %i visible per view\n",
+               numviews, n, numspawned, visible / numviews);
+    Con_Printf("visible sets per frame: %8.2f us walked, %8.2f us indexed\n",
+               times[0] * 1000000 / frames, times[1] * 1000000 / frames);
+    if (diffs)
+        Con_Printf("visbench: %i of %i views differ!\n", diffs, numviews);
+}
+
 /*
 =======================
 SV_UpdateToReliableMessages
@@ -1062,6 +1742,7 @@ void SV_SpawnServer(char* server) {
     // clear world interaction links
     //
     SV_ClearWorld();
+    Q_memset(sv_fatcache, 0, sizeof(sv_fatcache));
 
     sv.sound_precache[0] = pr_strings;
 
@@ -1079,6 +1760,7 @@ void SV_SpawnServer(char* server) {
     Q_memset(&ent->v, 0, progs->entityfields * 4);
     ent->free = false;
     ent->v.model = PR_SetString(sv.worldmodel->name);
+    pr_stringstores++;
     ent->v.modelindex = 1; // world model
     ent->v.solid = SOLID_BSP;
     ent->v.movetype = MOVETYPE_PUSH;
@@ -23,6 +23,7 @@
 #include "server.h"
 #include "console.h"
 #include "host.h"
+#include "profiler.h"
 #include "sys.h"
 #include "world.h"
 #include <math.h>
@@ -1101,6 +1102,8 @@ void SV_Physics(void) {
     i32 i;
     edict_t* ent;
 
+    PROF_BEGIN("SV_Physics");
+
     // let the progs know that a new frame has started
     pr_global_struct->self = EDICT_TO_PROG(sv.edicts);
     pr_global_struct->other = EDICT_TO_PROG(sv.edicts);
@@ -1144,4 +1147,6 @@ void SV_Physics(void) {
         pr_global_struct->force_retouch--;
 
     sv.time += host_frametime;
+
+    PROF_END();
 }
@@ -538,6 +538,8 @@ qboolean SV_ReadClientMessage(void) {
                         ret = 1;
                     else if (Q_strncasecmp(s, "ban", 3) == 0)
                         ret = 1;
+                    else if (Q_strncasecmp(s, "delta", 5) == 0)
+                        ret = 1;
                     if (ret == 1)
                         Cmd_ExecuteString(s, src_client);
                     else
@@ -551,6 +553,10 @@ qboolean SV_ReadClientMessage(void) {
                 case clc_move:
                     SV_ReadClientMove(&host_client->cmd);
                     break;
+
+                case clc_ack:
+                    SV_AckSnapshot(host_client, MSG_ReadLong());
+                    break;
             }
         }
     } while (ret == 1);
@@ -48,6 +48,9 @@ typedef struct {
 
 
 i32 SV_HullPointContents(hull_t* hull, i32 num, vec3_t p);
+static void SV_ClearTraceCache(void);
+static void SV_ClearLeafIndex(void);
+static void SV_UnindexEdict(edict_t* ent);
 
 /*
 ===============================================================================
@@ -181,13 +184,86 @@ typedef struct areanode_s {
     struct areanode_s* children[2];
     link_t trigger_edicts;
     link_t solid_edicts;
+    i32 depth;
+    i32 numedicts; // linked directly to this node
+    vec3_t mins, maxs;
 } areanode_t;
 
-#define AREA_DEPTH 4
-#define AREA_NODES 32
+#define AREA_DEPTH    4    // depth of the classic fixed tree
+#define AREA_MAXDEPTH 9    // deepest adaptive split
+#define AREA_NODES    1024 // enough for a full tree of AREA_MAXDEPTH
+#define AREA_LEAFSIZE 1024 // initial splits stop once leaves are this small
+#define AREA_MINSIZE  128  // never split a node thinner than this
+#define AREA_SPLIT    16   // edicts in a leaf before it is split
 
 static areanode_t sv_areanodes[AREA_NODES];
 static i32 sv_numareanodes;
+static i32 sv_areamaxdepth;
+static i32 sv_areawalk; // > 0 while SV_TouchLinks is walking the lists
+
+// 0 builds an adaptive tree, anything else a fixed tree of that depth
+cvar_t sv_areadepth = {"sv_areadepth", "0"};
+// lets the adaptive tree split on the vertical axis
+cvar_t sv_areasplitz = {"sv_areasplitz", "1"};
+
+movestats_t sv_movestats;
+
+/*
+===============
+SV_AreaNodeAxis
+
+Picks the axis a node would be split on, or -1 if it is too small
+===============
+*/
+static i32 SV_AreaNodeAxis(vec3_t mins, vec3_t maxs) {
+    vec3_t size;
+    i32 axis;
+
+    VectorSubtract(maxs, mins, size);
+    if (sv_areadepth.value)
+        return size[0] > size[1] ? 0 : 1;
+
+    axis = size[0] > size[1] ? 0 : 1;
+    if (sv_areasplitz.value && size[2] > size[axis])
+        axis = 2;
+    if (size[axis] < AREA_MINSIZE * 2)
+        return -1;
+    return axis;
+}
+
+/*
+===============
+SV_SplitAreaNode
+
+Turns a leaf into a node with two empty leafs below it
+===============
+*/
+static void SV_SplitAreaNode(areanode_t* anode, i32 axis) {
+    areanode_t* child;
+    i32 i;
+
+    anode->axis = axis;
+    anode->dist = 0.5 * (anode->maxs[axis] + anode->mins[axis]);
+
+    for (i = 0; i < 2; i++) {
+        child = &sv_areanodes[sv_numareanodes];
+        sv_numareanodes++;
+
+        ClearLink(&child->trigger_edicts);
+        ClearLink(&child->solid_edicts);
+        child->axis = -1;
+        child->children[0] = child->children[1] = NULL;
+        child->depth = anode->depth + 1;
+        child->numedicts = 0;
+        VectorCopy(anode->mins, child->mins);
+        VectorCopy(anode->maxs, child->maxs);
+        if (i == 0)
+            child->mins[axis] = anode->dist;
+        else
+            child->maxs[axis] = anode->dist;
+        anode->children[i] = child;
+    }
+}
 
 /*
 ===============
@@ -199,32 +275,42 @@ areanode_t* SV_CreateAreaNode(i32 depth, vec3_t mins, vec3_t maxs) {
     areanode_t* anode;
     vec3_t size;
     vec3_t mins1, maxs1, mins2, maxs2;
+    i32 axis;
 
     anode = &sv_areanodes[sv_numareanodes];
     sv_numareanodes++;
 
     ClearLink(&anode->trigger_edicts);
     ClearLink(&anode->solid_edicts);
-
-    if (depth == AREA_DEPTH) {
-        anode->axis = -1;
-        anode->children[0] = anode->children[1] = NULL;
+    anode->axis = -1;
+    anode->children[0] = anode->children[1] = NULL;
+    anode->depth = depth;
+    anode->numedicts = 0;
+    VectorCopy(mins, anode->mins);
+    VectorCopy(maxs, anode->maxs);
+
+    if (depth == sv_areamaxdepth)
         return anode;
-    }
 
+    // the adaptive tree only starts out deep enough to cover the map
+    // with moderately sized leafs, dense areas are split further as
+    // edicts get linked into them
     VectorSubtract(maxs, mins, size);
-    if (size[0] > size[1])
-        anode->axis = 0;
-    else
-        anode->axis = 1;
+    axis = SV_AreaNodeAxis(mins, maxs);
+    if (axis == -1)
+        return anode;
+    if (!sv_areadepth.value && depth >= AREA_DEPTH &&
+        size[0] <= AREA_LEAFSIZE && size[1] <= AREA_LEAFSIZE)
+        return anode;
 
-    anode->dist = 0.5 * (maxs[anode->axis] + mins[anode->axis]);
+    anode->axis = axis;
+    anode->dist = 0.5 * (maxs[axis] + mins[axis]);
     VectorCopy(mins, mins1);
     VectorCopy(mins, mins2);
     VectorCopy(maxs, maxs1);
     VectorCopy(maxs, maxs2);
 
-    maxs1[anode->axis] = mins2[anode->axis] = anode->dist;
+    maxs1[axis] = mins2[axis] = anode->dist;
 
     anode->children[0] = SV_CreateAreaNode(depth + 1, mins2, maxs2);
     anode->children[1] = SV_CreateAreaNode(depth + 1, mins1, maxs1);
@@ -232,6 +318,68 @@ areanode_t* SV_CreateAreaNode(i32 depth, vec3_t mins, vec3_t maxs) {
     return anode;
 }
 
+/*
+===============
+SV_RelinkAreaNode
+
+Pushes the edicts of a freshly split node down into whichever child
+fully contains them
+===============
+*/
+static void SV_RelinkAreaNode(areanode_t* anode) {
+    link_t* lists[2];
+    link_t *l, *next, *head;
+    areanode_t* child;
+    edict_t* ent;
+    i32 i;
+
+    lists[0] = &anode->solid_edicts;
+    lists[1] = &anode->trigger_edicts;
+    for (i = 0; i < 2; i++) {
+        for (l = lists[i]->next; l != lists[i]; l = next) {
+            next = l->next;
+            ent = EDICT_FROM_AREA(l);
+            if (ent->v.absmin[anode->axis] > anode->dist)
+                child = anode->children[0];
+            else if (ent->v.absmax[anode->axis] < anode->dist)
+                child = anode->children[1];
+            else
+                continue;
+
+            head = i == 0 ? &child->solid_edicts : &child->trigger_edicts;
+            RemoveLink(&ent->area);
+            InsertLinkBefore(&ent->area, head);
+            ent->areanode = child;
+            anode->numedicts--;
+            child->numedicts++;
+        }
+    }
+}
+
+/*
+===============
+SV_BalanceAreaNode
+
+Splits a crowded leaf, as long as nothing is walking the lists
+===============
+*/
+static void SV_BalanceAreaNode(areanode_t* anode) {
+    i32 axis;
+
+    if (sv_areadepth.value || sv_areawalk)
+        return;
+    if (anode->numedicts <= AREA_SPLIT || anode->depth >= sv_areamaxdepth)
+        return;
+    if (sv_numareanodes + 2 > AREA_NODES)
+        return;
+    axis = SV_AreaNodeAxis(anode->mins, anode->maxs);
+    if (axis == -1)
+        return;
+
+    SV_SplitAreaNode(anode, axis);
+    SV_RelinkAreaNode(anode);
+}
+
 /*
 ===============
 SV_ClearWorld
@@ -241,8 +389,20 @@ SV_ClearWorld
 void SV_ClearWorld(void) {
     SV_InitBoxHull();
 
+    SV_ClearTraceCache();
+    SV_ClearLeafIndex();
+
     Q_memset(sv_areanodes, 0, sizeof(sv_areanodes));
     sv_numareanodes = 0;
+    sv_areawalk = 0;
+    if (sv_areadepth.value)
+        sv_areamaxdepth = (i32) sv_areadepth.value;
+    else
+        sv_areamaxdepth = AREA_MAXDEPTH;
+    if (sv_areamaxdepth < 1)
+        sv_areamaxdepth = 1;
+    if (sv_areamaxdepth > AREA_MAXDEPTH)
+        sv_areamaxdepth = AREA_MAXDEPTH;
     SV_CreateAreaNode(0, sv.worldmodel->mins, sv.worldmodel->maxs);
 }
 
@@ -254,10 +414,14 @@ SV_UnlinkEdict
 ===============
 */
 void SV_UnlinkEdict(edict_t* ent) {
+    SV_UnindexEdict(ent);
+
     if (!ent->area.prev)
         return; // not linked in anywhere
     RemoveLink(&ent->area);
     ent->area.prev = ent->area.next = NULL;
+    ent->areanode->numedicts--;
+    ent->areanode = NULL;
 }
 
 
@@ -309,6 +473,229 @@ void SV_TouchLinks(edict_t* ent, areanode_t* node) {
 }
 
 
+/*
+====================
+SV_AreaStats_f
+
+Prints the shape of the area tree and how the linked edicts spread over it
+====================
+*/
+void SV_AreaStats_f(void) {
+    areanode_t* anode;
+    areanode_t* crowded;
+    i32 leafs, linked, deepest;
+    i32 i;
+
+    if (!sv.active) {
+        Con_Printf("areastats: no server running\n");
+        return;
+    }
+
+    leafs = linked = deepest = 0;
+    crowded = sv_areanodes;
+    for (i = 0, anode = sv_areanodes; i < sv_numareanodes; i++, anode++) {
+        if (anode->axis == -1)
+            leafs++;
+        if (anode->depth > deepest)
+            deepest = anode->depth;
+        if (anode->numedicts > crowded->numedicts)
+            crowded = anode;
+        linked += anode->numedicts;
+    }
+
+    Con_Printf("%i/%i nodes, %i leafs, depth %i/%i\n", sv_numareanodes,
+               AREA_NODES, leafs, deepest, sv_areamaxdepth);
+    Con_Printf("%i edicts linked, %i in the most crowded node (depth %i%s)\n",
+               linked, crowded->numedicts, crowded->depth,
+               crowded->axis == -1 ? ", leaf" : "");
+    if (sv_movestats.moves)
+        Con_Printf("%.0f moves, %.1f nodes %.1f boxes per move\n",
+                   (double) sv_movestats.moves,
+                   (double) sv_movestats.nodes / sv_movestats.moves,
+                   (double) sv_movestats.boxes / sv_movestats.moves);
+    if (sv_movestats.traces)
+        Con_Printf("%.0f hull traces, %.1f%% from the trace cache\n",
+                   (double) sv_movestats.traces,
+                   100.0 * sv_movestats.tracehits / sv_movestats.traces);
+}
+
+/*
+====================
+SV_AreaEdictsInList
+====================
+*/
+static i32 SV_AreaEdictsInList(link_t* list, vec3_t mins, vec3_t maxs,
+                               edict_t** edicts, i32 count, i32 maxcount) {
+    link_t* l;
+    edict_t* check;
+
+    for (l = list->next; l != list && count < maxcount; l = l->next) {
+        check = EDICT_FROM_AREA(l);
+        if (mins[0] > check->v.absmax[0] || mins[1] > check->v.absmax[1] ||
+            mins[2] > check->v.absmax[2] || maxs[0] < check->v.absmin[0] ||
+            maxs[1] < check->v.absmin[1] || maxs[2] < check->v.absmin[2])
+            continue;
+        edicts[count++] = check;
+    }
+    return count;
+}
+
+/*
+====================
+SV_AreaEdicts_r
+====================
+*/
+static i32 SV_AreaEdicts_r(areanode_t* node, vec3_t mins, vec3_t maxs,
+                           edict_t** edicts, i32 count, i32 maxcount) {
+    count = SV_AreaEdictsInList(&node->solid_edicts, mins, maxs, edicts, count,
+                                maxcount);
+    count = SV_AreaEdictsInList(&node->trigger_edicts, mins, maxs, edicts,
+                                count, maxcount);
+
+    // recurse down both sides
+    if (node->axis == -1)
+        return count;
+
+    if (maxs[node->axis] > node->dist)
+        count = SV_AreaEdicts_r(node->children[0], mins, maxs, edicts, count,
+                                maxcount);
+    if (mins[node->axis] < node->dist)
+        count = SV_AreaEdicts_r(node->children[1], mins, maxs, edicts, count,
+                                maxcount);
+    return count;
+}
+
+/*
+====================
+SV_AreaEdicts
+
+Fills edicts with every linked edict whose absolute box touches mins/maxs
+====================
+*/
+i32 SV_AreaEdicts(vec3_t mins, vec3_t maxs, edict_t** edicts, i32 maxcount) {
+    return SV_AreaEdicts_r(sv_areanodes, mins, maxs, edicts, 0, maxcount);
+}
+
+
+/*
+===============================================================================
+
+LEAF INDEX
+
+Every edict is kept in a list for each PVS leaf SV_FindTouchedLeafs found
+it in, and the leafs with edicts in them are kept in a list of their own,
+so finding what a PVS sees visits only those leafs and not every edict.
+
+===============================================================================
+*/
+
+// the place of an edict in the list of its nth leaf
+#define LEAFLINK(e, n) ((e) * MAX_ENT_LEAFS + (n))
+
+static i16 sv_leafedicts[MAX_MAP_LEAFS]; // first link of each leaf, or -1
+static i16 sv_leafnext[MAX_EDICTS * MAX_ENT_LEAFS];
+static i16 sv_leafprev[MAX_EDICTS * MAX_ENT_LEAFS]; // -1 for the first
+static byte sv_indexedleafs[MAX_EDICTS]; // of ent->leafnums in the lists
+
+static i16 sv_occupied[MAX_MAP_LEAFS]; // leafs with edicts in them
+static i16 sv_occupiedslot[MAX_MAP_LEAFS]; // in sv_occupied, or -1
+static i32 sv_numoccupied;
+
+/*
+===============
+SV_ClearLeafIndex
+===============
+*/
+static void SV_ClearLeafIndex(void) {
+    Q_memset(sv_leafedicts, 0xff, sizeof(sv_leafedicts));
+    Q_memset(sv_occupiedslot, 0xff, sizeof(sv_occupiedslot));
+    Q_memset(sv_indexedleafs, 0, sizeof(sv_indexedleafs));
+    sv_numoccupied = 0;
+}
+
+/*
+===============
+SV_IndexEdict
+
+Adds ent to the lists of the leafs SV_FindTouchedLeafs found
+===============
+*/
+static void SV_IndexEdict(edict_t* ent) {
+    i32 e, n, link, leafnum;
+
+    e = NUM_FOR_EDICT(ent);
+    for (n = 0; n < ent->num_leafs; n++) {
+        leafnum = ent->leafnums[n];
+        link = LEAFLINK(e, n);
+
+        sv_leafprev[link] = -1;
+        sv_leafnext[link] = sv_leafedicts[leafnum];
+        if (sv_leafedicts[leafnum] != -1)
+            sv_leafprev[sv_leafedicts[leafnum]] = link;
+        sv_leafedicts[leafnum] = link;
+
+        if (sv_occupiedslot[leafnum] == -1) {
+            sv_occupiedslot[leafnum] = sv_numoccupied;
+            sv_occupied[sv_numoccupied++] = leafnum;
+        }
+    }
+    sv_indexedleafs[e] = ent->num_leafs;
+}
+
+/*
+===============
+SV_UnindexEdict
+===============
+*/
+static void SV_UnindexEdict(edict_t* ent) {
+    i32 e, n, link, leafnum, slot;
+
+    e = NUM_FOR_EDICT(ent);
+    for (n = 0; n < sv_indexedleafs[e]; n++) {
+        leafnum = ent->leafnums[n];
+        link = LEAFLINK(e, n);
+
+        if (sv_leafprev[link] != -1)
+            sv_leafnext[sv_leafprev[link]] = sv_leafnext[link];
+        else
+            sv_leafedicts[leafnum] = sv_leafnext[link];
+        if (sv_leafnext[link] != -1)
+            sv_leafprev[sv_leafnext[link]] = sv_leafprev[link];
+
+        if (sv_leafedicts[leafnum] == -1) {
+            // move the last occupied leaf into its slot
+            slot = sv_occupiedslot[leafnum];
+            sv_occupied[slot] = sv_occupied[--sv_numoccupied];
+            sv_occupiedslot[sv_occupied[slot]] = slot;
+            sv_occupiedslot[leafnum] = -1;
+        }
+    }
+    sv_indexedleafs[e] = 0;
+}
+
+/*
+===============
+SV_MarkEdictsInPVS
+
+Sets the bit of every edict that touches a leaf in pvs
+===============
+*/
+void SV_MarkEdictsInPVS(const byte* pvs, u32* marks) {
+    i32 i, e, link, leafnum;
+
+    for (i = 0; i < sv_numoccupied; i++) {
+        leafnum = sv_occupied[i];
+        if (!(pvs[leafnum >> 3] & (1 << (leafnum & 7))))
+            continue;
+        for (link = sv_leafedicts[leafnum]; link != -1;
+             link = sv_leafnext[link]) {
+            e = link / MAX_ENT_LEAFS;
+            marks[e >> 5] |= 1u << (e & 31);
+        }
+    }
+}
+
+
 /*
 ===============
 SV_FindTouchedLeafs
@@ -360,8 +747,7 @@ SV_LinkEdict
 void SV_LinkEdict(edict_t* ent, qboolean touch_triggers) {
     areanode_t* node;
 
-    if (ent->area.prev)
-        SV_UnlinkEdict(ent); // unlink from old position
+    SV_UnlinkEdict(ent); // unlink from old position
 
     if (ent == sv.edicts)
         return; // don't add the world
@@ -396,6 +782,7 @@ void SV_LinkEdict(edict_t* ent, qboolean touch_triggers) {
     ent->num_leafs = 0;
     if (ent->v.modelindex)
         SV_FindTouchedLeafs(ent, sv.worldmodel->nodes);
+    SV_IndexEdict(ent);
 
     if (ent->v.solid == SOLID_NOT)
         return;
@@ -419,10 +806,18 @@ void SV_LinkEdict(edict_t* ent, qboolean touch_triggers) {
         InsertLinkBefore(&ent->area, &node->trigger_edicts);
     else
         InsertLinkBefore(&ent->area, &node->solid_edicts);
+    ent->areanode = node;
+    node->numedicts++;
+
+    if (node->axis == -1)
+        SV_BalanceAreaNode(node);
 
     // if touch_triggers, touch all entities at this node and decend for more
-    if (touch_triggers)
+    if (touch_triggers) {
+        sv_areawalk++;
         SV_TouchLinks(ent, sv_areanodes);
+        sv_areawalk--;
+    }
 }
 
 
@@ -650,6 +1045,66 @@ qboolean SV_RecursiveHullCheck(hull_t* hull, i32 num, float p1f, float p2f,
 }
 
 
+/*
+===============================================================================
+
+TRACE CACHE
+
+Monster movement tends to repeat the exact same hull traces within and
+across frames, so the results of traces through brush model hulls are
+remembered. The key holds the world space endpoints and the hull offset,
+which moves along with a brush model, so a model that moves no longer
+matches its old entries and nothing needs to be flushed until the map
+changes. Endpoints are compared bit for bit, a near miss has a different
+endpos and has to be traced again.
+
+===============================================================================
+*/
+
+#define TRACE_CACHE 2048 // must be a power of two
+
+typedef struct {
+    hull_t* hull; // NULL = unused
+    vec3_t start, end, offset;
+    trace_t trace; // before the entity is filled in
+} tracecache_t;
+
+static tracecache_t sv_traces[TRACE_CACHE];
+
+cvar_t sv_tracecache = {"sv_tracecache", "1"};
+
+/*
+==================
+SV_TraceCacheSlot
+==================
+*/
+static tracecache_t* SV_TraceCacheSlot(hull_t* hull, vec3_t start,
+                                       vec3_t end, vec3_t offset) {
+    u32 words[9];
+    u32 h;
+    i32 i;
+
+    Q_memcpy(words, start, sizeof(vec3_t));
+    Q_memcpy(words + 3, end, sizeof(vec3_t));
+    Q_memcpy(words + 6, offset, sizeof(vec3_t));
+
+    h = (u32) (uintptr_t) hull * 2654435761u;
+    for (i = 0; i < 9; i++)
+        h = (h ^ words[i]) * 16777619u;
+    h ^= h >> 15;
+
+    return &sv_traces[h & (TRACE_CACHE - 1)];
+}
+
+/*
+==================
+SV_ClearTraceCache
+==================
+*/
+static void SV_ClearTraceCache(void) {
+    Q_memset(sv_traces, 0, sizeof(sv_traces));
+}
+
 /*
 ==================
 SV_ClipMoveToEntity
@@ -664,6 +1119,7 @@ trace_t SV_ClipMoveToEntity(edict_t* ent, vec3_t start, vec3_t mins,
     vec3_t offset;
     vec3_t start_l, end_l;
     hull_t* hull;
+    tracecache_t* cache;
 
     // fill in a default trace
     Q_memset(&trace, 0, sizeof(trace_t));
@@ -674,6 +1130,22 @@ trace_t SV_ClipMoveToEntity(edict_t* ent, vec3_t start, vec3_t mins,
     // get the clipping hull
     hull = SV_HullForEntity(ent, mins, maxs, offset);
 
+    // the box hull is rebuilt for every entity, so it can't be cached
+    cache = NULL;
+    if (hull != &box_hull && sv_tracecache.value) {
+        sv_movestats.traces++;
+        cache = SV_TraceCacheSlot(hull, start, end, offset);
+        if (cache->hull == hull && VectorCompare(cache->start, start) &&
+            VectorCompare(cache->end, end) &&
+            VectorCompare(cache->offset, offset)) {
+            sv_movestats.tracehits++;
+            trace = cache->trace;
+            if (trace.fraction < 1 || trace.startsolid)
+                trace.ent = ent;
+            return trace;
+        }
+    }
+
     VectorSubtract(start, offset, start_l);
     VectorSubtract(end, offset, end_l);
 
@@ -685,6 +1157,14 @@ trace_t SV_ClipMoveToEntity(edict_t* ent, vec3_t start, vec3_t mins,
     if (trace.fraction != 1)
         VectorAdd(trace.endpos, offset, trace.endpos);
 
+    if (cache) {
+        cache->hull = hull;
+        VectorCopy(start, cache->start);
+        VectorCopy(end, cache->end);
+        VectorCopy(offset, cache->offset);
+        cache->trace = trace;
+    }
+
     // did we clip the move?
     if (trace.fraction < 1 || trace.startsolid)
         trace.ent = ent;
@@ -706,6 +1186,8 @@ void SV_ClipToLinks(areanode_t* node, moveclip_t* clip) {
     edict_t* touch;
     trace_t trace;
 
+    sv_movestats.nodes++;
+
     // touch linked edicts
     for (l = node->solid_edicts.next; l != &node->solid_edicts; l = next) {
         next = l->next;
@@ -720,6 +1202,8 @@ void SV_ClipToLinks(areanode_t* node, moveclip_t* clip) {
         if (clip->type == MOVE_NOMONSTERS && touch->v.solid != SOLID_BSP)
             continue;
 
+        sv_movestats.boxes++;
+
         if (clip->boxmins[0] > touch->v.absmax[0] ||
             clip->boxmins[1] > touch->v.absmax[1] ||
             clip->boxmins[2] > touch->v.absmax[2] ||
@@ -833,6 +1317,7 @@ trace_t SV_Move(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, i32 type,
                   clip.boxmaxs);
 
     // clip to entities
+    sv_movestats.moves++;
     SV_ClipToLinks(sv_areanodes, &clip);
 
     return clip.trace;
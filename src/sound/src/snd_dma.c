@@ -26,6 +26,7 @@
 #include "console.h"
 #include "host.h"
 #include "model.h"
+#include "profiler.h"
 #include "snd_codec.h"
 #include "sys.h"
 #include <stdlib.h>
@@ -215,7 +216,7 @@ void S_Init(void) {
         Con_Printf("Sound is already initialized\n");
         return;
     }
-    if (COM_CheckParm("-nosound")) {
+    if (COM_CheckParm("-nosound") || isHeadless) {
         return;
     }
     S_RegisterConsoleVars();
@@ -753,6 +754,8 @@ void S_Update(vec3_t origin, vec3_t forward, vec3_t right, vec3_t up) {
         return;
     }
 
+    PROF_BEGIN("S_Update");
+
     if (sfxvolume.value != old_sfxvolume) {
         SND_UpdateSfxVolume();
     }
@@ -829,6 +832,8 @@ void S_Update(vec3_t origin, vec3_t forward, vec3_t right, vec3_t up) {
 
     // mix some sound
     S_Update_();
+
+    PROF_END();
 }
 
 static void GetSoundtime(void) {
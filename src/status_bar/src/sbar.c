@@ -858,8 +858,6 @@ void Sbar_Draw(void) {
     if (sb_updates >= vid.numpages)
         return;
 
-    scr_copyeverything = 1;
-
     sb_updates++;
 
     if (sb_lines && vid.width > 320)
@@ -1001,7 +999,6 @@ void Sbar_DeathmatchOverlay(void) {
     char num[12];
     scoreboard_t* s;
 
-    scr_copyeverything = 1;
     scr_fullupdate = 0;
 
     pic = Draw_CachePic("gfx/ranking.lmp");
@@ -1084,7 +1081,6 @@ void Sbar_MiniDeathmatchOverlay(void) {
     if (vid.width < 512 || !sb_lines)
         return;
 
-    scr_copyeverything = 1;
     scr_fullupdate = 0;
 
     // scores
@@ -1177,7 +1173,6 @@ void Sbar_IntermissionOverlay(void) {
     i32 dig;
     i32 num;
 
-    scr_copyeverything = 1;
     scr_fullupdate = 0;
 
     if (cl.gametype == GAME_DEATHMATCH) {
@@ -1218,8 +1213,6 @@ Sbar_FinaleOverlay
 void Sbar_FinaleOverlay(void) {
     qpic_t* pic;
 
-    scr_copyeverything = 1;
-
     pic = Draw_CachePic("gfx/finale.lmp");
     Draw_TransPic((vid.width - pic->width) / 2, 16, pic);
 }
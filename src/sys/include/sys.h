@@ -32,6 +32,9 @@ extern qboolean msg_suppress_1;
 
 extern qboolean isDedicated;
 
+// no window or audio device, set for -dedicated, -headless and -benchmark
+extern qboolean isHeadless;
+
 
 //
 // file IO
@@ -70,6 +73,11 @@ void Sys_Quit(void);
 
 double Sys_FloatTime();
 
+//
+// gives the cpu away for the given number of seconds
+//
+void Sys_Sleep(double seconds);
+
 char* Sys_ConsoleInput(void);
 
 //
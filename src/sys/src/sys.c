@@ -36,12 +36,19 @@
 #include <stdarg.h>
 #include <string.h>
 
+#ifndef _WIN32
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
 #ifdef HAVE_SIGNAL_H
 #include <signal.h>
 #endif
 
 
 qboolean isDedicated;
+qboolean isHeadless;
 
 /*
 ===============================================================================
@@ -172,11 +179,16 @@ void Sys_Printf(char* fmt, ...) {
     va_start(argptr, fmt);
     vprintf(fmt, argptr);
     va_end(argptr);
+
+    // stdout is usually a pipe or a log file when running headless
+    if (isHeadless)
+        fflush(stdout);
 }
 
 void Sys_Quit(void) {
     Host_Shutdown();
-    ES_DisplayScreen();
+    if (!isHeadless)
+        ES_DisplayScreen();
     exit(0);
 }
 
@@ -194,7 +206,60 @@ double Sys_FloatTime() {
     return time_diff / frequency;
 }
 
+void Sys_Sleep(double seconds) {
+    if (seconds <= 0)
+        return;
+#ifndef _WIN32
+    struct timespec ts;
+    ts.tv_sec = (time_t) seconds;
+    ts.tv_nsec = (long) ((seconds - (double) ts.tv_sec) * 1000000000.0);
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+        ;
+#else
+    SDL_Delay((Uint32) (seconds * 1000.0));
+#endif
+}
+
+/*
+================
+Sys_ConsoleInput
+
+Returns a complete line typed on stdin, newline included, or NULL.
+Only a dedicated server reads stdin, it never blocks.
+================
+*/
 char* Sys_ConsoleInput(void) {
+#ifndef _WIN32
+    static char text[256];
+    static i32 len;
+    static qboolean closed;
+    struct pollfd pfd;
+    char c;
+
+    if (!isDedicated || closed)
+        return NULL;
+
+    pfd.fd = STDIN_FILENO;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    while (poll(&pfd, 1, 0) > 0) {
+        if (read(STDIN_FILENO, &c, 1) != 1) {
+            closed = true; // stdin is /dev/null or was closed
+            return NULL;
+        }
+        if (c == '\r')
+            continue;
+        if (len < (i32) sizeof(text) - 2)
+            text[len++] = c;
+        if (c == '\n') {
+            if (text[len - 1] != '\n')
+                text[len++] = '\n'; // the line was too long
+            text[len] = 0;
+            len = 0;
+            return text;
+        }
+    }
+#endif
     return NULL;
 }
 
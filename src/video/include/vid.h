@@ -68,7 +68,10 @@ void VID_Shutdown(void);
 // Called at shutdown
 
 void VID_Update(vrect_t* rects);
-// flushes the given rectangles from the view buffer to the screen
+// flushes the given rectangle from the view buffer to the screen
+
+void VID_UpdateRects(vrect_t* rects, i32 count);
+// flushes count rectangles, only the parts of the screen that were drawn
 
 void VID_SetMode(i32 modenum);
 // sets the mode; only used by the Quake engine for resetting to mode 0 (the
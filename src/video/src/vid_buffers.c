@@ -21,23 +21,36 @@
 
 
 #include "vid_buffers.h"
+#include "console.h"
+#include "cvar.h"
 #include "d_local.h"
 #include "sys.h"
+#include <SDL_cpuinfo.h>
+#include <SDL_mutex.h>
+#include <SDL_thread.h>
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define VID_AVX2
+#endif
 
 
 // The paletted buffer that we draw to (i.e. the one that holds vid_buffer).
 static SDL_Surface* screen_buffer = NULL;
 
-// The RGBA intermediate buffer that we blit the screen_buffer to.
-static SDL_Surface* argb_buffer = NULL;
-
-extern const u32 pixel_format;
+// With vid_async, the rows of the last frame that the present thread is
+// expanding while the next frame is drawn into screen_buffer.
+static byte* async_buffer = NULL;
 
 static i32 VID_highhunkmark;
-static i32 vid_surfcachesize;
 
 static qboolean palette_changed;
-static SDL_Color pal[256];
+
+// The palette as texture pixels, pixel_format is ARGB8888.
+static u32 pal[256];
+
+static cvar_t vid_async = {"vid_async", "0", true};
+
+static qboolean vid_hasavx2;
 
 
 /*
@@ -48,14 +61,8 @@ PALETTE
 ================================================================================
 */
 
-static void VID_UpdatePalette(void) {
-    SDL_Palette* sdl_palette = screen_buffer->format->palette;
-    SDL_SetPaletteColors(sdl_palette, pal, 0, 256);
-    palette_changed = false;
-}
-
 void VID_SetPalette(const byte* palette) {
-    // Translate the palette values to an SDL palette array and set the values.
+    // Translate the palette values to texture pixels.
     for (i32 i = 0; i < 256; i++) {
         byte r = palette[i * 3];
         byte g = palette[(i * 3) + 1];
@@ -63,10 +70,10 @@ void VID_SetPalette(const byte* palette) {
 
         // Zero out the bottom two bits of each channel:
         // the PC VGA controller only supports 6 bits of accuracy.
-        pal[i].r = r & ~3;
-        pal[i].g = g & ~3;
-        pal[i].b = b & ~3;
-        pal[i].a = SDL_ALPHA_OPAQUE;
+        r &= ~3;
+        g &= ~3;
+        b &= ~3;
+        pal[i] = ((u32) SDL_ALPHA_OPAQUE << 24) | (r << 16) | (g << 8) | b;
     }
 
     palette_changed = true;
@@ -87,16 +94,8 @@ INITIALIZATION AND SHUTDOWN
 ================================================================================
 */
 
-static void VID_AllocSurfaceCache() {
-    byte* buffer = (byte*) d_pzbuffer;
-    size_t cache_offset = vid.width * vid.height * sizeof(*d_pzbuffer);
-    byte* cache = &buffer[cache_offset];
-    D_InitCaches(cache, vid_surfcachesize);
-}
-
 static void VID_AllocZBuffer() {
     i32 chunk = vid.width * vid.height * sizeof(*d_pzbuffer);
-    chunk += vid_surfcachesize;
     VID_highhunkmark = Hunk_HighMark();
     d_pzbuffer = Hunk_HighAllocName(chunk, "video");
     if (!d_pzbuffer) {
@@ -104,21 +103,6 @@ static void VID_AllocZBuffer() {
     }
 }
 
-//
-// Create the 32-bit RGBA buffer. Format of argb_buffer must match the
-// screen pixel format because we import the surface data into the texture.
-//
-static void VID_AllocRgbaBuffer(void) {
-    void* pixels = NULL;
-    int w = (int) vid.width;
-    int h = (int) vid.height;
-    int depth = 0;
-    int pitch = 0;
-    argb_buffer = SDL_CreateRGBSurfaceWithFormatFrom(
-        pixels, w, h, depth, pitch, pixel_format
-    );
-}
-
 //
 // Create the 8-bit paletted screen buffer.
 //
@@ -144,23 +128,25 @@ static void VID_AllocScreenBuffer(void) {
 void VID_ReallocBuffers(void) {
     VID_FreeBuffers();
 
-    vid_surfcachesize = D_SurfaceCacheForRes(vid.width, vid.height);
     VID_AllocScreenBuffer();
-    VID_AllocRgbaBuffer();
     VID_AllocZBuffer();
-    VID_AllocSurfaceCache();
+    // the surface cache lives apart from the z buffer so it can be resized
+    // without a mode change
+    D_InitCaches();
 
-    VID_UpdatePalette();
+    // The texture is new, expand the whole screen into it.
+    palette_changed = true;
 }
 
 void VID_FreeBuffers(void) {
+    VID_FinishTexture();
     if (screen_buffer) {
         SDL_FreeSurface(screen_buffer);
         screen_buffer = NULL;
     }
-    if (argb_buffer) {
-        SDL_FreeSurface(argb_buffer);
-        argb_buffer = NULL;
+    if (async_buffer) {
+        Q_free(async_buffer);
+        async_buffer = NULL;
     }
     if (d_pzbuffer) {
         D_FlushCaches();
@@ -190,37 +176,259 @@ void VID_UnlockBuffer(void) {
     SDL_UnlockSurface(screen_buffer);
 }
 
+//==============================================================================
+
+
+/*
+================================================================================
+
+PALETTE EXPANSION
+
+================================================================================
+*/
+
+// A rectangle of the screen being expanded into the locked texture.
+typedef struct {
+    SDL_Texture* texture;
+    u32* dst;
+    i32 dstpitch; // in pixels
+    const byte* src;
+    i32 srcpitch;
+    i32 width;
+    i32 height;
+    const u32* palette;
+} expandjob_t;
+
+static expandjob_t expand_job;
+static u32 expand_palette[256]; // as it was when the frame was drawn
+static qboolean expand_async; // vid_async is on and the thread is running
+static qboolean expand_pending;
+static SDL_Thread* expand_thread;
+static SDL_sem* expand_startsem;
+static SDL_sem* expand_donesem;
+
+static void VID_ExpandRow(u32* dst, const byte* src, i32 count,
+                          const u32* palette) {
+    for (; count >= 4; count -= 4) {
+        dst[0] = palette[src[0]];
+        dst[1] = palette[src[1]];
+        dst[2] = palette[src[2]];
+        dst[3] = palette[src[3]];
+        dst += 4;
+        src += 4;
+    }
+    while (count-- > 0) {
+        *dst++ = palette[*src++];
+    }
+}
+
+#ifdef VID_AVX2
+#if defined(__GNUC__)
+__attribute__((target("avx2")))
+#endif
+static void VID_ExpandRowAVX2(u32* dst, const byte* src, i32 count,
+                              const u32* palette) {
+    // Eight indices widened to 32 bits and looked up with one gather.
+    for (; count >= 8; count -= 8) {
+        __m128i bytes = _mm_loadl_epi64((const __m128i*) src);
+        __m256i index = _mm256_cvtepu8_epi32(bytes);
+        __m256i pixels =
+            _mm256_i32gather_epi32((const int*) palette, index, 4);
+        _mm256_storeu_si256((__m256i*) dst, pixels);
+        dst += 8;
+        src += 8;
+    }
+    while (count-- > 0) {
+        *dst++ = palette[*src++];
+    }
+}
+#endif
+
+static void VID_ExpandRows(const expandjob_t* job) {
+    void (*expand)(u32*, const byte*, i32, const u32*) = VID_ExpandRow;
+#ifdef VID_AVX2
+    // d_simd picks the vector code here too, 2 keeps it off AVX2.
+    if (vid_hasavx2 && (i32) d_simd.value == 1) {
+        expand = VID_ExpandRowAVX2;
+    }
+#endif
+    u32* dst = job->dst;
+    const byte* src = job->src;
+    for (i32 i = 0; i < job->height; i++) {
+        expand(dst, src, job->width, job->palette);
+        dst += job->dstpitch;
+        src += job->srcpitch;
+    }
+}
+
+static int SDLCALL VID_ExpandThread(void* unused) {
+    for (;;) {
+        SDL_SemWait(expand_startsem);
+        VID_ExpandRows(&expand_job);
+        SDL_SemPost(expand_donesem);
+    }
+    return 0;
+}
+
+static qboolean VID_StartExpandThread(void) {
+    if (expand_thread) {
+        return true;
+    }
+    if (!expand_startsem) {
+        expand_startsem = SDL_CreateSemaphore(0);
+        expand_donesem = SDL_CreateSemaphore(0);
+    }
+    if (expand_startsem && expand_donesem) {
+        expand_thread = SDL_CreateThread(VID_ExpandThread, "present", NULL);
+    }
+    if (!expand_thread) {
+        Con_Printf("Couldn't start present thread: %s\n", SDL_GetError());
+        Cvar_SetValue("vid_async", 0);
+        return false;
+    }
+    SDL_DetachThread(expand_thread);
+    return true;
+}
+
 //
-// Blit from the paletted 8-bit screen buffer to the intermediate
-// 32-bit RGBA buffer and then update the intermediate texture with
-// the contents of the RGBA buffer.
+// The parts of the screen to expand: the rects that were drawn, or everything
+// when the palette has changed.
 //
-void VID_UpdateTexture(SDL_Texture* texture, vrect_t* rect) {
-    if (palette_changed) {
-        VID_UpdatePalette();
-        // Ensure we blit the whole screen after updating the palette.
-        rect->x = 0;
-        rect->x = 0;
-        rect->width = (i32) vid.width;
-        rect->height = (i32) vid.height;
-    }
-    SDL_Rect src_rect = {
-        .x = rect->x,
-        .y = rect->y,
-        .w = rect->width,
-        .h = rect->height,
-    };
-    SDL_Rect dst_rect = {
-        .x = 0,
-        .y = 0,
-        .w = rect->width,
-        .h = rect->height,
-    };
-    SDL_LockTexture(texture, &src_rect, &argb_buffer->pixels,
-                    &argb_buffer->pitch);
-    SDL_LowerBlit(screen_buffer, &src_rect, argb_buffer, &dst_rect);
-    SDL_UnlockTexture(texture);
+static vrect_t* VID_ExpandRects(vrect_t* rects, i32* count) {
+    static vrect_t full;
+    if (!palette_changed) {
+        return rects;
+    }
+    full.x = 0;
+    full.y = 0;
+    full.width = (i32) vid.width;
+    full.height = (i32) vid.height;
+    palette_changed = false;
+    *count = 1;
+    return &full;
 }
 
-//==============================================================================
+//
+// Lock the rect of the texture and set up a job expanding src into it.
+//
+static qboolean VID_LockJob(expandjob_t* job, SDL_Texture* texture,
+                            const SDL_Rect* r, const byte* src) {
+    void* pixels;
+    int pitch;
+    if (SDL_LockTexture(texture, r, &pixels, &pitch) < 0) {
+        return false;
+    }
+    job->texture = texture;
+    job->dst = pixels;
+    job->dstpitch = pitch / (i32) sizeof(u32);
+    job->srcpitch = screen_buffer->pitch;
+    job->src = &src[r->y * job->srcpitch + r->x];
+    job->width = r->w;
+    job->height = r->h;
+    return true;
+}
+
+//
+// Expand the paletted 8-bit screen buffer straight into the memory of the
+// locked 32-bit texture, only over the rects that were drawn. With vid_async
+// the expansion of the previous frame is finished instead, and the texture
+// is one frame behind.
+//
+void VID_UpdateTexture(SDL_Texture* texture, vrect_t* rects, i32 count) {
+    VID_FinishTexture();
+    expand_async = vid_async.value && VID_StartExpandThread();
+    if (expand_async) {
+        return;
+    }
 
+    // Each rect is locked on its own: a locked texture is write only, so
+    // the bounds of far apart rects can't be locked without redrawing what
+    // lies between them.
+    rects = VID_ExpandRects(rects, &count);
+    for (i32 i = 0; i < count; i++) {
+        SDL_Rect r = {
+            .x = rects[i].x,
+            .y = rects[i].y,
+            .w = rects[i].width,
+            .h = rects[i].height,
+        };
+        expandjob_t job;
+        if (SDL_RectEmpty(&r)) {
+            continue;
+        }
+        if (!VID_LockJob(&job, texture, &r, screen_buffer->pixels)) {
+            return;
+        }
+        job.palette = pal;
+        VID_ExpandRows(&job);
+        SDL_UnlockTexture(texture);
+    }
+}
+
+//
+// With vid_async, start expanding the frame that was just drawn on the
+// present thread, so it overlaps drawing the next frame. The thread can only
+// fill one locked rect, so it gets the bounds of all of them. The rows are
+// copied first because the next frame is drawn into the same screen buffer.
+//
+void VID_QueueTexture(SDL_Texture* texture, vrect_t* rects, i32 count) {
+    if (!expand_async) {
+        return;
+    }
+
+    SDL_Rect r = {0};
+    rects = VID_ExpandRects(rects, &count);
+    for (i32 i = 0; i < count; i++) {
+        SDL_Rect rect = {
+            .x = rects[i].x,
+            .y = rects[i].y,
+            .w = rects[i].width,
+            .h = rects[i].height,
+        };
+        SDL_UnionRect(&r, &rect, &r);
+    }
+    if (SDL_RectEmpty(&r)) {
+        return;
+    }
+
+    i32 pitch = screen_buffer->pitch;
+    if (!async_buffer) {
+        async_buffer = Q_malloc(pitch * vid.height);
+        if (!async_buffer) {
+            Sys_Error("Not enough memory for video mode\n");
+        }
+    }
+
+    const byte* pixels = screen_buffer->pixels;
+    for (i32 y = r.y; y < r.y + r.h; y++) {
+        i32 offset = y * pitch + r.x;
+        Q_memcpy(&async_buffer[offset], &pixels[offset], r.w);
+    }
+
+    if (!VID_LockJob(&expand_job, texture, &r, async_buffer)) {
+        return;
+    }
+    Q_memcpy(expand_palette, pal, sizeof(pal));
+    expand_job.palette = expand_palette;
+    expand_pending = true;
+    SDL_SemPost(expand_startsem);
+}
+
+//
+// Wait for the present thread and unlock the texture it expanded into.
+//
+void VID_FinishTexture(void) {
+    if (!expand_pending) {
+        return;
+    }
+    SDL_SemWait(expand_donesem);
+    SDL_UnlockTexture(expand_job.texture);
+    expand_pending = false;
+}
+
+void VID_InitBuffers(void) {
+    Cvar_RegisterVariable(&vid_async);
+    vid_hasavx2 = SDL_HasAVX2() == SDL_TRUE;
+}
+
+//==============================================================================
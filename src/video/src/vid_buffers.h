@@ -29,6 +29,12 @@ void VID_ReallocBuffers(void);
 
 void VID_FreeBuffers(void);
 
-void VID_UpdateTexture(SDL_Texture* texture, vrect_t* rect);
+void VID_InitBuffers(void);
+
+void VID_UpdateTexture(SDL_Texture* texture, vrect_t* rects, i32 count);
+
+void VID_QueueTexture(SDL_Texture* texture, vrect_t* rects, i32 count);
+
+void VID_FinishTexture(void);
 
 #endif
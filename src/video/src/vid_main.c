@@ -39,9 +39,10 @@ const u32 pixel_format = SDL_PIXELFORMAT_ARGB8888;
 
 
 void VID_Init(const byte* palette) {
-    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+    if (!isHeadless && SDL_Init(SDL_INIT_VIDEO) < 0) {
         Sys_Error("Failed to initialize video: %s", SDL_GetError());
     }
+    VID_InitBuffers();
     VID_InitWindow();
     VID_InitModes();
     VID_SetPalette(palette);
@@ -59,7 +60,11 @@ void VID_Shutdown(void) {
 }
 
 void VID_Update(vrect_t* rects) {
-    VID_UpdateWindow(rects);
+    VID_UpdateRects(rects, 1);
+}
+
+void VID_UpdateRects(vrect_t* rects, i32 count) {
+    VID_UpdateWindow(rects, count);
     VID_UpdateModes();
 }
 
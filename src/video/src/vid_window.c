@@ -85,11 +85,16 @@ static void VID_RegisterCvars(void) {
 
 void VID_InitWindow(void) {
     VID_RegisterCvars();
+    if (isHeadless) {
+        // no window, frames are only drawn into the offscreen buffers
+        return;
+    }
     VID_CreateWindow();
     VID_CreateRenderer();
 }
 
 void VID_ShutdownWindow(void) {
+    VID_FinishTexture();
     if (texture) {
         SDL_DestroyTexture(texture);
         texture = NULL;
@@ -188,12 +193,16 @@ static void VID_AllocTexture(void) {
 }
 
 void VID_ResizeScreen(void) {
+    VID_FinishTexture();
     if (texture) {
         SDL_DestroyTexture(texture);
         texture = NULL;
     }
-    VID_AllocTexture();
     VID_ReallocBuffers();
+    if (!window) {
+        return;
+    }
+    VID_AllocTexture();
     if (VID_IsFullscreenMode()) {
         VID_SetFullscreen();
     } else {
@@ -205,7 +214,7 @@ void VID_ResizeScreen(void) {
 
 
 static void VID_UpdateMouse(void) {
-    if (VID_IsFullscreenMode()) {
+    if (!window || VID_IsFullscreenMode()) {
         return;
     }
     if (windowed_mouse != VID_WindowedMouse()) {
@@ -214,27 +223,30 @@ static void VID_UpdateMouse(void) {
     }
 }
 
-static void VID_UpdateScreen(vrect_t* rect) {
-    if (!rect) {
+static void VID_UpdateScreen(vrect_t* rects, i32 count) {
+    if (!rects || !window) {
         return;
     }
-    // Update the texture with the contents of the screen buffer.
-    VID_UpdateTexture(texture, rect);
+    // Update the texture with the contents of the screen buffer, or with
+    // vid_async with the frame expanded in the background.
+    VID_UpdateTexture(texture, rects, count);
     // Clear the renderer's backbuffer to remove any previous contents.
     SDL_RenderClear(renderer);
     // Copy the updated texture to the backbuffer for rendering.
     SDL_RenderCopy(renderer, texture, NULL, NULL);
     // Present the backbuffer content to the screen.
     SDL_RenderPresent(renderer);
+    // With vid_async start expanding this frame, it shows up next update.
+    VID_QueueTexture(texture, rects, count);
 }
 
-void VID_UpdateWindow(vrect_t* rect) {
-    VID_UpdateScreen(rect);
+void VID_UpdateWindow(vrect_t* rects, i32 count) {
+    VID_UpdateScreen(rects, count);
     VID_UpdateMouse();
 }
 
 void VID_HandlePause(qboolean pause) {
-    if (VID_IsFullscreenMode()) {
+    if (!window || VID_IsFullscreenMode()) {
         return;
     }
     if (pause) {
@@ -245,5 +257,8 @@ void VID_HandlePause(qboolean pause) {
 }
 
 void VID_MinimizeWindow(void) {
+    if (!window) {
+        return;
+    }
     SDL_MinimizeWindow(window);
 }
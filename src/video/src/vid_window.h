@@ -30,7 +30,7 @@ void VID_ShutdownWindow(void);
 
 void VID_ResizeScreen(void);
 
-void VID_UpdateWindow(vrect_t* rect);
+void VID_UpdateWindow(vrect_t* rects, i32 count);
 
 void VID_MinimizeWindow(void);
 